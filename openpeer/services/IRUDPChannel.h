@@ -87,8 +87,9 @@ namespace openpeer
 
       enum CongestionAlgorithms
       {
-        CongestionAlgorithm_None =                         0,
-        CongestionAlgorithm_TCPLikeWindowWithSlowCreepUp = 1,
+        CongestionAlgorithm_None =                              0,
+        CongestionAlgorithm_TCPLikeWindowWithSlowCreepUp =      1,
+        CongestionAlgorithm_DelayBasedWindowWithLowExtraDelay = 2,
       };
 
       static const char *toString(CongestionAlgorithms value);
@@ -73,6 +73,15 @@ namespace openpeer
                                                 IPAddress fromIPAddress,
                                                 STUNPacketPtr stun
                                                 );
+
+      //-----------------------------------------------------------------------
+      // PURPOSE: Same as above except the lookup is performed using a view
+      //          of the received packet; the packet is only decoded into a
+      //          STUNPacket object if an outstanding request is found.
+      static ISTUNRequesterPtr handleSTUNPacket(
+                                                IPAddress fromIPAddress,
+                                                const STUNPacketView &stun
+                                                );
     };
   }
 }
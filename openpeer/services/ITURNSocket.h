@@ -163,6 +163,12 @@ namespace openpeer
       typedef services::ITURNSocketPtr ITURNSocketPtr;
       typedef ITURNSocket::TURNSocketStates TURNSocketStates;
 
+      struct PacketPart
+      {
+        const BYTE *mBuffer;
+        size_t mBufferLengthInBytes;
+      };
+
       //-----------------------------------------------------------------------
       // PURPOSE: Notify that the TURN socket state has changed from the
       //          previous state.
@@ -191,6 +197,21 @@ namespace openpeer
                                               size_t packetLengthInBytes
                                               ) = 0;
 
+      //-----------------------------------------------------------------------
+      // PURPOSE: Request that the delegate send a packet on behalf of the
+      //          TURN socket which is made up of the passed in parts (in
+      //          order) to the requested destination.
+      // NOTE:    The parts are only valid for the duration of the call.
+      //          The default gathers the parts into a single buffer and
+      //          calls notifyTURNSocketSendPacket; override it to send the
+      //          parts with a gather write instead.
+      virtual bool notifyTURNSocketSendPacketParts(
+                                                   ITURNSocketPtr socket,
+                                                   IPAddress destination,
+                                                   const PacketPart *parts,
+                                                   size_t totalParts
+                                                   );
+
       virtual void onTURNSocketWriteReady(ITURNSocketPtr socket) = 0;
     };
   }
@@ -199,8 +220,10 @@ namespace openpeer
 ZS_DECLARE_PROXY_BEGIN(openpeer::services::ITURNSocketDelegate)
 ZS_DECLARE_PROXY_TYPEDEF(openpeer::services::ITURNSocketPtr, ITURNSocketPtr)
 ZS_DECLARE_PROXY_TYPEDEF(openpeer::services::ITURNSocketDelegate::TURNSocketStates, TURNSocketStates)
+ZS_DECLARE_PROXY_TYPEDEF(openpeer::services::ITURNSocketDelegate::PacketPart, PacketPart)
 ZS_DECLARE_PROXY_METHOD_2(onTURNSocketStateChanged, ITURNSocketPtr, TURNSocketStates)
 ZS_DECLARE_PROXY_METHOD_SYNC_4(handleTURNSocketReceivedPacket, ITURNSocketPtr, IPAddress, const BYTE *, size_t)
 ZS_DECLARE_PROXY_METHOD_SYNC_RETURN_4(notifyTURNSocketSendPacket, bool, ITURNSocketPtr, IPAddress, const BYTE *, size_t)
+ZS_DECLARE_PROXY_METHOD_SYNC_RETURN_4(notifyTURNSocketSendPacketParts, bool, ITURNSocketPtr, IPAddress, const PacketPart *, size_t)
 ZS_DECLARE_PROXY_METHOD_1(onTURNSocketWriteReady, openpeer::services::ITURNSocketPtr)
 ZS_DECLARE_PROXY_END()
@@ -60,7 +60,8 @@ namespace openpeer
         Flag_DP_DuplicatePacket =       (1 << 4),
         Flag_EC_ECNPacket =             (1 << 3),
         Flag_EQ_GSNREqualsGSNFR =       (1 << 2),
-        Flag_AR_ACKRequired =           (1 << 1)
+        Flag_AR_ACKRequired =           (1 << 1),
+        Flag_FR_FECRepair =             (1 << 0)    // the data is the XOR parity of a block of packets ending at the sequence number (only used when negotiated)
       };
 
       enum VectorFlags
@@ -40,7 +40,10 @@
 
 #include <boost/shared_array.hpp>
 
+#define OPENPEER_STUN_MAGIC_COOKIE (0x2112A442)
+#define OPENPEER_STUN_HEADER_SIZE_IN_BYTES (20)
 #define OPENPEER_STUN_MESSAGE_INTEGRITY_LENGTH_IN_BYTES (20)
+#define OPENPEER_STUN_TRANSACTION_ID_LENGTH_IN_BYTES (96/8)
 #define OPENPEER_SERVICES_CLIENT_SOFTARE_DECLARATION "openpeer STUN 1.0"
 
 namespace openpeer
@@ -127,6 +130,7 @@ namespace openpeer
         Attribute_GSNFR =                   0x1745,
         Attribute_RUDPFlags =               0x1746,
         Attribute_ACKVector =               0x1747,
+        Attribute_FECBlockSize =            0x9748,   // comprehension-optional so a peer without FEC support ignores the offer
 
         // obsolete attributes that should be ignored
         Attribute_ReservedResponseAddress = 0x0002,
@@ -219,7 +223,7 @@ namespace openpeer
       STUNPacketPtr clone(bool changeTransactionID) const;
 
       static STUNPacketPtr parseIfSTUN(                                         // returns empty smart pointer if wasn't a STUN packet
-                                       const BYTE *packet,               // NOTE: While this is const we have to overwrite the packet data momentarily during MESSAGE-INTEGRITY calculation
+                                       const BYTE *packet,
                                        size_t packetLengthInBytes,
                                        RFCs allowedRFCs,
                                        bool allowRFC3489 = true,
@@ -230,7 +234,7 @@ namespace openpeer
       static ParseLookAheadStates parseStreamIfSTUN(
                                                     STUNPacketPtr &outSTUN,
                                                     size_t &outActualSizeInBytes,
-                                                    const BYTE *packet,        // NOTE: While this is const we have to overwrite the packet data momentarily during MESSAGE-INTEGRITY calculation
+                                                    const BYTE *packet,
                                                     size_t streamDataAvailableInBytes,
                                                     RFCs allowedRFCs,
                                                     bool allowRFC3489 = false,
@@ -250,6 +254,37 @@ namespace openpeer
 
       SecureByteBlockPtr packetize(RFCs rfc);
 
+      //-----------------------------------------------------------------------
+      // PURPOSE: packetize directly into a caller provided buffer
+      // RETURNS: the length of the packetized packet; if this is larger than
+      //          "bufferLengthInBytes" nothing was written and the caller
+      //          must retry with a buffer at least this large
+      // NOTE:    "mOriginalPacket" points into "buffer" afterwards
+      size_t packetizeInto(
+                           BYTE *buffer,
+                           size_t bufferLengthInBytes,
+                           RFCs rfc
+                           );
+
+      size_t getPacketizedLength(RFCs rfc) const;
+
+      //-----------------------------------------------------------------------
+      // PURPOSE: packetize everything except the value of the DATA attribute
+      //          so the data can be sent from where it already lives
+      // RETURNS: false if the message has no DATA attribute, includes a
+      //          MESSAGE-INTEGRITY or the buffers are too small
+      // NOTE:    The message on the wire is the prefix, "mData", zero padding
+      //          of "mData" to a DWORD boundary and then the suffix.
+      bool packetizeAroundData(
+                               BYTE *prefix,
+                               size_t prefixLengthInBytes,
+                               size_t &outPrefixLengthInBytes,
+                               BYTE *suffix,
+                               size_t suffixLengthInBytes,
+                               size_t &outSuffixLengthInBytes,
+                               RFCs rfc
+                               );
+
       bool isValidResponseTo(
                              STUNPacketPtr stunRequest,
                              RFCs allowedRFCs
@@ -261,6 +296,8 @@ namespace openpeer
                                    const char *realm = NULL
                                    ) const;
 
+      bool isValidMessageIntegrity(internal::MessageIntegrityKeyPtr key) const;  // key must have been obtained for the expected credentials
+
       bool isRFC3489() const;
       bool isRFC5389() const;
 
@@ -277,7 +314,6 @@ namespace openpeer
       PUID mLogObjectID;                                        // when output to a log, which object ID was responsible for this packet (never packetized or parsed)
 
       const BYTE *mOriginalPacket;                              // NOTE: This is only valid as long as the packet which it was parsed from is valid and must be valid for the validate routine
-                                                                // ALSO: Because the RFC demands the length of the packet during MESSAGE-INTEGRITY be set to the value as if the MESSAGE-INTEGRITY but not including anything after we have to overwrite the length in the original packet momentarily then put back original value
 
       Classes mClass;
       Methods mMethod;
@@ -287,7 +323,7 @@ namespace openpeer
       String mReason;
 
       DWORD  mMagicCookie;                                      // if this is 0x2112A442 then this is the new RFC otherwise it is RFC3489
-      BYTE   mTransactionID[96/8];
+      BYTE   mTransactionID[OPENPEER_STUN_TRANSACTION_ID_LENGTH_IN_BYTES];
 
       // attributes
 
@@ -303,6 +339,8 @@ namespace openpeer
       String mRealm;
       String mNonce;
 
+      internal::MessageIntegrityKeyPtr mMessageIntegrityKey;    // optional key already obtained for the credentials above so packetizing skips the key cache (never packetized or parsed)
+
       String mSoftware;
 
       CredentialMechanisms mCredentialMechanism;
@@ -359,6 +397,8 @@ namespace openpeer
 
       String mConnectionInfo;                                   // additional connection information in RUDP
 
+      DWORD mFECBlockSize;                                      // 0 means this value is not set (i.e. no XOR parity repair packets)
+
       QWORD mGSNR;                                              // 0 means this value is not set
       QWORD mGSNFR;                                             // 0 means this value is not set
 
@@ -372,5 +412,97 @@ namespace openpeer
       CongestionControlList mLocalCongestionControl;
       CongestionControlList mRemoteCongestionControl;
     };
+
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    #pragma mark
+    #pragma mark STUNPacketView
+    #pragma mark
+
+    // A non-owning view of a STUN packet which points directly into the
+    // received datagram. Parsing a view validates the header, the attribute
+    // layout and the FINGERPRINT but decodes no attribute values and never
+    // allocates; attribute values are located on demand. The view (and any
+    // pointer obtained from it) is only valid as long as the datagram is.
+    struct STUNPacketView
+    {
+    public:
+      typedef STUNPacket::Classes Classes;
+      typedef STUNPacket::Methods Methods;
+      typedef STUNPacket::Attributes Attributes;
+      typedef STUNPacket::RFCs RFCs;
+
+    public:
+      STUNPacketView();
+
+      static bool parse(                                                        // returns false if this wasn't a STUN packet
+                        STUNPacketView &outView,
+                        const BYTE *packet,
+                        size_t packetLengthInBytes,
+                        RFCs allowedRFCs,
+                        bool allowRFC3489 = true
+                        );
+
+      //-----------------------------------------------------------------------
+      // PURPOSE: decode the viewed packet into a full STUNPacket object
+      // RETURNS: the decoded packet or NULL if an attribute value within the
+      //          packet could not be decoded
+      // NOTE:    Only call once the packet is known to be wanted by someone.
+      STUNPacketPtr materialize(
+                                const char *logObject = NULL,
+                                PUID logObjectID = 0
+                                ) const;
+
+      const char *classAsString() const;
+      const char *methodAsString() const;
+
+      bool isRFC3489() const;
+      bool isRFC5389() const;
+
+      RFCs guessRFC(RFCs allowedRFCs) const;
+
+      bool hasAttribute(Attributes attribute) const;
+      bool findAttribute(                                                       // returns the first attribute of the type in the packet
+                         Attributes attribute,
+                         const BYTE * &outData,
+                         size_t &outDataLengthInBytes
+                         ) const;
+
+      bool hasUsername() const                {return 0 != mUsernameLengthInBytes;}
+      bool splitUsername(                                                       // returns false if the username is not in "local:remote" form
+                         const char * &outLocalUsernameFrag,
+                         size_t &outLocalUsernameFragLengthInBytes,
+                         const char * &outRemoteUsernameFrag,
+                         size_t &outRemoteUsernameFragLengthInBytes
+                         ) const;
+
+      bool isValidMessageIntegrity(
+                                   const char *password,                // must be SASLprep(password)
+                                   const char *username = NULL,
+                                   const char *realm = NULL
+                                   ) const;
+
+    public:
+      const BYTE *mPacket;                                      // the original datagram (not owned)
+      size_t mPacketLengthInBytes;                              // the length of the STUN message including the 20 byte header
+      RFCs mAllowedRFCs;                                        // the RFCs the view was parsed against (used when materializing)
+      bool mAllowRFC3489;                                       // was the view parsed allowing RFC 3489 (used when materializing)
+
+      Classes mClass;
+      Methods mMethod;
+
+      DWORD mMagicCookie;
+      const BYTE *mTransactionID;                               // points to the 96 bit transaction ID inside the packet
+
+      const char *mUsername;                                    // points to the (non NUL terminated) USERNAME value inside the packet or NULL
+      size_t mUsernameLengthInBytes;
+
+      const BYTE *mMessageIntegrity;                            // points to the MESSAGE-INTEGRITY value inside the packet or NULL
+      size_t mMessageIntegrityMessageLengthInBytes;             // how big is the input into the HMAC algorithm, including 20 byte header
+
+      bool mFingerprintIncluded;
+    };
   }
 }
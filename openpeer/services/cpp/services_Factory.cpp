@@ -560,11 +560,14 @@ namespace openpeer
                                                              QWORD nextSequenberNumberExpectingToReceive,
                                                              WORD sendingChannelNumber,
                                                              WORD receivingChannelNumber,
-                                                             DWORD minimumNegotiatedRTTInMilliseconds
+                                                             DWORD minimumNegotiatedRTTInMilliseconds,
+                                                             CongestionAlgorithms algorithmForLocal,
+                                                             CongestionAlgorithms algorithmForRemote,
+                                                             DWORD fecBlockSize
                                                              )
       {
         if (this) {}
-        return RUDPChannelStream::create(queue, delegate, nextSequenceNumberToUseForSending, nextSequenberNumberExpectingToReceive, sendingChannelNumber, receivingChannelNumber, minimumNegotiatedRTTInMilliseconds);
+        return RUDPChannelStream::create(queue, delegate, nextSequenceNumberToUseForSending, nextSequenberNumberExpectingToReceive, sendingChannelNumber, receivingChannelNumber, minimumNegotiatedRTTInMilliseconds, algorithmForLocal, algorithmForRemote, fecBlockSize);
       }
 
       //-----------------------------------------------------------------------
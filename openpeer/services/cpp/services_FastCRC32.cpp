@@ -0,0 +1,288 @@
+/*
+
+ Copyright (c) 2013, SMB Phone Inc.
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+
+ 1. Redistributions of source code must retain the above copyright notice, this
+ list of conditions and the following disclaimer.
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ The views and conclusions contained in the software and documentation are those
+ of the authors and should not be interpreted as representing official policies,
+ either expressed or implied, of the FreeBSD Project.
+
+ */
+
+#include <openpeer/services/internal/services_FastCRC32.h>
+
+#ifdef OPENPEER_SERVICES_CRC32_HAS_PCLMUL
+#include <cpuid.h>
+#include <emmintrin.h>
+#include <smmintrin.h>
+#include <wmmintrin.h>
+#endif //OPENPEER_SERVICES_CRC32_HAS_PCLMUL
+
+// reversed representation of the IEEE 802.3 polynomial 0x04C11DB7
+#define OPENPEER_SERVICES_CRC32_POLYNOMIAL (0xEDB88320)
+
+// the folding loop needs at least four 128 bit lanes of input
+#define OPENPEER_SERVICES_CRC32_MIN_FOLD_LENGTH_IN_BYTES (64)
+
+namespace openpeer
+{
+  namespace services
+  {
+    namespace internal
+    {
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      #pragma mark
+      #pragma mark (helpers)
+      #pragma mark
+
+      //-----------------------------------------------------------------------
+      struct CRC32Tables
+      {
+        DWORD mTable[8][256];
+        bool mAccelerated;
+
+        CRC32Tables() :
+          mAccelerated(false)
+        {
+          for (DWORD index = 0; index < 256; ++index) {
+            DWORD crc = index;
+            for (int bit = 0; bit < 8; ++bit) {
+              crc = (crc & 1) ? ((crc >> 1) ^ OPENPEER_SERVICES_CRC32_POLYNOMIAL) : (crc >> 1);
+            }
+            mTable[0][index] = crc;
+          }
+
+          // each further table advances the CRC of a byte by one more byte
+          for (DWORD index = 0; index < 256; ++index) {
+            for (size_t slice = 1; slice < 8; ++slice) {
+              DWORD previous = mTable[slice-1][index];
+              mTable[slice][index] = (previous >> 8) ^ mTable[0][previous & 0xFF];
+            }
+          }
+
+#ifdef OPENPEER_SERVICES_CRC32_HAS_PCLMUL
+          unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+          if (0 != __get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+            mAccelerated = (0 != (ecx & bit_PCLMUL)) && (0 != (ecx & bit_SSE4_1));
+          }
+#endif //OPENPEER_SERVICES_CRC32_HAS_PCLMUL
+        }
+      };
+
+      // NOTE: built during static initialization so no lookup ever races
+      //       the construction of the tables
+      static const CRC32Tables gCRC32Tables;
+
+      //-----------------------------------------------------------------------
+      static inline DWORD readLittleEndian(const BYTE *buffer)
+      {
+        return ((DWORD)buffer[0]) | (((DWORD)buffer[1]) << 8) | (((DWORD)buffer[2]) << 16) | (((DWORD)buffer[3]) << 24);
+      }
+
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      #pragma mark
+      #pragma mark FastCRC32
+      #pragma mark
+
+      //-----------------------------------------------------------------------
+      DWORD FastCRC32::calculate(
+                                 const BYTE *buffer,
+                                 size_t bufferLengthInBytes,
+                                 DWORD crc
+                                 )
+      {
+        DWORD state = ~crc;
+
+#ifdef OPENPEER_SERVICES_CRC32_HAS_PCLMUL
+        if ((gCRC32Tables.mAccelerated) &&
+            (bufferLengthInBytes >= OPENPEER_SERVICES_CRC32_MIN_FOLD_LENGTH_IN_BYTES)) {
+          size_t foldLengthInBytes = bufferLengthInBytes & ~((size_t)0xF);
+          state = calculateFolded(state, buffer, foldLengthInBytes);
+          buffer += foldLengthInBytes;
+          bufferLengthInBytes -= foldLengthInBytes;
+        }
+#endif //OPENPEER_SERVICES_CRC32_HAS_PCLMUL
+
+        return ~calculateSliced(state, buffer, bufferLengthInBytes);
+      }
+
+      //-----------------------------------------------------------------------
+      bool FastCRC32::isAccelerated()
+      {
+        return gCRC32Tables.mAccelerated;
+      }
+
+      //-----------------------------------------------------------------------
+      DWORD FastCRC32::calculateSliced(
+                                       DWORD state,
+                                       const BYTE *buffer,
+                                       size_t bufferLengthInBytes
+                                       )
+      {
+        const DWORD (&table)[8][256] = gCRC32Tables.mTable;
+
+        while (bufferLengthInBytes >= 8) {
+          DWORD one = readLittleEndian(buffer) ^ state;
+          DWORD two = readLittleEndian(buffer + 4);
+
+          state = table[7][one & 0xFF] ^
+                  table[6][(one >> 8) & 0xFF] ^
+                  table[5][(one >> 16) & 0xFF] ^
+                  table[4][one >> 24] ^
+                  table[3][two & 0xFF] ^
+                  table[2][(two >> 8) & 0xFF] ^
+                  table[1][(two >> 16) & 0xFF] ^
+                  table[0][two >> 24];
+
+          buffer += 8;
+          bufferLengthInBytes -= 8;
+        }
+
+        while (bufferLengthInBytes > 0) {
+          state = (state >> 8) ^ table[0][(state ^ (*buffer)) & 0xFF];
+          ++buffer;
+          --bufferLengthInBytes;
+        }
+
+        return state;
+      }
+
+#ifdef OPENPEER_SERVICES_CRC32_HAS_PCLMUL
+      //-----------------------------------------------------------------------
+      __attribute__((target("pclmul,sse4.1")))
+      DWORD FastCRC32::calculateFolded(
+                                       DWORD state,
+                                       const BYTE *buffer,
+                                       size_t bufferLengthInBytes
+                                       )
+      {
+        // Folding constants for the bit reflected polynomial as given in
+        // "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ
+        // Instruction" (Gopal et al, Intel). The length must be a multiple
+        // of 16 and at least 64 bytes.
+        static const QWORD k1k2[2] __attribute__((aligned(16))) = {0x0154442bd4ULL, 0x01c6e41596ULL};
+        static const QWORD k3k4[2] __attribute__((aligned(16))) = {0x01751997d0ULL, 0x00ccaa009eULL};
+        static const QWORD k5k0[2] __attribute__((aligned(16))) = {0x0163cd6124ULL, 0x0000000000ULL};
+        static const QWORD poly[2] __attribute__((aligned(16))) = {0x01db710641ULL, 0x01f7011641ULL};
+
+        __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8, y5, y6, y7, y8;
+
+        x1 = _mm_loadu_si128((const __m128i *)(buffer + 0x00));
+        x2 = _mm_loadu_si128((const __m128i *)(buffer + 0x10));
+        x3 = _mm_loadu_si128((const __m128i *)(buffer + 0x20));
+        x4 = _mm_loadu_si128((const __m128i *)(buffer + 0x30));
+
+        x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int)state));
+
+        x0 = _mm_load_si128((const __m128i *)k1k2);
+
+        buffer += 64;
+        bufferLengthInBytes -= 64;
+
+        // fold four lanes in parallel
+        while (bufferLengthInBytes >= 64) {
+          x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+          x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+          x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+          x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+
+          x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+          x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+          x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+          x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+
+          y5 = _mm_loadu_si128((const __m128i *)(buffer + 0x00));
+          y6 = _mm_loadu_si128((const __m128i *)(buffer + 0x10));
+          y7 = _mm_loadu_si128((const __m128i *)(buffer + 0x20));
+          y8 = _mm_loadu_si128((const __m128i *)(buffer + 0x30));
+
+          x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), y5);
+          x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), y6);
+          x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), y7);
+          x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), y8);
+
+          buffer += 64;
+          bufferLengthInBytes -= 64;
+        }
+
+        // fold the four lanes into one
+        x0 = _mm_load_si128((const __m128i *)k3k4);
+
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+        // fold any remaining 16 byte blocks
+        while (bufferLengthInBytes >= 16) {
+          x2 = _mm_loadu_si128((const __m128i *)buffer);
+
+          x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+          x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+          x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+          buffer += 16;
+          bufferLengthInBytes -= 16;
+        }
+
+        // fold 128 bits down to 64 bits
+        x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+        x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+        x1 = _mm_srli_si128(x1, 8);
+        x1 = _mm_xor_si128(x1, x2);
+
+        x0 = _mm_loadl_epi64((const __m128i *)k5k0);
+
+        x2 = _mm_srli_si128(x1, 4);
+        x1 = _mm_and_si128(x1, x3);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x1 = _mm_xor_si128(x1, x2);
+
+        // Barrett reduction down to 32 bits
+        x0 = _mm_load_si128((const __m128i *)poly);
+
+        x2 = _mm_and_si128(x1, x3);
+        x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+        x2 = _mm_and_si128(x2, x3);
+        x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+        x1 = _mm_xor_si128(x1, x2);
+
+        return (DWORD)_mm_extract_epi32(x1, 1);
+      }
+#endif //OPENPEER_SERVICES_CRC32_HAS_PCLMUL
+    }
+  }
+}
@@ -31,11 +31,13 @@
 
 #include <openpeer/services/internal/services_ICESocket.h>
 #include <openpeer/services/internal/services_ICESocketSession.h>
+#include <openpeer/services/internal/services_SocketEventBackend.h>
 #include <openpeer/services/internal/services_TURNSocket.h>
 #include <openpeer/services/internal/services_Helper.h>
 #include <openpeer/services/internal/services_wire.h>
 
 #include <openpeer/services/ISTUNRequesterManager.h>
+#include <openpeer/services/IMessageQueueManager.h>
 #include <openpeer/services/IHTTP.h>
 #include <openpeer/services/ISettings.h>
 
@@ -49,8 +51,11 @@
 #include <cryptopp/osrng.h>
 #include <cryptopp/crc.h>
 
+#include <boost/functional/hash.hpp>
+
 #ifndef _WIN32
 #include <sys/types.h>
+#include <sys/socket.h>
 #ifdef _ANDROID
 #include <openpeer/services/internal/ifaddrs-android.h>
 #else
@@ -58,8 +63,14 @@
 #endif
 #endif //_WIN32
 
-#define OPENPEER_SERVICES_ICESOCKET_RECYCLE_BUFFER_SIZE  (1 << (sizeof(WORD)*8))
-#define OPENPEER_SERVICES_ICESOCKET_MAX_RECYLCE_BUFFERS  4
+#define OPENPEER_SERVICES_ICESOCKET_MAX_LEARNED_ROUTES  (1024)
+
+#define OPENPEER_SERVICES_ICESOCKET_SHARD_THREAD_NAME "org.openpeer.services.iceSocketShardThread"
+
+// only Linux load balances datagrams across SO_REUSEPORT sockets
+#if defined(__linux__) && defined(SO_REUSEPORT)
+#define OPENPEER_SERVICES_ICESOCKET_HAS_REUSEPORT
+#endif //defined(__linux__) && defined(SO_REUSEPORT)
 
 #define OPENPEER_SERVICES_ICESOCKET_MINIMUM_TURN_KEEP_ALIVE_TIME_IN_SECONDS  OPENPEER_SERVICES_IICESOCKET_DEFAULT_HOW_LONG_CANDIDATES_MUST_REMAIN_VALID_IN_SECONDS
 
@@ -127,6 +138,68 @@ namespace openpeer
         return (candidate.mRelatedIP.isEmpty() ? candidate.mIPAddress : candidate.mRelatedIP);
       }
 
+      //-----------------------------------------------------------------------
+      static bool setReusePort(SocketPtr socket)
+      {
+#ifdef OPENPEER_SERVICES_ICESOCKET_HAS_REUSEPORT
+        int enable = 1;
+        return (0 == setsockopt(socket->getSocket(), SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(enable)));
+#else
+        return false;
+#endif //OPENPEER_SERVICES_ICESOCKET_HAS_REUSEPORT
+      }
+
+      //-----------------------------------------------------------------------
+      enum PacketClasses
+      {
+        PacketClass_STUN,
+        PacketClass_ChannelData,    // TURN channel data or RUDP (both are prefixed by a channel number)
+        PacketClass_Application,
+      };
+
+      //-----------------------------------------------------------------------
+      static PacketClasses classifyPacket(
+                                          const BYTE *buffer,
+                                          size_t bufferLengthInBytes
+                                          )
+      {
+        // RFC 7983 style demultiplexing on the first byte of the datagram:
+        // [0..3] STUN, [64..127] channel numbers 0x4000 -> 0x7FFF and
+        // anything else can only be data for a session.
+        if (bufferLengthInBytes < sizeof(DWORD)) return PacketClass_Application;
+
+        BYTE first = buffer[0];
+        if (first < 4) {
+          // RFC 3489 STUN is never accepted by this socket thus the magic
+          // cookie and a length which fits the datagram must be present
+          if (bufferLengthInBytes < OPENPEER_STUN_HEADER_SIZE_IN_BYTES) return PacketClass_Application;
+          DWORD magicCookie = Helper::readDWORD(buffer + sizeof(DWORD));
+          if (OPENPEER_STUN_MAGIC_COOKIE != magicCookie) return PacketClass_Application;
+
+          WORD messageLengthInBytes = Helper::readWORD(buffer + sizeof(WORD));
+          if (0 != (messageLengthInBytes & 0x3)) return PacketClass_Application;
+          if (bufferLengthInBytes < ((size_t)OPENPEER_STUN_HEADER_SIZE_IN_BYTES) + messageLengthInBytes) return PacketClass_Application;
+          return PacketClass_STUN;
+        }
+
+        if ((first >= 64) && (first <= 127)) return PacketClass_ChannelData;
+        return PacketClass_Application;
+      }
+
+      //-----------------------------------------------------------------------
+      static size_t hashIPAddress(const IPAddress &ip)
+      {
+        sockaddr_in6 address;
+        memset(&address, 0, sizeof(address));
+        ip.getIPv6(address);
+
+        const BYTE *bytes = reinterpret_cast<const BYTE *>(&(address.sin6_addr));
+
+        size_t result = boost::hash_range(bytes, bytes + sizeof(address.sin6_addr));
+        boost::hash_combine(result, address.sin6_port);
+        return result;
+      }
+
       //-----------------------------------------------------------------------
       //-----------------------------------------------------------------------
       //-----------------------------------------------------------------------
@@ -165,6 +238,11 @@ namespace openpeer
         mFirstWORDInAnyPacketWillNotConflictWithTURNChannels(firstWORDInAnyPacketWillNotConflictWithTURNChannels),
         mTURNLastUsed(zsLib::now()),
 
+        mReceiveBatchSize(ISettings::getUInt(OPENPEER_SERVICES_SETTING_ICE_SOCKET_RECEIVE_BATCH_SIZE)),
+        mTotalShards(ISettings::getUInt(OPENPEER_SERVICES_SETTING_ICE_SOCKET_SHARDS)),
+        mSegmentationOffload(ISettings::getBool(OPENPEER_SERVICES_SETTING_UDP_SEGMENTATION_OFFLOAD)),
+        mMTUSizedReceiveBuffers(ISettings::getBool(OPENPEER_SERVICES_SETTING_ICE_SOCKET_MTU_SIZED_RECEIVE_BUFFERS)),
+
         mLastCandidateCRC(0),
 
         mForceUseTURN(ISettings::getBool(OPENPEER_SERVICES_SETTING_FORCE_USE_TURN)),
@@ -177,6 +255,36 @@ namespace openpeer
 
         ZS_LOG_BASIC(log("created"))
 
+        if (mReceiveBatchSize < 1) mReceiveBatchSize = 1;
+        if (mReceiveBatchSize > OPENPEER_SERVICES_ICESOCKET_MAX_RECEIVE_BATCH_SIZE) mReceiveBatchSize = OPENPEER_SERVICES_ICESOCKET_MAX_RECEIVE_BATCH_SIZE;
+
+        if (mTotalShards < 1) mTotalShards = 1;
+        if (mTotalShards > OPENPEER_SERVICES_ICESOCKET_MAX_SHARDS) {
+          ZS_LOG_WARNING(Detail, log("too many socket shards requested") + ZS_PARAM("shards", mTotalShards) + ZS_PARAM("max", OPENPEER_SERVICES_ICESOCKET_MAX_SHARDS))
+          mTotalShards = OPENPEER_SERVICES_ICESOCKET_MAX_SHARDS;
+        }
+
+#ifndef OPENPEER_SERVICES_ICESOCKET_HAS_REUSEPORT
+        if (mTotalShards > 1) {
+          ZS_LOG_WARNING(Detail, log("socket sharding is not supported on this platform") + ZS_PARAM("shards", mTotalShards))
+          mTotalShards = 1;
+        }
+#endif //ndef OPENPEER_SERVICES_ICESOCKET_HAS_REUSEPORT
+
+        // each shard index always maps to the same thread (shared by every
+        // ICE socket) so a pinned session keeps its thread across rebinds
+        mShardQueues[0] = queue;
+        for (size_t index = 1; index < mTotalShards; ++index) {
+          String threadName = String(OPENPEER_SERVICES_ICESOCKET_SHARD_THREAD_NAME) + "." + string(index);
+          mShardQueues[index] = IMessageQueueManager::getMessageQueue(threadName);
+        }
+
+        if ((mSegmentationOffload) &&
+            (!UDPBatch::isSegmentationSupported())) {
+          ZS_LOG_WARNING(Detail, log("UDP segmentation offload is not supported on this platform"))
+          mSegmentationOffload = false;
+        }
+
         String networkOrder = ISettings::getString(OPENPEER_SERVICES_SETTING_INTERFACE_NAME_ORDER);
         if (networkOrder.hasData()) {
           IHelper::SplitMap split;
@@ -443,6 +551,7 @@ namespace openpeer
 
         // remember the session for later
         mSessions[session->getID()] = session;
+        mSessionsByUsername.insert(ICESocketSessionUsernameMap::value_type(getUsername(session), session));
         return true;
       }
       
@@ -526,6 +635,76 @@ namespace openpeer
         return false;
       }
 
+      //-----------------------------------------------------------------------
+      size_t ICESocket::sendBatchTo(
+                                    const Candidate &viaLocalCandidate,
+                                    const IPAddress &destination,
+                                    const SendBuffer *buffers,
+                                    size_t totalBuffers,
+                                    bool isUserData
+                                    )
+      {
+        if (isShutdown()) {
+          OPENPEER_SERVICES_WIRE_LOG_WARNING(Debug, log("cannot send packet batch via ICE socket as it is already shutdown") + ZS_PARAM("candidate", viaLocalCandidate.toDebug()) + ZS_PARAM("to ip", destination.string()) + ZS_PARAM("total", totalBuffers) + ZS_PARAM("user data", isUserData))
+          return 0;
+        }
+
+        if ((0 == totalBuffers) ||
+            (!buffers)) return 0;
+
+        SocketPtr socket;
+
+        // scope: get socket value
+        {
+          AutoRecursiveLock lock(*this);
+
+          if (Type_Relayed != viaLocalCandidate.mType) {
+            LocalSocketIPAddressMap::iterator found = mSocketLocalIPs.find(getViaLocalIP(viaLocalCandidate));
+            if (found == mSocketLocalIPs.end()) {
+              OPENPEER_SERVICES_WIRE_LOG_WARNING(Detail, log("did not find local IP to use"))
+              return 0;
+            }
+            socket = (*found).second->mSocket;
+          }
+        }
+
+        if ((Type_Relayed == viaLocalCandidate.mType) ||
+            (mForceUseTURN)) {
+          // TURN relays each packet separately (and forced TURN silently drops local packets anyway)
+          size_t totalSent = 0;
+          for (; totalSent < totalBuffers; ++totalSent) {
+            if (!sendTo(viaLocalCandidate, destination, buffers[totalSent].mBuffer, buffers[totalSent].mBufferLengthInBytes, isUserData)) break;
+          }
+          return totalSent;
+        }
+
+        if (!socket) {
+          OPENPEER_SERVICES_WIRE_LOG_WARNING(Debug, log("cannot send packet batch as UDP socket is not set") + ZS_PARAM("candidate", viaLocalCandidate.toDebug()) + ZS_PARAM("to ip", destination.string()) + ZS_PARAM("total", totalBuffers) + ZS_PARAM("user data", isUserData))
+          return 0;
+        }
+
+        if (!Helper::containsIP(mRestrictedIPs, destination)) {
+          ZS_LOG_WARNING(Trace, log("preventing data packet batch from going to destination as destination is not in restricted IP list") + ZS_PARAM("destination", destination.string()))
+          return totalBuffers;
+        }
+
+        try {
+          bool wouldBlock = false;
+          size_t totalSent = UDPBatch::sendTo(socket, destination, buffers, totalBuffers, &wouldBlock, mSegmentationOffload);
+          OPENPEER_SERVICES_WIRE_LOG_TRACE(log("sending packet batch") + ZS_PARAM("candidate", viaLocalCandidate.toDebug()) + ZS_PARAM("to ip", destination.string()) + ZS_PARAM("total", totalBuffers) + ZS_PARAM("user data", isUserData) + ZS_PARAM("total sent", totalSent) + ZS_PARAM("would block", wouldBlock))
+          if (ZS_IS_LOGGING(Insane)) {
+            for (size_t index = 0; index < totalSent; ++index) {
+              String base64 = IHelper::convertToBase64(buffers[index].mBuffer, buffers[index].mBufferLengthInBytes);
+              OPENPEER_SERVICES_WIRE_LOG_INSANE(log("SEND PACKET ON WIRE") + ZS_PARAM("destination", destination.string()) + ZS_PARAM("wire out", base64))
+            }
+          }
+          return totalSent;
+        } catch(Socket::Exceptions::Unspecified &error) {
+          ZS_LOG_ERROR(Detail, log("sendTo error") + ZS_PARAM("error", error.errorCode()))
+        }
+        return 0;
+      }
+
       //-----------------------------------------------------------------------
       void ICESocket::addRoute(
                                ICESocketSessionPtr session,
@@ -534,22 +713,35 @@ namespace openpeer
                                const IPAddress &source
                                )
       {
-        removeRoute(session);
+        UseICESocketSessionPtr useSession = session;
+
+        AutoRecursiveLock lock(*this);
+
+        // copy the published table, modify the copy and then publish the
+        // copy (packets in flight continue to use the previous table); the
+        // copy makes each add O(n) in the number of routes which is fine
+        // for the handful of routes a socket carries
+        QuickRouteMapCopyPtr routes = copyRoutes(boost::atomic_load(&mRoutes));
+
+        for (QuickRouteMap::iterator iter = routes->begin(); iter != routes->end(); ) {
+          QuickRouteMap::iterator current = iter; ++iter;
+          if ((*current).second == useSession) routes->erase(current);
+        }
+
         RouteTuple tuple(viaIP, viaLocalIP, source);
-        mRoutes[tuple] = session;
+        (*routes)[tuple] = useSession;
+
+        boost::atomic_store(&mRoutes, QuickRouteMapPtr(routes));
       }
 
       //-----------------------------------------------------------------------
       void ICESocket::removeRoute(ICESocketSessionPtr inSession)
       {
-        for (QuickRouteMap::iterator iter = mRoutes.begin(); iter != mRoutes.end(); ) {
-          QuickRouteMap::iterator current = iter; ++iter;
+        UseICESocketSessionPtr session = inSession;
+        if (!session) return;
 
-          UseICESocketSessionPtr &session = (*current).second;
-          if (session == inSession) {
-            mRoutes.erase(current);
-          }
-        }
+        AutoRecursiveLock lock(*this);
+        removeRoutes(mRoutes, NULL, session->getID());
       }
 
       //-----------------------------------------------------------------------
@@ -564,12 +756,45 @@ namespace openpeer
           return;
         }
 
-        removeRoute(ICESocketSession::convert((*found).second));
+        UseICESocketSessionPtr session = (*found).second;
+
+        removeRoute(ICESocketSession::convert(session));
+        removeLearnedRoutes(sessionID);
+        unpinSession(sessionID);
+
+        ICEUsername username = getUsername(session);
+        std::pair<ICESocketSessionUsernameMap::iterator, ICESocketSessionUsernameMap::iterator> range = mSessionsByUsername.equal_range(username);
+        for (ICESocketSessionUsernameMap::iterator iter = range.first; iter != range.second; ) {
+          ICESocketSessionUsernameMap::iterator current = iter; ++iter;
+          if (sessionID != (*current).second->getID()) continue;
+          mSessionsByUsername.erase(current);
+        }
+
         mSessions.erase(found);
         
         step();
       }
 
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      #pragma mark
+      #pragma mark ICESocket => IICESocketAsync
+      #pragma mark
+
+      //-----------------------------------------------------------------------
+      void ICESocket::onICESocketShardBatchReceived(ShardBatchPtr batch)
+      {
+        CandidatePtr viaLocalCandidate = getShardLocalCandidate(batch->mBindIP);
+        if (!viaLocalCandidate) return;
+
+        // the batch was forwarded to the thread which delivers it thus it is
+        // never dispatched again; this method cannot be called within the
+        // scope of a lock because it calls a delegate synchronously
+        internalReceivedBatch(*viaLocalCandidate, batch->mSocket, &(batch->mReceived[0]), batch->mTotalReceived);
+      }
+
       //-----------------------------------------------------------------------
       //-----------------------------------------------------------------------
       //-----------------------------------------------------------------------
@@ -590,9 +815,9 @@ namespace openpeer
           LocalSocketPtr &localSocket = (*iter).second;
 
           if (monitor) {
-            localSocket->mSocket->monitor(Socket::Monitor::All);
+            SocketEventBackend::monitor(localSocket->mSocket, Socket::Monitor::All);
           } else {
-            localSocket->mSocket->monitor((Socket::Monitor::Options)(Socket::Monitor::Read | Socket::Monitor::Exception));
+            SocketEventBackend::monitor(localSocket->mSocket, (Socket::Monitor::Options)(Socket::Monitor::Read | Socket::Monitor::Exception));
           }
         }
       }
@@ -600,11 +825,12 @@ namespace openpeer
       //-----------------------------------------------------------------------
       void ICESocket::onReadReady(SocketPtr socket)
       {
-        boost::shared_array<BYTE> buffer;
+        PacketBufferPtr buffers[OPENPEER_SERVICES_ICESOCKET_MAX_RECEIVE_BATCH_SIZE];
+        UDPBatch::ReceiveBuffer received[OPENPEER_SERVICES_ICESOCKET_MAX_RECEIVE_BATCH_SIZE];
+
         CandidatePtr viaLocalCandidate;
-        IPAddress source;
-        size_t bytesRead = 0;
-        AutoRecycleBuffer recycle(*this, buffer);
+        size_t totalRead = 0;
+        size_t batchSize = mReceiveBatchSize;
 
         // scope: we are going to read the data while within the local but process it outside the lock
         {
@@ -622,17 +848,14 @@ namespace openpeer
           try {
             bool wouldBlock = false;
 
-            getBuffer(buffer);
-
-            bytesRead = localSocket->mSocket->receiveFrom(source, buffer.get(), OPENPEER_SERVICES_ICESOCKET_RECYCLE_BUFFER_SIZE, &wouldBlock);
-            if (0 == bytesRead) return;
+            ReceiveSlots &slots = localSocket->mReceiveSlots;
+            slots.prepare(batchSize);
 
-            OPENPEER_SERVICES_WIRE_LOG_TRACE(log("packet received") + ZS_PARAM("ip", + source.string()) + ZS_PARAM("handle", socket->getSocket()))
+            totalRead = UDPBatch::receiveFrom(localSocket->mSocket, &(slots.mReceived[0]), batchSize, &wouldBlock);
+            if (0 == totalRead) return;
 
-            if (ZS_IS_LOGGING(Insane)) {
-              String base64 = Helper::convertToBase64(buffer.get(), bytesRead);
-              OPENPEER_SERVICES_WIRE_LOG_INSANE(log("RECEIVE PACKET ON WIRE") + ZS_PARAM("source", source.string()) + ZS_PARAM("wire in", base64))
-            }
+            // the filled buffers leave with the packets
+            slots.takeFilled(totalRead, &(buffers[0]), &(received[0]));
 
           } catch(Socket::Exceptions::Unspecified &error) {
             ZS_LOG_ERROR(Detail, log("receiveFrom error") + ZS_PARAM("error", error.errorCode()))
@@ -643,7 +866,7 @@ namespace openpeer
 
         // this method cannot be called within the scope of a lock because it
         // calls a delegate synchronously
-        internalReceivedData(*viaLocalCandidate, *viaLocalCandidate, source, buffer.get(), bytesRead);
+        dispatchBatch(0, *viaLocalCandidate, socket, &(buffers[0]), &(received[0]), totalRead);
       }
 
       //-----------------------------------------------------------------------
@@ -714,6 +937,7 @@ namespace openpeer
           localSocket->mSTUNInfos.clear();
           localSocket->mSTUNDiscoveries.clear();
 
+          SocketEventBackend::detach(localSocket->mSocket);
           localSocket->mSocket->close();
           localSocket->mSocket.reset();
 
@@ -834,6 +1058,60 @@ namespace openpeer
         return false;
       }
 
+      //-----------------------------------------------------------------------
+      bool ICESocket::notifyTURNSocketSendPacketParts(
+                                                      ITURNSocketPtr socket,
+                                                      IPAddress destination,
+                                                      const PacketPart *parts,
+                                                      size_t totalParts
+                                                      )
+      {
+        AutoRecursiveLock lock(*this);
+
+        ZS_THROW_INVALID_ARGUMENT_IF(totalParts > OPENPEER_SERVICES_UDPBATCH_MAX_GATHERED_BUFFERS)
+
+        UDPBatch::SendBuffer buffers[OPENPEER_SERVICES_UDPBATCH_MAX_GATHERED_BUFFERS];
+        size_t packetLengthInBytes = 0;
+        for (size_t index = 0; index < totalParts; ++index) {
+          buffers[index].mBuffer = parts[index].mBuffer;
+          buffers[index].mBufferLengthInBytes = parts[index].mBufferLengthInBytes;
+          packetLengthInBytes += parts[index].mBufferLengthInBytes;
+        }
+
+        OPENPEER_SERVICES_WIRE_LOG_TRACE(log("sending packet parts for TURN") + ZS_PARAM("TURN socket ID", socket->getID()) + ZS_PARAM("destination", destination.string()) + ZS_PARAM("parts", totalParts) + ZS_PARAM("length", packetLengthInBytes))
+
+        if (isShutdown()) {
+          OPENPEER_SERVICES_WIRE_LOG_WARNING(Debug, log("unable to send data on behalf of TURN as ICE socket is shutdown") + ZS_PARAM("TURN socket ID", socket->getID()))
+          return false;
+        }
+
+        LocalSocketTURNSocketMap::iterator found = mSocketTURNs.find(socket);
+        if (found == mSocketTURNs.end()) {
+          OPENPEER_SERVICES_WIRE_LOG_WARNING(Debug, log("unable to send data on behalf of TURN as TURN socket does not match any local socket (TURN reconnect reattempt?)") + ZS_PARAM("socket ID", socket->getID()))
+          return false;
+        }
+        LocalSocketPtr &localSocket = (*found).second;
+
+        try {
+          bool wouldBlock = false;
+
+          if (!Helper::containsIP(mRestrictedIPs, destination)) {
+            ZS_LOG_WARNING(Trace, log("preventing TURN packet from going to destination as destination is not in restricted IP list") + ZS_PARAM("destination", destination.string()))
+            return true;
+          }
+
+          size_t bytesSent = UDPBatch::sendGathered(localSocket->mSocket, destination, &(buffers[0]), totalParts, &wouldBlock);
+          bool sent = ((!wouldBlock) && (bytesSent == packetLengthInBytes));
+          if (!sent) {
+            OPENPEER_SERVICES_WIRE_LOG_WARNING(Debug, log("unable to send data on behalf of TURN as UDP socket did not send the data") + ZS_PARAM("would block", wouldBlock) + ZS_PARAM("bytes sent", bytesSent))
+          }
+          return sent;
+        } catch(Socket::Exceptions::Unspecified &error) {
+          OPENPEER_SERVICES_WIRE_LOG_ERROR(Detail, log("sendTo error") + ZS_PARAM("error", error.errorCode()))
+        }
+        return false;
+      }
+
       //-----------------------------------------------------------------------
       void ICESocket::onTURNSocketWriteReady(ITURNSocketPtr socket)
       {
@@ -1024,10 +1302,23 @@ namespace openpeer
         IHelper::debugAppend(resultEl, "turn stutdown duration (s)", mTURNShutdownIfNotUsedBy);
 
         IHelper::debugAppend(resultEl, "sessions", mSessions.size());
+        IHelper::debugAppend(resultEl, "sessions by username", mSessionsByUsername.size());
+
+        QuickRouteMapPtr routes = boost::atomic_load(&mRoutes);
+        QuickRouteMapPtr learnedRoutes = boost::atomic_load(&mLearnedRoutes);
+
+        IHelper::debugAppend(resultEl, "routes", routes ? routes->size() : 0);
+        IHelper::debugAppend(resultEl, "learned routes", learnedRoutes ? learnedRoutes->size() : 0);
 
-        IHelper::debugAppend(resultEl, "routes", mRoutes.size());
+        SessionShardMapPtr sessionShards = boost::atomic_load(&mSessionShards);
+        IHelper::debugAppend(resultEl, "pinned sessions", sessionShards ? sessionShards->size() : 0);
 
-        IHelper::debugAppend(resultEl, "recyle buffers", mRecycledBuffers.size());
+        IHelper::debugAppend(resultEl, "receive batch size", mReceiveBatchSize);
+        IHelper::debugAppend(resultEl, "receive batch supported", UDPBatch::isSupported());
+        IHelper::debugAppend(resultEl, "shards", mTotalShards);
+        IHelper::debugAppend(resultEl, "segmentation offload", mSegmentationOffload);
+        IHelper::debugAppend(resultEl, "mtu sized receive buffers", mMTUSizedReceiveBuffers);
+        IHelper::debugAppend(resultEl, PacketBufferPool::toDebug());
 
         IHelper::debugAppend(resultEl, "notified candidates changed", mNotifiedCandidateChanged);
         IHelper::debugAppend(resultEl, "candidate crc", mLastCandidateCRC);
@@ -1103,6 +1394,8 @@ namespace openpeer
 
         mFoundation.reset();
 
+        mSessionsByUsername.clear();
+
         if (mSessions.size() > 0) {
           ICESocketSessionMap temp = mSessions;
           mSessions.clear();
@@ -1113,7 +1406,9 @@ namespace openpeer
           }
         }
 
-        mRoutes.clear();
+        boost::atomic_store(&mRoutes, QuickRouteMapPtr());
+        boost::atomic_store(&mLearnedRoutes, QuickRouteMapPtr());
+        boost::atomic_store(&mSessionShards, SessionShardMapPtr());
 
         mSocketLocalIPs.clear();
         mSocketTURNs.clear();
@@ -1272,16 +1567,33 @@ namespace openpeer
             LocalSocketPtr localSocket = (*found).second;
 
             localSocket->updateLocalPreference(localPreference);  // update the local preference based on the ordering of the local IPs
+
+            if (!hasAllShards(localSocket)) {
+              // a lost shard changes the SO_REUSEPORT group which already
+              // re-hashes the remotes, so rebuild the whole group now
+              // rather than leave a partial group behind
+              ZS_LOG_WARNING(Detail, log("socket shards are missing thus rebuilding shards") + ZS_PARAM("ip", string(bindIP)) + ZS_PARAM("shards", localSocket->mShards.size()))
+              closeShards(localSocket);
+              createShards(localSocket);
+            }
             continue;
           }
 
           SocketPtr socket;
+          bool receiveCoalescing = false;
 
           ZS_LOG_DEBUG(log("attempting to bind to IP") + ZS_PARAM("ip", string(bindIP)))
 
           try {
             socket = Socket::createUDP();
 
+            if (mTotalShards > 1) {
+              // every socket sharing the port must opt in before binding
+              if (!setReusePort(socket)) {
+                ZS_LOG_WARNING(Detail, log("unable to enable SO_REUSEPORT thus socket will not be sharded") + ZS_PARAM("ip", string(bindIP)))
+              }
+            }
+
             socket->bind(bindIP);
             socket->setBlocking(false);
             try {
@@ -1291,9 +1603,16 @@ namespace openpeer
             } catch(Socket::Exceptions::UnsupportedSocketOption &) {
             }
 
+            if (mSegmentationOffload) {
+              receiveCoalescing = UDPBatch::enableReceiveCoalescing(socket);
+              if (!receiveCoalescing) {
+                ZS_LOG_DEBUG(log("unable to enable receive coalescing") + ZS_PARAM("ip", string(bindIP)))
+              }
+            }
+
             IPAddress local = socket->getLocalAddress();
 
-            socket->setDelegate(mThisWeak.lock());
+            SocketEventBackend::attach(socket, mThisWeak.lock());
 
             mBindPort = local.getPort();
             bindIP.setPort(mBindPort);
@@ -1314,6 +1633,7 @@ namespace openpeer
 
           localSocket->mSocket = socket;
           localSocket->mLocal->mIPAddress = bindIP;
+          localSocket->mReceiveSlots.configure(receiveCoalescing, mMTUSizedReceiveBuffers, mReceiveBatchSize);
 
           String usernameFrag = (mFoundation ? mFoundation->getUsernameFrag() : mUsernameFrag);
 
@@ -1322,6 +1642,8 @@ namespace openpeer
 
           mSocketLocalIPs[bindIP] = localSocket;
           mSockets[socket] = localSocket;
+
+          createShards(localSocket);
         }
 
         if ((hadNone) &&
@@ -2137,12 +2459,15 @@ namespace openpeer
 
         localSocket->mTURNSockets.clear();  // forget any remaining alive
 
+        closeShards(localSocket);
+
         if (localSocket->mSocket) {
           LocalSocketMap::iterator found = mSockets.find(localSocket->mSocket);
           if (found != mSockets.end()) {
             mSockets.erase(found);
           }
 
+          SocketEventBackend::detach(localSocket->mSocket);
           localSocket->mSocket->close();
           localSocket->mSocket.reset();
         }
@@ -2152,19 +2477,8 @@ namespace openpeer
           mSocketLocalIPs.erase(found);
         }
 
-        for (QuickRouteMap::iterator iter_DoNotUse = mRoutes.begin(); iter_DoNotUse != mRoutes.end(); )
-        {
-          QuickRouteMap::iterator current = iter_DoNotUse;
-          ++iter_DoNotUse;
-
-          const RouteTuple &tuple = (*current).first;
-
-          const IPAddress &viaLocalIP = boost::get<1>(tuple);
-          
-          if (!viaLocalIP.isEqualIgnoringIPv4Format(localSocket->mLocal->mIPAddress)) continue;
-          
-          mRoutes.erase(current);
-        }
+        removeRoutes(mRoutes, &(localSocket->mLocal->mIPAddress), 0);
+        removeRoutes(mLearnedRoutes, &(localSocket->mLocal->mIPAddress), 0);
       }
       
       //-----------------------------------------------------------------------
@@ -2188,95 +2502,502 @@ namespace openpeer
       }
 
       //-----------------------------------------------------------------------
-      void ICESocket::internalReceivedData(
-                                           const Candidate &viaCandidate,
-                                           const Candidate &viaLocalCandidate,
-                                           const IPAddress &source,
-                                           const BYTE *buffer,
-                                           size_t bufferLengthInBytes
-                                           )
+      void ICESocket::createShards(LocalSocketPtr localSocket)
       {
-        // WARNING: DO NOT CALL THIS METHOD WHILE INSIDE A LOCK AS IT COULD
-        //          ** DEADLOCK **. This method calls delegates synchronously.
-        STUNPacketPtr stun = STUNPacket::parseIfSTUN(buffer, bufferLengthInBytes, STUNPacket::RFC_AllowAll, false, "ICESocket", mID);
+        if (mTotalShards < 2) return;
 
-        if (stun) {
-          OPENPEER_SERVICES_WIRE_LOG_TRACE(log("received STUN packet") + ZS_PARAM("via candidate", viaCandidate.toDebug()) + ZS_PARAM("source ip", source.string()) + ZS_PARAM("class", stun->classAsString()) + ZS_PARAM("method", stun->methodAsString()))
-          ITURNSocketPtr turn;
-          if (IICESocket::Type_Relayed != normalize(viaCandidate.mType)) {
+        const IPAddress &bindIP = localSocket->mLocal->mIPAddress;
 
-            // scope: going into a lock to obtain
-            {
-              AutoRecursiveLock lock(*this);
-              LocalSocketIPAddressMap::iterator found = mSocketLocalIPs.find(getViaLocalIP(viaCandidate));
-              if (found != mSocketLocalIPs.end()) {
-                LocalSocketPtr &localSocket = (*found).second;
+        for (size_t index = 1; index < mTotalShards; ++index)
+        {
+          SocketPtr socket;
+          bool receiveCoalescing = false;
 
-                TURNInfoRelatedIPMap::iterator foundRelay = localSocket->mTURNServerIPs.find(source);
-                if (foundRelay != localSocket->mTURNServerIPs.end()) {
-                  turn = (*foundRelay).second->mTURNSocket;
-                }
-              }
+          try {
+            socket = Socket::createUDP();
+
+            if (!setReusePort(socket)) {
+              ZS_LOG_WARNING(Detail, log("unable to enable SO_REUSEPORT on shard socket") + ZS_PARAM("ip", string(bindIP)) + ZS_PARAM("shard", index))
+              return;
             }
 
-            if (turn) {
-              if (turn->handleSTUNPacket(source, stun)) return;
+            socket->bind(bindIP);
+            socket->setBlocking(false);
+            try {
+#ifndef __QNX__
+              socket->setOptionFlag(Socket::SetOptionFlag::IgnoreSigPipe, true);
+#endif //ndef __QNX__
+            } catch(Socket::Exceptions::UnsupportedSocketOption &) {
             }
-          }
 
-          if (!turn) {
-            // if TURN was used, we would already called this routine... (i.e. prevent double lookup)
-            if (ISTUNRequesterManager::handleSTUNPacket(source, stun)) return;
+            if (mSegmentationOffload) {
+              receiveCoalescing = UDPBatch::enableReceiveCoalescing(socket);
+            }
+          } catch(Socket::Exceptions::Unspecified &error) {
+            ZS_LOG_ERROR(Detail, log("shard bind error") + ZS_PARAM("ip", string(bindIP)) + ZS_PARAM("shard", index) + ZS_PARAM("error", error.errorCode()))
+            return;
           }
 
-          UseICESocketSessionPtr next;
+          ShardPtr shard = Shard::create(mShardQueues[index], mThisWeak.lock(), index, bindIP, socket, receiveCoalescing);
 
-          if (STUNPacket::Method_Binding == stun->mMethod) {
-            if ((STUNPacket::Class_Request != stun->mClass) &&
-                (STUNPacket::Class_Indication != stun->mClass)) {
-              ZS_LOG_WARNING(Debug, log("ignoring STUN binding which is not a request/indication"))
-              return;
-            }
-          }
+          ZS_LOG_DEBUG(log("shard bound") + ZS_PARAM("ip", string(bindIP)) + ZS_PARAM("shard", index) + ZS_PARAM("shard id", shard->getID()))
 
-          if (STUNPacket::RFC_5766_TURN == stun->guessRFC(STUNPacket::RFC_AllowAll)) {
-            ZS_LOG_TRACE(log("ignoring TURN message (likely for cancelled requests)"))
-            return;    // ignore any ICE indications
-          }
+          localSocket->mShards.push_back(shard);
+        }
+      }
 
-          if (stun->mUsername.isEmpty()) {
-            ZS_LOG_WARNING(Detail, log("did not find ICE username on packet thus ignoring STUN packet"))
-            return;  // no username is present - this cannot be for us...
-          }
+      //-----------------------------------------------------------------------
+      bool ICESocket::hasAllShards(LocalSocketPtr localSocket) const
+      {
+        if (mTotalShards < 2) return true;
+        if (localSocket->mShards.size() != mTotalShards - 1) return false;
 
-          // username is present... but does it have the correct components?
-          size_t pos = stun->mUsername.find(":");
-          if (String::npos == pos) {
-            ZS_LOG_WARNING(Detail, log("did not find \":\" in username on packet thus ignoring STUN packet"))
-            return;  // no ":" means that it can't be an ICE requeest
+        for (ShardList::const_iterator iter = localSocket->mShards.begin(); iter != localSocket->mShards.end(); ++iter) {
+          if ((*iter)->isClosed()) return false;
+        }
+        return true;
+      }
+
+      //-----------------------------------------------------------------------
+      void ICESocket::closeShards(LocalSocketPtr localSocket)
+      {
+        for (ShardList::iterator iter = localSocket->mShards.begin(); iter != localSocket->mShards.end(); ++iter) {
+          (*iter)->close();
+        }
+        localSocket->mShards.clear();
+      }
+
+      //-----------------------------------------------------------------------
+      ICESocket::ICEUsername ICESocket::getUsername(UseICESocketSessionPtr session)
+      {
+        return session->getLocalUsernameFrag() + ":" + session->getRemoteUsernameFrag();
+      }
+
+      //-----------------------------------------------------------------------
+      void ICESocket::removeLearnedRoutes(PUID sessionID)
+      {
+        removeRoutes(mLearnedRoutes, NULL, sessionID);
+      }
+
+      //-----------------------------------------------------------------------
+      size_t ICESocket::pinSession(
+                                   UseICESocketSessionPtr session,
+                                   size_t shardIndex
+                                   )
+      {
+        PUID sessionID = session->getID();
+
+        // scope: the session is almost always pinned already
+        {
+          SessionShardMapPtr pins = boost::atomic_load(&mSessionShards);
+          if (pins) {
+            SessionShardMap::const_iterator found = pins->find(sessionID);
+            if (found != pins->end()) return (*found).second;
           }
+        }
 
-          // split the string at the post
-          String localUsernameFrag = stun->mUsername.substr(0, pos); // this would be our local username
-          String remoteUsernameFrag = stun->mUsername.substr(pos+1);  // this would be the remote username
+        AutoRecursiveLock lock(*this);
 
-          while (true)
-          {
-            // scope: find the next socket session to test in the list while in a lock
-            {
-              AutoRecursiveLock lock(*this);
-              if (mSessions.size() < 1) break;  // no sessions to check
+        SessionShardMapPtr published = boost::atomic_load(&mSessionShards);
+        if (published) {
+          // another shard could have pinned the session before the lock was obtained
+          SessionShardMap::const_iterator found = published->find(sessionID);
+          if (found != published->end()) return (*found).second;
+        }
 
-              if (!next) {
-                next = (*(mSessions.begin())).second;
-              } else {
-                ICESocketSessionMap::iterator iter = mSessions.find(next->getID());
-                if (iter == mSessions.end()) {
-                  // should have been found BUT it is possible the list was
-                  // changed while outside the lock so start the search from
-                  // the beginning again...
-                  next = (*(mSessions.begin())).second;
-                } else {
+        // a closed session is not pinned (it would never be unpinned)
+        if (mSessions.end() == mSessions.find(sessionID)) return shardIndex;
+
+        SessionShardMapCopyPtr pins(published ? new SessionShardMap(*published) : new SessionShardMap);
+        (*pins)[sessionID] = shardIndex;
+
+        boost::atomic_store(&mSessionShards, SessionShardMapPtr(pins));
+
+        ZS_LOG_DEBUG(log("session pinned to shard") + ZS_PARAM("session id", sessionID) + ZS_PARAM("shard", shardIndex))
+        return shardIndex;
+      }
+
+      //-----------------------------------------------------------------------
+      void ICESocket::unpinSession(PUID sessionID)
+      {
+        AutoRecursiveLock lock(*this);
+
+        SessionShardMapPtr published = boost::atomic_load(&mSessionShards);
+        if (!published) return;
+        if (published->end() == published->find(sessionID)) return;
+
+        SessionShardMapCopyPtr pins(new SessionShardMap(*published));
+        pins->erase(sessionID);
+
+        boost::atomic_store(&mSessionShards, SessionShardMapPtr(pins));
+      }
+
+      //-----------------------------------------------------------------------
+      ICESocket::QuickRouteMapCopyPtr ICESocket::copyRoutes(const QuickRouteMapPtr &routes)
+      {
+        if (!routes) return QuickRouteMapCopyPtr(new QuickRouteMap);
+        return QuickRouteMapCopyPtr(new QuickRouteMap(*routes));
+      }
+
+      //-----------------------------------------------------------------------
+      bool ICESocket::removeRoutes(
+                                   QuickRouteMapPtr &ioRoutes,
+                                   const IPAddress *viaLocalIP,
+                                   PUID sessionID
+                                   )
+      {
+        // NOTE: a NULL via local IP or a 0 session ID matches any route;
+        //       the caller must be in the lock as only one writer may
+        //       publish at a time.
+        QuickRouteMapPtr published = boost::atomic_load(&ioRoutes);
+        if (!published) return false;
+
+        QuickRouteMapCopyPtr routes;
+
+        for (QuickRouteMap::const_iterator iter = published->begin(); iter != published->end(); ++iter) {
+          const RouteTuple &tuple = (*iter).first;
+          const UseICESocketSessionPtr &session = (*iter).second;
+
+          if (viaLocalIP) {
+            if (!boost::get<1>(tuple).isEqualIgnoringIPv4Format(*viaLocalIP)) continue;
+          }
+          if (0 != sessionID) {
+            if (sessionID != session->getID()) continue;
+          }
+
+          if (!routes) routes = copyRoutes(published);  // only copy if something must change
+          routes->erase(tuple);
+        }
+
+        if (!routes) return false;
+
+        boost::atomic_store(&ioRoutes, QuickRouteMapPtr(routes));
+        return true;
+      }
+
+      //-----------------------------------------------------------------------
+      ICESocket::UseICESocketSessionPtr ICESocket::findRoute(
+                                                             const QuickRouteMapPtr &routes,
+                                                             const Candidate &viaCandidate,
+                                                             const Candidate &viaLocalCandidate,
+                                                             const IPAddress &source
+                                                             )
+      {
+        if (!routes) return UseICESocketSessionPtr();
+        if (routes->empty()) return UseICESocketSessionPtr();
+
+        QuickRouteMap::const_iterator found = routes->find(RouteTuple(viaCandidate.mIPAddress, viaLocalCandidate.mIPAddress, source));
+        if (found == routes->end()) return UseICESocketSessionPtr();
+
+        return (*found).second;
+      }
+
+      //-----------------------------------------------------------------------
+      void ICESocket::findSessionsByUsername(
+                                             const ICEUsername &username,
+                                             ICESocketSessionMap &outSessions
+                                             )
+      {
+        std::pair<ICESocketSessionUsernameMap::iterator, ICESocketSessionUsernameMap::iterator> range = mSessionsByUsername.equal_range(username);
+        for (ICESocketSessionUsernameMap::iterator iter = range.first; iter != range.second; ++iter) {
+          UseICESocketSessionPtr &session = (*iter).second;
+          outSessions[session->getID()] = session;
+        }
+      }
+
+      //-----------------------------------------------------------------------
+      void ICESocket::learnRoute(
+                                 const Candidate &viaCandidate,
+                                 const Candidate &viaLocalCandidate,
+                                 const IPAddress &source,
+                                 UseICESocketSessionPtr session
+                                 )
+      {
+        AutoRecursiveLock lock(*this);
+
+        ICESocketSessionMap::iterator found = mSessions.find(session->getID());
+        if (found == mSessions.end()) return;  // session closed while outside the lock
+
+        QuickRouteMapCopyPtr routes = copyRoutes(boost::atomic_load(&mLearnedRoutes));
+
+        if (routes->size() >= OPENPEER_SERVICES_ICESOCKET_MAX_LEARNED_ROUTES) {
+          ZS_LOG_DEBUG(log("learned route table is full (flushing)") + ZS_PARAM("size", routes->size()))
+          routes->clear();
+        }
+
+        RouteTuple tuple(viaCandidate.mIPAddress, viaLocalCandidate.mIPAddress, source);
+        (*routes)[tuple] = session;
+
+        boost::atomic_store(&mLearnedRoutes, QuickRouteMapPtr(routes));
+      }
+
+      //-----------------------------------------------------------------------
+      void ICESocket::resolveRoute(
+                                   const Candidate &viaCandidate,
+                                   const Candidate &viaLocalCandidate,
+                                   const IPAddress &source,
+                                   PacketRoute &outRoute
+                                   )
+      {
+        outRoute.mTURNSocket.reset();
+
+        // packets can only be from a TURN server if they did not arrive via a relay
+        if (IICESocket::Type_Relayed != normalize(viaCandidate.mType)) {
+          LocalSocketIPAddressMap::iterator found = mSocketLocalIPs.find(getViaLocalIP(viaCandidate));
+          if (found != mSocketLocalIPs.end()) {
+            LocalSocketPtr &localSocket = (*found).second;
+
+            TURNInfoRelatedIPMap::iterator foundRelay = localSocket->mTURNServerIPs.find(source);
+            if (foundRelay != localSocket->mTURNServerIPs.end()) {
+              outRoute.mTURNSocket = (*foundRelay).second->mTURNSocket;
+            }
+          }
+        }
+      }
+
+      //-----------------------------------------------------------------------
+      CandidatePtr ICESocket::getShardLocalCandidate(const IPAddress &bindIP)
+      {
+        AutoRecursiveLock lock(*this);
+
+        LocalSocketIPAddressMap::iterator found = mSocketLocalIPs.find(bindIP);
+        if (found == mSocketLocalIPs.end()) {
+          OPENPEER_SERVICES_WIRE_LOG_WARNING(Detail, log("local socket for shard is gone") + ZS_PARAM("ip", bindIP.string()))
+          return CandidatePtr();
+        }
+
+        return (*found).second->mLocal;
+      }
+
+      //-----------------------------------------------------------------------
+      void ICESocket::dispatchBatch(
+                                    size_t shardIndex,
+                                    const Candidate &viaLocalCandidate,
+                                    SocketPtr socket,
+                                    const PacketBufferPtr *buffers,
+                                    const UDPBatch::ReceiveBuffer *received,
+                                    size_t totalReceived
+                                    )
+      {
+        // WARNING: DO NOT CALL THIS METHOD WHILE INSIDE A LOCK AS IT COULD
+        //          ** DEADLOCK **. This method calls delegates synchronously.
+
+        if (mTotalShards < 2) {
+          internalReceivedBatch(viaLocalCandidate, socket, received, totalReceived);
+          return;
+        }
+
+        UDPBatch::ReceiveBuffer deliver[OPENPEER_SERVICES_ICESOCKET_MAX_RECEIVE_BATCH_SIZE];
+        size_t totalDeliver = 0;
+
+        ShardBatchPtr forward[OPENPEER_SERVICES_ICESOCKET_MAX_SHARDS];
+
+        QuickRouteMapPtr routes = boost::atomic_load(&mRoutes);
+        QuickRouteMapPtr learnedRoutes = boost::atomic_load(&mLearnedRoutes);
+
+        for (size_t index = 0; index < totalReceived; ++index) {
+          const UDPBatch::ReceiveBuffer &packet = received[index];
+
+          // every datagram coalesced into one read came from the same source
+          // so the whole read belongs to the same route
+          UseICESocketSessionPtr session = findRoute(routes, viaLocalCandidate, viaLocalCandidate, packet.mSource);
+          if (!session) session = findRoute(learnedRoutes, viaLocalCandidate, viaLocalCandidate, packet.mSource);
+
+          size_t target = (session ? pinSession(session, shardIndex) : 0);
+          if (target == shardIndex) {
+            deliver[totalDeliver] = packet;
+            ++totalDeliver;
+            continue;
+          }
+
+          // the buffer travels with the datagram so nothing is copied
+          ShardBatchPtr &batch = forward[target];
+          if (!batch) {
+            batch = ShardBatchPtr(new ShardBatch);
+            batch->mBindIP = viaLocalCandidate.mIPAddress;
+            batch->mSocket = socket;
+          }
+          batch->mBuffers[batch->mTotalReceived] = buffers[index];
+          batch->mReceived[batch->mTotalReceived] = packet;
+          ++(batch->mTotalReceived);
+        }
+
+        ICESocketPtr pThis = mThisWeak.lock();
+        if (pThis) {
+          for (size_t index = 0; index < mTotalShards; ++index) {
+            if (!forward[index]) continue;
+            IICESocketAsyncProxy::create(mShardQueues[index], pThis)->onICESocketShardBatchReceived(forward[index]);
+          }
+        }
+
+        if (0 == totalDeliver) return;
+
+        internalReceivedBatch(viaLocalCandidate, socket, &(deliver[0]), totalDeliver);
+      }
+
+      //-----------------------------------------------------------------------
+      void ICESocket::internalReceivedBatch(
+                                            const Candidate &viaLocalCandidate,
+                                            SocketPtr socket,
+                                            const UDPBatch::ReceiveBuffer *received,
+                                            size_t totalReceived
+                                            )
+      {
+        // WARNING: DO NOT CALL THIS METHOD WHILE INSIDE A LOCK AS IT COULD
+        //          ** DEADLOCK **. This method calls delegates synchronously.
+
+        for (size_t index = 0; index < totalReceived; ++index) {
+          const UDPBatch::ReceiveBuffer &packet = received[index];
+
+          OPENPEER_SERVICES_WIRE_LOG_TRACE(log("packet received") + ZS_PARAM("ip", + packet.mSource.string()) + ZS_PARAM("handle", socket->getSocket()) + ZS_PARAM("batch index", index) + ZS_PARAM("batch total", totalReceived))
+
+          if (ZS_IS_LOGGING(Insane)) {
+            String base64 = Helper::convertToBase64(packet.mBuffer, packet.mBytesRead);
+            OPENPEER_SERVICES_WIRE_LOG_INSANE(log("RECEIVE PACKET ON WIRE") + ZS_PARAM("source", packet.mSource.string()) + ZS_PARAM("wire in", base64))
+          }
+
+          if (packet.mTruncated) {
+            OPENPEER_SERVICES_WIRE_LOG_WARNING(Detail, log("dropping datagram larger than the receive buffer") + ZS_PARAM("ip", packet.mSource.string()) + ZS_PARAM("buffer size", packet.mBufferSizeInBytes))
+            continue;
+          }
+
+          size_t segmentSize = packet.segmentSize();
+
+          // a coalesced read holds several datagrams from the same source;
+          // each datagram is routed as it is handled so that sessions and
+          // routes created by earlier packets in the batch are seen
+          for (size_t offset = 0; offset < packet.mBytesRead; offset += segmentSize) {
+            size_t length = (packet.mBytesRead - offset < segmentSize ? packet.mBytesRead - offset : segmentSize);
+            internalReceivedData(viaLocalCandidate, viaLocalCandidate, packet.mSource, &(packet.mBuffer[offset]), length);
+          }
+        }
+      }
+
+      //-----------------------------------------------------------------------
+      void ICESocket::internalReceivedData(
+                                           const Candidate &viaCandidate,
+                                           const Candidate &viaLocalCandidate,
+                                           const IPAddress &source,
+                                           const BYTE *buffer,
+                                           size_t bufferLengthInBytes
+                                           )
+      {
+        // WARNING: DO NOT CALL THIS METHOD WHILE INSIDE A LOCK AS IT COULD
+        //          ** DEADLOCK **. This method calls delegates synchronously.
+
+        PacketRoute route;
+
+        // scope: resolve all lookups at once while in the lock
+        {
+          AutoRecursiveLock lock(*this);
+          resolveRoute(viaCandidate, viaLocalCandidate, source, route);
+        }
+
+        PacketClasses packetClass = classifyPacket(buffer, bufferLengthInBytes);
+
+        STUNPacketView view;
+
+        if ((PacketClass_STUN == packetClass) &&
+            (STUNPacketView::parse(view, buffer, bufferLengthInBytes, STUNPacket::RFC_AllowAll, false))) {
+          // NOTE: Everything up to the session lookup is decided from the view
+          //       so STUN packets which are not for us are never decoded.
+          OPENPEER_SERVICES_WIRE_LOG_TRACE(log("received STUN packet") + ZS_PARAM("via candidate", viaCandidate.toDebug()) + ZS_PARAM("source ip", source.string()) + ZS_PARAM("class", view.classAsString()) + ZS_PARAM("method", view.methodAsString()))
+          ITURNSocketPtr turn = route.mTURNSocket;
+          if (IICESocket::Type_Relayed != normalize(viaCandidate.mType)) {
+            if (turn) {
+              if (STUNPacket::Method_Data == view.mMethod) {
+                STUNPacketPtr stun = view.materialize("ICESocket", mID);
+                if (!stun) {
+                  ZS_LOG_WARNING(Trace, log("unable to decode TURN data indication"))
+                  return;
+                }
+                if (turn->handleSTUNPacket(source, stun)) return;
+              } else {
+                // TURN sockets hand every other method to the requester manager
+                if (ISTUNRequesterManager::handleSTUNPacket(source, view)) return;
+              }
+            }
+          }
+
+          if (!turn) {
+            // if TURN was used, we would already called this routine... (i.e. prevent double lookup)
+            if (ISTUNRequesterManager::handleSTUNPacket(source, view)) return;
+          }
+
+          UseICESocketSessionPtr next;
+
+          if (STUNPacket::Method_Binding == view.mMethod) {
+            if ((STUNPacket::Class_Request != view.mClass) &&
+                (STUNPacket::Class_Indication != view.mClass)) {
+              ZS_LOG_WARNING(Debug, log("ignoring STUN binding which is not a request/indication"))
+              return;
+            }
+          }
+
+          if (STUNPacket::RFC_5766_TURN == view.guessRFC(STUNPacket::RFC_AllowAll)) {
+            ZS_LOG_TRACE(log("ignoring TURN message (likely for cancelled requests)"))
+            return;    // ignore any ICE indications
+          }
+
+          if (!view.hasUsername()) {
+            ZS_LOG_WARNING(Detail, log("did not find ICE username on packet thus ignoring STUN packet"))
+            return;  // no username is present - this cannot be for us...
+          }
+
+          // username is present... but does it have the correct components?
+          if (NULL == memchr(view.mUsername, ':', view.mUsernameLengthInBytes)) {
+            ZS_LOG_WARNING(Detail, log("did not find \":\" in username on packet thus ignoring STUN packet"))
+            return;  // no ":" means that it can't be an ICE requeest
+          }
+
+          STUNPacketPtr stun = view.materialize("ICESocket", mID);
+          if (!stun) {
+            ZS_LOG_WARNING(Trace, log("unable to decode STUN packet thus ignoring"))
+            return;
+          }
+
+          size_t pos = stun->mUsername.find(":");
+
+          // split the string at the post
+          String localUsernameFrag = stun->mUsername.substr(0, pos); // this would be our local username
+          String remoteUsernameFrag = stun->mUsername.substr(pos+1);  // this would be the remote username
+
+          ICESocketSessionMap indexedSessions;
+
+          // scope: find the session(s) owning the username directly from the index
+          {
+            AutoRecursiveLock lock(*this);
+            findSessionsByUsername(stun->mUsername, indexedSessions);
+          }
+
+          for (ICESocketSessionMap::iterator iter = indexedSessions.begin(); iter != indexedSessions.end(); ++iter) {
+            if ((*iter).second->handleSTUNPacket(viaCandidate, source, stun, localUsernameFrag, remoteUsernameFrag)) return;
+          }
+
+          if (STUNPacket::Method_Binding == stun->mMethod) {
+            // a binding is only ever accepted by a session whose local and
+            // remote username frags both match thus the index is authoritative
+            ZS_LOG_WARNING(Debug, log("did not find session that handles STUN binding") + ZS_PARAM("username", stun->mUsername))
+            return;
+          }
+
+          while (true)
+          {
+            // scope: find the next socket session to test in the list while in a lock
+            {
+              AutoRecursiveLock lock(*this);
+              if (mSessions.size() < 1) break;  // no sessions to check
+
+              if (!next) {
+                next = (*(mSessions.begin())).second;
+              } else {
+                ICESocketSessionMap::iterator iter = mSessions.find(next->getID());
+                if (iter == mSessions.end()) {
+                  // should have been found BUT it is possible the list was
+                  // changed while outside the lock so start the search from
+                  // the beginning again...
+                  next = (*(mSessions.begin())).second;
+                } else {
                   ++iter;
                   if (iter == mSessions.end()) {
                     // while it is possible that a new session was inserted
@@ -2290,6 +3011,7 @@ namespace openpeer
             }
 
             if (!next) break;
+            if (indexedSessions.end() != indexedSessions.find(next->getID())) continue;  // already checked
             if (next->handleSTUNPacket(viaCandidate, source, stun, localUsernameFrag, remoteUsernameFrag)) return;
           }
 
@@ -2300,39 +3022,15 @@ namespace openpeer
         }
 
         // this isn't a STUN packet but it might be TURN channel data (but only if came from a TURN server)
-        if (IICESocket::Type_Relayed != normalize(viaCandidate.mType)) {
-          ITURNSocketPtr turn;
-
-          // scope: going into a lock to obtain
-          {
-            AutoRecursiveLock lock(*this);
-            LocalSocketIPAddressMap::iterator found = mSocketLocalIPs.find(getViaLocalIP(viaCandidate));
-            if (found != mSocketLocalIPs.end()) {
-              LocalSocketPtr &localSocket = (*found).second;
-
-              TURNInfoRelatedIPMap::iterator foundRelay = localSocket->mTURNServerIPs.find(source);
-              if (foundRelay != localSocket->mTURNServerIPs.end()) {
-                turn = (*foundRelay).second->mTURNSocket;
-              }
-            }
-          }
-
-          if (turn) {
-            if (turn->handleChannelData(source, buffer, bufferLengthInBytes)) return;
-          }
+        if ((PacketClass_ChannelData == packetClass) &&
+            (route.mTURNSocket)) {
+          if (route.mTURNSocket->handleChannelData(source, buffer, bufferLengthInBytes)) return;
         }
 
-        UseICESocketSessionPtr next;
-
-        // try to find a quick route to the session
-        {
-          AutoRecursiveLock lock(*this);
-          RouteTuple tuple(viaCandidate.mIPAddress, viaLocalCandidate.mIPAddress, source);
-          QuickRouteMap::iterator found = mRoutes.find(tuple);
-          if (found != mRoutes.end()) {
-            next = (*found).second;
-          }
-        }
+        // try to use the quick route to the session (the socket's lock is
+        // not required, only boost's shared_ptr spinlock while loading)
+        UseICESocketSessionPtr quick = findRoute(boost::atomic_load(&mRoutes), viaCandidate, viaLocalCandidate, source);
+        UseICESocketSessionPtr next = quick;
 
         if (next) {
           // we found a quick route - but does it actually handle the packet
@@ -2340,10 +3038,17 @@ namespace openpeer
           // configruations thus we might pick the wrong session)
           if (next->handlePacket(viaCandidate, source, buffer, bufferLengthInBytes)) return;
 
-          // we chose wrong, so allow the "hunt" method to take over
+          // we chose wrong, so try the route learned from a previous hunt
           next.reset();
         }
 
+        UseICESocketSessionPtr learned = findRoute(boost::atomic_load(&mLearnedRoutes), viaCandidate, viaLocalCandidate, source);
+
+        if ((learned) &&
+            (learned != quick)) {
+          if (learned->handlePacket(viaCandidate, source, buffer, bufferLengthInBytes)) return;
+        }
+
         // this could be channel data for one of the sessions, check each session
         while (true)
         {
@@ -2367,36 +3072,47 @@ namespace openpeer
           }
 
           if (!next) break;
-          if (next->handlePacket(viaCandidate, source, buffer, bufferLengthInBytes)) return;
+          if ((next == quick) || (next == learned)) continue;  // already checked
+
+          if (next->handlePacket(viaCandidate, source, buffer, bufferLengthInBytes)) {
+            // remember who handled this route so the next packet skips the hunt
+            learnRoute(viaCandidate, viaLocalCandidate, source, next);
+            return;
+          }
         }
 
         OPENPEER_SERVICES_WIRE_LOG_WARNING(Debug, log("did not find any socket session to handle data packet"))
       }
 
       //-----------------------------------------------------------------------
-      void ICESocket::getBuffer(RecycledPacketBuffer &outBuffer)
-      {
-        AutoRecursiveLock lock(*this);
-        if (mRecycledBuffers.size() < 1) {
-          outBuffer = RecycledPacketBuffer(new BYTE[OPENPEER_SERVICES_ICESOCKET_RECYCLE_BUFFER_SIZE]);
-          return;
-        }
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      #pragma mark
+      #pragma mark ICESocket::RouteHash
+      #pragma mark
 
-        outBuffer = mRecycledBuffers.front();
-        mRecycledBuffers.pop_front();
+      //-----------------------------------------------------------------------
+      size_t ICESocket::RouteHash::operator() (const RouteTuple &tuple) const
+      {
+        size_t result = hashIPAddress(boost::get<2>(tuple));
+        boost::hash_combine(result, hashIPAddress(boost::get<0>(tuple)));
+        boost::hash_combine(result, hashIPAddress(boost::get<1>(tuple)));
+        return result;
       }
 
       //-----------------------------------------------------------------------
-      void ICESocket::recycleBuffer(RecycledPacketBuffer &buffer)
-      {
-        AutoRecursiveLock lock(*this);
-        if (!buffer) return;
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      #pragma mark
+      #pragma mark ICESocket::ICEUsernameHash
+      #pragma mark
 
-        if (mRecycledBuffers.size() >= OPENPEER_SERVICES_ICESOCKET_MAX_RECYLCE_BUFFERS) {
-          buffer.reset();
-          return;
-        }
-        mRecycledBuffers.push_back(buffer);
+      //-----------------------------------------------------------------------
+      size_t ICESocket::ICEUsernameHash::operator() (const ICEUsername &username) const
+      {
+        return boost::hash_range(username.begin(), username.end());
       }
 
       //-----------------------------------------------------------------------
@@ -2505,6 +3221,286 @@ namespace openpeer
 
         mTURNSockets.erase(found);
       }
+
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      #pragma mark
+      #pragma mark ICESocket::ReceiveSlots
+      #pragma mark
+
+      //-----------------------------------------------------------------------
+      ICESocket::ReceiveSlots::ReceiveSlots() :
+        mBufferSizeInBytes(OPENPEER_SERVICES_PACKET_BUFFER_LARGE_SIZE_IN_BYTES),
+        mReservedBuffers(0)
+      {
+      }
+
+      //-----------------------------------------------------------------------
+      ICESocket::ReceiveSlots::~ReceiveSlots()
+      {
+        PacketBufferPool::unreserve(OPENPEER_SERVICES_PACKET_BUFFER_LARGE_SIZE_IN_BYTES, mReservedBuffers);
+      }
+
+      //-----------------------------------------------------------------------
+      void ICESocket::ReceiveSlots::configure(
+                                              bool receiveCoalescing,
+                                              bool mtuSizedBuffers,
+                                              size_t totalSlots
+                                              )
+      {
+        PacketBufferPool::unreserve(OPENPEER_SERVICES_PACKET_BUFFER_LARGE_SIZE_IN_BYTES, mReservedBuffers);
+        mReservedBuffers = 0;
+
+        for (size_t index = 0; index < OPENPEER_SERVICES_ICESOCKET_MAX_RECEIVE_BATCH_SIZE; ++index) {
+          mBuffers[index].reset();
+          mReceived[index] = UDPBatch::ReceiveBuffer();
+        }
+
+        // MTU sized buffers drop any larger datagram (the read cuts it short
+        // and flags it) so they are only used when asked for, and only where
+        // the read flags the truncation rather than failing outright
+        if ((mtuSizedBuffers) &&
+            (!receiveCoalescing) &&
+            (UDPBatch::isSupported())) {
+          mBufferSizeInBytes = OPENPEER_SERVICES_PACKET_BUFFER_SMALL_SIZE_IN_BYTES;
+          return;
+        }
+
+        // the slots keep up to a batch of large buffers checked out at all
+        // times so make sure the pool can still serve everyone else
+        mBufferSizeInBytes = OPENPEER_SERVICES_PACKET_BUFFER_LARGE_SIZE_IN_BYTES;
+        mReservedBuffers = totalSlots;
+        PacketBufferPool::reserve(mBufferSizeInBytes, mReservedBuffers);
+      }
+
+      //-----------------------------------------------------------------------
+      void ICESocket::ReceiveSlots::prepare(size_t totalSlots)
+      {
+        for (size_t index = 0; index < totalSlots; ++index) {
+          if (mBuffers[index]) continue;  // not filled by the last read
+
+          mBuffers[index] = PacketBufferPool::allocate(mBufferSizeInBytes);
+          mReceived[index].mBuffer = mBuffers[index]->data();
+          mReceived[index].mBufferSizeInBytes = mBuffers[index]->capacity();
+        }
+      }
+
+      //-----------------------------------------------------------------------
+      void ICESocket::ReceiveSlots::takeFilled(
+                                               size_t totalFilled,
+                                               PacketBufferPtr *outBuffers,
+                                               UDPBatch::ReceiveBuffer *outReceived
+                                               )
+      {
+        for (size_t index = 0; index < totalFilled; ++index) {
+          outBuffers[index].swap(mBuffers[index]);
+          outReceived[index] = mReceived[index];
+
+          mReceived[index] = UDPBatch::ReceiveBuffer();
+        }
+      }
+
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      #pragma mark
+      #pragma mark ICESocket::Shard
+      #pragma mark
+
+      //-----------------------------------------------------------------------
+      ICESocket::Shard::Shard(
+                              IMessageQueuePtr queue,
+                              ICESocketPtr outer,
+                              size_t shardIndex,
+                              const IPAddress &bindIP,
+                              SocketPtr socket,
+                              bool receiveCoalescing
+                              ) :
+        MessageQueueAssociator(queue),
+        SharedRecursiveLock(SharedRecursiveLock::create()),
+        mOuter(outer),
+        mShardIndex(shardIndex),
+        mBindIP(bindIP),
+        mSocket(socket),
+        mReceiveBatchSize(outer->mReceiveBatchSize),
+        mTotalPacketsReceived(0),
+        mTotalBatchesReceived(0)
+      {
+        ZS_LOG_DEBUG(log("created"))
+        mReceiveSlots.configure(receiveCoalescing, outer->mMTUSizedReceiveBuffers, mReceiveBatchSize);
+      }
+
+      //-----------------------------------------------------------------------
+      void ICESocket::Shard::init()
+      {
+        AutoRecursiveLock lock(*this);
+        SocketEventBackend::attach(mSocket, mThisWeak.lock(), (Socket::Monitor::Options)(Socket::Monitor::Read | Socket::Monitor::Exception));
+      }
+
+      //-----------------------------------------------------------------------
+      ICESocket::Shard::~Shard()
+      {
+        mThisWeak.reset();
+        ZS_LOG_DEBUG(log("destroyed"))
+        close();
+      }
+
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      #pragma mark
+      #pragma mark ICESocket::Shard => friend ICESocket
+      #pragma mark
+
+      //-----------------------------------------------------------------------
+      ICESocket::ShardPtr ICESocket::Shard::create(
+                                                   IMessageQueuePtr queue,
+                                                   ICESocketPtr outer,
+                                                   size_t shardIndex,
+                                                   const IPAddress &bindIP,
+                                                   SocketPtr socket,
+                                                   bool receiveCoalescing
+                                                   )
+      {
+        ShardPtr pThis(new Shard(queue, outer, shardIndex, bindIP, socket, receiveCoalescing));
+        pThis->mThisWeak = pThis;
+        pThis->init();
+        return pThis;
+      }
+
+      //-----------------------------------------------------------------------
+      bool ICESocket::Shard::isClosed() const
+      {
+        AutoRecursiveLock lock(*this);
+        return !mSocket;
+      }
+
+      //-----------------------------------------------------------------------
+      void ICESocket::Shard::close()
+      {
+        AutoRecursiveLock lock(*this);
+
+        if (!mSocket) return;
+
+        ZS_LOG_DEBUG(log("closing"))
+
+        SocketEventBackend::detach(mSocket);
+        mSocket->close();
+        mSocket.reset();
+      }
+
+      //-----------------------------------------------------------------------
+      ElementPtr ICESocket::Shard::toDebug() const
+      {
+        AutoRecursiveLock lock(*this);
+
+        ElementPtr resultEl = Element::create("ICESocket::Shard");
+
+        IHelper::debugAppend(resultEl, "id", mID);
+        IHelper::debugAppend(resultEl, "index", mShardIndex);
+        IHelper::debugAppend(resultEl, "bind ip", mBindIP.string());
+        IHelper::debugAppend(resultEl, "socket", (bool)mSocket);
+        IHelper::debugAppend(resultEl, "receive batch size", mReceiveBatchSize);
+        IHelper::debugAppend(resultEl, "total packets received", mTotalPacketsReceived);
+        IHelper::debugAppend(resultEl, "total batches received", mTotalBatchesReceived);
+
+        return resultEl;
+      }
+
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      #pragma mark
+      #pragma mark ICESocket::Shard => ISocketDelegate
+      #pragma mark
+
+      //-----------------------------------------------------------------------
+      void ICESocket::Shard::onReadReady(SocketPtr socket)
+      {
+        ICESocketPtr outer = mOuter.lock();
+        if (!outer) {
+          OPENPEER_SERVICES_WIRE_LOG_WARNING(Detail, log("ICE socket is gone"))
+          return;
+        }
+
+        PacketBufferPtr buffers[OPENPEER_SERVICES_ICESOCKET_MAX_RECEIVE_BATCH_SIZE];
+        UDPBatch::ReceiveBuffer received[OPENPEER_SERVICES_ICESOCKET_MAX_RECEIVE_BATCH_SIZE];
+
+        size_t totalRead = 0;
+        size_t batchSize = mReceiveBatchSize;
+
+        // scope: read using only the shard's lock (the ICE socket's lock is not needed)
+        {
+          AutoRecursiveLock lock(*this);
+
+          if (socket != mSocket) {
+            OPENPEER_SERVICES_WIRE_LOG_WARNING(Detail, log("UDP socket is not ready"))
+            return;
+          }
+
+          try {
+            bool wouldBlock = false;
+
+            mReceiveSlots.prepare(batchSize);
+
+            totalRead = UDPBatch::receiveFrom(mSocket, &(mReceiveSlots.mReceived[0]), batchSize, &wouldBlock);
+            if (0 != totalRead) {
+              mReceiveSlots.takeFilled(totalRead, &(buffers[0]), &(received[0]));
+            }
+          } catch(Socket::Exceptions::Unspecified &error) {
+            ZS_LOG_ERROR(Detail, log("receiveFrom error") + ZS_PARAM("error", error.errorCode()))
+            close();
+            return;
+          }
+
+          if (0 == totalRead) return;
+
+          mTotalPacketsReceived += totalRead;
+          ++mTotalBatchesReceived;
+        }
+
+        CandidatePtr viaLocalCandidate = outer->getShardLocalCandidate(mBindIP);
+        if (!viaLocalCandidate) return;
+
+        // sessions pinned to this shard are delivered on this thread, the
+        // rest are forwarded to the thread they are pinned to
+        outer->dispatchBatch(mShardIndex, *viaLocalCandidate, socket, &(buffers[0]), &(received[0]), totalRead);
+      }
+
+      //-----------------------------------------------------------------------
+      void ICESocket::Shard::onWriteReady(SocketPtr socket)
+      {
+        // all sends are performed on the ICE socket's primary socket
+      }
+
+      //-----------------------------------------------------------------------
+      void ICESocket::Shard::onException(SocketPtr socket)
+      {
+        ZS_LOG_WARNING(Detail, log("socket exception occured") + ZS_PARAM("shard", toDebug()))
+        close();
+      }
+
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      #pragma mark
+      #pragma mark ICESocket::Shard => (internal)
+      #pragma mark
+
+      //-----------------------------------------------------------------------
+      Log::Params ICESocket::Shard::log(const char *message) const
+      {
+        ElementPtr objectEl = Element::create("ICESocket::Shard");
+        IHelper::debugAppend(objectEl, "id", mID);
+        IHelper::debugAppend(objectEl, "index", mShardIndex);
+        return Log::Params(message, objectEl);
+      }
     }
 
     //-------------------------------------------------------------------------
@@ -36,6 +36,7 @@
 #include <openpeer/services/internal/services_ICESocketSession.h>
 #include <openpeer/services/internal/services_ICESocket.h>
 #include <openpeer/services/internal/services_Helper.h>
+#include <openpeer/services/internal/services_MessageIntegrityKeyCache.h>
 #include <openpeer/services/internal/services_wire.h>
 
 #include <openpeer/services/IICESocket.h>
@@ -230,6 +231,9 @@ namespace openpeer
         mLocalUsernameFrag = getSocket()->getUsernameFrag();
         mLocalPassword = getSocket()->getPassword();
 
+        mLocalMessageIntegrityKey = MessageIntegrityKeyCache::find(mLocalPassword);
+        mRemoteMessageIntegrityKey = MessageIntegrityKeyCache::find(mRemotePassword);
+
         if (delegate) {
           mDefaultSubscription = mSubscriptions.subscribe(delegate);
         }
@@ -578,7 +582,7 @@ namespace openpeer
 
         CandidatePairPtr found;
 
-        bool failedIntegrity = (!stun->isValidMessageIntegrity(mLocalPassword));
+        bool failedIntegrity = (!stun->isValidMessageIntegrity(mLocalMessageIntegrityKey));
         if (failedIntegrity) goto send_response;
 
         if (isCandidateMatch(mNominated, viaLocalCandidate, source)) {
@@ -712,6 +716,7 @@ namespace openpeer
             }
 
             response->mPassword = mLocalPassword;
+            response->mMessageIntegrityKey = mLocalMessageIntegrityKey;
             response->mCredentialMechanism = STUNPacket::CredentialMechanisms_ShortTerm;
 
             SecureByteBlockPtr buffer = response->packetize(STUNPacket::RFC_5245_ICE);
@@ -770,6 +775,7 @@ namespace openpeer
                 request->mUsername = mRemoteUsernameFrag + ":" + mLocalUsernameFrag;
                 if (mRemotePassword.hasData()) {
                   request->mPassword = mRemotePassword;
+                  request->mMessageIntegrityKey = mRemoteMessageIntegrityKey;
                 }
                 request->mPriorityIncluded = true;
                 request->mPriority = found->mLocal.mPriority;
@@ -906,6 +912,45 @@ namespace openpeer
         get(mInformedWriteReady) = true;
       }
 
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      #pragma mark
+      #pragma mark ICESocketSession => IICESocketSessionForRUDPTransport
+      #pragma mark
+
+      //-----------------------------------------------------------------------
+      size_t ICESocketSession::sendPackets(
+                                           const SendBuffer *packets,
+                                           size_t totalPackets
+                                           )
+      {
+        AutoRecursiveLock lock(*this);
+        if (isShutdown()) {
+          ZS_LOG_WARNING(Detail, log("unable to send packets as socket is already shutdown"))
+          return 0;
+        }
+
+        get(mInformedWriteReady) = false;  // same as sendPacket, a send clears the write-ready informed flag
+
+        if (!mNominated) {
+          ZS_LOG_WARNING(Detail, log("not allowed to send data as ICE nomination process is not complete"))
+          return 0;
+        }
+
+        UseICESocketPtr socket = mICESocket.lock();
+        if (!socket) {
+          ZS_LOG_WARNING(Debug, log("cannot send packets as ICE socket is closed") + ZS_PARAM("total", totalPackets))
+          return 0;
+        }
+
+        mLastSentData = zsLib::now();
+
+        OPENPEER_SERVICES_WIRE_LOG_TRACE(log("sending packets") + ZS_PARAM("candidate", mNominated->mLocal.toDebug()) + ZS_PARAM("to ip", mNominated->mRemote.mIPAddress.string()) + ZS_PARAM("total", totalPackets))
+        return socket->sendBatchTo(mNominated->mLocal, mNominated->mRemote.mIPAddress, packets, totalPackets, true);
+      }
+
       //-----------------------------------------------------------------------
       //-----------------------------------------------------------------------
       //-----------------------------------------------------------------------
@@ -1032,7 +1077,7 @@ namespace openpeer
               case STUNPacket::ErrorCode_RoleConflict: {
                 // this request better be signed properly or we will ignore the conflict...
                 if (!mRemotePassword.isEmpty()) {
-                  if (!response->isValidMessageIntegrity(mRemotePassword)) {
+                  if (!response->isValidMessageIntegrity(mRemoteMessageIntegrityKey)) {
                     ZS_LOG_WARNING(Detail, log("nomination caused role conflict reply did not pass integtiry check") + usePair->toDebug())
                     return false;
                   }
@@ -1060,7 +1105,7 @@ namespace openpeer
 
           // the nomination request succeeded (or so we think - make sure it was signed properly)!
           if (mRemotePassword.hasData()) {
-            if (!response->isValidMessageIntegrity(mRemotePassword)) {
+            if (!response->isValidMessageIntegrity(mRemoteMessageIntegrityKey)) {
               ZS_LOG_WARNING(Detail, log("response from nomination or alive check failed message integrity") + ZS_PARAM("was nominate requester", (requester == mNominateRequester)))
               return false;
             }
@@ -1114,7 +1159,7 @@ namespace openpeer
               case STUNPacket::ErrorCode_RoleConflict: {
                 // this request better be signed properly or we will ignore the conflict...
                 if (mRemotePassword.hasData()) {
-                  if (!response->isValidMessageIntegrity(mRemotePassword)) return false;
+                  if (!response->isValidMessageIntegrity(mRemoteMessageIntegrityKey)) return false;
                 }
 
                 ZS_LOG_WARNING(Detail, log("candidate role conflict error received") + pairing->toDebug())
@@ -1284,6 +1329,7 @@ namespace openpeer
         if (mRemotePassword.hasData()) {
           indication->mUsername = mRemoteUsernameFrag + ":" + mLocalUsernameFrag;
           indication->mPassword = mRemotePassword;
+          indication->mMessageIntegrityKey = mRemoteMessageIntegrityKey;
           indication->mCredentialMechanism = STUNPacket::CredentialMechanisms_ShortTerm;
         }
 
@@ -1324,6 +1370,7 @@ namespace openpeer
           isICE = true;
           request->mUsername = mRemoteUsernameFrag + ":" + mLocalUsernameFrag;
           request->mPassword = mRemotePassword;
+          request->mMessageIntegrityKey = mRemoteMessageIntegrityKey;
           request->mCredentialMechanism = STUNPacket::CredentialMechanisms_ShortTerm;
           request->mIceControllingIncluded = true;
           request->mIceControlling = mConflictResolver;
@@ -1389,6 +1436,7 @@ namespace openpeer
               isICE = true;
               request->mUsername = mRemoteUsernameFrag + ":" + mLocalUsernameFrag;
               request->mPassword = mRemotePassword;
+              request->mMessageIntegrityKey = mRemoteMessageIntegrityKey;
               request->mCredentialMechanism = STUNPacket::CredentialMechanisms_ShortTerm;
               request->mPriorityIncluded = true;
               request->mPriority = pairing->mLocal.mPriority;
@@ -2248,6 +2296,7 @@ namespace openpeer
           fix(request);
           request->mUsername = mRemoteUsernameFrag + ":" + mLocalUsernameFrag;
           request->mPassword = mRemotePassword;
+          request->mMessageIntegrityKey = mRemoteMessageIntegrityKey;
           request->mCredentialMechanism = STUNPacket::CredentialMechanisms_ShortTerm;
           request->mIceControllingIncluded = true;
           request->mIceControlling = mConflictResolver;
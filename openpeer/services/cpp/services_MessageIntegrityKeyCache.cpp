@@ -0,0 +1,298 @@
+/*
+
+ Copyright (c) 2013, SMB Phone Inc.
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+
+ 1. Redistributions of source code must retain the above copyright notice, this
+ list of conditions and the following disclaimer.
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ The views and conclusions contained in the software and documentation are those
+ of the authors and should not be interpreted as representing official policies,
+ either expressed or implied, of the FreeBSD Project.
+
+ */
+
+#include <openpeer/services/internal/services_MessageIntegrityKeyCache.h>
+
+#include <openpeer/services/STUNPacket.h>
+#include <openpeer/services/IHelper.h>
+
+#include <zsLib/Exception.h>
+#include <zsLib/XML.h>
+
+#include <cryptopp/cryptlib.h>
+#define CRYPTOPP_ENABLE_NAMESPACE_WEAK 1
+#include <cryptopp/md5.h>
+
+#include <string.h>
+
+namespace openpeer { namespace services { ZS_DECLARE_SUBSYSTEM(openpeer_services) } }
+
+namespace openpeer
+{
+  namespace services
+  {
+    namespace internal
+    {
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      #pragma mark
+      #pragma mark (helpers)
+      #pragma mark
+
+      //-----------------------------------------------------------------------
+      static bool isLongTerm(
+                             const char *username,
+                             const char *realm
+                             )
+      {
+        return (NULL != username) && (NULL != realm);
+      }
+
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      #pragma mark
+      #pragma mark MessageIntegrityKey
+      #pragma mark
+
+      //-----------------------------------------------------------------------
+      MessageIntegrityKey::MessageIntegrityKey(const BYTE *key)
+      {
+        memcpy(&(mKey[0]), key, sizeof(mKey));
+
+        // prime the inner and outer hash exactly as HMAC would on every
+        // restart (RFC 2104) so the per-packet cost is only the data
+        BYTE pad[CryptoPP::SHA1::BLOCKSIZE];
+
+        memset(&(pad[0]), 0x36, sizeof(pad));
+        for (size_t index = 0; index < sizeof(mKey); ++index) {
+          pad[index] ^= mKey[index];
+        }
+        mInnerHash.Update(&(pad[0]), sizeof(pad));
+
+        memset(&(pad[0]), 0x5C, sizeof(pad));
+        for (size_t index = 0; index < sizeof(mKey); ++index) {
+          pad[index] ^= mKey[index];
+        }
+        mOuterHash.Update(&(pad[0]), sizeof(pad));
+      }
+
+      //-----------------------------------------------------------------------
+      void MessageIntegrityKey::calculate(
+                                          const BYTE *prefix,
+                                          size_t prefixLengthInBytes,
+                                          const BYTE *data,
+                                          size_t dataLengthInBytes,
+                                          BYTE *outResult
+                                          ) const
+      {
+        ZS_THROW_INVALID_ASSUMPTION_IF(CryptoPP::SHA1::DIGESTSIZE != OPENPEER_STUN_MESSAGE_INTEGRITY_LENGTH_IN_BYTES)
+
+        BYTE innerDigest[CryptoPP::SHA1::DIGESTSIZE];
+
+        CryptoPP::SHA1 inner(mInnerHash);
+        if (0 != prefixLengthInBytes) inner.Update(prefix, prefixLengthInBytes);
+        if (0 != dataLengthInBytes) inner.Update(data, dataLengthInBytes);
+        inner.Final(&(innerDigest[0]));
+
+        CryptoPP::SHA1 outer(mOuterHash);
+        outer.Update(&(innerDigest[0]), sizeof(innerDigest));
+        outer.Final(outResult);
+      }
+
+      //-----------------------------------------------------------------------
+      bool MessageIntegrityKey::matches(const BYTE *key) const
+      {
+        return (0 == memcmp(&(mKey[0]), key, sizeof(mKey)));
+      }
+
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      #pragma mark
+      #pragma mark MessageIntegrityKeyCache
+      #pragma mark
+
+      //-----------------------------------------------------------------------
+      MessageIntegrityKeyCache::MessageIntegrityKeyCache()
+      {
+      }
+
+      //-----------------------------------------------------------------------
+      MessageIntegrityKeyPtr MessageIntegrityKeyCache::find(
+                                                            const char *password,
+                                                            const char *username,
+                                                            const char *realm
+                                                            )
+      {
+        if (NULL == password)
+          password = "";
+
+        BYTE derived[OPENPEER_SERVICES_MESSAGE_INTEGRITY_KEY_LENGTH_IN_BYTES];
+        deriveKey(password, username, realm, &(derived[0]));
+
+        size_t hashValue = hash(&(derived[0]));
+
+        Shard &shard = singleton().getShard(hashValue);
+
+        // scope: find an existing key
+        {
+          AutoLock lock(shard.mLock);
+
+          KeyMap::iterator iter = shard.mKeys.lower_bound(hashValue);
+          for (; (iter != shard.mKeys.end()) && ((*iter).first == hashValue); ++iter) {
+            MessageIntegrityKeyPtr &key = (*iter).second;
+            if (!key->matches(&(derived[0]))) continue;
+            ++shard.mTotalHits;
+            return key;
+          }
+        }
+
+        // prime the hash states outside the lock
+        MessageIntegrityKeyPtr key(new MessageIntegrityKey(&(derived[0])));
+
+        AutoLock lock(shard.mLock);
+
+        ++shard.mTotalMisses;
+
+        const size_t maxEntries = OPENPEER_SERVICES_MESSAGE_INTEGRITY_KEY_CACHE_MAX_ENTRIES / OPENPEER_SERVICES_MESSAGE_INTEGRITY_KEY_CACHE_TOTAL_SHARDS;
+        if (shard.mKeys.size() >= maxEntries) {
+          shard.evictUnused();
+        }
+        if (shard.mKeys.size() < maxEntries) {
+          shard.mKeys.insert(KeyMap::value_type(hashValue, key));
+        }
+        return key;
+      }
+
+      //-----------------------------------------------------------------------
+      ElementPtr MessageIntegrityKeyCache::toDebug()
+      {
+        MessageIntegrityKeyCache &cache = singleton();
+
+        size_t totalKeys = 0;
+        ULONG totalHits = 0;
+        ULONG totalMisses = 0;
+        ULONG totalEvictions = 0;
+
+        for (size_t index = 0; index < OPENPEER_SERVICES_MESSAGE_INTEGRITY_KEY_CACHE_TOTAL_SHARDS; ++index) {
+          Shard &shard = cache.mShards[index];
+
+          AutoLock lock(shard.mLock);
+          totalKeys += shard.mKeys.size();
+          totalHits += shard.mTotalHits;
+          totalMisses += shard.mTotalMisses;
+          totalEvictions += shard.mTotalEvictions;
+        }
+
+        ElementPtr resultEl = Element::create("MessageIntegrityKeyCache");
+
+        IHelper::debugAppend(resultEl, "keys", totalKeys);
+        IHelper::debugAppend(resultEl, "hits", totalHits);
+        IHelper::debugAppend(resultEl, "misses", totalMisses);
+        IHelper::debugAppend(resultEl, "evictions", totalEvictions);
+
+        return resultEl;
+      }
+
+      //-----------------------------------------------------------------------
+      MessageIntegrityKeyCache &MessageIntegrityKeyCache::singleton()
+      {
+        // NOTE: intentionally never destroyed as packets can be packetized
+        //       or validated from any thread at any time (including exit)
+        static MessageIntegrityKeyCache *cache = new MessageIntegrityKeyCache;
+        return *cache;
+      }
+
+      //-----------------------------------------------------------------------
+      void MessageIntegrityKeyCache::deriveKey(
+                                               const char *password,
+                                               const char *username,
+                                               const char *realm,
+                                               BYTE *outKey
+                                               )
+      {
+        CryptoPP::Weak::MD5 md5;
+
+        if (isLongTerm(username, realm)) {
+          md5.Update((const BYTE *)username, strlen(username));
+          md5.Update((const BYTE *)":", strlen(":"));
+          md5.Update((const BYTE *)realm, strlen(realm));
+          md5.Update((const BYTE *)":", strlen(":"));
+        }
+        md5.Update((const BYTE *)password, strlen(password));
+
+        ZS_THROW_INVALID_ASSUMPTION_IF(OPENPEER_SERVICES_MESSAGE_INTEGRITY_KEY_LENGTH_IN_BYTES != md5.DigestSize())
+        md5.Final(outKey);
+      }
+
+      //-----------------------------------------------------------------------
+      size_t MessageIntegrityKeyCache::hash(const BYTE *key)
+      {
+        // the key is already the output of a hash function
+        size_t result = 0;
+        memcpy(&result, key, sizeof(result));
+        return result;
+      }
+
+      //-----------------------------------------------------------------------
+      MessageIntegrityKeyCache::Shard &MessageIntegrityKeyCache::getShard(size_t hashValue)
+      {
+        return mShards[hashValue % OPENPEER_SERVICES_MESSAGE_INTEGRITY_KEY_CACHE_TOTAL_SHARDS];
+      }
+
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      #pragma mark
+      #pragma mark MessageIntegrityKeyCache::Shard
+      #pragma mark
+
+      //-----------------------------------------------------------------------
+      MessageIntegrityKeyCache::Shard::Shard() :
+        mTotalHits(0),
+        mTotalMisses(0),
+        mTotalEvictions(0)
+      {
+      }
+
+      //-----------------------------------------------------------------------
+      void MessageIntegrityKeyCache::Shard::evictUnused()
+      {
+        // NOTE: must be called while in the lock
+        for (KeyMap::iterator iter = mKeys.begin(); iter != mKeys.end(); ) {
+          KeyMap::iterator current = iter;
+          ++iter;
+
+          if (!(*current).second.unique()) continue;  // still in use by a TURN socket or a packet
+
+          mKeys.erase(current);
+          ++mTotalEvictions;
+        }
+      }
+    }
+  }
+}
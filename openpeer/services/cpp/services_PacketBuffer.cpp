@@ -0,0 +1,395 @@
+/*
+
+ Copyright (c) 2013, SMB Phone Inc.
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+
+ 1. Redistributions of source code must retain the above copyright notice, this
+ list of conditions and the following disclaimer.
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ The views and conclusions contained in the software and documentation are those
+ of the authors and should not be interpreted as representing official policies,
+ either expressed or implied, of the FreeBSD Project.
+
+ */
+
+#include <openpeer/services/internal/services_PacketBuffer.h>
+
+#include <openpeer/services/IHelper.h>
+
+#include <zsLib/XML.h>
+
+#include <string.h>
+
+#define OPENPEER_SERVICES_PACKET_BUFFER_SMALL_BUFFERS_PER_SLAB (64)
+#define OPENPEER_SERVICES_PACKET_BUFFER_SMALL_MAX_SLABS (64)
+
+#define OPENPEER_SERVICES_PACKET_BUFFER_LARGE_BUFFERS_PER_SLAB (4)
+#define OPENPEER_SERVICES_PACKET_BUFFER_LARGE_MAX_SLABS (16)
+
+// a large buffer is only referenced (instead of copied) if at least this
+// fraction of it holds the retained data
+#define OPENPEER_SERVICES_PACKET_BUFFER_MAX_WASTE_RATIO (4)
+
+namespace openpeer { namespace services { ZS_DECLARE_SUBSYSTEM(openpeer_services) } }
+
+namespace openpeer
+{
+  namespace services
+  {
+    namespace internal
+    {
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      #pragma mark
+      #pragma mark (helpers)
+      #pragma mark
+
+      //-----------------------------------------------------------------------
+      void intrusive_ptr_add_ref(PacketBuffer *buffer)
+      {
+        ++(buffer->mReferences);
+      }
+
+      //-----------------------------------------------------------------------
+      void intrusive_ptr_release(PacketBuffer *buffer)
+      {
+        if (0 != --(buffer->mReferences)) return;
+        PacketBufferPool::release(buffer);
+      }
+
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      #pragma mark
+      #pragma mark PacketBufferPool
+      #pragma mark
+
+      //-----------------------------------------------------------------------
+      PacketBufferPool::PacketBufferPool() :
+        mSmall(OPENPEER_SERVICES_PACKET_BUFFER_SMALL_SIZE_IN_BYTES, OPENPEER_SERVICES_PACKET_BUFFER_SMALL_BUFFERS_PER_SLAB, OPENPEER_SERVICES_PACKET_BUFFER_SMALL_MAX_SLABS),
+        mLarge(OPENPEER_SERVICES_PACKET_BUFFER_LARGE_SIZE_IN_BYTES, OPENPEER_SERVICES_PACKET_BUFFER_LARGE_BUFFERS_PER_SLAB, OPENPEER_SERVICES_PACKET_BUFFER_LARGE_MAX_SLABS)
+      {
+      }
+
+      //-----------------------------------------------------------------------
+      PacketBufferPtr PacketBufferPool::allocate(size_t minimumSizeInBytes)
+      {
+        SizeClass *sizeClass = singleton().findClass(minimumSizeInBytes);
+        if (sizeClass) {
+          PacketBuffer *buffer = sizeClass->allocate();
+          if (buffer) return PacketBufferPtr(buffer);
+        }
+
+        return allocateFromHeap(minimumSizeInBytes);
+      }
+
+      //-----------------------------------------------------------------------
+      PacketBufferPtr PacketBufferPool::findOwner(
+                                                  const BYTE *buffer,
+                                                  size_t bufferLengthInBytes
+                                                  )
+      {
+        if (!buffer) return PacketBufferPtr();
+
+        PacketBufferPool &pool = singleton();
+
+        PacketBuffer *owner = pool.mSmall.find(buffer);
+        if (!owner) owner = pool.mLarge.find(buffer);
+        if (!owner) return PacketBufferPtr();
+
+        if (!owner->contains(buffer, bufferLengthInBytes)) return PacketBufferPtr();
+        if (owner->mReferences < 1) return PacketBufferPtr();   // not checked out (caller broke the contract)
+
+        return PacketBufferPtr(owner);
+      }
+
+      //-----------------------------------------------------------------------
+      PacketBufferPtr PacketBufferPool::retain(
+                                               const BYTE *buffer,
+                                               size_t bufferLengthInBytes,
+                                               const BYTE * &outBuffer
+                                               )
+      {
+        PacketBufferPtr owner = findOwner(buffer, bufferLengthInBytes);
+        if (owner) {
+          if ((owner->capacity() <= OPENPEER_SERVICES_PACKET_BUFFER_SMALL_SIZE_IN_BYTES) ||
+              (bufferLengthInBytes * OPENPEER_SERVICES_PACKET_BUFFER_MAX_WASTE_RATIO >= owner->capacity())) {
+            outBuffer = buffer;
+            return owner;
+          }
+        }
+
+        PacketBufferPtr result = allocate(bufferLengthInBytes);
+        if (0 != bufferLengthInBytes) {
+          memcpy(result->data(), buffer, bufferLengthInBytes);
+        }
+        outBuffer = result->data();
+        return result;
+      }
+
+      //-----------------------------------------------------------------------
+      void PacketBufferPool::reserve(
+                                     size_t minimumSizeInBytes,
+                                     size_t totalBuffers
+                                     )
+      {
+        SizeClass *sizeClass = singleton().findClass(minimumSizeInBytes);
+        if (!sizeClass) return;
+
+        AutoLock lock(sizeClass->mLock);
+        sizeClass->mReservedBuffers += totalBuffers;
+      }
+
+      //-----------------------------------------------------------------------
+      void PacketBufferPool::unreserve(
+                                       size_t minimumSizeInBytes,
+                                       size_t totalBuffers
+                                       )
+      {
+        SizeClass *sizeClass = singleton().findClass(minimumSizeInBytes);
+        if (!sizeClass) return;
+
+        AutoLock lock(sizeClass->mLock);
+        sizeClass->mReservedBuffers -= (totalBuffers < sizeClass->mReservedBuffers ? totalBuffers : sizeClass->mReservedBuffers);
+      }
+
+      //-----------------------------------------------------------------------
+      ElementPtr PacketBufferPool::toDebug()
+      {
+        PacketBufferPool &pool = singleton();
+
+        ElementPtr resultEl = Element::create("PacketBufferPool");
+
+        IHelper::debugAppend(resultEl, pool.mSmall.toDebug("small"));
+        IHelper::debugAppend(resultEl, pool.mLarge.toDebug("large"));
+
+        return resultEl;
+      }
+
+      //-----------------------------------------------------------------------
+      PacketBufferPool &PacketBufferPool::singleton()
+      {
+        // NOTE: intentionally never destroyed as buffers can be released
+        //       from other threads at any time (including during exit)
+        static PacketBufferPool *pool = new PacketBufferPool;
+        return *pool;
+      }
+
+      //-----------------------------------------------------------------------
+      PacketBufferPool::SizeClass *PacketBufferPool::findClass(size_t sizeInBytes)
+      {
+        if (sizeInBytes <= mSmall.mBufferSizeInBytes) return &mSmall;
+        if (sizeInBytes <= mLarge.mBufferSizeInBytes) return &mLarge;
+        return NULL;
+      }
+
+      //-----------------------------------------------------------------------
+      PacketBufferPtr PacketBufferPool::allocateFromHeap(size_t sizeInBytes)
+      {
+        PacketBuffer *buffer = new PacketBuffer;
+        buffer->mData = new BYTE[sizeInBytes > 0 ? sizeInBytes : 1];
+        buffer->mCapacity = sizeInBytes;
+        return PacketBufferPtr(buffer);
+      }
+
+      //-----------------------------------------------------------------------
+      void PacketBufferPool::release(PacketBuffer *buffer)
+      {
+        if (buffer->mSizeClass) {
+          buffer->mSizeClass->recycle(buffer);
+          return;
+        }
+
+        delete [] buffer->mData;
+        buffer->mData = NULL;
+        delete buffer;
+      }
+
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      #pragma mark
+      #pragma mark PacketBufferPool::SizeClass
+      #pragma mark
+
+      //-----------------------------------------------------------------------
+      PacketBufferPool::SizeClass::SizeClass(
+                                             size_t bufferSizeInBytes,
+                                             size_t buffersPerSlab,
+                                             size_t maxSlabs
+                                             ) :
+        mBufferSizeInBytes(bufferSizeInBytes),
+        mBuffersPerSlab(buffersPerSlab),
+        mMaxSlabs(maxSlabs),
+        mReservedBuffers(0),
+        mFreeList(NULL),
+        mTotalAllocations(0),
+        mTotalReused(0),
+        mTotalHeapFallbacks(0),
+        mTotalOutstanding(0)
+      {
+      }
+
+      //-----------------------------------------------------------------------
+      PacketBufferPool::SizeClass::~SizeClass()
+      {
+        for (SlabMap::iterator iter = mSlabs.begin(); iter != mSlabs.end(); ++iter) {
+          Slab &slab = (*iter).second;
+          delete [] slab.mBuffers;
+          delete [] slab.mMemory;
+        }
+        mSlabs.clear();
+        mFreeList = NULL;
+      }
+
+      //-----------------------------------------------------------------------
+      PacketBuffer *PacketBufferPool::SizeClass::allocate()
+      {
+        AutoLock lock(mLock);
+
+        if (!mFreeList) {
+          // slabs are never returned so a released reservation only stops
+          // further growth
+          size_t maxSlabs = mMaxSlabs + ((mReservedBuffers + mBuffersPerSlab - 1) / mBuffersPerSlab);
+          if (mSlabs.size() >= maxSlabs) {
+            ++mTotalHeapFallbacks;
+            return NULL;
+          }
+
+          Slab slab;
+          slab.mMemory = new BYTE[mBufferSizeInBytes * mBuffersPerSlab];
+          slab.mBuffers = new PacketBuffer[mBuffersPerSlab];
+          slab.mTotalBuffers = mBuffersPerSlab;
+
+          // thread the new buffers onto the free list in address order
+          for (size_t index = mBuffersPerSlab; index > 0; --index) {
+            PacketBuffer &buffer = slab.mBuffers[index-1];
+            buffer.mSizeClass = this;
+            buffer.mData = slab.mMemory + ((index-1) * mBufferSizeInBytes);
+            buffer.mCapacity = mBufferSizeInBytes;
+            buffer.mNextFree = mFreeList;
+            mFreeList = &buffer;
+          }
+
+          mSlabs[slab.mMemory] = slab;
+        } else {
+          ++mTotalReused;
+        }
+
+        PacketBuffer *result = mFreeList;
+        mFreeList = result->mNextFree;
+        result->mNextFree = NULL;
+
+        ++mTotalAllocations;
+        ++mTotalOutstanding;
+        return result;
+      }
+
+      //-----------------------------------------------------------------------
+      void PacketBufferPool::SizeClass::recycle(PacketBuffer *buffer)
+      {
+        AutoLock lock(mLock);
+
+        buffer->mNextFree = mFreeList;
+        mFreeList = buffer;
+
+        --mTotalOutstanding;
+      }
+
+      //-----------------------------------------------------------------------
+      PacketBuffer *PacketBufferPool::SizeClass::find(const BYTE *buffer) const
+      {
+        AutoLock lock(mLock);
+
+        if (mSlabs.empty()) return NULL;
+
+        SlabMap::const_iterator found = mSlabs.upper_bound(buffer);
+        if (found == mSlabs.begin()) return NULL;
+        --found;
+
+        const Slab &slab = (*found).second;
+
+        size_t offset = static_cast<size_t>(buffer - slab.mMemory);
+        size_t index = offset / mBufferSizeInBytes;
+        if (index >= slab.mTotalBuffers) return NULL;
+
+        return &(slab.mBuffers[index]);
+      }
+
+      //-----------------------------------------------------------------------
+      ElementPtr PacketBufferPool::SizeClass::toDebug(const char *name) const
+      {
+        AutoLock lock(mLock);
+
+        ElementPtr resultEl = Element::create(name);
+
+        IHelper::debugAppend(resultEl, "buffer size", mBufferSizeInBytes);
+        IHelper::debugAppend(resultEl, "buffers per slab", mBuffersPerSlab);
+        IHelper::debugAppend(resultEl, "slabs", mSlabs.size());
+        IHelper::debugAppend(resultEl, "max slabs", mMaxSlabs);
+        IHelper::debugAppend(resultEl, "reserved buffers", mReservedBuffers);
+        IHelper::debugAppend(resultEl, "total allocations", mTotalAllocations);
+        IHelper::debugAppend(resultEl, "total reused", mTotalReused);
+        IHelper::debugAppend(resultEl, "total heap fallbacks", mTotalHeapFallbacks);
+        IHelper::debugAppend(resultEl, "total outstanding", mTotalOutstanding);
+
+        return resultEl;
+      }
+
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      #pragma mark
+      #pragma mark PacketBuffer
+      #pragma mark
+
+      //-----------------------------------------------------------------------
+      PacketBuffer::PacketBuffer() :
+        mSizeClass(NULL),
+        mData(NULL),
+        mCapacity(0),
+        mReferences(0),
+        mNextFree(NULL)
+      {
+      }
+
+      //-----------------------------------------------------------------------
+      PacketBuffer::~PacketBuffer()
+      {
+      }
+
+      //-----------------------------------------------------------------------
+      bool PacketBuffer::contains(
+                                  const BYTE *buffer,
+                                  size_t bufferLengthInBytes
+                                  ) const
+      {
+        if (buffer < mData) return false;
+        if (buffer + bufferLengthInBytes > mData + mCapacity) return false;
+        return true;
+      }
+    }
+  }
+}
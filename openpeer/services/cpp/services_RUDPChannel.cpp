@@ -33,6 +33,7 @@
 #include <openpeer/services/internal/services_ICESocket.h>
 #include <openpeer/services/internal/services_IRUDPChannelStream.h>
 #include <openpeer/services/internal/services_Helper.h>
+#include <openpeer/services/internal/services_PacketBuffer.h>
 
 #include <openpeer/services/RUDPPacket.h>
 
@@ -177,6 +178,9 @@ namespace openpeer
         mRemoteSequenceNumber(remoteSequenceNumber),
         mMinimumRTT(minimumRTT),
         mLifetime(lifetime),
+        mLocalCongestionAlgorithm(IRUDPChannel::CongestionAlgorithm_TCPLikeWindowWithSlowCreepUp),
+        mRemoteCongestionAlgorithm(IRUDPChannel::CongestionAlgorithm_TCPLikeWindowWithSlowCreepUp),
+        mFECBlockSize(0),
         mLocalChannelInfo(localChannelInfo ? localChannelInfo : ""),
         mRemoteChannelInfo(remoteChannelInfo ? remoteChannelInfo : ""),
         mLastSentData(zsLib::now()),
@@ -347,8 +351,12 @@ namespace openpeer
         AutoRecursiveLock lock(pThis->mLock);
         get(pThis->mIncoming) = true;
         pThis->init();
+        // the "remote" offered list applies to our sending and the "local" offered list applies to theirs
+        IRUDPChannelStream::selectAlgorithm(stun->mRemoteCongestionControl, pThis->mLocalCongestionAlgorithm);
+        IRUDPChannelStream::selectAlgorithm(stun->mLocalCongestionControl, pThis->mRemoteCongestionAlgorithm);
+        pThis->mFECBlockSize = IRUDPChannelStream::getResponseToOfferedFECBlockSize(stun->mFECBlockSize);
         // do not allow sending to the remote party until we receive an ACK or data
-        pThis->mStream = IRUDPChannelStream::create(queue, pThis, pThis->mLocalSequenceNumber, pThis->mRemoteSequenceNumber, pThis->mOutgoingChannelNumber, pThis->mIncomingChannelNumber, pThis->mMinimumRTT);
+        pThis->mStream = IRUDPChannelStream::create(queue, pThis, pThis->mLocalSequenceNumber, pThis->mRemoteSequenceNumber, pThis->mOutgoingChannelNumber, pThis->mIncomingChannelNumber, pThis->mMinimumRTT, pThis->mLocalCongestionAlgorithm, pThis->mRemoteCongestionAlgorithm, pThis->mFECBlockSize);
         pThis->mStream->holdSendingUntilReceiveSequenceNumber(stun->mNextSequenceNumber);
         pThis->handleSTUN(stun, outResponse, localUsernameFrag, remoteUsernameFrag);
         if (!outResponse) {
@@ -588,9 +596,12 @@ namespace openpeer
             return true;
           }
 
-          // do not try to sneak in new congestion controls... we do not support anything but the default right now...
-          if ((stun->mLocalCongestionControl.end() == find(stun->mLocalCongestionControl.begin(), stun->mLocalCongestionControl.end(), IRUDPChannel::CongestionAlgorithm_TCPLikeWindowWithSlowCreepUp)) ||
-              (stun->mRemoteCongestionControl.end() == find(stun->mRemoteCongestionControl.begin(), stun->mRemoteCongestionControl.end(), IRUDPChannel::CongestionAlgorithm_TCPLikeWindowWithSlowCreepUp))) {
+          CongestionAlgorithms localAlgorithm = IRUDPChannel::CongestionAlgorithm_None;
+          CongestionAlgorithms remoteAlgorithm = IRUDPChannel::CongestionAlgorithm_None;
+
+          // do not try to sneak in congestion controls we do not support...
+          if ((!IRUDPChannelStream::selectAlgorithm(stun->mRemoteCongestionControl, localAlgorithm)) ||
+              (!IRUDPChannelStream::selectAlgorithm(stun->mLocalCongestionControl, remoteAlgorithm))) {
             ZS_LOG_ERROR(Detail, log("received open channel with unsupported congrestion controls"))
             stun->mErrorCode = STUNPacket::ErrorCode_UnsupportedTransportProtocol;
             outResponse = STUNPacket::createErrorResponse(stun);
@@ -598,6 +609,17 @@ namespace openpeer
             return true;
           }
 
+          // ...or to change the congestion controls (or FEC) already in use by the stream
+          if ((localAlgorithm != mLocalCongestionAlgorithm) ||
+              (remoteAlgorithm != mRemoteCongestionAlgorithm) ||
+              (IRUDPChannelStream::getResponseToOfferedFECBlockSize(stun->mFECBlockSize) != mFECBlockSize)) {
+            ZS_LOG_WARNING(Detail, log("received open channel with non supported congestion control renegociation") + ZS_PARAM("local", IRUDPChannel::toString(localAlgorithm)) + ZS_PARAM("remote", IRUDPChannel::toString(remoteAlgorithm)))
+            stun->mErrorCode = STUNPacket::ErrorCode_AllocationMismatch;
+            outResponse = STUNPacket::createErrorResponse(stun);
+            fix(outResponse);
+            return true;
+          }
+
           mLastReceivedData = zsLib::now();
           outResponse = STUNPacket::createResponse(stun);
           fix(outResponse);
@@ -613,6 +635,7 @@ namespace openpeer
           outResponse->mNextSequenceNumber = mLocalSequenceNumber;
           outResponse->mMinimumRTTIncluded = true;
           outResponse->mMinimumRTT = minimumRTT;
+          outResponse->mFECBlockSize = mFECBlockSize;
           outResponse->mLifetime = lifetime;
           outResponse->mChannelNumber = mIncomingChannelNumber;
 
@@ -692,7 +715,7 @@ namespace openpeer
                                    )
       {
         IRUDPChannelStreamPtr stream;
-        SecureByteBlockPtr newBuffer;
+        PacketBufferPtr retainedBuffer;
 
         // scope: do the work in the context of a lock but call the stream outside the lock
         {
@@ -706,16 +729,19 @@ namespace openpeer
 
           ZS_LOG_TRACE(log("received RUDP packet") + ZS_PARAM("stream ID", stream->getID()) + ZS_PARAM("length", bufferLengthInBytes))
 
-          newBuffer = IHelper::convertToBuffer(buffer, bufferLengthInBytes);
+          // keep the socket's pooled buffer alive (or a right sized copy of it)
+          const BYTE *retained = NULL;
+          retainedBuffer = PacketBufferPool::retain(buffer, bufferLengthInBytes, retained);
 
-          // fix the pointer to point to the newly constructed buffer
-          if (NULL != rudp->mData)
-            rudp->mData = ((*newBuffer) + (rudp->mData - buffer));
+          // fix the pointer to point to the retained buffer
+          if ((NULL != rudp->mData) &&
+              (retained != buffer))
+            rudp->mData = (retained + (rudp->mData - buffer));
 
           mLastReceivedData = zsLib::now();
         }
 
-        stream->handlePacket(rudp, newBuffer, false);
+        stream->handlePacket(rudp, retainedBuffer, false);
       }
 
       //-----------------------------------------------------------------------
@@ -779,6 +805,7 @@ namespace openpeer
         stun->mMinimumRTTIncluded = true;
         stun->mMinimumRTT = mMinimumRTT;
         stun->mConnectionInfo = mLocalChannelInfo;
+        stun->mFECBlockSize = IRUDPChannelStream::getRecommendedFECBlockSize();
         stun->mLocalCongestionControl = local;
         stun->mRemoteCongestionControl = remote;
         if (mRemotePassword.isEmpty()) {
@@ -883,8 +910,12 @@ namespace openpeer
         pThis->mRealm = stun->mRealm;
         pThis->mNonce = stun->mNonce;
         pThis->init();
+        // the "remote" offered list applies to our sending and the "local" offered list applies to theirs
+        IRUDPChannelStream::selectAlgorithm(stun->mRemoteCongestionControl, pThis->mLocalCongestionAlgorithm);
+        IRUDPChannelStream::selectAlgorithm(stun->mLocalCongestionControl, pThis->mRemoteCongestionAlgorithm);
+        pThis->mFECBlockSize = IRUDPChannelStream::getResponseToOfferedFECBlockSize(stun->mFECBlockSize);
         // do not allow sending to the remote party until we receive an ACK or data
-        pThis->mStream = IRUDPChannelStream::create(queue, pThis, pThis->mLocalSequenceNumber, pThis->mRemoteSequenceNumber, pThis->mOutgoingChannelNumber, pThis->mIncomingChannelNumber, pThis->mMinimumRTT);
+        pThis->mStream = IRUDPChannelStream::create(queue, pThis, pThis->mLocalSequenceNumber, pThis->mRemoteSequenceNumber, pThis->mOutgoingChannelNumber, pThis->mIncomingChannelNumber, pThis->mMinimumRTT, pThis->mLocalCongestionAlgorithm, pThis->mRemoteCongestionAlgorithm, pThis->mFECBlockSize);
         pThis->mStream->holdSendingUntilReceiveSequenceNumber(stun->mNextSequenceNumber);
         pThis->handleSTUN(stun, outResponse, localUsernameFrag, remoteUsernameFrag);
         if (!outResponse) {
@@ -982,6 +1013,35 @@ namespace openpeer
         return false;
       }
 
+      //-----------------------------------------------------------------------
+      size_t RUDPChannel::notifyRUDPChannelStreamSendPackets(
+                                                             IRUDPChannelStreamPtr stream,
+                                                             const SendBuffer *packets,
+                                                             size_t totalPackets
+                                                             )
+      {
+        ZS_LOG_TRACE(log("notify channel stream send packets") + ZS_PARAM("stream ID", stream->getID()) + ZS_PARAM("total", totalPackets))
+        IRUDPChannelDelegateForSessionAndListenerPtr master;
+        IPAddress remoteIP;
+
+        {
+          AutoRecursiveLock lock(mLock);
+          if (!mMasterDelegate) return 0;
+          master = mMasterDelegate;
+          remoteIP = mRemoteIP;
+          mLastSentData = zsLib::now();
+        }
+
+        try {
+          return master->notifyRUDPChannelSendPackets(mThisWeak.lock(), remoteIP, packets, totalPackets);
+        } catch(IRUDPChannelDelegateForSessionAndListenerProxy::Exceptions::DelegateGone &) {
+          ZS_LOG_WARNING(Detail, log("master delegate gone for sent packets"))
+          setError(RUDPChannelShutdownReason_DelegateGone, "delegate gone");
+          cancel(false);
+        }
+        return 0;
+      }
+
       //-----------------------------------------------------------------------
       void RUDPChannel::onRUDPChannelStreamSendExternalACKNow(
                                                               IRUDPChannelStreamPtr stream,
@@ -995,7 +1055,8 @@ namespace openpeer
         STUNPacketPtr stun;
 
         IPAddress remoteIP;
-        SecureByteBlockPtr packet;
+        PacketBufferPtr packet;
+        size_t packetLengthInBytes = 0;
 
         {
           AutoRecursiveLock lock(mLock);
@@ -1020,13 +1081,15 @@ namespace openpeer
             return;
           }
 
-          packet = stun->packetize(STUNPacket::RFC_draft_RUDP);
-          ZS_LOG_TRACE(log("STUN ACK sent") + ZS_PARAM("method", "indication") + ZS_PARAM("stun packet size", packet->SizeInBytes()))
+          packetLengthInBytes = stun->getPacketizedLength(STUNPacket::RFC_draft_RUDP);
+          packet = PacketBufferPool::allocate(packetLengthInBytes);
+          stun->packetizeInto(packet->data(), packet->capacity(), STUNPacket::RFC_draft_RUDP);
+          ZS_LOG_TRACE(log("STUN ACK sent") + ZS_PARAM("method", "indication") + ZS_PARAM("stun packet size", packetLengthInBytes))
           mLastSentData = zsLib::now();
         }
 
         try {
-          master->notifyRUDPChannelSendPacket(mThisWeak.lock(), remoteIP, *packet, packet->SizeInBytes());
+          master->notifyRUDPChannelSendPacket(mThisWeak.lock(), remoteIP, packet->data(), packetLengthInBytes);
         } catch(IRUDPChannelDelegateForSessionAndListenerProxy::Exceptions::DelegateGone &) {
           ZS_LOG_WARNING(Detail, log("master delegate gone for send external ack now"))
           setError(RUDPChannelShutdownReason_DelegateGone, "delegate gone");
@@ -1184,26 +1247,40 @@ namespace openpeer
             mLifetime = response->mLifetime;
           }
 
-          if (response->mLocalCongestionControl.size() > 0) {
-            if (response->mLocalCongestionControl.begin() != find(response->mLocalCongestionControl.begin(), response->mLocalCongestionControl.end(), IRUDPChannel::CongestionAlgorithm_TCPLikeWindowWithSlowCreepUp)) {
-              ZS_LOG_ERROR(Detail, log("remote party did not offer valid local congestion control"))
-              return false;
-            }
+          STUNPacketPtr request = requester->getRequest();
+          if (!request) {
+            ZS_LOG_ERROR(Detail, log("open request is missing"))
+            return false;
           }
 
-          if (response->mRemoteCongestionControl.size() > 0) {
-            if (response->mRemoteCongestionControl.begin() != find(response->mRemoteCongestionControl.begin(), response->mRemoteCongestionControl.end(), IRUDPChannel::CongestionAlgorithm_TCPLikeWindowWithSlowCreepUp)) {
-              ZS_LOG_ERROR(Detail, log("remote party did not offer valid remote congestion control"))
-              return false;
-            }
+          // in the reply "remote" applies to our sending and "local" applies to theirs, an empty list means the first algorithm we offered was selected
+          const IRUDPChannelStream::CongestionAlgorithmList &selectedForLocal = (response->mRemoteCongestionControl.size() > 0 ? response->mRemoteCongestionControl : request->mLocalCongestionControl);
+          const IRUDPChannelStream::CongestionAlgorithmList &selectedForRemote = (response->mLocalCongestionControl.size() > 0 ? response->mLocalCongestionControl : request->mRemoteCongestionControl);
+
+          if ((selectedForLocal.size() < 1) ||
+              (selectedForRemote.size() < 1)) {
+            ZS_LOG_ERROR(Detail, log("remote party did not select a congestion control algorithm"))
+            return false;
           }
 
-          // this is not legal if they don't support our encoders/decoders as the first preference since that is what we asked for
-          if ((response->mLocalCongestionControl.begin() != find(response->mLocalCongestionControl.begin(), response->mLocalCongestionControl.end(), IRUDPChannel::CongestionAlgorithm_TCPLikeWindowWithSlowCreepUp)) ||
-              (response->mRemoteCongestionControl.begin() != find(response->mRemoteCongestionControl.begin(), response->mRemoteCongestionControl.end(), IRUDPChannel::CongestionAlgorithm_TCPLikeWindowWithSlowCreepUp))) {
-            ZS_LOG_ERROR(Detail, log("remote party did not select our congestion control algorithm"))
+          // this is not legal if they selected an algorithm that we did not offer
+          if ((request->mLocalCongestionControl.end() == find(request->mLocalCongestionControl.begin(), request->mLocalCongestionControl.end(), selectedForLocal.front())) ||
+              (request->mRemoteCongestionControl.end() == find(request->mRemoteCongestionControl.begin(), request->mRemoteCongestionControl.end(), selectedForRemote.front()))) {
+            ZS_LOG_ERROR(Detail, log("remote party did not select an offered congestion control algorithm") + ZS_PARAM("local", IRUDPChannel::toString(selectedForLocal.front())) + ZS_PARAM("remote", IRUDPChannel::toString(selectedForRemote.front())))
+            return false;
+          }
+
+          mLocalCongestionAlgorithm = selectedForLocal.front();
+          mRemoteCongestionAlgorithm = selectedForRemote.front();
+
+          // a remote party which does not understand FEC ignores the offer and does not answer it
+          if ((0 != response->mFECBlockSize) &&
+              ((0 == request->mFECBlockSize) ||
+               (response->mFECBlockSize > request->mFECBlockSize))) {
+            ZS_LOG_ERROR(Detail, log("remote party selected an FEC block size which was not offered") + ZS_PARAM("offered", request->mFECBlockSize) + ZS_PARAM("selected", response->mFECBlockSize))
             return false;
           }
+          mFECBlockSize = response->mFECBlockSize;
 
           mRemoteSequenceNumber = response->mNextSequenceNumber;
           mOutgoingChannelNumber = response->mChannelNumber;
@@ -1218,7 +1295,10 @@ namespace openpeer
                                                mRemoteSequenceNumber,
                                                mOutgoingChannelNumber,
                                                mIncomingChannelNumber,
-                                               mMinimumRTT
+                                               mMinimumRTT,
+                                               mLocalCongestionAlgorithm,
+                                               mRemoteCongestionAlgorithm,
+                                               mFECBlockSize
                                                );
 
           if ((mReceiveStream) &&
@@ -1405,6 +1485,9 @@ namespace openpeer
 
         IHelper::debugAppend(resultEl, "minimum RTT", mMinimumRTT);
         IHelper::debugAppend(resultEl, "lifetime", mLifetime);
+        IHelper::debugAppend(resultEl, "local congestion algorithm", IRUDPChannel::toString(mLocalCongestionAlgorithm));
+        IHelper::debugAppend(resultEl, "remote congestion algorithm", IRUDPChannel::toString(mRemoteCongestionAlgorithm));
+        IHelper::debugAppend(resultEl, "fec block size", mFECBlockSize);
 
         IHelper::debugAppend(resultEl, "local channel info", mLocalChannelInfo);
         IHelper::debugAppend(resultEl, "remote channel info", mRemoteChannelInfo);
@@ -1784,6 +1867,7 @@ namespace openpeer
       {
         case CongestionAlgorithm_None:                          return "None";
         case CongestionAlgorithm_TCPLikeWindowWithSlowCreepUp:  return "TCP-like Window with slow creep up";
+        case CongestionAlgorithm_DelayBasedWindowWithLowExtraDelay: return "Delay-based Window with low extra delay";
       }
       return "UNDEFINED";
     }
@@ -32,6 +32,8 @@
 #include <openpeer/services/internal/services_RUDPChannelStream.h>
 #include <openpeer/services/internal/services_Helper.h>
 
+#include <openpeer/services/ISettings.h>
+
 #include <openpeer/services/RUDPPacket.h>
 
 #include <zsLib/Exception.h>
@@ -49,8 +51,17 @@
 
 #define OPENPEER_SERVICES_RUDP_MINIMUM_RECOMMENDED_RTT_IN_MILLISECONDS (40)
 #define OPENPEER_SERVICES_RUDP_MINIMUM_BURST_TIMER_IN_MILLISECONDS (20)
+#define OPENPEER_SERVICES_RUDP_MINIMUM_PACING_TIMER_IN_MILLISECONDS (2)
 #define OPENPEER_SERVICES_RUDP_DEFAULT_CALCULATE_RTT_IN_MILLISECONDS (200)
 
+#define OPENPEER_SERVICES_RUDP_INITIAL_RTO_IN_MILLISECONDS (1000)
+#define OPENPEER_SERVICES_RUDP_MINIMUM_RTO_IN_MILLISECONDS (200)
+#define OPENPEER_SERVICES_RUDP_MAXIMUM_RTO_IN_SECONDS (60)
+#define OPENPEER_SERVICES_RUDP_RTO_CLOCK_GRANULARITY_IN_MILLISECONDS (10)
+
+#define OPENPEER_SERVICES_RUDP_MAX_FEC_BLOCK_SIZE (32)
+#define OPENPEER_SERVICES_RUDP_FEC_REPAIR_HEADER_LENGTH_IN_BYTES (4)
+
 #define OPENPEER_SERVICES_MINIMUM_DATA_BUFFER_LENGTH_ALLOCATED_IN_BYTES (16*1024)
 #define OPENPEER_SERVICES_MAX_RECYCLE_BUFFERS 16
 
@@ -58,8 +69,6 @@
 
 #define OPENPEER_SERVICES_MAX_EXPAND_WINDOW_SINCE_LAST_READ_DELIVERED_IN_SECONDS (10)
 
-#define OPENPEER_SERVICES_UNFREEZE_AFTER_SECONDS_OF_GOOD_TRANSMISSION (10)
-#define OPENPEER_SERVICES_DEFAULT_PACKETS_PER_BURST (3)
 
 //#define OPENPEER_INDUCE_FAKE_PACKET_LOSS
 #define OPENPEER_INDUCE_FAKE_PACKET_LOSS_PERCENTAGE (10)
@@ -155,8 +164,19 @@ namespace openpeer
         outLocalAlgorithms.clear();
         outRemoteAlgoirthms.clear();
 
+        // always offer "TCPLikeWindow" so remote parties that only know that algorithm can still connect
+        if (ISettings::getBool(OPENPEER_SERVICES_SETTING_RUDP_PREFER_DELAY_BASED_CONGESTION_CONTROL)) {
+          outLocalAlgorithms.push_back(IRUDPChannel::CongestionAlgorithm_DelayBasedWindowWithLowExtraDelay);
+          outRemoteAlgoirthms.push_back(IRUDPChannel::CongestionAlgorithm_DelayBasedWindowWithLowExtraDelay);
+        }
+
         outLocalAlgorithms.push_back(IRUDPChannel::CongestionAlgorithm_TCPLikeWindowWithSlowCreepUp);
         outRemoteAlgoirthms.push_back(IRUDPChannel::CongestionAlgorithm_TCPLikeWindowWithSlowCreepUp);
+
+        if (!ISettings::getBool(OPENPEER_SERVICES_SETTING_RUDP_PREFER_DELAY_BASED_CONGESTION_CONTROL)) {
+          outLocalAlgorithms.push_back(IRUDPChannel::CongestionAlgorithm_DelayBasedWindowWithLowExtraDelay);
+          outRemoteAlgoirthms.push_back(IRUDPChannel::CongestionAlgorithm_DelayBasedWindowWithLowExtraDelay);
+        }
       }
 
       //-----------------------------------------------------------------------
@@ -167,26 +187,70 @@ namespace openpeer
                                                               CongestionAlgorithmList &outResponseAlgorithmsForRemote
                                                               )
       {
-        CongestionAlgorithmList::const_iterator findLocal = find(offeredAlgorithmsForLocal.begin(), offeredAlgorithmsForLocal.end(), IRUDPChannel::CongestionAlgorithm_TCPLikeWindowWithSlowCreepUp);
-        CongestionAlgorithmList::const_iterator findRemote = find(offeredAlgorithmsForRemote.begin(), offeredAlgorithmsForRemote.end(), IRUDPChannel::CongestionAlgorithm_TCPLikeWindowWithSlowCreepUp);
-        if (offeredAlgorithmsForLocal.end() == findLocal)
+        CongestionAlgorithms selectedLocal = IRUDPChannel::CongestionAlgorithm_None;
+        CongestionAlgorithms selectedRemote = IRUDPChannel::CongestionAlgorithm_None;
+
+        if (!selectAlgorithm(offeredAlgorithmsForLocal, selectedLocal))
           return false;
-        if (offeredAlgorithmsForRemote.end() == findRemote)
+        if (!selectAlgorithm(offeredAlgorithmsForRemote, selectedRemote))
           return false;
 
         outResponseAlgorithmsForLocal.clear();
         outResponseAlgorithmsForRemote.clear();
 
-        // only need to select a preferred if the preferred does not match our only choice of "TCPLikeWindow" that available at this time
-        if (offeredAlgorithmsForLocal.begin() != findLocal)
-          outResponseAlgorithmsForLocal.push_back(IRUDPChannel::CongestionAlgorithm_TCPLikeWindowWithSlowCreepUp);
+        // only need to respond with a selection if the selection does not match the offered preferred algorithm
+        if (offeredAlgorithmsForLocal.front() != selectedLocal)
+          outResponseAlgorithmsForLocal.push_back(selectedLocal);
 
-        if (offeredAlgorithmsForRemote.begin() != findRemote)
-          outResponseAlgorithmsForRemote.push_back(IRUDPChannel::CongestionAlgorithm_TCPLikeWindowWithSlowCreepUp);
+        if (offeredAlgorithmsForRemote.front() != selectedRemote)
+          outResponseAlgorithmsForRemote.push_back(selectedRemote);
 
         return true;
       }
 
+      //-----------------------------------------------------------------------
+      bool IRUDPChannelStream::selectAlgorithm(
+                                               const CongestionAlgorithmList &offeredAlgorithms,
+                                               CongestionAlgorithms &outSelectedAlgorithm
+                                               )
+      {
+        for (CongestionAlgorithmList::const_iterator iter = offeredAlgorithms.begin(); iter != offeredAlgorithms.end(); ++iter) {
+          if (IRUDPCongestionControl::isSupported(*iter)) {
+            outSelectedAlgorithm = (*iter);
+            return true;
+          }
+        }
+        return false;
+      }
+
+      //-----------------------------------------------------------------------
+      DWORD IRUDPChannelStream::getRecommendedFECBlockSize()
+      {
+        ULONG blockSize = ISettings::getUInt(OPENPEER_SERVICES_SETTING_RUDP_FEC_BLOCK_SIZE);
+        if (blockSize > OPENPEER_SERVICES_RUDP_MAX_FEC_BLOCK_SIZE)
+          blockSize = OPENPEER_SERVICES_RUDP_MAX_FEC_BLOCK_SIZE;
+        return blockSize;
+      }
+
+      //-----------------------------------------------------------------------
+      DWORD IRUDPChannelStream::getResponseToOfferedFECBlockSize(DWORD offeredBlockSize)
+      {
+        if (0 == offeredBlockSize) return 0;
+
+        DWORD blockSize = offeredBlockSize;
+        if (blockSize > OPENPEER_SERVICES_RUDP_MAX_FEC_BLOCK_SIZE)
+          blockSize = OPENPEER_SERVICES_RUDP_MAX_FEC_BLOCK_SIZE;
+
+        // receiving repair packets costs little so any offer is accepted but
+        // if FEC is configured locally the smaller (i.e. stronger) block wins
+        DWORD preferred = getRecommendedFECBlockSize();
+        if ((0 != preferred) &&
+            (preferred < blockSize))
+          blockSize = preferred;
+
+        return blockSize;
+      }
+
       //-------------------------------------------------------------------------
       ElementPtr IRUDPChannelStream::toDebug(IRUDPChannelStreamPtr stream)
       {
@@ -203,7 +267,8 @@ namespace openpeer
                                                        WORD receivingChannelNumber,
                                                        DWORD minimumNegotiatedRTT,
                                                        CongestionAlgorithms algorithmForLocal,
-                                                       CongestionAlgorithms algorithmForRemote
+                                                       CongestionAlgorithms algorithmForRemote,
+                                                       DWORD fecBlockSize
                                                        )
       {
         return internal::IRUDPChannelStreamFactory::singleton().create(
@@ -213,7 +278,10 @@ namespace openpeer
                                                                        nextSequenberNumberExpectingToReceive,
                                                                        sendingChannelNumber,
                                                                        receivingChannelNumber,
-                                                                       minimumNegotiatedRTT
+                                                                       minimumNegotiatedRTT,
+                                                                       algorithmForLocal,
+                                                                       algorithmForRemote,
+                                                                       fecBlockSize
                                                                        );
       }
 
@@ -233,7 +301,10 @@ namespace openpeer
                                            QWORD nextSequenberNumberExpectingToReceive,
                                            WORD sendingChannelNumber,
                                            WORD receivingChannelNumber,
-                                           DWORD minimumNegotiatedRTTInMilliseconds
+                                           DWORD minimumNegotiatedRTTInMilliseconds,
+                                           CongestionAlgorithms algorithmForLocal,
+                                           CongestionAlgorithms algorithmForRemote,
+                                           DWORD fecBlockSize
                                            ) :
         MessageQueueAssociator(queue),
         mDelegate(IRUDPChannelStreamDelegateProxy::createWeak(queue, delegate)),
@@ -244,23 +315,55 @@ namespace openpeer
         mReceivingChannelNumber(receivingChannelNumber),
         mMinimumRTT(Milliseconds(minimumNegotiatedRTTInMilliseconds)),
         mCalculatedRTT(Milliseconds(OPENPEER_SERVICES_RUDP_DEFAULT_CALCULATE_RTT_IN_MILLISECONDS)),
+        mSRTT(Milliseconds(0)),
+        mRTTVAR(Milliseconds(0)),
+        mRTO(Milliseconds(OPENPEER_SERVICES_RUDP_INITIAL_RTO_IN_MILLISECONDS)),
+        mRTOBackoff(0),
+        mLastRTTSample(Milliseconds(0)),
+        mTotalRTTSamples(0),
+        mTotalRTTSamplesIgnored(0),
         mNextSequenceNumber(nextSequenceNumberToUseForSending),
         mGSNR(nextSequenberNumberExpectingToReceive-1),
         mGSNFR(nextSequenberNumberExpectingToReceive-1),
         mShutdownState(IRUDPChannel::Shutdown_None),
         mLastDeliveredReadData(zsLib::now()),
+        mSendingPackets(OPENPEER_SERVICES_MAX_WINDOW_TO_NEXT_SEQUENCE_NUMBER),
+        mReceivedPackets(OPENPEER_SERVICES_MAX_WINDOW_TO_NEXT_SEQUENCE_NUMBER),
+        mRemoteCongestionAlgorithm(algorithmForRemote),
+        mTotalBurstBatons(1),
         mAvailableBurstBatons(1),
-        mAddToAvailableBurstBatonsDuation(Milliseconds(OPENPEER_SERVICES_RUDP_DEFAULT_CALCULATE_RTT_IN_MILLISECONDS)),
-        mPacketsPerBurst(OPENPEER_SERVICES_DEFAULT_PACKETS_PER_BURST),
-        mStartedSendingAtTime(zsLib::now()),
-        mTotalSendingPeriodWithoutIssues(Milliseconds(0)),
+        mAddToAvailableBurstBatonsDuation(Milliseconds(0)),
+        mPacketsPerBurst(1),
+        mPacing(ISettings::getBool(OPENPEER_SERVICES_SETTING_RUDP_PACING)),
+        mPacedPacketsRemainingInBurst(0),
+        mPacingCredit(0),
+        mBurstTimerDuration(Milliseconds(0)),
+        mTotalPacketsSent(0),
+        mTotalPacketsResent(0),
+        mTotalPacketsReportedLost(0),
+        mFECBlockSize(fecBlockSize > OPENPEER_SERVICES_RUDP_MAX_FEC_BLOCK_SIZE ? OPENPEER_SERVICES_RUDP_MAX_FEC_BLOCK_SIZE : fecBlockSize),
+        mFECPacketsInBlock(0),
+        mFECLastSequenceNumber(0),
+        mFECFlags(0),
+        mFECDataLength(0),
+        mFECMaxDataLength(0),
+        mTotalFECRepairsSent(0),
+        mTotalFECRepairsReceived(0),
+        mTotalFECPacketsRecovered(0),
+        mTotalFECBlocksUnrecoverable(0),
         mForceACKOfSentPacketsRequestID(0)
       {
         IHelper::setTimerThreadPriority();
 
-        ZS_LOG_DETAIL(log("created"))
+        ZS_LOG_DETAIL(log("created") + ZS_PARAM("local algorithm", IRUDPChannel::toString(algorithmForLocal)) + ZS_PARAM("remote algorithm", IRUDPChannel::toString(algorithmForRemote)) + ZS_PARAM("fec block size", mFECBlockSize))
+        memset(&(mFECData[0]), 0, sizeof(mFECData));
         if (mCalculatedRTT < mMinimumRTT)
           mCalculatedRTT = mMinimumRTT;
+        if (mRTO < mMinimumRTT)
+          mRTO = mMinimumRTT;
+
+        mCongestionControl = IRUDPCongestionControl::create(algorithmForLocal, mCalculatedRTT);
+        applyCongestionControl();
 
         CryptoPP::AutoSeededRandomPool rng;
         rng.GenerateBlock(&(mRandomPool[0]), sizeof(mRandomPool));
@@ -277,7 +380,7 @@ namespace openpeer
         if(isNoop()) return;
         
         mThisWeak.reset();
-        ZS_LOG_DETAIL(log("destroyed"))
+        ZS_LOG_DETAIL(log("destroyed") + ZS_PARAM("SRTT", mSRTT.total_milliseconds()) + ZS_PARAM("RTTVAR", mRTTVAR.total_milliseconds()) + ZS_PARAM("RTO", mRTO.total_milliseconds()) + ZS_PARAM("RTT samples", mTotalRTTSamples) + ZS_PARAM("RTT samples ignored", mTotalRTTSamplesIgnored) + ZS_PARAM("pacing", mPacing) + ZS_PARAM("packets sent", mTotalPacketsSent) + ZS_PARAM("packets resent", mTotalPacketsResent) + ZS_PARAM("packets reported lost", mTotalPacketsReportedLost) + ZS_PARAM("fec repairs sent", mTotalFECRepairsSent) + ZS_PARAM("fec repairs received", mTotalFECRepairsReceived) + ZS_PARAM("fec packets recovered", mTotalFECPacketsRecovered) + ZS_PARAM("fec blocks unrecoverable", mTotalFECBlocksUnrecoverable))
         cancel();
       }
 
@@ -312,7 +415,10 @@ namespace openpeer
                                                      QWORD nextSequenberNumberExpectingToReceive,
                                                      WORD sendingChannelNumber,
                                                      WORD receivingChannelNumber,
-                                                     DWORD minimumNegotiatedRTT
+                                                     DWORD minimumNegotiatedRTT,
+                                                     CongestionAlgorithms algorithmForLocal,
+                                                     CongestionAlgorithms algorithmForRemote,
+                                                     DWORD fecBlockSize
                                                      )
       {
         RUDPChannelStreamPtr pThis(new RUDPChannelStream(
@@ -322,7 +428,10 @@ namespace openpeer
                                                          nextSequenberNumberExpectingToReceive,
                                                          sendingChannelNumber,
                                                          receivingChannelNumber,
-                                                         minimumNegotiatedRTT
+                                                         minimumNegotiatedRTT,
+                                                         algorithmForLocal,
+                                                         algorithmForRemote,
+                                                         fecBlockSize
                                                          ));
         pThis->mThisWeak = pThis;
         pThis->init();
@@ -438,11 +547,11 @@ namespace openpeer
       //-----------------------------------------------------------------------
       bool RUDPChannelStream::handlePacket(
                                            RUDPPacketPtr packet,
-                                           SecureByteBlockPtr originalBuffer,
+                                           PacketBufferPtr originalBuffer,
                                            bool ecnMarked
                                            )
       {
-        ZS_LOG_TRACE(log("handle packet called") + ZS_PARAM("size", originalBuffer->SizeInBytes()) + ZS_PARAM("ecn", ecnMarked))
+        ZS_LOG_TRACE(log("handle packet called") + ZS_PARAM("size", packet->mDataLengthInBytes) + ZS_PARAM("ecn", ecnMarked))
 
         bool fireExternalACKIfNotSent = false;
 
@@ -460,6 +569,13 @@ namespace openpeer
 
           QWORD sequenceNumber = packet->getSequenceNumber(mGSNR);
 
+          if (packet->isFlagSet(RUDPPacket::Flag_FR_FECRepair)) {
+            // a repair packet does not consume a sequence number and its ACK
+            // information is not processed, it can only rebuild a lost packet
+            if (!handleFECRepair(sequenceNumber, packet, fireExternalACKIfNotSent)) return true;
+            goto handlePacketSendNow;
+          }
+
           // we no longer have to wait on a send once we find the correct sequence number
           if (sequenceNumber >= mWaitToSendUntilReceivedRemoteSequenceNumber)
             get(mWaitToSendUntilReceivedRemoteSequenceNumber) = 0;
@@ -498,8 +614,7 @@ namespace openpeer
           }
 
           // we handled the ack now receive the data...
-          BufferedPacketMap::iterator findIter = mReceivedPackets.find(sequenceNumber);
-          if (findIter != mReceivedPackets.end()) {
+          if (mReceivedPackets.find(sequenceNumber)) {
             ZS_LOG_WARNING(Debug, log("received packet is duplicated and already exist in pending buffers thus dropping packet") + ZS_PARAM("packet sequence number", sequenceToString(sequenceNumber)))
             // we have already received and processed this packet
             get(mDuplicateReceived) = true;
@@ -536,9 +651,9 @@ namespace openpeer
           BufferedPacketPtr bufferedPacket = BufferedPacket::create();
           bufferedPacket->mSequenceNumber = sequenceNumber;
           bufferedPacket->mRUDPPacket = packet;
-          bufferedPacket->mPacket = originalBuffer;
+          bufferedPacket->mReceivedBuffer = originalBuffer;
 
-          mReceivedPackets[sequenceNumber] = bufferedPacket;
+          mReceivedPackets.insert(sequenceNumber, bufferedPacket);
           if (sequenceNumber > mGSNR) {
             mGSNR = sequenceNumber;
             get(mGSNRParity) = packet->isFlagSet(RUDPPacket::Flag_PS_ParitySending);
@@ -554,6 +669,7 @@ namespace openpeer
 
         } // scope
 
+      handlePacketSendNow:
         // because we have possible new ACKs the window might have progressed, attempt to send more data now
         bool sent = sendNow();  // WARNING: this method cannot be called from within a lock
         if (sent) {
@@ -656,14 +772,14 @@ namespace openpeer
           bool firstTime = true;
 
           QWORD sequenceNumber = 0;
-          for (BufferedPacketMap::iterator iter = mSendingPackets.begin(); iter != mSendingPackets.end(); ++iter) {
-            sequenceNumber = (*iter).first;
+          for (BufferedPacketRing::iterator iter = mSendingPackets.begin(); iter != mSendingPackets.end(); ++iter) {
+            sequenceNumber = iter.sequenceNumber();
 
             if (sequenceNumber > mForceACKOfSentPacketsAtSendingSequnceNumber) {
               break;
             }
 
-            BufferedPacketPtr &packet = (*iter).second;
+            BufferedPacketPtr &packet = (*iter);
             if (firstTime) {
               firstTime = false;
               ZS_LOG_TRACE(log("force ACK starting to process")  +
@@ -724,8 +840,8 @@ namespace openpeer
           QWORD sequenceNumber = mGSNFR+1;
 
           // create a vector until the vector is full or we run out of packets that we have received
-          for (BufferedPacketMap::iterator iter = mReceivedPackets.begin(); iter != mReceivedPackets.end(); ++iter) {
-            BufferedPacketPtr packet = (*iter).second;
+          for (BufferedPacketRing::iterator iter = mReceivedPackets.begin(); iter != mReceivedPackets.end(); ++iter) {
+            BufferedPacketPtr &packet = (*iter);
             bool added = true;
             while (sequenceNumber < packet->mSequenceNumber)
             {
@@ -821,6 +937,10 @@ namespace openpeer
             mEnsureDataHasArrivedWhenNoMoreBurstBatonsAvailableTimer->cancel();
             mEnsureDataHasArrivedWhenNoMoreBurstBatonsAvailableTimer.reset();
 
+            // back off the timeout (RFC 6298 section 5.5) until an RTT sample arrives again
+            if (getRTO() < Seconds(OPENPEER_SERVICES_RUDP_MAXIMUM_RTO_IN_SECONDS))
+              ++mRTOBackoff;
+
             // we will use the "force" ACK mechanism to ensure that data has arrived
             get(mForceACKNextTimePossible) = true;
             goto quickExitToSendNow;
@@ -829,13 +949,8 @@ namespace openpeer
           if (timer == mAddToAvailableBurstBatonsTimer) {
             ZS_LOG_TRACE(log("available burst batons timer fired") + ZS_PARAM("timer ID", timer->getID()))
 
-            if (0 == (rand()%2)) {
-              ++mAvailableBurstBatons;
-              ZS_LOG_TRACE(log("creating a new sending burst baton now") + ZS_PARAM("batons available", mAvailableBurstBatons))
-            } else {
-              ++mPacketsPerBurst;
-              ZS_LOG_TRACE(log("increasing the packets per burst") + ZS_PARAM("packets per burst", mPacketsPerBurst))
-            }
+            mCongestionControl->notifyIncreaseInterval();
+            applyCongestionControl();
             goto quickExitToSendNow;
           }
 
@@ -928,6 +1043,15 @@ namespace openpeer
         IHelper::debugAppend(resultEl, "minimum RTT (ms)", mMinimumRTT);
         IHelper::debugAppend(resultEl, "calculated RTT (ms)", mCalculatedRTT);
 
+        IHelper::debugAppend(resultEl, "SRTT (ms)", mSRTT);
+        IHelper::debugAppend(resultEl, "RTTVAR (ms)", mRTTVAR);
+        IHelper::debugAppend(resultEl, "RTO (ms)", mRTO);
+        IHelper::debugAppend(resultEl, "RTO backoff", mRTOBackoff);
+        IHelper::debugAppend(resultEl, "RTO with backoff (ms)", getRTO());
+        IHelper::debugAppend(resultEl, "last RTT sample (ms)", mLastRTTSample);
+        IHelper::debugAppend(resultEl, "RTT samples", mTotalRTTSamples);
+        IHelper::debugAppend(resultEl, "RTT samples ignored (Karn)", mTotalRTTSamplesIgnored);
+
         IHelper::debugAppend(resultEl, "next sequence number", 0 != mNextSequenceNumber ? sequenceToString(mNextSequenceNumber) : String());
 
         IHelper::debugAppend(resultEl, "xor parity to now", mXORedParityToNow ? "1" : "0");
@@ -958,6 +1082,10 @@ namespace openpeer
 
         IHelper::debugAppend(resultEl, "total packets to resend", mTotalPacketsToResend);
 
+        IHelper::debugAppend(resultEl, "congestion control", IRUDPCongestionControl::toDebug(mCongestionControl));
+        IHelper::debugAppend(resultEl, "remote congestion algorithm", IRUDPChannel::toString(mRemoteCongestionAlgorithm));
+
+        IHelper::debugAppend(resultEl, "total burst batons", mTotalBurstBatons);
         IHelper::debugAppend(resultEl, "available burst batons", mAvailableBurstBatons);
 
         IHelper::debugAppend(resultEl, "burst timer", (bool)mBurstTimer);
@@ -969,9 +1097,25 @@ namespace openpeer
 
         IHelper::debugAppend(resultEl, "total packets per burst", mPacketsPerBurst);
 
-        IHelper::debugAppend(resultEl, "bandwidth increase frozen", mBandwidthIncreaseFrozen);
-        IHelper::debugAppend(resultEl, "started sending time", mStartedSendingAtTime);
-        IHelper::debugAppend(resultEl, "total sending period without issues (ms)", mTotalSendingPeriodWithoutIssues);
+        IHelper::debugAppend(resultEl, "pacing", mPacing);
+        IHelper::debugAppend(resultEl, "paced packets remaining in burst", mPacedPacketsRemainingInBurst);
+        IHelper::debugAppend(resultEl, "pacing credit", mPacingCredit);
+        IHelper::debugAppend(resultEl, "pacing gap (ms)", getPacingGap());
+        IHelper::debugAppend(resultEl, "burst timer duration (ms)", mBurstTimerDuration);
+
+        IHelper::debugAppend(resultEl, "packets sent", mTotalPacketsSent);
+        IHelper::debugAppend(resultEl, "packets resent", mTotalPacketsResent);
+        IHelper::debugAppend(resultEl, "packets reported lost", mTotalPacketsReportedLost);
+        IHelper::debugAppend(resultEl, "loss rate (%)", (0 != mTotalPacketsSent ? (static_cast<double>(mTotalPacketsReportedLost) * 100.0) / static_cast<double>(mTotalPacketsSent) : 0.0));
+
+        IHelper::debugAppend(resultEl, "fec block size", mFECBlockSize);
+        IHelper::debugAppend(resultEl, "fec packets in block", mFECPacketsInBlock);
+        IHelper::debugAppend(resultEl, "fec pending repairs", mFECPendingRepairs.size());
+        IHelper::debugAppend(resultEl, "fec delivered packets", mFECDeliveredPackets.size());
+        IHelper::debugAppend(resultEl, "fec repairs sent", mTotalFECRepairsSent);
+        IHelper::debugAppend(resultEl, "fec repairs received", mTotalFECRepairsReceived);
+        IHelper::debugAppend(resultEl, "fec packets recovered", mTotalFECPacketsRecovered);
+        IHelper::debugAppend(resultEl, "fec blocks unrecoverable", mTotalFECBlocksUnrecoverable);
 
         IHelper::debugAppend(resultEl, "force ACKs of sent packets sending sequence number", 0 != mForceACKOfSentPacketsAtSendingSequnceNumber ? sequenceToString(mForceACKOfSentPacketsAtSendingSequnceNumber) : String());
         IHelper::debugAppend(resultEl, "force ACKs of sent packets request ID", mForceACKOfSentPacketsRequestID);
@@ -999,6 +1143,8 @@ namespace openpeer
 
         mSendingPackets.clear();
         mReceivedPackets.clear();
+        mFECDeliveredPackets.clear();
+        mFECPendingRepairs.clear();
 
         if (mReceiveStream) {
           mReceiveStream->cancel();
@@ -1088,6 +1234,68 @@ namespace openpeer
 #endif //OPENPEER_INDUCE_FAKE_PACKET_LOSS
       }
 
+      //-----------------------------------------------------------------------
+      bool RUDPChannelStream::sendNowBurst(
+                                           IRUDPChannelStreamDelegatePtr &delegate,
+                                           BufferedPacketPtr *packets,
+                                           const UDPBatch::SendBuffer *buffers,
+                                           size_t totalPackets,
+                                           BufferedPacketPtr &ioFirstPacketCreated,
+                                           BufferedPacketPtr &outLastPacketSent
+                                           )
+      {
+        if (0 == totalPackets) return true;
+
+        ZS_LOG_TRACE(log("attempting to (re)send burst") + ZS_PARAM("first sequence number", sequenceToString(packets[0]->mSequenceNumber)) + ZS_PARAM("total", totalPackets))
+
+        size_t totalSent = 0;
+
+#ifdef OPENPEER_INDUCE_FAKE_PACKET_LOSS
+        // send one at a time so each packet can be lost on its own
+        for (; totalSent < totalPackets; ++totalSent) {
+          if (!sendNowHelper(delegate, buffers[totalSent].mBuffer, buffers[totalSent].mBufferLengthInBytes)) break;
+        }
+#else
+        if (1 == totalPackets) {
+          totalSent = (sendNowHelper(delegate, buffers[0].mBuffer, buffers[0].mBufferLengthInBytes) ? 1 : 0);
+        } else {
+          totalSent = delegate->notifyRUDPChannelStreamSendPackets(mThisWeak.lock(), buffers, totalPackets);
+        }
+#endif //OPENPEER_INDUCE_FAKE_PACKET_LOSS
+
+        if (0 != totalSent) {
+          outLastPacketSent = packets[totalSent - 1];
+
+          AutoRecursiveLock lock(mLock);
+          Time tick = zsLib::now();
+          for (size_t index = 0; index < totalSent; ++index) {
+            BufferedPacketPtr &packet = packets[index];
+            if (0 == packet->mTotalTimesSent) {
+              // the RTT is measured from the first time the packet went over the wire
+              packet->mTimeSentOrReceived = tick;
+            }
+            ++(packet->mTotalTimesSent);
+          }
+        }
+
+        if (totalSent >= totalPackets) return true;
+
+        ZS_LOG_WARNING(Trace, log("unable to send data onto wire as data failed to send") + ZS_PARAM("sequence number", sequenceToString(packets[totalSent]->mSequenceNumber)) + ZS_PARAM("unsent", totalPackets - totalSent))
+
+        AutoRecursiveLock lock(mLock);
+        for (size_t index = totalSent; index < totalPackets; ++index) {
+          BufferedPacketPtr &packet = packets[index];
+          if (ioFirstPacketCreated == packet) {
+            // failed to deliver any new packet over the wire...
+            ioFirstPacketCreated.reset();
+          }
+
+          // the packet never went out thus deliver it in the next burst
+          packet->flagForResending(mTotalPacketsToResend);
+        }
+        return false;
+      }
+
       //-----------------------------------------------------------------------
       bool RUDPChannelStream::sendNow()
       {
@@ -1166,15 +1374,32 @@ namespace openpeer
         try {
           ULONG packetsToSend = 1;
 
+          // the burst is gathered and handed to the delegate as a single
+          // batch so the socket can send it with one system call
+          BufferedPacketPtr burstPackets[OPENPEER_SERVICES_UDPBATCH_MAX_PACKETS];
+          SecureByteBlockPtr burstData[OPENPEER_SERVICES_UDPBATCH_MAX_PACKETS];         // keeps the packetized data alive until sent
+          UDPBatch::SendBuffer burstBuffers[OPENPEER_SERVICES_UDPBATCH_MAX_PACKETS];
+          size_t totalInBurst = 0;
+
+          BufferedPacketPtr lastPacketQueued;
+
           // scope: check out if we can send now
           {
             AutoRecursiveLock lock(mLock);
-            if (0 == mAvailableBurstBatons) {
-              ZS_LOG_TRACE(log("no batons for bursting available for sending data thus aborting send routine"))
-              goto sendNowQuickExit;
+            if ((!mPacing) ||
+                (0 == mPacedPacketsRemainingInBurst)) {
+              if (0 == mAvailableBurstBatons) {
+                ZS_LOG_TRACE(log("no batons for bursting available for sending data thus aborting send routine"))
+                goto sendNowQuickExit;
+              }
+              mPacedPacketsRemainingInBurst = (mPacing ? mPacketsPerBurst : 0);
             }
 
-            packetsToSend = mPacketsPerBurst;
+            packetsToSend = (mPacing ? getPacedPacketsToSend() : mPacketsPerBurst);
+            if (0 == packetsToSend) {
+              ZS_LOG_TRACE(log("pacing does not allow another packet to be sent yet") + ZS_PARAM("remaining in burst", mPacedPacketsRemainingInBurst) + ZS_PARAM("credit", mPacingCredit))
+              goto sendNowQuickExit;
+            }
           }
 
           while (0 != packetsToSend)
@@ -1187,21 +1412,29 @@ namespace openpeer
               AutoRecursiveLock lock(mLock);
 
               if (0 != mTotalPacketsToResend) {
-                BufferedPacketMap::iterator iter = mSendingPackets.begin();
-                if (lastPacketSent) {
-                  iter = mSendingPackets.find(lastPacketSent->mSequenceNumber);
+                BufferedPacketRing::iterator iter = mSendingPackets.begin();
+                if (lastPacketQueued) {
+                  iter = mSendingPackets.at(lastPacketQueued->mSequenceNumber);
                 }
                 if (iter == mSendingPackets.end()) {
                   iter = mSendingPackets.begin();
                 }
 
                 for (; iter != mSendingPackets.end(); ++iter) {
-                  BufferedPacketPtr &packet = (*iter).second;
+                  BufferedPacketPtr &packet = (*iter);
                   if (packet->mFlagForResendingInNextBurst) {
                     attemptToDeliver = packet;
                     attemptToDeliverBuffer = packet->mPacket;
                   }
                 }
+
+                if (attemptToDeliver) {
+                  ZS_LOG_TRACE(log("flag for resending in next burst is set this will force an ACK next time possible"))
+
+                  get(mForceACKNextTimePossible) = true;                // we need to force an ACK when there is resent data to ensure it has arrived
+                  attemptToDeliver->doNotResend(mTotalPacketsToResend); // cleared now so the packet is not picked twice for this burst (flagged again if the burst fails to send)
+                  ++mTotalPacketsResent;
+                }
               }
             }
 
@@ -1210,8 +1443,8 @@ namespace openpeer
 
               // there are no packets to be resent so attempt to create a new packet to send...
 
-              if (!mSendStream) goto sendNowQuickExit;
-              if (mSendStream->getTotalReadBuffersAvailable() < 1) goto sendNowQuickExit;
+              if (!mSendStream) break;
+              if (mSendStream->getTotalReadBuffersAvailable() < 1) break;
 
               // we need to start breaking up new packets immediately that will be sent over the wire
               RUDPPacketPtr newPacket = RUDPPacket::create();
@@ -1236,8 +1469,8 @@ namespace openpeer
                 QWORD sequenceNumber = mGSNFR+1;
 
                 // create a vector until the vector is full or we run out of packets
-                for (BufferedPacketMap::iterator iter = mReceivedPackets.begin(); iter != mReceivedPackets.end(); ++iter) {
-                  BufferedPacketPtr packet = (*iter).second;
+                for (BufferedPacketRing::iterator iter = mReceivedPackets.begin(); iter != mReceivedPackets.end(); ++iter) {
+                  BufferedPacketPtr &packet = (*iter);
                   bool added = true;
                   while (sequenceNumber < packet->mSequenceNumber)
                   {
@@ -1290,6 +1523,13 @@ namespace openpeer
               BYTE temp[OPENPEER_SERVICES_RUDP_MAX_PACKET_SIZE_WHEN_PMTU_IS_NOT_KNOWN];
 
               size_t availableBytes = newPacket->getRoomAvailableForData(OPENPEER_SERVICES_RUDP_MAX_PACKET_SIZE_WHEN_PMTU_IS_NOT_KNOWN);
+              if (0 != mFECBlockSize) {
+                // leave room for the repair header (and a GSNFR header word this
+                // packet might not need) so the repair packet of the block is
+                // never bigger than the packets it protects
+                size_t reserved = OPENPEER_SERVICES_RUDP_FEC_REPAIR_HEADER_LENGTH_IN_BYTES + sizeof(DWORD);
+                availableBytes = (availableBytes > reserved ? availableBytes - reserved : 0);
+              }
 
               size_t bytesRead = getFromWriteBuffer(&(temp[0]), availableBytes);
               newPacket->mData = &(temp[0]);
@@ -1298,8 +1538,9 @@ namespace openpeer
 #else
               newPacket->mDataLengthInBytes = static_cast<decltype(newPacket->mDataLengthInBytes)>(bytesRead);
 #endif
+              // the last packet of a burst asks for an ACK (when pacing, the burst spans many send attempts)
               if ((mSendStream->getTotalReadBuffersAvailable() < 1) ||
-                  (1 == packetsToSend)) {
+                  (1 == (mPacing ? mPacedPacketsRemainingInBurst : packetsToSend))) {
                 newPacket->setFlag(RUDPPacket::Flag_AR_ACKRequired);
                 if (mEnsureDataHasArrivedWhenNoMoreBurstBatonsAvailableTimer) {
                   ZS_LOG_TRACE(log("since a newly created packet has an ACK we will cancel the current ensure timer") + ZS_PARAM("timer ID", mEnsureDataHasArrivedWhenNoMoreBurstBatonsAvailableTimer->getID()))
@@ -1319,6 +1560,13 @@ namespace openpeer
               bufferedPacket->mRUDPPacket = newPacket;
               bufferedPacket->mPacket = packetizedBuffer;
 
+              if (0 != mFECBlockSize) {
+                addToFECBlock(mNextSequenceNumber, *newPacket);
+                // do not leave the tail of the data unprotected while waiting for the block to fill
+                if (mSendStream->getTotalReadBuffersAvailable() < 1)
+                  finalizeFECBlock();
+              }
+
               ZS_LOG_TRACE(
                            log("adding buffer to pending list")
                            + ZS_PARAM("sequence number", sequenceToString(mNextSequenceNumber))
@@ -1337,11 +1585,12 @@ namespace openpeer
 
               if (mSendingPackets.size() == 0) {
                 // this is the starting point where we are sending packets
-                mStartedSendingAtTime = zsLib::now();
+                mCongestionControl->notifySendingStarted();
               }
-              mSendingPackets[mNextSequenceNumber] = bufferedPacket;
+              mSendingPackets.insert(mNextSequenceNumber, bufferedPacket);
 
               ++mNextSequenceNumber;
+              ++mTotalPacketsSent;
 
               if (!firstPacketCreated) {
                 // remember this as the first packet created
@@ -1354,32 +1603,55 @@ namespace openpeer
 
             if (!attemptToDeliver) {
               ZS_LOG_TRACE(log("no more packets to send at this time"))
-              goto sendNowQuickExit;
+              break;
             }
 
-            ZS_LOG_TRACE(log("attempting to (re)send packet") + ZS_PARAM("sequence number", sequenceToString(attemptToDeliver->mSequenceNumber)) + ZS_PARAM("packets to send", packetsToSend))
-            bool sent = sendNowHelper(delegate, *attemptToDeliverBuffer, attemptToDeliverBuffer->SizeInBytes());
-            if (!sent) {
-              ZS_LOG_WARNING(Trace, log("unable to send data onto wire as data failed to send") + ZS_PARAM("sequence number", sequenceToString(attemptToDeliver->mSequenceNumber)))
-              if (firstPacketCreated == attemptToDeliver) {
-                // failed to deliver any packet over the wire...
-                firstPacketCreated.reset();
-              }
-              goto sendNowQuickExit;
-            }
+            ZS_LOG_TRACE(log("queuing packet to (re)send") + ZS_PARAM("sequence number", sequenceToString(attemptToDeliver->mSequenceNumber)) + ZS_PARAM("packets to send", packetsToSend))
 
-            // successfully (re)sent the packet...
+            burstPackets[totalInBurst] = attemptToDeliver;
+            burstData[totalInBurst] = attemptToDeliverBuffer;
+            burstBuffers[totalInBurst].mBuffer = *attemptToDeliverBuffer;
+            burstBuffers[totalInBurst].mBufferLengthInBytes = attemptToDeliverBuffer->SizeInBytes();
+            ++totalInBurst;
 
-            lastPacketSent = attemptToDeliver;
+            lastPacketQueued = attemptToDeliver;
             --packetsToSend;  // total packets to send in the burst is now decreased
 
+            if (mPacing) {
+              AutoRecursiveLock lock(mLock);
+              if (0 != mPacedPacketsRemainingInBurst)
+                --mPacedPacketsRemainingInBurst;
+            }
+
+            if (OPENPEER_SERVICES_UDPBATCH_MAX_PACKETS == totalInBurst) {
+              if (!sendNowBurst(delegate, &(burstPackets[0]), &(burstBuffers[0]), totalInBurst, firstPacketCreated, lastPacketSent)) goto sendNowQuickExit;
+              totalInBurst = 0;
+            }
+          }
+
+          sendNowBurst(delegate, &(burstPackets[0]), &(burstBuffers[0]), totalInBurst, firstPacketCreated, lastPacketSent);
+
+          // repair packets completed by this burst follow the data they
+          // protect; they are best effort and never resent
+          RepairPacketList repairs;
+          {
             AutoRecursiveLock lock(mLock);
-            if (attemptToDeliver->mFlagForResendingInNextBurst) {
-              ZS_LOG_TRACE(log("flag for resending in next burst is set this will force an ACK next time possible"))
+            repairs.swap(mFECPendingRepairs);
+          }
 
-              get(mForceACKNextTimePossible) = true;                // we need to force an ACK when there is resent data to ensure it has arrived
-              attemptToDeliver->doNotResend(mTotalPacketsToResend); // if this was marked for resending, then clear it now since it is resent
+          QWORD repairsSent = 0;
+          for (RepairPacketList::iterator iter = repairs.begin(); iter != repairs.end(); ++iter) {
+            SecureByteBlockPtr &repair = (*iter);
+            if (!sendNowHelper(delegate, *repair, repair->SizeInBytes())) {
+              ZS_LOG_WARNING(Trace, log("unable to send FEC repair packet thus dropping remaining repairs") + ZS_PARAM("dropped", repairs.size() - static_cast<size_t>(repairsSent)))
+              break;
             }
+            ++repairsSent;
+          }
+
+          if (0 != repairsSent) {
+            AutoRecursiveLock lock(mLock);
+            mTotalFECRepairsSent += repairsSent;
           }
         } catch(IRUDPChannelStreamDelegateProxy::Exceptions::DelegateGone &) {
           AutoRecursiveLock lock(mLock);
@@ -1396,9 +1668,19 @@ namespace openpeer
       sendNowQuickExit:
         AutoRecursiveLock lock(mLock);
         if (lastPacketSent) {
-          if (lastPacketSent->mPacket) {  // make sure the packet hasn't already been released
-            // the last packet sent over the wire will hold the baton
-            lastPacketSent->consumeBaton(mAvailableBurstBatons);
+          bool burstComplete = true;
+          if (mPacing) {
+            // a paced burst only gives up its baton once all its packets are out (or there is nothing left to send)
+            ULONG writeBuffers = mSendStream ? mSendStream->getTotalReadBuffersAvailable() : 0;
+            burstComplete = (0 == mPacedPacketsRemainingInBurst) || ((0 == mTotalPacketsToResend) && (0 == writeBuffers));
+          }
+
+          if (burstComplete) {
+            mPacedPacketsRemainingInBurst = 0;
+            if (lastPacketSent->mPacket) {  // make sure the packet hasn't already been released
+              // the last packet sent over the wire will hold the baton
+              lastPacketSent->consumeBaton(mAvailableBurstBatons);
+            }
           }
         }
         sendNowCleanup();
@@ -1425,16 +1707,15 @@ namespace openpeer
           ZS_LOG_TRACE(log("already shutdown thus aborting"))
         }
 
-        handleUnfreezing();
-
         bool burstTimerRequired = false;
         bool forceACKOfSentPacketsRequired = false;
         bool ensureDataHasArrivedTimer = false;
-        bool addBatonsTimer = (!mBandwidthIncreaseFrozen) && (0 == mTotalPacketsToResend) && ((mSendingPackets.size() > 0) || (writeBuffers > 0));
+        bool addBatonsTimer = (mAddToAvailableBurstBatonsDuation > Milliseconds(0)) && (0 == mTotalPacketsToResend) && ((mSendingPackets.size() > 0) || (writeBuffers > 0));
 
-        if (0 != mAvailableBurstBatons)
+        if ((0 != mAvailableBurstBatons) ||
+            ((mPacing) && (0 != mPacedPacketsRemainingInBurst)))
         {
-          // there is available batons so the burst timer should be alive if there is data ready to send
+          // there is available batons (or a paced burst still in progress) so the burst timer should be alive if there is data ready to send
           burstTimerRequired = ((mSendingPackets.size() > 0) && (0 != mTotalPacketsToResend)) ||
                                 (writeBuffers > 0);
         }
@@ -1468,8 +1749,8 @@ namespace openpeer
             // to do it next time possible then we should see if there is
             // already an outstanding ACK require packet holding a baton
             // in which case we don't need to force an ACK immediately
-            for (BufferedPacketMap::iterator iter = mSendingPackets.begin(); iter != mSendingPackets.end(); ++iter) {
-              BufferedPacketPtr &packet = (*iter).second;
+            for (BufferedPacketRing::iterator iter = mSendingPackets.begin(); iter != mSendingPackets.end(); ++iter) {
+              BufferedPacketPtr &packet = (*iter);
 
               if ((packet->mHoldsBaton) &&
                   (packet->mRUDPPacket->isFlagSet(RUDPPacket::Flag_AR_ACKRequired)) &&
@@ -1508,16 +1789,22 @@ namespace openpeer
         }
 
         if (burstTimerRequired) {
-          if (!mBurstTimer) {
-            Duration burstDuration = mCalculatedRTT / ((int)mAvailableBurstBatons);
+          Duration burstDuration = getBurstTimerDuration();
+
+          if ((mBurstTimer) &&
+              (mPacing) &&
+              (((burstDuration * 2) < mBurstTimerDuration) || (burstDuration > (mBurstTimerDuration * 2)))) {
+            // the pacing rate has moved too far from the rate the timer was created for
+            ZS_LOG_TRACE(log("replacing pacing timer") + ZS_PARAM("timer ID", mBurstTimer->getID()) + ZS_PARAM("old duration", mBurstTimerDuration.total_milliseconds()) + ZS_PARAM("new duration", burstDuration.total_milliseconds()))
+            mBurstTimer->cancel();
+            mBurstTimer.reset();
+          }
 
-            // all available bursts should happen in one RTT
+          if (!mBurstTimer) {
+            mBurstTimerDuration = burstDuration;
             mBurstTimer = Timer::create(mThisWeak.lock(), burstDuration);
-            if (burstDuration < Milliseconds(OPENPEER_SERVICES_RUDP_MINIMUM_BURST_TIMER_IN_MILLISECONDS)) {
-              burstDuration = Milliseconds(OPENPEER_SERVICES_RUDP_MINIMUM_BURST_TIMER_IN_MILLISECONDS);
-            }
 
-            ZS_LOG_TRACE(log("creating a burst timer since there is data to send and available batons to send it") + ZS_PARAM("timer ID", mBurstTimer->getID()) + ZS_PARAM("available batons", mAvailableBurstBatons) + ZS_PARAM("write size", writeBuffers) + ZS_PARAM("sending size", mSendingPackets.size()) + ZS_PARAM("burst duration", burstDuration.total_milliseconds()) + ZS_PARAM("calculated RTT", mCalculatedRTT.total_milliseconds()))
+            ZS_LOG_TRACE(log("creating a burst timer since there is data to send and available batons to send it") + ZS_PARAM("timer ID", mBurstTimer->getID()) + ZS_PARAM("available batons", mAvailableBurstBatons) + ZS_PARAM("write size", writeBuffers) + ZS_PARAM("sending size", mSendingPackets.size()) + ZS_PARAM("burst duration", burstDuration.total_milliseconds()) + ZS_PARAM("pacing", mPacing) + ZS_PARAM("calculated RTT", mCalculatedRTT.total_milliseconds()))
           }
         } else {
           if (mBurstTimer) {
@@ -1530,12 +1817,12 @@ namespace openpeer
 
         if (ensureDataHasArrivedTimer) {
           if (!mEnsureDataHasArrivedWhenNoMoreBurstBatonsAvailableTimer) {
-            Duration ensureDuration = (mCalculatedRTT*3)/2;
+            Duration ensureDuration = getRTO();
 
-            // The timer is set to fire at 1.5 x calculated RTT
+            // The timer is set to fire at the (backed off) retransmission timeout
             mEnsureDataHasArrivedWhenNoMoreBurstBatonsAvailableTimer = Timer::create(mThisWeak.lock(), ensureDuration, false);
 
-            ZS_LOG_TRACE(log("starting ensure timer to make sure packets get acked") + ZS_PARAM("timer ID", mEnsureDataHasArrivedWhenNoMoreBurstBatonsAvailableTimer->getID()) + ZS_PARAM("available batons", mAvailableBurstBatons) + ZS_PARAM("write size", writeBuffers) + ZS_PARAM("sending size", mSendingPackets.size()) + ZS_PARAM("ensure duration", ensureDuration.total_milliseconds()) + ZS_PARAM("calculated RTT", mCalculatedRTT.total_milliseconds()))
+            ZS_LOG_TRACE(log("starting ensure timer to make sure packets get acked") + ZS_PARAM("timer ID", mEnsureDataHasArrivedWhenNoMoreBurstBatonsAvailableTimer->getID()) + ZS_PARAM("available batons", mAvailableBurstBatons) + ZS_PARAM("write size", writeBuffers) + ZS_PARAM("sending size", mSendingPackets.size()) + ZS_PARAM("ensure duration", ensureDuration.total_milliseconds()) + ZS_PARAM("calculated RTT", mCalculatedRTT.total_milliseconds()) + ZS_PARAM("RTO backoff", mRTOBackoff))
           }
         } else {
           if (mEnsureDataHasArrivedWhenNoMoreBurstBatonsAvailableTimer) {
@@ -1564,11 +1851,11 @@ namespace openpeer
         if (addBatonsTimer) {
           if (!mAddToAvailableBurstBatonsTimer) {
             mAddToAvailableBurstBatonsTimer = Timer::create(mThisWeak.lock(), mAddToAvailableBurstBatonsDuation);
-            ZS_LOG_TRACE(log("creating a new add to available batons timer") + ZS_PARAM("timer ID", mAddToAvailableBurstBatonsTimer->getID()) + ZS_PARAM("frozen", mBandwidthIncreaseFrozen) + ZS_PARAM("available batons", mAvailableBurstBatons) + ZS_PARAM("write size", writeBuffers) + ZS_PARAM("sending size", mSendingPackets.size()))
+            ZS_LOG_TRACE(log("creating a new add to available batons timer") + ZS_PARAM("timer ID", mAddToAvailableBurstBatonsTimer->getID()) + ZS_PARAM("duration milliseconds", mAddToAvailableBurstBatonsDuation.total_milliseconds()) + ZS_PARAM("available batons", mAvailableBurstBatons) + ZS_PARAM("write size", writeBuffers) + ZS_PARAM("sending size", mSendingPackets.size()))
           }
         } else {
           if (mAddToAvailableBurstBatonsTimer) {
-            ZS_LOG_TRACE(log("cancelling add to available batons timer") + ZS_PARAM("timer ID", mAddToAvailableBurstBatonsTimer->getID()) + ZS_PARAM("frozen", mBandwidthIncreaseFrozen) + ZS_PARAM("available batons", mAvailableBurstBatons) + ZS_PARAM("write size", writeBuffers) + ZS_PARAM("sending size", mSendingPackets.size()))
+            ZS_LOG_TRACE(log("cancelling add to available batons timer") + ZS_PARAM("timer ID", mAddToAvailableBurstBatonsTimer->getID()) + ZS_PARAM("duration milliseconds", mAddToAvailableBurstBatonsDuation.total_milliseconds()) + ZS_PARAM("available batons", mAvailableBurstBatons) + ZS_PARAM("write size", writeBuffers) + ZS_PARAM("sending size", mSendingPackets.size()))
             mAddToAvailableBurstBatonsTimer->cancel();
             mAddToAvailableBurstBatonsTimer.reset();
           }
@@ -1635,9 +1922,9 @@ namespace openpeer
           // we still have packets that are unacked, check to see if we can ACK them
 
           // find the gsnfr packet
-          BufferedPacketMap::iterator gsnfrIter = mSendingPackets.find(gsnfr);
-          if (gsnfrIter != mSendingPackets.end()) {
-            BufferedPacketPtr gsnfrPacket = (*gsnfrIter).second;
+          BufferedPacketPtr *gsnfrFound = mSendingPackets.find(gsnfr);
+          if (gsnfrFound) {
+            BufferedPacketPtr gsnfrPacket = (*gsnfrFound);
 
             // the parity up to now must match or there is a problem
             if (xpFlag !=  gsnfrPacket->mXORedParityToNow) {
@@ -1645,41 +1932,27 @@ namespace openpeer
             }
           }
 
-          BufferedPacketMap::iterator gsnrIter = mSendingPackets.find(gsnr);
-          if (gsnrIter != mSendingPackets.end()) {
-            BufferedPacketPtr gsnrPacket = (*gsnrIter).second;
+          BufferedPacketPtr gsnrPacket;
+          BufferedPacketPtr *gsnrFound = mSendingPackets.find(gsnr);
+          if (gsnrFound) {
+            gsnrPacket = (*gsnrFound);
 
             if (gsnrPacket->mRUDPPacket->isFlagSet(RUDPPacket::Flag_AR_ACKRequired)) {
 
-              // it might be possible to measure the RTT now, but only if this ACK was received from the first send attempt
-              if (!(gsnrPacket->mFlaggedAsFailedToReceive)) {
-                Duration oldRTT = mCalculatedRTT;
+              // it might be possible to measure the RTT now, but only if the
+              // packet went over the wire once (Karn's rule) as otherwise it is
+              // unknown which transmission is being ACKed
+              if (!(gsnrPacket->mRTTSampled)) {
+                gsnrPacket->mRTTSampled = true;
 
-                mCalculatedRTT = zsLib::now() - gsnrPacket->mTimeSentOrReceived;
+                if (1 == gsnrPacket->mTotalTimesSent) {
+                  Duration sampleRTT = zsLib::now() - gsnrPacket->mTimeSentOrReceived;
+                  updateRTT(sampleRTT);
 
-                // we have the new calculated time but we will only move halfway between the old calculation and the new one
-                if (mCalculatedRTT > oldRTT) {
-                  mCalculatedRTT = oldRTT + ((mCalculatedRTT - oldRTT) / 2);
+                  mCongestionControl->notifyRTT(sampleRTT, mCalculatedRTT);
                 } else {
-                  mCalculatedRTT = oldRTT - ((oldRTT - mCalculatedRTT) / 2);
-                }
-                if (mCalculatedRTT < mMinimumRTT)
-                  mCalculatedRTT = mMinimumRTT;
-
-                ZS_LOG_TRACE(log("calculating RTT") + ZS_PARAM("RTT milliseconds", mCalculatedRTT.total_milliseconds()))
-
-                if (mCalculatedRTT > mAddToAvailableBurstBatonsDuation) {
-                  mAddToAvailableBurstBatonsDuation = (mCalculatedRTT * 2);
-                  if (mAddToAvailableBurstBatonsTimer) {
-                    PUID oldTimerID = mAddToAvailableBurstBatonsTimer->getID();
-
-                    // replace existing timer with new timer
-                    mAddToAvailableBurstBatonsTimer->cancel();
-                    mAddToAvailableBurstBatonsTimer.reset();
-
-                    mAddToAvailableBurstBatonsTimer = Timer::create(mThisWeak.lock(), mAddToAvailableBurstBatonsDuation);
-                    ZS_LOG_TRACE(log("add to available batons timer is set too small based on calculated RTT") + ZS_PARAM("old timer ID", oldTimerID) + ZS_PARAM("new timer ID", mAddToAvailableBurstBatonsTimer->getID()) + ZS_PARAM("duration milliseconds", mAddToAvailableBurstBatonsDuation.total_milliseconds()))
-                  }
+                  ZS_LOG_TRACE(log("cannot sample RTT from ACK of resent packet") + ZS_PARAM("sequence number", sequenceToString(gsnrPacket->mSequenceNumber)) + ZS_PARAM("times sent", gsnrPacket->mTotalTimesSent))
+                  ++mTotalRTTSamplesIgnored;
                 }
               }
             }
@@ -1689,10 +1962,11 @@ namespace openpeer
           }
 
           bool hadPackets = (mSendingPackets.size() > 0);
+          ULONG totalAcked = 0;
 
           // we can now acknowledge and clean out all packets up-to and including the gsnfr packet
           while (0 != mSendingPackets.size()) {
-            BufferedPacketPtr current = (*(mSendingPackets.begin())).second;
+            BufferedPacketPtr current = mSendingPackets.front();
 
             // do not delete past the point of the gsnfr received
             if (current->mSequenceNumber > gsnfr) {
@@ -1701,14 +1975,20 @@ namespace openpeer
 
             ZS_LOG_TRACE(log("cleaning ACKed packet") + ZS_PARAM("sequence number", sequenceToString(current->mSequenceNumber)) + ZS_PARAM("GSNFR", sequenceToString(gsnfr)))
 
+            if (current->mPacket) ++totalAcked;
             current->flagAsReceivedByRemoteParty(mTotalPacketsToResend, mAvailableBurstBatons);
-            mSendingPackets.erase(mSendingPackets.begin());
+            mSendingPackets.popFront();
+          }
+
+          if (0 != totalAcked) {
+            mCongestionControl->notifyAcked(totalAcked);
+            totalAcked = 0;
           }
 
           if ((mSendingPackets.size() == 0) &&
               (hadPackets) &&
               (!ecFlag)) {
-            mTotalSendingPeriodWithoutIssues = mTotalSendingPeriodWithoutIssues + (zsLib::now() - mStartedSendingAtTime);
+            mCongestionControl->notifySendingCompleted();
             hadPackets = false;
           }
 
@@ -1730,14 +2010,14 @@ namespace openpeer
           String vectorParityField;
           bool couldNotCalculateVectorParity = false;
 
-          BufferedPacketMap::iterator iter = mSendingPackets.begin();
+          BufferedPacketRing::iterator iter = mSendingPackets.begin();
 
           while (true)
           {
             if (iter == mSendingPackets.end())
               break;
 
-            BufferedPacketPtr bufferedPacket = (*iter).second;
+            BufferedPacketPtr &bufferedPacket = (*iter);
             if (bufferedPacket->mSequenceNumber < vectorSequenceNumber) {
               ZS_LOG_TRACE(log("ignoring buffered packet because it doesn't exist in the vector"))
               // ignore the buffered packet since its not reached the vector yet...
@@ -1767,6 +2047,7 @@ namespace openpeer
 
               // mark the current packet as being received by cleaning out the original packet data (but not the packet information)
               ZS_LOG_TRACE(log("marking packet as received because of vector ACK") + ZS_PARAM("sequence number", sequenceToString(bufferedPacket->mSequenceNumber)))
+              if (bufferedPacket->mPacket) ++totalAcked;
               bufferedPacket->flagAsReceivedByRemoteParty(mTotalPacketsToResend, mAvailableBurstBatons);
             } else {
               // this packet was not received, do not remove the packet data
@@ -1776,6 +2057,7 @@ namespace openpeer
                 bufferedPacket->mFlaggedAsFailedToReceive = true;
                 bufferedPacket->flagForResending(mTotalPacketsToResend);  // since this is the first report of this packet being lost we can be sure it needs to be resent immediately
                 foundLoss = true;
+                ++mTotalPacketsReportedLost;
               }
             }
 
@@ -1786,17 +2068,21 @@ namespace openpeer
             ++vectorSequenceNumber;
           }
 
-          if (gsnrIter != mSendingPackets.end()) {
+          if (gsnrPacket) {
             // now it is time to mark the gsnr as received
-            BufferedPacketPtr gsnrPacket = (*gsnrIter).second;
             ZS_LOG_TRACE(log("marking GSNR as received in vector case") + ZS_PARAM("sequence number", sequenceToString(gsnrPacket->mSequenceNumber)))
+            if (gsnrPacket->mPacket) ++totalAcked;
             gsnrPacket->flagAsReceivedByRemoteParty(mTotalPacketsToResend, mAvailableBurstBatons);
           }
 
+          if (0 != totalAcked) {
+            mCongestionControl->notifyAcked(totalAcked);
+          }
+
           if ((mSendingPackets.size() == 0) &&
               (hadPackets) &&
               (!ecFlag)) {
-            mTotalSendingPeriodWithoutIssues = mTotalSendingPeriodWithoutIssues + (zsLib::now() - mStartedSendingAtTime);
+            mCongestionControl->notifySendingCompleted();
             hadPackets = false;
           }
 
@@ -1832,7 +2118,7 @@ namespace openpeer
 
       handleAckQuickExit:
 
-        handleUnfreezing();
+        applyCongestionControl();
 
         if (mSendingPackets.size() < 1) {
           // cancel any forced ACK if the sending size goes down to zero (since there is no longer a need to force
@@ -1845,6 +2131,9 @@ namespace openpeer
       void RUDPChannelStream::handleECN()
       {
         ZS_LOG_TRACE(log("handling ECN"))
+
+        mCongestionControl->notifyECN();
+        applyCongestionControl();
       }
 
       //-----------------------------------------------------------------------
@@ -1858,87 +2147,397 @@ namespace openpeer
       {
         ZS_LOG_TRACE(log("handle packet loss"))
 
-        bool wasFrozen = mBandwidthIncreaseFrozen;
+        mCongestionControl->notifyPacketLoss();
+        applyCongestionControl();
+      }
 
-        // freeze the increase to prevent an increase in the socket sending
-        get(mBandwidthIncreaseFrozen) = true;
-        mStartedSendingAtTime = zsLib::now();
-        mTotalSendingPeriodWithoutIssues = Milliseconds(0);
+      //-----------------------------------------------------------------------
+      void RUDPChannelStream::applyCongestionControl()
+      {
+        Duration increaseInterval = mCongestionControl->getIncreaseInterval();
+        if (increaseInterval != mAddToAvailableBurstBatonsDuation) {
+          mAddToAvailableBurstBatonsDuation = increaseInterval;
 
-        if (mAddToAvailableBurstBatonsTimer) {
-          ZS_LOG_TRACE(log("cancelling add to available burst batons due to loss") + ZS_PARAM("timer ID", mAddToAvailableBurstBatonsTimer->getID()))
-          mAddToAvailableBurstBatonsTimer->cancel();
-          mAddToAvailableBurstBatonsTimer.reset();
+          PUID oldTimerID = 0;
+
+          if (mAddToAvailableBurstBatonsTimer) {
+            // kill the adding timer since the duration has changed (its okay, it will be recreated later if still needed)
+            oldTimerID = mAddToAvailableBurstBatonsTimer->getID();
+
+            mAddToAvailableBurstBatonsTimer->cancel();
+            mAddToAvailableBurstBatonsTimer.reset();
+          }
+
+          ZS_LOG_TRACE(log("congestion control changed the increase interval") + ZS_PARAM("old add to batons timer ID", oldTimerID) + ZS_PARAM("duration milliseconds", mAddToAvailableBurstBatonsDuation.total_milliseconds()))
         }
 
-        // double the time until more batons get added
-        if (!wasFrozen) {
-          mAddToAvailableBurstBatonsDuation = mAddToAvailableBurstBatonsDuation * 2;
-          ZS_LOG_TRACE(log("increasing add to available burst batons duration") + ZS_PARAM("duration milliseconds", mAddToAvailableBurstBatonsDuation.total_milliseconds()))
+        ULONG packetsPerBurst = mCongestionControl->getPacketsPerBurst();
+        if (packetsPerBurst < 1)
+          packetsPerBurst = 1;
+
+        if (packetsPerBurst != mPacketsPerBurst) {
+          ZS_LOG_TRACE(log("congestion control changed packets per burst") + ZS_PARAM("old value", mPacketsPerBurst) + ZS_PARAM("new packets per burst", packetsPerBurst))
+          mPacketsPerBurst = packetsPerBurst;
         }
 
-        if (mPacketsPerBurst > 1) {
-          // decrease the packets per burst by half
-          ULONG wasPacketsPerBurst = mPacketsPerBurst;
-          mPacketsPerBurst = mPacketsPerBurst / 2;
-          if (mPacketsPerBurst < 1)
-            mPacketsPerBurst = 1;
-          ZS_LOG_TRACE(log("decreasing packets per burst") + ZS_PARAM("old value", wasPacketsPerBurst) + ZS_PARAM("new packets per burst", mPacketsPerBurst))
-          return;
+        ULONG totalBatons = mCongestionControl->getTotalBatons();
+        if (totalBatons < 1)
+          totalBatons = 1;
+
+        while (mTotalBurstBatons < totalBatons) {
+          ++mTotalBurstBatons;
+          ++mAvailableBurstBatons;
+          ZS_LOG_TRACE(log("creating a new sending burst baton now") + ZS_PARAM("total batons", mTotalBurstBatons) + ZS_PARAM("batons available", mAvailableBurstBatons))
+        }
+
+        while (mTotalBurstBatons > totalBatons) {
+          if (!destroyBaton()) break;
+          --mTotalBurstBatons;
         }
+      }
 
+      //-----------------------------------------------------------------------
+      bool RUDPChannelStream::destroyBaton()
+      {
         if (mAvailableBurstBatons > 1) {
           // decrease the available batons by one (to slow sending of more bursts)
           --mAvailableBurstBatons;
           ZS_LOG_TRACE(log("decreasing batons available") + ZS_PARAM("available batons", mAvailableBurstBatons))
-          return;
+          return true;
         }
 
         // we cannot destroy the last baton available
         ULONG whichBatonToDestroy = (mAvailableBurstBatons == 0 ? 1 : 0);
 
         // we must destroy a baton that is pending in the sending packets
-        for (BufferedPacketMap::iterator iter = mSendingPackets.begin(); iter != mSendingPackets.end(); ++iter) {
-          BufferedPacketPtr &packet = (*iter).second;
+        for (BufferedPacketRing::iterator iter = mSendingPackets.begin(); iter != mSendingPackets.end(); ++iter) {
+          BufferedPacketPtr &packet = (*iter);
           if (packet->mHoldsBaton) {
             if (0 == whichBatonToDestroy) {
               packet->releaseBaton(mAvailableBurstBatons);  // release the baton from being held by the packet
               --mAvailableBurstBatons;                      // destroy the baton
               ZS_LOG_TRACE(log("destroying a baton that was being held") + ZS_PARAM("available batons", mAvailableBurstBatons))
-              return;
+              return true;
             }
 
             --whichBatonToDestroy;
           }
         }
+
+        return false;
       }
 
       //-----------------------------------------------------------------------
-      void RUDPChannelStream::handleUnfreezing()
+      void RUDPChannelStream::updateRTT(Duration sample)
       {
-        if (mTotalSendingPeriodWithoutIssues > Seconds(OPENPEER_SERVICES_UNFREEZE_AFTER_SECONDS_OF_GOOD_TRANSMISSION)) {
-          get(mBandwidthIncreaseFrozen) = false;
-          mTotalSendingPeriodWithoutIssues = Milliseconds(0);
+        if (sample < Milliseconds(0))
+          sample = Milliseconds(0);
 
-          // decrease the time between adding new batons
-          mAddToAvailableBurstBatonsDuation = (mAddToAvailableBurstBatonsDuation / 2);
+        mLastRTTSample = sample;
+        ++mTotalRTTSamples;
 
-          // prevent the adding window from ever getting smaller than the RTT
-          if (mAddToAvailableBurstBatonsDuation < mCalculatedRTT)
-            mAddToAvailableBurstBatonsDuation = mCalculatedRTT;
+        if (1 == mTotalRTTSamples) {
+          mSRTT = sample;
+          mRTTVAR = sample / 2;
+        } else {
+          Duration delta = (mSRTT > sample ? mSRTT - sample : sample - mSRTT);
 
-          PUID oldTimerID = 0;
+          // RTTVAR <- 3/4 * RTTVAR + 1/4 * |SRTT - R'| (using the old SRTT)
+          // SRTT <- 7/8 * SRTT + 1/8 * R'
+          mRTTVAR = ((mRTTVAR * 3) + delta) / 4;
+          mSRTT = ((mSRTT * 7) + sample) / 8;
+        }
 
-          if (mAddToAvailableBurstBatonsTimer) {
-            // kill the adding timer since the duration has changed (its okay, it will be recreated later)
-            oldTimerID = mAddToAvailableBurstBatonsTimer->getID();
+        // RTO <- SRTT + max(G, K * RTTVAR) where K = 4
+        Duration variance = mRTTVAR * 4;
+        if (variance < Milliseconds(OPENPEER_SERVICES_RUDP_RTO_CLOCK_GRANULARITY_IN_MILLISECONDS))
+          variance = Milliseconds(OPENPEER_SERVICES_RUDP_RTO_CLOCK_GRANULARITY_IN_MILLISECONDS);
 
-            mAddToAvailableBurstBatonsTimer->cancel();
-            mAddToAvailableBurstBatonsTimer.reset();
+        mRTO = mSRTT + variance;
+        if (mRTO < Milliseconds(OPENPEER_SERVICES_RUDP_MINIMUM_RTO_IN_MILLISECONDS))
+          mRTO = Milliseconds(OPENPEER_SERVICES_RUDP_MINIMUM_RTO_IN_MILLISECONDS);
+        if (mRTO < mMinimumRTT)
+          mRTO = mMinimumRTT;
+        if (mRTO > Seconds(OPENPEER_SERVICES_RUDP_MAXIMUM_RTO_IN_SECONDS))
+          mRTO = Seconds(OPENPEER_SERVICES_RUDP_MAXIMUM_RTO_IN_SECONDS);
+
+        // a fresh sample replaces any backed off timeout
+        mRTOBackoff = 0;
+
+        mCalculatedRTT = mSRTT;
+        if (mCalculatedRTT < mMinimumRTT)
+          mCalculatedRTT = mMinimumRTT;
+
+        ZS_LOG_TRACE(log("calculating RTT") + ZS_PARAM("sample milliseconds", sample.total_milliseconds()) + ZS_PARAM("SRTT milliseconds", mSRTT.total_milliseconds()) + ZS_PARAM("RTTVAR milliseconds", mRTTVAR.total_milliseconds()) + ZS_PARAM("RTO milliseconds", mRTO.total_milliseconds()) + ZS_PARAM("RTT milliseconds", mCalculatedRTT.total_milliseconds()))
+      }
+
+      //-----------------------------------------------------------------------
+      Duration RUDPChannelStream::getRTO() const
+      {
+        Duration rto = mRTO;
+        for (ULONG backoff = 0; backoff < mRTOBackoff; ++backoff) {
+          rto = rto * 2;
+          if (rto >= Seconds(OPENPEER_SERVICES_RUDP_MAXIMUM_RTO_IN_SECONDS))
+            return Seconds(OPENPEER_SERVICES_RUDP_MAXIMUM_RTO_IN_SECONDS);
+        }
+        return rto;
+      }
+
+      //-----------------------------------------------------------------------
+      Duration RUDPChannelStream::getPacingGap() const
+      {
+        // the whole window (every baton's burst) is spread evenly across one RTT
+        ULONG window = mTotalBurstBatons * mPacketsPerBurst;
+        if (window < 1)
+          window = 1;
+        return mCalculatedRTT / ((int)window);
+      }
+
+      //-----------------------------------------------------------------------
+      Duration RUDPChannelStream::getBurstTimerDuration() const
+      {
+        if (mPacing) {
+          Duration gap = getPacingGap();
+          if (gap < Milliseconds(OPENPEER_SERVICES_RUDP_MINIMUM_PACING_TIMER_IN_MILLISECONDS))
+            gap = Milliseconds(OPENPEER_SERVICES_RUDP_MINIMUM_PACING_TIMER_IN_MILLISECONDS);
+          return gap;
+        }
+
+        // all available bursts should happen in one RTT
+        Duration burstDuration = mCalculatedRTT / ((int)(mAvailableBurstBatons > 0 ? mAvailableBurstBatons : 1));
+        if (burstDuration < Milliseconds(OPENPEER_SERVICES_RUDP_MINIMUM_BURST_TIMER_IN_MILLISECONDS))
+          burstDuration = Milliseconds(OPENPEER_SERVICES_RUDP_MINIMUM_BURST_TIMER_IN_MILLISECONDS);
+        return burstDuration;
+      }
+
+      //-----------------------------------------------------------------------
+      ULONG RUDPChannelStream::getPacedPacketsToSend()
+      {
+        Time tick = zsLib::now();
+
+        double gap = static_cast<double>(getPacingGap().total_microseconds());
+        if (gap < 1.0)
+          gap = 1.0;
+
+        if (Time() == mLastPacingTime) {
+          mPacingCredit = 1.0;
+        } else {
+          mPacingCredit += static_cast<double>((tick - mLastPacingTime).total_microseconds()) / gap;
+        }
+        mLastPacingTime = tick;
+
+        // an idle period must not build up into a burst, allow at most what
+        // one timer tick is worth (the timer can be coarser than the gap)
+        double maxCredit = (static_cast<double>(getBurstTimerDuration().total_microseconds()) / gap) + 1.0;
+        if (mPacingCredit > maxCredit)
+          mPacingCredit = maxCredit;
+
+        ULONG result = static_cast<ULONG>(mPacingCredit);
+        if (result > mPacedPacketsRemainingInBurst)
+          result = mPacedPacketsRemainingInBurst;
+
+        mPacingCredit -= static_cast<double>(result);
+        return result;
+      }
+
+      //-----------------------------------------------------------------------
+      void RUDPChannelStream::addToFECBlock(
+                                            QWORD sequenceNumber,
+                                            const RUDPPacket &packet
+                                            )
+      {
+        size_t length = packet.mDataLengthInBytes;
+        ZS_THROW_BAD_STATE_IF(length > sizeof(mFECData))
+
+        mFECFlags ^= packet.mFlags;
+        mFECDataLength = static_cast<WORD>(mFECDataLength ^ packet.mDataLengthInBytes);
+        for (size_t index = 0; index < length; ++index) {
+          mFECData[index] ^= packet.mData[index];
+        }
+        if (length > mFECMaxDataLength)
+          mFECMaxDataLength = length;
+
+        mFECLastSequenceNumber = sequenceNumber;
+        ++mFECPacketsInBlock;
+
+        if (mFECPacketsInBlock >= mFECBlockSize)
+          finalizeFECBlock();
+      }
+
+      //-----------------------------------------------------------------------
+      void RUDPChannelStream::finalizeFECBlock()
+      {
+        if (0 == mFECPacketsInBlock) return;
+
+        // the repair packet's data is a small header followed by the XOR of
+        // the data of every packet in the block (shorter data is treated as
+        // zero padded), i.e.
+        //   [0]    - total packets in the block (ending at the sequence number)
+        //   [1]    - XOR of the flags of the packets
+        //   [2..3] - XOR of the data lengths of the packets (network order)
+        BYTE temp[OPENPEER_SERVICES_RUDP_FEC_REPAIR_HEADER_LENGTH_IN_BYTES + sizeof(mFECData)];
+        temp[0] = static_cast<BYTE>(mFECPacketsInBlock);
+        temp[1] = mFECFlags;
+        temp[2] = static_cast<BYTE>((mFECDataLength >> 8) & 0xFF);
+        temp[3] = static_cast<BYTE>(mFECDataLength & 0xFF);
+        memcpy(&(temp[OPENPEER_SERVICES_RUDP_FEC_REPAIR_HEADER_LENGTH_IN_BYTES]), &(mFECData[0]), mFECMaxDataLength);
+
+        RUDPPacketPtr repair = RUDPPacket::create();
+        repair->setSequenceNumber(mFECLastSequenceNumber);
+        repair->setGSN(mGSNR, mGSNFR);
+        repair->mChannelNumber = mSendingChannelNumber;
+        repair->setFlag(RUDPPacket::Flag_FR_FECRepair);
+        repair->mData = &(temp[0]);
+        repair->mDataLengthInBytes = static_cast<WORD>(OPENPEER_SERVICES_RUDP_FEC_REPAIR_HEADER_LENGTH_IN_BYTES + mFECMaxDataLength);
+
+        SecureByteBlockPtr packetizedBuffer = repair->packetize();
+        ZS_THROW_BAD_STATE_IF(!packetizedBuffer)
+
+        ZS_LOG_TRACE(log("FEC repair packet created") + ZS_PARAM("last sequence number", sequenceToString(mFECLastSequenceNumber)) + ZS_PARAM("packets in block", mFECPacketsInBlock) + ZS_PARAM("packet size", packetizedBuffer->SizeInBytes()))
+
+        mFECPendingRepairs.push_back(packetizedBuffer);
+
+        memset(&(mFECData[0]), 0, mFECMaxDataLength);
+        mFECPacketsInBlock = 0;
+        mFECFlags = 0;
+        mFECDataLength = 0;
+        mFECMaxDataLength = 0;
+      }
+
+      //-----------------------------------------------------------------------
+      bool RUDPChannelStream::handleFECRepair(
+                                              QWORD lastSequenceNumber,
+                                              RUDPPacketPtr repair,
+                                              bool &outACKRequired
+                                              )
+      {
+        ++mTotalFECRepairsReceived;
+
+        if (0 == mFECBlockSize) {
+          ZS_LOG_WARNING(Debug, log("received FEC repair packet but FEC was not negotiated") + ZS_PARAM("last sequence number", sequenceToString(lastSequenceNumber)))
+          return false;
+        }
+
+        if ((NULL == repair->mData) ||
+            (repair->mDataLengthInBytes < OPENPEER_SERVICES_RUDP_FEC_REPAIR_HEADER_LENGTH_IN_BYTES)) {
+          ZS_LOG_WARNING(Debug, log("received FEC repair packet which is too small") + ZS_PARAM("size", repair->mDataLengthInBytes))
+          return false;
+        }
+
+        const BYTE *header = repair->mData;
+        const BYTE *repairData = header + OPENPEER_SERVICES_RUDP_FEC_REPAIR_HEADER_LENGTH_IN_BYTES;
+        size_t repairLength = repair->mDataLengthInBytes - OPENPEER_SERVICES_RUDP_FEC_REPAIR_HEADER_LENGTH_IN_BYTES;
+
+        QWORD totalInBlock = header[0];
+        BYTE flags = header[1];
+        WORD dataLength = static_cast<WORD>((static_cast<WORD>(header[2]) << 8) | header[3]);
+
+        if ((0 == totalInBlock) ||
+            (totalInBlock > mFECBlockSize) ||
+            (totalInBlock > lastSequenceNumber)) {
+          ZS_LOG_WARNING(Debug, log("received FEC repair packet with an illegal block size") + ZS_PARAM("packets in block", totalInBlock) + ZS_PARAM("fec block size", mFECBlockSize))
+          return false;
+        }
+
+        if (lastSequenceNumber <= mGSNFR) {
+          ZS_LOG_TRACE(log("FEC repair packet ignored as whole block already received") + ZS_PARAM("last sequence number", sequenceToString(lastSequenceNumber)) + ZS_PARAM("GSNFR", sequenceToString(mGSNFR)))
+          return false;
+        }
+
+        if (lastSequenceNumber > (mGSNR + OPENPEER_SERVICES_MAX_WINDOW_TO_NEXT_SEQUENCE_NUMBER)) {
+          ZS_LOG_WARNING(Debug, log("received FEC repair packet beyond allowed window") + ZS_PARAM("GSNR", sequenceToString(mGSNR)) + ZS_PARAM("last sequence number", sequenceToString(lastSequenceNumber)))
+          return false;
+        }
+
+        QWORD firstSequenceNumber = lastSequenceNumber - totalInBlock + 1;
+
+        QWORD missingSequenceNumber = 0;
+        ULONG totalMissing = 0;
+        ULONG totalUnavailable = 0;
+
+        for (QWORD sequenceNumber = firstSequenceNumber; sequenceNumber <= lastSequenceNumber; ++sequenceNumber) {
+          if (mReceivedPackets.find(sequenceNumber)) continue;
+          if (sequenceNumber <= mGSNFR) {
+            if (!mFECDeliveredPackets.find(sequenceNumber)) ++totalUnavailable;   // delivered but no longer remembered
+            continue;
+          }
+          missingSequenceNumber = sequenceNumber;
+          ++totalMissing;
+        }
+
+        if (0 == totalMissing) {
+          ZS_LOG_TRACE(log("FEC repair packet not needed as no packet in block is missing") + ZS_PARAM("first sequence number", sequenceToString(firstSequenceNumber)) + ZS_PARAM("last sequence number", sequenceToString(lastSequenceNumber)))
+          return false;
+        }
+
+        if ((1 != totalMissing) ||
+            (0 != totalUnavailable)) {
+          ZS_LOG_DEBUG(log("FEC repair packet cannot rebuild block") + ZS_PARAM("first sequence number", sequenceToString(firstSequenceNumber)) + ZS_PARAM("last sequence number", sequenceToString(lastSequenceNumber)) + ZS_PARAM("missing", totalMissing) + ZS_PARAM("unavailable", totalUnavailable))
+          ++mTotalFECBlocksUnrecoverable;
+          return false;
+        }
+
+        // XOR every other packet of the block out of the repair data to leave the missing packet behind
+        PacketBufferPtr buffer = PacketBufferPool::allocate(repairLength > 0 ? repairLength : 1);
+        BYTE *data = buffer->data();
+        memcpy(data, repairData, repairLength);
+
+        for (QWORD sequenceNumber = firstSequenceNumber; sequenceNumber <= lastSequenceNumber; ++sequenceNumber) {
+          if (sequenceNumber == missingSequenceNumber) continue;
+
+          BufferedPacketPtr *found = mReceivedPackets.find(sequenceNumber);
+          if (!found) found = mFECDeliveredPackets.find(sequenceNumber);
+          ZS_THROW_BAD_STATE_IF(!found)
+
+          RUDPPacketPtr &packet = (*found)->mRUDPPacket;
+          size_t length = packet->mDataLengthInBytes;
+          if (length > repairLength) {
+            ZS_LOG_WARNING(Debug, log("FEC repair packet is smaller than a packet in its block") + ZS_PARAM("sequence number", sequenceToString(sequenceNumber)) + ZS_PARAM("size", length) + ZS_PARAM("repair size", repairLength))
+            ++mTotalFECBlocksUnrecoverable;
+            return false;
+          }
+
+          flags ^= packet->mFlags;
+          dataLength = static_cast<WORD>(dataLength ^ packet->mDataLengthInBytes);
+          for (size_t index = 0; index < length; ++index) {
+            data[index] ^= packet->mData[index];
           }
+        }
+
+        if (dataLength > repairLength) {
+          ZS_LOG_WARNING(Debug, log("FEC repair packet rebuilt an impossible data length") + ZS_PARAM("length", dataLength) + ZS_PARAM("repair size", repairLength))
+          ++mTotalFECBlocksUnrecoverable;
+          return false;
+        }
 
-          ZS_LOG_TRACE(log("good period of transmission without issue thus unfreezing/increasing baton adding frequency") + ZS_PARAM("old add to batons timer ID", oldTimerID) + ZS_PARAM("duration milliseconds", mAddToAvailableBurstBatonsDuation.total_milliseconds()))
+        RUDPPacketPtr recovered = RUDPPacket::create();
+        recovered->mChannelNumber = repair->mChannelNumber;
+        recovered->setSequenceNumber(missingSequenceNumber);
+        recovered->mFlags = static_cast<BYTE>(flags & (RUDPPacket::Flag_PS_ParitySending | RUDPPacket::Flag_EC_ECNPacket | RUDPPacket::Flag_AR_ACKRequired));   // the ACK related flags of the lost packet are not needed
+        recovered->mData = (0 != dataLength ? data : NULL);
+        recovered->mDataLengthInBytes = dataLength;
+
+        BufferedPacketPtr bufferedPacket = BufferedPacket::create();
+        bufferedPacket->mSequenceNumber = missingSequenceNumber;
+        bufferedPacket->mRUDPPacket = recovered;
+        bufferedPacket->mReceivedBuffer = buffer;
+
+        mReceivedPackets.insert(missingSequenceNumber, bufferedPacket);
+        if (missingSequenceNumber > mGSNR) {
+          mGSNR = missingSequenceNumber;
+          get(mGSNRParity) = recovered->isFlagSet(RUDPPacket::Flag_PS_ParitySending);
         }
+
+        if (missingSequenceNumber >= mWaitToSendUntilReceivedRemoteSequenceNumber)
+          get(mWaitToSendUntilReceivedRemoteSequenceNumber) = 0;
+
+        ++mTotalFECPacketsRecovered;
+        outACKRequired = recovered->isFlagSet(RUDPPacket::Flag_AR_ACKRequired);
+
+        ZS_LOG_DEBUG(log("rebuilt lost packet from FEC repair packet") + ZS_PARAM("sequence number", sequenceToString(missingSequenceNumber)) + ZS_PARAM("size", dataLength) + ZS_PARAM("GSNR", sequenceToString(mGSNR)) + ZS_PARAM("GSNFR", sequenceToString(mGSNFR)))
+
+        deliverReadPackets();
+        return true;
       }
 
       //-----------------------------------------------------------------------
@@ -1949,8 +2548,7 @@ namespace openpeer
 
         // see how many packets we can confirm as received
         while (mReceivedPackets.size() > 0) {
-          BufferedPacketMap::iterator iter = mReceivedPackets.begin();
-          BufferedPacketPtr bufferedPacket = (*iter).second;
+          BufferedPacketPtr bufferedPacket = mReceivedPackets.front();
 
           // can only process the next if the packet is the next in the ordered series
           if (bufferedPacket->mSequenceNumber != (mGSNFR+1))
@@ -1986,8 +2584,19 @@ namespace openpeer
           mGSNFR = bufferedPacket->mSequenceNumber;
           get(mXORedParityToGSNFR) = internal::logicalXOR(mXORedParityToGSNFR, bufferedPacket->mRUDPPacket->isFlagSet(RUDPPacket::Flag_PS_ParitySending));
 
+          if (0 != mFECBlockSize) {
+            // a repair packet may still need this packet to rebuild a later packet of the same block
+            mFECDeliveredPackets.insert(bufferedPacket->mSequenceNumber, bufferedPacket);
+          }
+
           // the front packet can now be removed
-          mReceivedPackets.erase(iter);
+          mReceivedPackets.popFront();
+        }
+
+        // a block never spans more than the block size so older delivered packets are no longer needed
+        while ((mFECDeliveredPackets.size() > 0) &&
+               ((mFECDeliveredPackets.front()->mSequenceNumber + mFECBlockSize) <= mGSNFR)) {
+          mFECDeliveredPackets.popFront();
         }
 
         if (delivered) {
@@ -2094,6 +2703,8 @@ namespace openpeer
         pThis->mXORedParityToNow = false;
         pThis->mHoldsBaton = false;
         pThis->mFlaggedAsFailedToReceive = false;
+        pThis->mTotalTimesSent = 0;
+        pThis->mRTTSampled = false;
         pThis->mFlagForResendingInNextBurst = false;
         return pThis;
       }
@@ -0,0 +1,471 @@
+/*
+
+ Copyright (c) 2013, SMB Phone Inc.
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+
+ 1. Redistributions of source code must retain the above copyright notice, this
+ list of conditions and the following disclaimer.
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ The views and conclusions contained in the software and documentation are those
+ of the authors and should not be interpreted as representing official policies,
+ either expressed or implied, of the FreeBSD Project.
+
+ */
+
+
+#include <openpeer/services/internal/services_RUDPCongestionControl.h>
+
+#include <openpeer/services/IHelper.h>
+#include <openpeer/services/ISettings.h>
+
+#include <zsLib/XML.h>
+
+#include <stdlib.h>
+
+#define OPENPEER_SERVICES_RUDP_TCP_LIKE_DEFAULT_PACKETS_PER_BURST (3)
+#define OPENPEER_SERVICES_RUDP_TCP_LIKE_UNFREEZE_AFTER_SECONDS_OF_GOOD_TRANSMISSION (10)
+
+#define OPENPEER_SERVICES_RUDP_DELAY_BASED_DEFAULT_TARGET_DELAY_IN_MILLISECONDS (100)
+#define OPENPEER_SERVICES_RUDP_DELAY_BASED_INITIAL_WINDOW_IN_PACKETS (3)
+#define OPENPEER_SERVICES_RUDP_DELAY_BASED_MINIMUM_WINDOW_IN_PACKETS (2)
+#define OPENPEER_SERVICES_RUDP_DELAY_BASED_MAXIMUM_WINDOW_IN_PACKETS (256)
+#define OPENPEER_SERVICES_RUDP_DELAY_BASED_GAIN (1.0)
+#define OPENPEER_SERVICES_RUDP_DELAY_BASED_RANDOM_LOSS_DECREASE (0.875)
+#define OPENPEER_SERVICES_RUDP_DELAY_BASED_PACKETS_PER_BATON (4)
+#define OPENPEER_SERVICES_RUDP_DELAY_BASED_MINIMUM_BURST_INTERVAL_IN_MILLISECONDS (20)
+#define OPENPEER_SERVICES_RUDP_DELAY_BASED_BASE_DELAY_INTERVAL_IN_SECONDS (60)
+
+namespace openpeer { namespace services { ZS_DECLARE_SUBSYSTEM(openpeer_services_rudp) } }
+
+namespace openpeer
+{
+  namespace services
+  {
+    namespace internal
+    {
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      #pragma mark
+      #pragma mark IRUDPCongestionControl
+      #pragma mark
+
+      //-----------------------------------------------------------------------
+      bool IRUDPCongestionControl::isSupported(CongestionAlgorithms algorithm)
+      {
+        switch (algorithm) {
+          case IRUDPChannel::CongestionAlgorithm_TCPLikeWindowWithSlowCreepUp:      return true;
+          case IRUDPChannel::CongestionAlgorithm_DelayBasedWindowWithLowExtraDelay: return true;
+          default:                                                                  break;
+        }
+        return false;
+      }
+
+      //-----------------------------------------------------------------------
+      IRUDPCongestionControlPtr IRUDPCongestionControl::create(
+                                                               CongestionAlgorithms algorithm,
+                                                               Duration calculatedRTT
+                                                               )
+      {
+        switch (algorithm) {
+          case IRUDPChannel::CongestionAlgorithm_DelayBasedWindowWithLowExtraDelay: return IRUDPCongestionControlPtr(new RUDPDelayBasedCongestionControl(calculatedRTT));
+          default:                                                                  break;
+        }
+        return IRUDPCongestionControlPtr(new RUDPTCPLikeCongestionControl(calculatedRTT));
+      }
+
+      //-----------------------------------------------------------------------
+      ElementPtr IRUDPCongestionControl::toDebug(IRUDPCongestionControlPtr control)
+      {
+        if (!control) return ElementPtr();
+        return control->toDebug();
+      }
+
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      #pragma mark
+      #pragma mark RUDPTCPLikeCongestionControl
+      #pragma mark
+
+      //-----------------------------------------------------------------------
+      RUDPTCPLikeCongestionControl::RUDPTCPLikeCongestionControl(Duration calculatedRTT) :
+        mTotalBatons(1),
+        mPacketsPerBurst(OPENPEER_SERVICES_RUDP_TCP_LIKE_DEFAULT_PACKETS_PER_BURST),
+        mCalculatedRTT(calculatedRTT),
+        mIncreaseInterval(calculatedRTT),
+        mIncreaseFrozen(false),
+        mStartedSendingAtTime(zsLib::now()),
+        mTotalSendingPeriodWithoutIssues(Milliseconds(0))
+      {
+      }
+
+      //-----------------------------------------------------------------------
+      ElementPtr RUDPTCPLikeCongestionControl::toDebug() const
+      {
+        ElementPtr resultEl = Element::create("RUDPTCPLikeCongestionControl");
+
+        IHelper::debugAppend(resultEl, "algorithm", IRUDPChannel::toString(getAlgorithm()));
+        IHelper::debugAppend(resultEl, "total batons", mTotalBatons);
+        IHelper::debugAppend(resultEl, "packets per burst", mPacketsPerBurst);
+        IHelper::debugAppend(resultEl, "calculated RTT (ms)", mCalculatedRTT);
+        IHelper::debugAppend(resultEl, "increase interval (ms)", mIncreaseInterval);
+        IHelper::debugAppend(resultEl, "increase frozen", mIncreaseFrozen);
+        IHelper::debugAppend(resultEl, "started sending time", mStartedSendingAtTime);
+        IHelper::debugAppend(resultEl, "total sending period without issues (ms)", mTotalSendingPeriodWithoutIssues);
+
+        return resultEl;
+      }
+
+      //-----------------------------------------------------------------------
+      Duration RUDPTCPLikeCongestionControl::getIncreaseInterval() const
+      {
+        if (mIncreaseFrozen) return Duration();
+        return mIncreaseInterval;
+      }
+
+      //-----------------------------------------------------------------------
+      void RUDPTCPLikeCongestionControl::notifyIncreaseInterval()
+      {
+        if (0 == (rand()%2)) {
+          ++mTotalBatons;
+          ZS_LOG_TRACE(log("creating a new sending burst baton now") + ZS_PARAM("total batons", mTotalBatons))
+        } else {
+          ++mPacketsPerBurst;
+          ZS_LOG_TRACE(log("increasing the packets per burst") + ZS_PARAM("packets per burst", mPacketsPerBurst))
+        }
+      }
+
+      //-----------------------------------------------------------------------
+      void RUDPTCPLikeCongestionControl::notifySendingStarted()
+      {
+        mStartedSendingAtTime = zsLib::now();
+      }
+
+      //-----------------------------------------------------------------------
+      void RUDPTCPLikeCongestionControl::notifySendingCompleted()
+      {
+        mTotalSendingPeriodWithoutIssues = mTotalSendingPeriodWithoutIssues + (zsLib::now() - mStartedSendingAtTime);
+        handleUnfreezing();
+      }
+
+      //-----------------------------------------------------------------------
+      void RUDPTCPLikeCongestionControl::notifyRTT(
+                                                   Duration sample,
+                                                   Duration calculatedRTT
+                                                   )
+      {
+        mCalculatedRTT = calculatedRTT;
+
+        if (mCalculatedRTT > mIncreaseInterval) {
+          mIncreaseInterval = (mCalculatedRTT * 2);
+          ZS_LOG_TRACE(log("increase interval is too small based on calculated RTT") + ZS_PARAM("interval milliseconds", mIncreaseInterval.total_milliseconds()))
+        }
+      }
+
+      //-----------------------------------------------------------------------
+      void RUDPTCPLikeCongestionControl::notifyPacketLoss()
+      {
+        bool wasFrozen = mIncreaseFrozen;
+
+        // freeze the increase to prevent an increase in the socket sending
+        mIncreaseFrozen = true;
+        mStartedSendingAtTime = zsLib::now();
+        mTotalSendingPeriodWithoutIssues = Milliseconds(0);
+
+        // double the time until the window increases again
+        if (!wasFrozen) {
+          mIncreaseInterval = mIncreaseInterval * 2;
+          ZS_LOG_TRACE(log("increasing increase interval") + ZS_PARAM("interval milliseconds", mIncreaseInterval.total_milliseconds()))
+        }
+
+        if (mPacketsPerBurst > 1) {
+          // decrease the packets per burst by half
+          ULONG wasPacketsPerBurst = mPacketsPerBurst;
+          mPacketsPerBurst = mPacketsPerBurst / 2;
+          ZS_LOG_TRACE(log("decreasing packets per burst") + ZS_PARAM("old value", wasPacketsPerBurst) + ZS_PARAM("new packets per burst", mPacketsPerBurst))
+          return;
+        }
+
+        // we cannot destroy the last baton
+        if (mTotalBatons > 1) {
+          --mTotalBatons;
+          ZS_LOG_TRACE(log("decreasing total batons") + ZS_PARAM("total batons", mTotalBatons))
+        }
+      }
+
+      //-----------------------------------------------------------------------
+      void RUDPTCPLikeCongestionControl::notifyECN()
+      {
+        // ECN marks are reported but have never reduced this algorithm's window
+      }
+
+      //-----------------------------------------------------------------------
+      Log::Params RUDPTCPLikeCongestionControl::log(const char *message) const
+      {
+        ElementPtr objectEl = Element::create("RUDPTCPLikeCongestionControl");
+        return Log::Params(message, objectEl);
+      }
+
+      //-----------------------------------------------------------------------
+      void RUDPTCPLikeCongestionControl::handleUnfreezing()
+      {
+        if (mTotalSendingPeriodWithoutIssues <= Seconds(OPENPEER_SERVICES_RUDP_TCP_LIKE_UNFREEZE_AFTER_SECONDS_OF_GOOD_TRANSMISSION)) return;
+
+        mIncreaseFrozen = false;
+        mTotalSendingPeriodWithoutIssues = Milliseconds(0);
+
+        // decrease the time between increases
+        mIncreaseInterval = (mIncreaseInterval / 2);
+
+        // prevent the increase interval from ever getting smaller than the RTT
+        if (mIncreaseInterval < mCalculatedRTT)
+          mIncreaseInterval = mCalculatedRTT;
+
+        ZS_LOG_TRACE(log("good period of transmission without issue thus unfreezing/increasing increase frequency") + ZS_PARAM("interval milliseconds", mIncreaseInterval.total_milliseconds()))
+      }
+
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      #pragma mark
+      #pragma mark RUDPDelayBasedCongestionControl
+      #pragma mark
+
+      //-----------------------------------------------------------------------
+      RUDPDelayBasedCongestionControl::RUDPDelayBasedCongestionControl(Duration calculatedRTT) :
+        mWindow(OPENPEER_SERVICES_RUDP_DELAY_BASED_INITIAL_WINDOW_IN_PACKETS),
+        mSlowStart(true),
+        mTargetDelay(Milliseconds(ISettings::getUInt(OPENPEER_SERVICES_SETTING_RUDP_DELAY_BASED_TARGET_DELAY_IN_MILLISECONDS))),
+        mCalculatedRTT(calculatedRTT),
+        mCurrentDelayPos(0),
+        mTotalCurrentDelays(0),
+        mBaseDelayPos(0),
+        mTotalBaseDelays(0),
+        mTotalCongestionDecreases(0),
+        mTotalRandomLossDecreases(0)
+      {
+        if (mTargetDelay <= Milliseconds(0)) {
+          mTargetDelay = Milliseconds(OPENPEER_SERVICES_RUDP_DELAY_BASED_DEFAULT_TARGET_DELAY_IN_MILLISECONDS);
+        }
+      }
+
+      //-----------------------------------------------------------------------
+      ElementPtr RUDPDelayBasedCongestionControl::toDebug() const
+      {
+        ElementPtr resultEl = Element::create("RUDPDelayBasedCongestionControl");
+
+        IHelper::debugAppend(resultEl, "algorithm", IRUDPChannel::toString(getAlgorithm()));
+        IHelper::debugAppend(resultEl, "window (packets)", mWindow);
+        IHelper::debugAppend(resultEl, "slow start", mSlowStart);
+        IHelper::debugAppend(resultEl, "total batons", getTotalBatons());
+        IHelper::debugAppend(resultEl, "packets per burst", getPacketsPerBurst());
+        IHelper::debugAppend(resultEl, "target delay (ms)", mTargetDelay);
+        IHelper::debugAppend(resultEl, "calculated RTT (ms)", mCalculatedRTT);
+        IHelper::debugAppend(resultEl, "current delay (ms)", getCurrentDelay());
+        IHelper::debugAppend(resultEl, "base delay (ms)", getBaseDelay());
+        IHelper::debugAppend(resultEl, "queuing delay (ms)", getQueuingDelay());
+        IHelper::debugAppend(resultEl, "last decrease", mLastDecrease);
+        IHelper::debugAppend(resultEl, "congestion decreases", mTotalCongestionDecreases);
+        IHelper::debugAppend(resultEl, "random loss decreases", mTotalRandomLossDecreases);
+
+        return resultEl;
+      }
+
+      //-----------------------------------------------------------------------
+      ULONG RUDPDelayBasedCongestionControl::getTotalBatons() const
+      {
+        ULONG window = static_cast<ULONG>(mWindow);
+
+        ULONG batons = window / OPENPEER_SERVICES_RUDP_DELAY_BASED_PACKETS_PER_BATON;
+
+        // every baton is a burst spread across one RTT so do not use more
+        // batons than there are burst intervals in an RTT
+        ULONG maxBatons = static_cast<ULONG>(mCalculatedRTT.total_milliseconds() / OPENPEER_SERVICES_RUDP_DELAY_BASED_MINIMUM_BURST_INTERVAL_IN_MILLISECONDS);
+        if (batons > maxBatons) batons = maxBatons;
+
+        return (batons > 0 ? batons : 1);
+      }
+
+      //-----------------------------------------------------------------------
+      ULONG RUDPDelayBasedCongestionControl::getPacketsPerBurst() const
+      {
+        ULONG window = static_cast<ULONG>(mWindow);
+        ULONG batons = getTotalBatons();
+        ULONG result = (window + batons - 1) / batons;
+        return (result > 0 ? result : 1);
+      }
+
+      //-----------------------------------------------------------------------
+      void RUDPDelayBasedCongestionControl::notifyAcked(ULONG totalPackets)
+      {
+        if (0 == totalPackets) return;
+
+        double offTarget = 1.0;
+        if (hasDelaySamples()) {
+          double target = static_cast<double>(mTargetDelay.total_milliseconds());
+          double queuing = static_cast<double>(getQueuingDelay().total_milliseconds());
+
+          // the queue is building, leave slow start
+          if (queuing * 2 >= target) mSlowStart = false;
+
+          offTarget = (target - queuing) / target;
+          if (offTarget < -1.0) offTarget = -1.0;
+        }
+
+        if (mSlowStart) {
+          mWindow += static_cast<double>(totalPackets);
+        } else {
+          mWindow += (OPENPEER_SERVICES_RUDP_DELAY_BASED_GAIN * offTarget * static_cast<double>(totalPackets)) / mWindow;
+        }
+
+        if (mWindow < OPENPEER_SERVICES_RUDP_DELAY_BASED_MINIMUM_WINDOW_IN_PACKETS) mWindow = OPENPEER_SERVICES_RUDP_DELAY_BASED_MINIMUM_WINDOW_IN_PACKETS;
+        if (mWindow > OPENPEER_SERVICES_RUDP_DELAY_BASED_MAXIMUM_WINDOW_IN_PACKETS) mWindow = OPENPEER_SERVICES_RUDP_DELAY_BASED_MAXIMUM_WINDOW_IN_PACKETS;
+      }
+
+      //-----------------------------------------------------------------------
+      void RUDPDelayBasedCongestionControl::notifyRTT(
+                                                      Duration sample,
+                                                      Duration calculatedRTT
+                                                      )
+      {
+        mCalculatedRTT = calculatedRTT;
+
+        if (sample <= Milliseconds(0)) return;
+
+        mCurrentDelays[mCurrentDelayPos] = sample;
+        mCurrentDelayPos = (mCurrentDelayPos + 1) % OPENPEER_SERVICES_RUDP_DELAY_BASED_CURRENT_DELAY_SAMPLES;
+        if (mTotalCurrentDelays < OPENPEER_SERVICES_RUDP_DELAY_BASED_CURRENT_DELAY_SAMPLES) ++mTotalCurrentDelays;
+
+        // the base delay keeps the lowest delay seen per interval so a route
+        // change to a longer path is eventually accepted as the new base
+        Time tick = zsLib::now();
+        if (0 == mTotalBaseDelays) {
+          mBaseDelayPos = 0;
+          mBaseDelays[mBaseDelayPos] = sample;
+          mTotalBaseDelays = 1;
+          mBaseDelayMinuteStarted = tick;
+          return;
+        }
+
+        if (tick >= mBaseDelayMinuteStarted + Seconds(OPENPEER_SERVICES_RUDP_DELAY_BASED_BASE_DELAY_INTERVAL_IN_SECONDS)) {
+          mBaseDelayPos = (mBaseDelayPos + 1) % OPENPEER_SERVICES_RUDP_DELAY_BASED_BASE_DELAY_HISTORY;
+          mBaseDelays[mBaseDelayPos] = sample;
+          if (mTotalBaseDelays < OPENPEER_SERVICES_RUDP_DELAY_BASED_BASE_DELAY_HISTORY) ++mTotalBaseDelays;
+          mBaseDelayMinuteStarted = tick;
+          return;
+        }
+
+        if (sample < mBaseDelays[mBaseDelayPos]) mBaseDelays[mBaseDelayPos] = sample;
+      }
+
+      //-----------------------------------------------------------------------
+      void RUDPDelayBasedCongestionControl::notifyPacketLoss()
+      {
+        // a loss while the queue is building is congestion, a loss with an
+        // (almost) empty queue is most likely random loss on the path
+        bool congestion = (!hasDelaySamples()) || (getQueuingDelay() * 2 >= mTargetDelay);
+
+        if (congestion) {
+          if (decrease(0.5, "congestion loss")) ++mTotalCongestionDecreases;
+          return;
+        }
+
+        if (decrease(OPENPEER_SERVICES_RUDP_DELAY_BASED_RANDOM_LOSS_DECREASE, "random loss")) ++mTotalRandomLossDecreases;
+      }
+
+      //-----------------------------------------------------------------------
+      void RUDPDelayBasedCongestionControl::notifyECN()
+      {
+        if (decrease(0.5, "ECN")) ++mTotalCongestionDecreases;
+      }
+
+      //-----------------------------------------------------------------------
+      Log::Params RUDPDelayBasedCongestionControl::log(const char *message) const
+      {
+        ElementPtr objectEl = Element::create("RUDPDelayBasedCongestionControl");
+        return Log::Params(message, objectEl);
+      }
+
+      //-----------------------------------------------------------------------
+      Duration RUDPDelayBasedCongestionControl::getCurrentDelay() const
+      {
+        if (0 == mTotalCurrentDelays) return Duration();
+
+        Duration result = mCurrentDelays[0];
+        for (size_t index = 1; index < mTotalCurrentDelays; ++index) {
+          if (mCurrentDelays[index] < result) result = mCurrentDelays[index];
+        }
+        return result;
+      }
+
+      //-----------------------------------------------------------------------
+      Duration RUDPDelayBasedCongestionControl::getBaseDelay() const
+      {
+        if (0 == mTotalBaseDelays) return Duration();
+
+        Duration result = mBaseDelays[0];
+        for (size_t index = 1; index < mTotalBaseDelays; ++index) {
+          if (mBaseDelays[index] < result) result = mBaseDelays[index];
+        }
+        return result;
+      }
+
+      //-----------------------------------------------------------------------
+      Duration RUDPDelayBasedCongestionControl::getQueuingDelay() const
+      {
+        Duration current = getCurrentDelay();
+        Duration base = getBaseDelay();
+        if (current <= base) return Duration();
+        return current - base;
+      }
+
+      //-----------------------------------------------------------------------
+      bool RUDPDelayBasedCongestionControl::decrease(
+                                                     double factor,
+                                                     const char *reason
+                                                     )
+      {
+        Time tick = zsLib::now();
+
+        // only react once per RTT since every loss of the same window is
+        // reported separately
+        if ((Time() != mLastDecrease) &&
+            (tick < mLastDecrease + mCalculatedRTT)) {
+          ZS_LOG_TRACE(log("window already decreased within the last RTT") + ZS_PARAM("reason", reason) + ZS_PARAM("window", mWindow))
+          return false;
+        }
+
+        mLastDecrease = tick;
+        mSlowStart = false;
+
+        double wasWindow = mWindow;
+        mWindow = mWindow * factor;
+        if (mWindow < OPENPEER_SERVICES_RUDP_DELAY_BASED_MINIMUM_WINDOW_IN_PACKETS) mWindow = OPENPEER_SERVICES_RUDP_DELAY_BASED_MINIMUM_WINDOW_IN_PACKETS;
+
+        ZS_LOG_TRACE(log("decreasing window") + ZS_PARAM("reason", reason) + ZS_PARAM("old window", wasWindow) + ZS_PARAM("window", mWindow) + ZS_PARAM("queuing delay (ms)", getQueuingDelay().total_milliseconds()))
+        return true;
+      }
+    }
+  }
+}
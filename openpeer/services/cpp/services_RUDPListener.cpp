@@ -31,11 +31,14 @@
 
 #include <openpeer/services/internal/services_RUDPListener.h>
 #include <openpeer/services/internal/services_RUDPChannel.h>
+#include <openpeer/services/internal/services_SocketEventBackend.h>
+#include <openpeer/services/internal/services_UDPBatch.h>
 #include <openpeer/services/STUNPacket.h>
 #include <openpeer/services/RUDPPacket.h>
 #include <openpeer/services/ISTUNRequesterManager.h>
 #include <openpeer/services/IICESocket.h>
 #include <openpeer/services/IHelper.h>
+#include <openpeer/services/ISettings.h>
 
 #include <zsLib/Exception.h>
 #include <zsLib/helpers.h>
@@ -55,8 +58,6 @@
 
 #include <algorithm>
 
-#define OPENPEER_SERVICES_RUDPLISTENER_RECYCLE_BUFFER_SIZE (1 << (sizeof(WORD)*8))
-#define OPENPEER_SERVICES_RUDPLISTENER_MAX_RECYLCE_BUFFERS (100)
 
 #define OPENPEER_SERVICES_RUDPLISTENER_MAX_NONCE_LIFETIME_IN_SECONDS (5*60)
 
@@ -214,6 +215,7 @@ namespace openpeer
         mCurrentState(RUDPListenerState_Listening),
         mDelegate(IRUDPListenerDelegateProxy::createWeak(delegate)),
         mBindPort(port),
+        mSegmentationOffload(ISettings::getBool(OPENPEER_SERVICES_SETTING_UDP_SEGMENTATION_OFFLOAD) && UDPBatch::isSegmentationSupported()),
         mRealm(realm ? realm : "")
       {
         IHelper::setSocketThreadPriority();
@@ -321,8 +323,7 @@ namespace openpeer
       {
         IPAddress remote;
         STUNPacketPtr stun;
-        RecycledPacketBuffer buffer;
-        AutoRecycleBuffer autoRecycle(*this, buffer);
+        PacketBufferPtr buffer;
         size_t bytesRead = 0;
 
         // scope: read from the socket
@@ -330,10 +331,10 @@ namespace openpeer
           AutoRecursiveLock lock(mLock);
           if (!mDelegate) return;
 
-          getBuffer(buffer);
+          buffer = PacketBufferPool::allocate();
 
           try {
-            bytesRead = mUDPSocket->receiveFrom(remote, buffer.get(), OPENPEER_SERVICES_RUDPLISTENER_RECYCLE_BUFFER_SIZE);
+            bytesRead = mUDPSocket->receiveFrom(remote, buffer->data(), buffer->capacity());
           } catch(Socket::Exceptions::Unspecified &) {
             cancel();
             return;
@@ -344,7 +345,18 @@ namespace openpeer
 
         STUNPacketPtr response;
 
-        stun = STUNPacket::parseIfSTUN(buffer.get(), bytesRead, static_cast<STUNPacket::RFCs>(STUNPacket::RFC_5389_STUN | STUNPacket::RFC_draft_RUDP), false, "RUDPListener", mID);
+        STUNPacketView view;
+        if (STUNPacketView::parse(view, buffer->data(), bytesRead, static_cast<STUNPacket::RFCs>(STUNPacket::RFC_5389_STUN | STUNPacket::RFC_draft_RUDP), false)) {
+          // first thing to check is if this is a response to an outstanding request
+          if (ISTUNRequesterManager::handleSTUNPacket(remote, view)) return;
+
+          // next we ignore all responses/error responses because they would have been handled by a requester
+          if ((STUNPacket::Class_Response == view.mClass) ||
+              (STUNPacket::Class_ErrorResponse == view.mClass)) return;
+
+          stun = view.materialize("RUDPListener", mID);
+        }
+
         while (stun)  // NOTE: using this as a scope that can be broken rather than a loop
         {
           String localUsernameFrag;
@@ -362,13 +374,6 @@ namespace openpeer
             }
           }
 
-          // first thing to check is if this is a response to an outstanding request
-          if (ISTUNRequesterManager::handleSTUNPacket(remote, stun)) return;
-
-          // next we ignore all responses/error responses because they would have been handled by a requester
-          if ((STUNPacket::Class_Response == stun->mClass) ||
-              (STUNPacket::Class_ErrorResponse == stun->mClass)) return;
-
           // now we check for a binding request and respond accordingly
           if (STUNPacket::Method_Binding == stun->mMethod) {
             if (STUNPacket::Class_Indication == stun->mClass) return;  // we do not allow indication requests
@@ -457,7 +462,7 @@ namespace openpeer
         }
 
         // try and parse this as an RUDPPacket now
-        RUDPPacketPtr rudp = RUDPPacket::parseIfRUDP(buffer.get(), bytesRead);
+        RUDPPacketPtr rudp = RUDPPacket::parseIfRUDP(buffer->data(), bytesRead);
         if (rudp) {
           UseRUDPChannelPtr session;
 
@@ -473,7 +478,7 @@ namespace openpeer
           }
 
           // push the RUDP packet to the session to handle
-          session->handleRUDP(rudp, buffer.get(), bytesRead);
+          session->handleRUDP(rudp, buffer->data(), bytesRead);
         }
       }
 
@@ -550,6 +555,29 @@ namespace openpeer
         return sendTo(remoteIP, packet, packetLengthInBytes);
       }
 
+      //-----------------------------------------------------------------------
+      size_t RUDPListener::notifyRUDPChannelSendPackets(
+                                                        RUDPChannelPtr channel,
+                                                        const IPAddress &remoteIP,
+                                                        const SendBuffer *packets,
+                                                        size_t totalPackets
+                                                        )
+      {
+        AutoRecursiveLock lock(mLock);
+        if (isShutdown()) return 0;
+        if (!mUDPSocket) return 0;
+
+        try {
+          bool wouldBlock = false;
+          size_t totalSent = UDPBatch::sendTo(mUDPSocket, remoteIP, packets, totalPackets, &wouldBlock, mSegmentationOffload);
+          ZS_LOG_TRACE(log("sendTo batch called") + ZS_PARAM("destination", remoteIP.string()) + ZS_PARAM("total", totalPackets) + ZS_PARAM("total sent", totalSent) + ZS_PARAM("would block", wouldBlock))
+          return totalSent;
+        } catch(Socket::Exceptions::Unspecified &) {
+          ZS_LOG_ERROR(Detail, log("sendTo batch exception") + ZS_PARAM("destination", remoteIP.string()) + ZS_PARAM("total", totalPackets))
+        }
+        return 0;
+      }
+
       //-----------------------------------------------------------------------
       //-----------------------------------------------------------------------
       //-----------------------------------------------------------------------
@@ -605,6 +633,7 @@ namespace openpeer
         mGracefulShutdownReference.reset();
 
         if (mUDPSocket) {
+          SocketEventBackend::detach(mUDPSocket);
           mUDPSocket->close();
           mUDPSocket.reset();
         }
@@ -612,8 +641,6 @@ namespace openpeer
         mLocalChannelNumberSessions.clear();
         mRemoteChannelNumberSessions.clear();
         mPendingSessions.clear();
-
-        mRecycledBuffers.clear();
       }
 
       //-----------------------------------------------------------------------
@@ -648,7 +675,7 @@ namespace openpeer
 
           mUDPSocket->bind(any);
           mUDPSocket->setBlocking(false);
-          mUDPSocket->setDelegate(mThisWeak.lock());
+          SocketEventBackend::attach(mUDPSocket, mThisWeak.lock());
           IPAddress local = mUDPSocket->getLocalAddress();
           mBindPort = local.getPort();
           ZS_THROW_CUSTOM_PROPERTIES_1_IF(Socket::Exceptions::Unspecified, 0 == mBindPort, 0)
@@ -844,33 +871,6 @@ namespace openpeer
         return (bool)response;
       }
 
-      //-----------------------------------------------------------------------
-      void RUDPListener::getBuffer(RecycledPacketBuffer &outBuffer)
-      {
-        AutoRecursiveLock lock(mLock);
-        if (mRecycledBuffers.size() < 1) {
-          outBuffer = RecycledPacketBuffer(new BYTE[OPENPEER_SERVICES_RUDPLISTENER_RECYCLE_BUFFER_SIZE]);
-          return;
-        }
-
-        outBuffer = mRecycledBuffers.front();
-        mRecycledBuffers.pop_front();
-      }
-
-      //-----------------------------------------------------------------------
-      void RUDPListener::recycleBuffer(RecycledPacketBuffer &buffer)
-      {
-        AutoRecursiveLock lock(mLock);
-        if (!buffer) return;
-
-        if (mRecycledBuffers.size() >= OPENPEER_SERVICES_RUDPLISTENER_MAX_RECYLCE_BUFFERS) {
-          buffer.reset();
-          return;
-        }
-        mRecycledBuffers.push_back(buffer);
-        buffer.reset();
-      }
-
       //-----------------------------------------------------------------------
       //-----------------------------------------------------------------------
       //-----------------------------------------------------------------------
@@ -30,6 +30,7 @@
  */
 
 #include <openpeer/services/RUDPPacket.h>
+#include <openpeer/services/internal/services_Helper.h>
 #include <zsLib/Exception.h>
 #include <zsLib/Stringize.h>
 
@@ -166,7 +167,7 @@ namespace openpeer
       ZS_THROW_INVALID_USAGE_IF(!packet)
       if (packetLengthInBytes < OPENPEER_SERVICES_MINIMUM_PACKET_LENGTH_IN_BYTES) return RUDPPacketPtr();  // does not meet the minimum size expectations so it can't be RUDP
 
-      WORD channelNumber = ntohs(((WORD *)packet)[0]);
+      WORD channelNumber = internal::Helper::readWORD(packet);
 
       if ((channelNumber < LegalChannelNumber_StartRange) ||
           (channelNumber > LegalChannelNumber_EndRange)) {
@@ -174,11 +175,11 @@ namespace openpeer
         return RUDPPacketPtr();
       }
 
-      WORD dataLength = ntohs(((WORD *)packet)[1]);
+      WORD dataLength = internal::Helper::readWORD(packet + sizeof(WORD));
 
       BYTE flags = packet[sizeof(WORD)+sizeof(WORD)];
-      DWORD sequenceNumber = ntohl(((DWORD *)packet)[1]) & 0xFFFFFF;  // lower 24bits are valid only
-      DWORD gsnr = ntohl(((DWORD *)packet)[2]) & 0xFFFFFF;            // lower 24bits are valid only
+      DWORD sequenceNumber = internal::Helper::readDWORD(packet + sizeof(DWORD)) & 0xFFFFFF;  // lower 24bits are valid only
+      DWORD gsnr = internal::Helper::readDWORD(packet + (sizeof(DWORD)*2)) & 0xFFFFFF;            // lower 24bits are valid only
       DWORD gsnfr = gsnr;
       BYTE vectorSize = 0;
       BYTE vectorFlags = 0;
@@ -188,7 +189,7 @@ namespace openpeer
         if (packetLengthInBytes < OPENPEER_SERVICES_MINIMUM_PACKET_LENGTH_IN_BYTES + sizeof(DWORD)) return RUDPPacketPtr();  // does not meet the minimum size expectations so it can't be RUDP
         vectorSize = (packet[sizeof(DWORD)*3]) & (0x7F);
         vectorFlags = (packet[sizeof(DWORD)*3]) & (0x80);
-        gsnfr = ntohl(((DWORD *)packet)[3]) & 0xFFFFFF;               // lower 24bits are valid only
+        gsnfr = internal::Helper::readDWORD(packet + (sizeof(DWORD)*3)) & 0xFFFFFF;               // lower 24bits are valid only
       }
 
       // has to have enough room to contain vector, extended header and all data
@@ -631,6 +632,11 @@ namespace openpeer
         } else {
           flagStr += "(--)";
         }
+        if (isFlagSet(Flag_FR_FECRepair)) {
+          flagStr += "(fr)";
+        } else {
+          flagStr += "(--)";
+        }
         if (isFlagSet(Flag_VP_VectorParity)) {
           flagStr += "(vp)";
         } else {
@@ -31,6 +31,7 @@
 
 #include <openpeer/services/internal/services_RUDPTransport.h>
 #include <openpeer/services/internal/services_RUDPChannel.h>
+#include <openpeer/services/internal/services_ICESocketSession.h>
 #include <openpeer/services/internal/services_Helper.h>
 
 #include <openpeer/services/RUDPPacket.h>
@@ -556,6 +557,40 @@ namespace openpeer
         return session->sendPacket(packet, packetLengthInBytes);  // no need to call within a lock
       }
 
+      //-----------------------------------------------------------------------
+      size_t RUDPTransport::notifyRUDPChannelSendPackets(
+                                                         RUDPChannelPtr channel,
+                                                         const IPAddress &remoteIP,
+                                                         const SendBuffer *packets,
+                                                         size_t totalPackets
+                                                         )
+      {
+        IICESocketSessionPtr session = getICESession();
+        if (!session) {
+          ZS_LOG_WARNING(Detail, log("send packets failed as ICE session object destroyed"))
+          return 0;
+        }
+
+        if (ZS_IS_LOGGING(Insane)) {
+          for (size_t index = 0; index < totalPackets; ++index) {
+            String base64 = Helper::convertToBase64(packets[index].mBuffer, packets[index].mBufferLengthInBytes);
+            ZS_LOG_INSANE(log("SEND PACKET ON WIRE") + ZS_PARAM("wire out", base64))
+          }
+        }
+
+        UseICESocketSessionPtr batchSession = ICESocketSession::convert(session);
+        if (batchSession) {
+          return batchSession->sendPackets(packets, totalPackets);  // no need to call within a lock
+        }
+
+        // session does not support sending a burst at once
+        size_t totalSent = 0;
+        for (; totalSent < totalPackets; ++totalSent) {
+          if (!session->sendPacket(packets[totalSent].mBuffer, packets[totalSent].mBufferLengthInBytes)) break;
+        }
+        return totalSent;
+      }
+
       //-----------------------------------------------------------------------
       //-----------------------------------------------------------------------
       //-----------------------------------------------------------------------
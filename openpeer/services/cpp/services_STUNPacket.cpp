@@ -32,6 +32,9 @@
 #include <openpeer/services/STUNPacket.h>
 #include <openpeer/services/RUDPPacket.h>
 #include <openpeer/services/IHelper.h>
+#include <openpeer/services/internal/services_FastCRC32.h>
+#include <openpeer/services/internal/services_Helper.h>
+#include <openpeer/services/internal/services_MessageIntegrityKeyCache.h>
 
 #include <zsLib/Exception.h>
 #include <zsLib/Stringize.h>
@@ -40,17 +43,10 @@
 
 #include <cryptopp/cryptlib.h>
 #include <cryptopp/osrng.h>
-#include <cryptopp/crc.h>
-#define CRYPTOPP_ENABLE_NAMESPACE_WEAK 1
-#include <cryptopp/md5.h>
-#include <cryptopp/hmac.h>
-#include <cryptopp/sha.h>
 
 #include <algorithm>
 
-#define OPENPEER_STUN_MAGIC_COOKIE                 (0x2112A442)
 #define OPENPEER_STUN_MAGIC_XOR_FINGERPRINT_VALUE  (0x5354554e)
-#define OPENPEER_STUN_HEADER_SIZE_IN_BYTES         (20)
 #define OPENPEER_STUN_COMPREHENSION_REQUIRED_MIN   (0x0000)
 #define OPENPEER_STUN_COMPREHENSION_REQUIRED_MAX   (0x7FFF)
 #define OPENPEER_STUN_MAX_USERNAME                 (513)
@@ -120,6 +116,7 @@ namespace openpeer
         STUNPacket::Attribute_GSNFR,
         STUNPacket::Attribute_RUDPFlags,
         STUNPacket::Attribute_ACKVector,
+        STUNPacket::Attribute_FECBlockSize,
 
         // integrity and fingerprint always come last in this order
         STUNPacket::Attribute_MessageIntegrity,
@@ -160,7 +157,7 @@ namespace openpeer
         if (attributeLength < sizeof(DWORD)) return false;
 
         BYTE family = dataPos[1];
-        WORD port = ntohs(((WORD *)dataPos)[1]);
+        WORD port = internal::Helper::readWORD(dataPos + sizeof(WORD));
 
         // from RFC:
         // X-Port is computed by taking the mapped port in host byte order,
@@ -176,7 +173,7 @@ namespace openpeer
             // address in host byte order, XOR'ing it with the magic cookie, and
             // converting the result to network byte order.
 
-            DWORD ipAddress = ntohl(((DWORD *)dataPos)[1]);
+            DWORD ipAddress = internal::Helper::readDWORD(dataPos + sizeof(DWORD));
             ipAddress ^= magicCookie;
             outIPAddress = IPAddress(ipAddress, port);
             break;
@@ -289,6 +286,7 @@ namespace openpeer
           case STUNPacket::Attribute_GSNFR:               return sizeof(QWORD);
           case STUNPacket::Attribute_RUDPFlags:           return sizeof(DWORD);
           case STUNPacket::Attribute_ACKVector:           return stun.mACKVectorLength;
+          case STUNPacket::Attribute_FECBlockSize:        return sizeof(DWORD);
           default:                                        break;
         }
         return 0;
@@ -400,6 +398,7 @@ namespace openpeer
           case STUNPacket::Attribute_GSNFR:               rfcBits = STUNPacket::RFC_draft_RUDP; break;
           case STUNPacket::Attribute_RUDPFlags:           rfcBits = STUNPacket::RFC_draft_RUDP; break;
           case STUNPacket::Attribute_ACKVector:           rfcBits = STUNPacket::RFC_draft_RUDP; break;
+          case STUNPacket::Attribute_FECBlockSize:        rfcBits = STUNPacket::RFC_draft_RUDP; break;
 
           case STUNPacket::Attribute_ReservedResponseAddress:
           case STUNPacket::Attribute_ReservedChangeAddress:
@@ -647,7 +646,8 @@ namespace openpeer
           case STUNPacket::Attribute_NextSequenceNumber: return true;
           case STUNPacket::Attribute_MinimumRTT:
           case STUNPacket::Attribute_ConnectionInfo:
-          case STUNPacket::Attribute_CongestionControl:   {
+          case STUNPacket::Attribute_CongestionControl:
+          case STUNPacket::Attribute_FECBlockSize:        {
             if (STUNPacket::Method_ReliableChannelOpen != stun.mMethod)
               return false;
             return true;
@@ -901,6 +901,7 @@ namespace openpeer
           }
           case STUNPacket::Attribute_MinimumRTT:          return false;         // this is optional during the request/response
           case STUNPacket::Attribute_ConnectionInfo:      return false;         // this is optional during the request/response
+          case STUNPacket::Attribute_FECBlockSize:        return false;         // this is optional during the request/response
           case STUNPacket::Attribute_CongestionControl:   {
             if (STUNPacket::Method_ReliableChannelOpen != stun.mMethod)         // not used unless it is RUDP channel open
               return false;
@@ -934,7 +935,59 @@ namespace openpeer
       }
 
       //-----------------------------------------------------------------------
-      static STUNPacket::RFCs guessRFC(const STUNPacket &stun)
+      static bool isValidFingerprint(
+                                     const BYTE *packet,
+                                     const BYTE *attributeStart,
+                                     const BYTE *dataPos
+                                     )
+      {
+        PTRNUMBER size = ((PTRNUMBER)attributeStart) - ((PTRNUMBER)packet);
+        DWORD crcValue = FastCRC32::calculate(packet, (size_t)size);
+        crcValue ^= OPENPEER_STUN_MAGIC_XOR_FINGERPRINT_VALUE;
+        return (crcValue == internal::Helper::readDWORD(dataPos));
+      }
+
+      //-----------------------------------------------------------------------
+      static bool isValidMessageIntegrity(
+                                          const BYTE *packet,
+                                          size_t messageIntegrityMessageLengthInBytes,
+                                          const BYTE *messageIntegrity,
+                                          const MessageIntegrityKey &key
+                                          )
+      {
+        BYTE result[OPENPEER_STUN_MESSAGE_INTEGRITY_LENGTH_IN_BYTES];
+        memset(&(result[0]), 0, sizeof(result));
+
+        // for the sake of message integrity the length in the header must be
+        // the size of the packet up to and including the message integrity
+        // attribute, so the first header DWORD is hashed from a patched copy
+        // rather than overwriting the received packet
+        BYTE header[sizeof(DWORD)];
+        memcpy(&(header[0]), packet, sizeof(header));
+        ((WORD *)(&(header[0])))[1] = htons(static_cast<WORD>(messageIntegrityMessageLengthInBytes + sizeof(DWORD) + sizeof(result) - OPENPEER_STUN_HEADER_SIZE_IN_BYTES));
+
+        key.calculate(&(header[0]), sizeof(header), packet + sizeof(header), messageIntegrityMessageLengthInBytes - sizeof(header), &(result[0]));
+
+        return (0 == memcmp(messageIntegrity, &(result[0]), sizeof(result)));
+      }
+
+      //-----------------------------------------------------------------------
+      static bool isValidMessageIntegrity(
+                                          const BYTE *packet,
+                                          size_t messageIntegrityMessageLengthInBytes,
+                                          const BYTE *messageIntegrity,
+                                          const char *password,
+                                          const char *username,
+                                          const char *realm
+                                          )
+      {
+        MessageIntegrityKeyPtr key = MessageIntegrityKeyCache::find(password, username, realm);
+        return isValidMessageIntegrity(packet, messageIntegrityMessageLengthInBytes, messageIntegrity, *key);
+      }
+
+      //-----------------------------------------------------------------------
+      template <typename PacketType>
+      static STUNPacket::RFCs guessRFC(const PacketType &stun)
       {
         switch (stun.mMethod) {
           case STUNPacket::Method_Binding:          {
@@ -971,7 +1024,8 @@ namespace openpeer
       }
 
       //-----------------------------------------------------------------------
-      static STUNPacket::RFCs guessRFC(const STUNPacket &stun, STUNPacket::RFCs allowedRFCs)
+      template <typename PacketType>
+      static STUNPacket::RFCs guessRFC(const PacketType &stun, STUNPacket::RFCs allowedRFCs)
       {
         STUNPacket::RFCs guessedRFC = guessRFC(stun);
         if (0 != (((UINT)guessedRFC) & ((UINT)allowedRFCs)))
@@ -1185,37 +1239,13 @@ namespace openpeer
           case STUNPacket::CredentialMechanisms_None:       break;
           case STUNPacket::CredentialMechanisms_ShortTerm:
           case STUNPacket::CredentialMechanisms_LongTerm:   {
-            CryptoPP::Weak::MD5 md5;
-
-            /*
-            size_t len = strlen(gHexstream)/2;
-            boost::shared_array<BYTE> blob(new BYTE[len*2]);
-            BYTE *compare = blob.get();
-            memset(compare, 0, len*2);
-            convertHexStream(compare);
-            */
-
-            BYTE key[16];
-            memset(&(key[0]), 0, sizeof(key));
-
-//            String user = "bogus";
-//            String pass = "bogus";
-//            String realm = "yakolako.com";
-
-            const String &user = stun.mUsername;
-            const String &pass = stun.mPassword;
-            const String &realm = stun.mRealm;
-
-            if (STUNPacket::CredentialMechanisms_LongTerm == stun.mCredentialMechanism) {
-              md5.Update((const BYTE *)((CSTR)user), user.length());
-              md5.Update((const BYTE *)":", strlen(":"));
-              md5.Update((const BYTE *)((CSTR)realm), realm.length());
-              md5.Update((const BYTE *)":", strlen(":"));
-            }
-            md5.Update((const BYTE *)((CSTR)pass), pass.length());
+            bool longTerm = (STUNPacket::CredentialMechanisms_LongTerm == stun.mCredentialMechanism);
 
-            ZS_THROW_INVALID_ASSUMPTION_IF(sizeof(key) != md5.DigestSize())
-            md5.Final(&(key[0]));
+            // a key supplied with the packet skips deriving and looking up the key
+            MessageIntegrityKeyPtr key = stun.mMessageIntegrityKey;
+            if (!key) {
+              key = MessageIntegrityKeyCache::find(stun.mPassword.c_str(), longTerm ? stun.mUsername.c_str() : NULL, longTerm ? stun.mRealm.c_str() : NULL);
+            }
 
             BYTE result[OPENPEER_STUN_MESSAGE_INTEGRITY_LENGTH_IN_BYTES];
             memset(&(result[0]), 0, sizeof(result));
@@ -1223,20 +1253,12 @@ namespace openpeer
             // messageIntegrityMessageLengthInBytes is the length of the packet up to but not including the message integrity attribute
             size_t messageIntegrityMessageLengthInBytes = ((PTRNUMBER)attributeStartPos) - ((PTRNUMBER)(stun.mOriginalPacket));
 
-            // remember the packet's original length
-            WORD originalLength = ((WORD *)stun.mOriginalPacket)[1];
-            // change the length for the sake of doing the message integrity calculation
-            ((WORD *)stun.mOriginalPacket)[1] = htons(static_cast<WORD>(messageIntegrityMessageLengthInBytes + sizeof(DWORD) + sizeof(stun.mMessageIntegrity) - OPENPEER_STUN_HEADER_SIZE_IN_BYTES));
-
-            CryptoPP::HMAC<CryptoPP::SHA1> hmac(&(key[0]), sizeof(key));
-            hmac.Update(stun.mOriginalPacket, messageIntegrityMessageLengthInBytes);
-//            hmac.Update(compare, len - 24);
-            ZS_THROW_INVALID_ASSUMPTION_IF(sizeof(result) != hmac.DigestSize())
+            // the length is hashed as if the packet ended with the message integrity attribute
+            BYTE header[sizeof(DWORD)];
+            memcpy(&(header[0]), stun.mOriginalPacket, sizeof(header));
+            ((WORD *)(&(header[0])))[1] = htons(static_cast<WORD>(messageIntegrityMessageLengthInBytes + sizeof(DWORD) + sizeof(stun.mMessageIntegrity) - OPENPEER_STUN_HEADER_SIZE_IN_BYTES));
 
-            // put back the original length
-            ((WORD *)stun.mOriginalPacket)[1] = originalLength;
-
-            hmac.Final(&(result[0]));
+            key->calculate(&(header[0]), sizeof(header), stun.mOriginalPacket + sizeof(header), messageIntegrityMessageLengthInBytes - sizeof(header), &(result[0]));
 
             memcpy(pos, &(result[0]), sizeof(result));
             break;
@@ -1278,14 +1300,9 @@ namespace openpeer
          convertHexStream(compare);
          */
 
-        CryptoPP::CRC32 crc;
         PTRNUMBER size = ((PTRNUMBER)startPos) - ((PTRNUMBER)stun.mOriginalPacket);
-        crc.Update(stun.mOriginalPacket, (size_t)size);
-//        crc.Update(compare, len);
+        DWORD crcValue = FastCRC32::calculate(stun.mOriginalPacket, (size_t)size);
 
-        ZS_THROW_INVALID_ASSUMPTION_IF(crc.DigestSize() != sizeof(DWORD))
-        DWORD crcValue = 0;
-        crc.Final((BYTE *)(&crcValue));
         crcValue ^= OPENPEER_STUN_MAGIC_XOR_FINGERPRINT_VALUE;
 
         ((DWORD *)pos)[0] = htonl(crcValue);
@@ -1317,6 +1334,35 @@ namespace openpeer
         packetizeCongestionControl(pos, stun.mRemoteCongestionControl, true);
       }
 
+      //-----------------------------------------------------------------------
+      static void packetizeHeader(
+                                  BYTE *packet,
+                                  const STUNPacket &stun,
+                                  size_t packetLengthInBytes
+                                  )
+      {
+        //0                   1                   2                   3
+        //0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1
+        //+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+        //|0 0|     STUN Message Type     |         Message Length        |
+        //+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+        //|                         Magic Cookie                          |
+        //+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+        //|                                                               |
+        //|                     Transaction ID (96 bits)                  |
+        //|                                                               |
+        //+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+
+        WORD messageType = ((0x02 & ((WORD)stun.mClass)) << 7) | ((0x01 & ((WORD)stun.mClass)) << 4);
+        messageType |= ((0xF80 & ((WORD)stun.mMethod)) << 2) | ((0x70 & ((WORD)stun.mMethod)) << 1) | (0xF & ((WORD)stun.mMethod));
+
+        ((WORD *)packet)[0] = htons(messageType);
+        ((WORD *)packet)[1] = htons((WORD)(packetLengthInBytes - OPENPEER_STUN_HEADER_SIZE_IN_BYTES));
+
+        ((DWORD *)packet)[1] = htonl(stun.mMagicCookie);
+        memcpy(&(((DWORD *)packet)[2]), &(stun.mTransactionID[0]), sizeof(stun.mTransactionID));
+      }
+
       //-----------------------------------------------------------------------
       static void packetizeAttribute(
                                      BYTE * &pos,
@@ -1385,6 +1431,7 @@ namespace openpeer
           case STUNPacket::Attribute_GSNFR:               packetizeQWORD(pos, stun.mGSNFR); break;
           case STUNPacket::Attribute_RUDPFlags:           packetizeDWORD(pos, 0); *pos = stun.mReliabilityFlags; break;
           case STUNPacket::Attribute_ACKVector:           packetizeBuffer(pos, stun.mACKVector.get(), stun.mACKVectorLength); break;
+          case STUNPacket::Attribute_FECBlockSize:        packetizeDWORD(pos, stun.mFECBlockSize); break;
 
           default:                                        break;
         }
@@ -1472,6 +1519,7 @@ namespace openpeer
         case Attribute_GSNFR:                   return "GSNFR";
         case Attribute_RUDPFlags:               return "RUDP flags";
         case Attribute_ACKVector:               return "ACK vector";
+        case Attribute_FECBlockSize:            return "FEC block size";
 
         case Attribute_ReservedResponseAddress: return "obsolete response address";
         case Attribute_ReservedChangeAddress:   return "obsolete change address";
@@ -1583,6 +1631,7 @@ namespace openpeer
       mNextSequenceNumber(0),
       mMinimumRTTIncluded(false),
       mMinimumRTT(0),
+      mFECBlockSize(0),
       mGSNR(0),
       mGSNFR(0),
       mReliabilityFlagsIncluded(false),
@@ -1707,6 +1756,7 @@ namespace openpeer
       dest->mPassword = mPassword;
       dest->mRealm = mRealm;
       dest->mNonce = mNonce;
+      dest->mMessageIntegrityKey = mMessageIntegrityKey;
       dest->mSoftware = mSoftware;
       dest->mCredentialMechanism = mCredentialMechanism;
       dest->mMessageIntegrityMessageLengthInBytes = mMessageIntegrityMessageLengthInBytes;
@@ -1742,6 +1792,7 @@ namespace openpeer
       dest->mMinimumRTTIncluded = mMinimumRTTIncluded;
       dest->mMinimumRTT = mMinimumRTT;
       dest->mConnectionInfo = mConnectionInfo;
+      dest->mFECBlockSize = mFECBlockSize;
       dest->mGSNR = mGSNR;
       dest->mGSNFR = mGSNFR;
       dest->mReliabilityFlagsIncluded = mReliabilityFlagsIncluded;
@@ -1796,14 +1847,14 @@ namespace openpeer
       if (0 != (packet[0] & 0xC0)) return STUNPacketPtr();
 
       // The magic cookie field MUST contain the fixed value OPENPEER_STUN_MAGIC_COOKIE in network byte order.
-      DWORD magicCookie = ntohl(((DWORD *)packet)[1]);
+      DWORD magicCookie = internal::Helper::readDWORD(packet + sizeof(DWORD));
       if ((!allowRFC3489) &&
           (OPENPEER_STUN_MAGIC_COOKIE != magicCookie)) return STUNPacketPtr();
 
-      WORD messageType = ntohs(((WORD *)packet)[0]);
+      WORD messageType = internal::Helper::readWORD(packet);
       WORD messageTypeClass = ((messageType & 0x100) >> 7) | ((messageType & 0x10) >> 4);
       WORD messageTypeMethod = ((messageType & 0x3E00) >> 2) | ((messageType & 0xE0) >> 1) | (messageType & 0xF);
-      WORD messageLengthInBytes = htons(((WORD *)packet)[1]);
+      WORD messageLengthInBytes = internal::Helper::readWORD(packet + sizeof(WORD));
 
       // The message length MUST contain the size, in bytes, of the message
       // not including the 20-byte STUN header.  Since all STUN attributes are
@@ -1847,8 +1898,8 @@ namespace openpeer
 
         ZS_THROW_BAD_STATE_IF(availableBytes < sizeof(DWORD))         // this can't be!
 
-        WORD attributeType = ntohs(((WORD *)pos)[0]);
-        WORD attributeLength = ntohs(((WORD *)pos)[1]);
+        WORD attributeType = internal::Helper::readWORD(pos);
+        WORD attributeLength = internal::Helper::readWORD(pos + sizeof(WORD));
         const BYTE *attributeStart = pos;
 
         pos += sizeof(DWORD);
@@ -1902,7 +1953,7 @@ namespace openpeer
 
             case Attribute_ErrorCode: {
               if (attributeLength < sizeof(DWORD)) return STUNPacketPtr();
-              WORD code = ntohs(((WORD *)dataPos)[1]);
+              WORD code = internal::Helper::readWORD(dataPos + sizeof(WORD));
               WORD hundredsDigit = (0x700 & code) >> 8;
               WORD twoDigits = (0xFF & code);
               if (((hundredsDigit < 3) || (hundredsDigit > 6)) ||
@@ -1918,7 +1969,7 @@ namespace openpeer
             case Attribute_UnknownAttribute: {
               if (0 != (attributeLength % sizeof(WORD))) return STUNPacketPtr();
               while (attributeLength >= 2) {
-                stun->mUnknownAttributes.push_back(htons(((WORD *)dataPos)[0]));
+                stun->mUnknownAttributes.push_back(internal::Helper::readWORD(dataPos));
                 dataPos += sizeof(WORD);
                 attributeLength -= 2;
               }
@@ -1939,14 +1990,7 @@ namespace openpeer
             case Attribute_FingerPrint:         {
               if (attributeLength < sizeof(DWORD)) return STUNPacketPtr();
               foundFingerprint = true;
-              CryptoPP::CRC32 crc;
-              PTRNUMBER size = ((PTRNUMBER)attributeStart) - ((PTRNUMBER)packet);
-              crc.Update(packet, (size_t)size);
-              ZS_THROW_INVALID_ASSUMPTION_IF(crc.DigestSize() != sizeof(DWORD))
-              DWORD crcValue = 0;
-              crc.Final((BYTE *)(&crcValue));
-              crcValue ^= OPENPEER_STUN_MAGIC_XOR_FINGERPRINT_VALUE;
-              if (crcValue != ntohl(((DWORD *)dataPos)[0])) return STUNPacketPtr();
+              if (!internal::isValidFingerprint(packet, attributeStart, dataPos)) return STUNPacketPtr();
               stun->mFingerprintIncluded = true;
               break;
             }
@@ -1954,13 +1998,13 @@ namespace openpeer
             // RFC5766 TURN specific attributes
             case Attribute_ChannelNumber:         {
               if (attributeLength < sizeof(WORD)) return STUNPacketPtr();
-              stun->mChannelNumber = ntohs(((WORD *)dataPos)[0]);
+              stun->mChannelNumber = internal::Helper::readWORD(dataPos);
               break;
             }
             case Attribute_Lifetime:              {
               if (attributeLength < sizeof(DWORD)) return STUNPacketPtr();
               stun->mLifetimeIncluded = true;
-              stun->mLifetime = ntohl(((DWORD *)dataPos)[0]);
+              stun->mLifetime = internal::Helper::readDWORD(dataPos);
               break;
             }
             case Attribute_XORPeerAddress:        {
@@ -2003,7 +2047,7 @@ namespace openpeer
             case Attribute_Priority:              {
               if (attributeLength < sizeof(DWORD)) return STUNPacketPtr();
               stun->mPriorityIncluded = true;
-              stun->mPriority = ntohl(((DWORD *)dataPos)[0]);
+              stun->mPriority = internal::Helper::readDWORD(dataPos);
               break;
             }
             case Attribute_UseCandidate:          stun->mUseCandidateIncluded = true; break;
@@ -2030,7 +2074,7 @@ namespace openpeer
             case STUNPacket::Attribute_MinimumRTT:          {
               if (attributeLength < sizeof(DWORD)) return STUNPacketPtr();
               stun->mMinimumRTTIncluded = true;
-              stun->mMinimumRTT = ntohl(((DWORD *)dataPos)[0]);
+              stun->mMinimumRTT = internal::Helper::readDWORD(dataPos);
               break;
             }
             case STUNPacket::Attribute_ConnectionInfo:      if (!internal::parseSTUNString(dataPos, attributeLength, OPENPEER_STUN_MAX_CONNECTION_INFO, stun->mConnectionInfo)) return STUNPacketPtr(); break;
@@ -2044,7 +2088,7 @@ namespace openpeer
               dataPos += sizeof(WORD);  // skip over the header
               size_t length = ((attributeLength - sizeof(WORD)) / sizeof(WORD));
               for (; length > 0; --length) {
-                list.push_back(static_cast<IRUDPChannel::CongestionAlgorithms>(ntohs(((WORD *)dataPos)[0])));
+                list.push_back(static_cast<IRUDPChannel::CongestionAlgorithms>(internal::Helper::readWORD(dataPos)));
                 dataPos += sizeof(WORD);
               }
               if (direction)
@@ -2077,6 +2121,11 @@ namespace openpeer
               stun->mACKVectorLength = attributeLength;
               break;
             }
+            case STUNPacket::Attribute_FECBlockSize:        {
+              if (attributeLength < sizeof(DWORD)) return STUNPacketPtr();
+              stun->mFECBlockSize = internal::Helper::readDWORD(dataPos);
+              break;
+            }
 
             // obsolete STUN attributes should be ignored
             case STUNPacket::Attribute_ReservedResponseAddress:
@@ -2179,7 +2228,7 @@ namespace openpeer
 
       if (streamDataAvailableInBytes < sizeof(WORD)) return ParseLookAheadState_InsufficientDataToDeterimine;
 
-      WORD messageType = ntohs(((WORD *)packet)[0]);
+      WORD messageType = internal::Helper::readWORD(packet);
       WORD messageTypeClass = ((messageType & 0x100) >> 7) | ((messageType & 0x10) >> 4);
       WORD messageTypeMethod = ((messageType & 0x3E00) >> 2) | ((messageType & 0xE0) >> 1) | (messageType & 0xF);
 
@@ -2197,7 +2246,7 @@ namespace openpeer
 
       if (streamDataAvailableInBytes < sizeof(DWORD)) return ParseLookAheadState_InsufficientDataToDeterimine;
 
-      WORD messageLengthInBytes = htons(((WORD *)packet)[1]);
+      WORD messageLengthInBytes = internal::Helper::readWORD(packet + sizeof(WORD));
       if (0 != (messageLengthInBytes % sizeof(DWORD))) return ParseLookAheadState_NotSTUN;  // every attribute is aligned to a DWORD size
 
       // The message length MUST contain the size, in bytes, of the message
@@ -2210,7 +2259,7 @@ namespace openpeer
       if (streamDataAvailableInBytes < (sizeof(DWORD)*2)) return ParseLookAheadState_InsufficientDataToDeterimine;
 
       // The magic cookie field MUST contain the fixed value OPENPEER_STUN_MAGIC_COOKIE in network byte order.
-      DWORD magicCookie = ntohl(((DWORD *)packet)[1]);
+      DWORD magicCookie = internal::Helper::readDWORD(packet + sizeof(DWORD));
       if ((!allowRFC3489) &&
           (OPENPEER_STUN_MAGIC_COOKIE != magicCookie)) return ParseLookAheadState_NotSTUN;
 
@@ -2388,6 +2437,9 @@ namespace openpeer
       if (hasAttribute(STUNPacket::Attribute_ConnectionInfo)) {
         IHelper::debugAppend(resultEl, "connection info", mConnectionInfo);
       }
+      if (hasAttribute(STUNPacket::Attribute_FECBlockSize)) {
+        IHelper::debugAppend(resultEl, "fec block size", mFECBlockSize);
+      }
       if (hasAttribute(STUNPacket::Attribute_GSNR)) {
         IHelper::debugAppend(resultEl, "gsnr", string(mGSNR) + " (" +  + string(mGSNR & 0xFFFFFF) + ")");
       }
@@ -2492,51 +2544,51 @@ namespace openpeer
     //-------------------------------------------------------------------------
     SecureByteBlockPtr STUNPacket::packetize(RFCs rfc)
     {
-      if (ZS_IS_LOGGING(Trace)) {
-        ZS_LOG_BASIC(debug("packetize"));
-      }
+      size_t outPacketLengthInBytes = getPacketizedLength(rfc);
+
+      SecureByteBlockPtr outPacket(new SecureByteBlock(outPacketLengthInBytes));
 
+      packetizeInto(*outPacket, outPacketLengthInBytes, rfc);
+      return outPacket;
+    }
+
+    //-------------------------------------------------------------------------
+    size_t STUNPacket::getPacketizedLength(RFCs rfc) const
+    {
       size_t outPacketLengthInBytes = OPENPEER_STUN_HEADER_SIZE_IN_BYTES;
 
       // count the length of all the attributes when they are packetized
-      {
-        for (size_t loop = 0; Attribute_None != internal::gAttributeOrdering[loop]; ++loop) {
-          if (hasAttribute(internal::gAttributeOrdering[loop])) {
-            if (internal::shouldPacketizeAttribute(*this, rfc, internal::gAttributeOrdering[loop])) {
-              outPacketLengthInBytes += internal::packetizeAttributeLength(*this, rfc, internal::gAttributeOrdering[loop]);
-            }
+      for (size_t loop = 0; Attribute_None != internal::gAttributeOrdering[loop]; ++loop) {
+        if (hasAttribute(internal::gAttributeOrdering[loop])) {
+          if (internal::shouldPacketizeAttribute(*this, rfc, internal::gAttributeOrdering[loop])) {
+            outPacketLengthInBytes += internal::packetizeAttributeLength(*this, rfc, internal::gAttributeOrdering[loop]);
           }
         }
       }
 
+      return outPacketLengthInBytes;
+    }
 
-      //**********************************************************************
-      // now we know the packet size, we fill it up...
-      SecureByteBlockPtr outPacket(new SecureByteBlock(outPacketLengthInBytes));
-
-      BYTE *packet = *outPacket;
-      memset(packet, 0, outPacketLengthInBytes);
+    //-------------------------------------------------------------------------
+    size_t STUNPacket::packetizeInto(
+                                     BYTE *buffer,
+                                     size_t bufferLengthInBytes,
+                                     RFCs rfc
+                                     )
+    {
+      size_t outPacketLengthInBytes = getPacketizedLength(rfc);
+      if (outPacketLengthInBytes > bufferLengthInBytes) return outPacketLengthInBytes;
 
-      //0                   1                   2                   3
-      //0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1
-      //+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
-      //|0 0|     STUN Message Type     |         Message Length        |
-      //+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
-      //|                         Magic Cookie                          |
-      //+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
-      //|                                                               |
-      //|                     Transaction ID (96 bits)                  |
-      //|                                                               |
-      //+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+      ZS_THROW_INVALID_ARGUMENT_IF(!buffer)
 
-      WORD messageType = ((0x02 & ((WORD)mClass)) << 7) | ((0x01 & ((WORD)mClass)) << 4);
-      messageType |= ((0xF80 & ((WORD)mMethod)) << 2) | ((0x70 & ((WORD)mMethod)) << 1) | (0xF & ((WORD)mMethod));
+      if (ZS_IS_LOGGING(Trace)) {
+        ZS_LOG_BASIC(debug("packetize"));
+      }
 
-      ((WORD *)packet)[0] = htons(messageType);
-      ((WORD *)packet)[1] = htons((WORD)(outPacketLengthInBytes - OPENPEER_STUN_HEADER_SIZE_IN_BYTES));
+      BYTE *packet = buffer;
+      memset(packet, 0, outPacketLengthInBytes);
 
-      ((DWORD *)packet)[1] = htonl(mMagicCookie);
-      memcpy(&(((DWORD *)packet)[2]), &(mTransactionID[0]), sizeof(mTransactionID));
+      internal::packetizeHeader(packet, *this, outPacketLengthInBytes);
 
       BYTE *pos = packet + OPENPEER_STUN_HEADER_SIZE_IN_BYTES;
       mOriginalPacket = packet;
@@ -2552,7 +2604,108 @@ namespace openpeer
         }
       }
 
-      return outPacket;
+      return outPacketLengthInBytes;
+    }
+
+    //-------------------------------------------------------------------------
+    bool STUNPacket::packetizeAroundData(
+                                         BYTE *prefix,
+                                         size_t prefixLengthInBytes,
+                                         size_t &outPrefixLengthInBytes,
+                                         BYTE *suffix,
+                                         size_t suffixLengthInBytes,
+                                         size_t &outSuffixLengthInBytes,
+                                         RFCs rfc
+                                         )
+    {
+      outPrefixLengthInBytes = 0;
+      outSuffixLengthInBytes = 0;
+
+      if (!hasAttribute(Attribute_Data)) return false;
+      if (!internal::shouldPacketizeAttribute(*this, rfc, Attribute_Data)) return false;
+
+      // the integrity is calculated over one contiguous buffer
+      if ((hasAttribute(Attribute_MessageIntegrity)) &&
+          (internal::shouldPacketizeAttribute(*this, rfc, Attribute_MessageIntegrity))) return false;
+
+      size_t prefixLength = OPENPEER_STUN_HEADER_SIZE_IN_BYTES;
+      size_t suffixLength = 0;
+      bool beforeData = true;
+
+      for (size_t loop = 0; Attribute_None != internal::gAttributeOrdering[loop]; ++loop) {
+        Attributes attribute = internal::gAttributeOrdering[loop];
+        if (Attribute_Data == attribute) {
+          prefixLength += sizeof(DWORD);    // only the attribute header of the data is part of the prefix
+          beforeData = false;
+          continue;
+        }
+        if (beforeData) {
+          prefixLength += internal::packetizeAttributeLength(*this, rfc, attribute);
+        } else {
+          suffixLength += internal::packetizeAttributeLength(*this, rfc, attribute);
+        }
+      }
+
+      if ((prefixLength > prefixLengthInBytes) ||
+          (suffixLength > suffixLengthInBytes)) return false;
+
+      ZS_THROW_INVALID_ARGUMENT_IF(!prefix)
+      ZS_THROW_INVALID_ARGUMENT_IF((0 != suffixLength) && (!suffix))
+
+      if (ZS_IS_LOGGING(Trace)) {
+        ZS_LOG_BASIC(debug("packetize around data"))
+      }
+
+      size_t paddingLength = internal::dwordBoundary(mDataLength) - mDataLength;
+
+      memset(prefix, 0, prefixLength);
+      if (0 != suffixLength) {
+        memset(suffix, 0, suffixLength);
+      }
+
+      internal::packetizeHeader(prefix, *this, prefixLength + mDataLength + paddingLength + suffixLength);
+      mOriginalPacket = prefix;
+
+      BYTE *pos = prefix + OPENPEER_STUN_HEADER_SIZE_IN_BYTES;
+      beforeData = true;
+
+      for (size_t loop = 0; Attribute_None != internal::gAttributeOrdering[loop]; ++loop) {
+        Attributes attribute = internal::gAttributeOrdering[loop];
+        if (Attribute_Data == attribute) {
+          internal::packetizeAttributeHeader(pos, Attribute_Data, mDataLength);
+          pos = suffix;
+          beforeData = false;
+          continue;
+        }
+
+        if (!hasAttribute(attribute)) continue;
+        if (!internal::shouldPacketizeAttribute(*this, rfc, attribute)) continue;
+
+        if ((!beforeData) &&
+            (Attribute_FingerPrint == attribute)) {
+
+          // the fingerprint covers the prefix, the data, the padding and the suffix up to this attribute
+          static const BYTE zeros[sizeof(DWORD)] = {0, 0, 0, 0};
+
+          DWORD crcValue = internal::FastCRC32::calculate(prefix, prefixLength);
+          crcValue = internal::FastCRC32::calculate(mData, mDataLength, crcValue);
+          crcValue = internal::FastCRC32::calculate(&(zeros[0]), paddingLength, crcValue);
+          crcValue = internal::FastCRC32::calculate(suffix, (size_t)(((PTRNUMBER)pos) - ((PTRNUMBER)suffix)), crcValue);
+
+          crcValue ^= OPENPEER_STUN_MAGIC_XOR_FINGERPRINT_VALUE;
+
+          internal::packetizeAttributeHeader(pos, attribute, sizeof(DWORD));
+          ((DWORD *)pos)[0] = htonl(crcValue);
+          pos += sizeof(DWORD);
+          continue;
+        }
+
+        internal::packetizeAttribute(pos, *this, rfc, attribute);
+      }
+
+      outPrefixLengthInBytes = prefixLength;
+      outSuffixLengthInBytes = suffixLength;
+      return true;
     }
 
     //-------------------------------------------------------------------------
@@ -2607,42 +2760,20 @@ namespace openpeer
         return false;
       }
 
-      if (NULL == password)
-        password = "";
-
-      CryptoPP::Weak::MD5 md5;
+      return internal::isValidMessageIntegrity(mOriginalPacket, mMessageIntegrityMessageLengthInBytes, &(mMessageIntegrity[0]), password, username, realm);
+    }
 
-      BYTE key[16];
-      memset(&(key[0]), 0, sizeof(key));
+    //-------------------------------------------------------------------------
+    bool STUNPacket::isValidMessageIntegrity(internal::MessageIntegrityKeyPtr key) const
+    {
+      ZS_THROW_INVALID_ARGUMENT_IF(!key)
 
-      if ((NULL != username) && (NULL != realm)) {
-        md5.Update((const BYTE *)username, strlen(username));
-        md5.Update((const BYTE *)":", strlen(":"));
-        md5.Update((const BYTE *)realm, strlen(realm));
-        md5.Update((const BYTE *)":", strlen(":"));
+      if (!mOriginalPacket) {
+        ZS_LOG_ERROR(Trace, log("packet does not have message integrity"))
+        return false;
       }
-      md5.Update((const BYTE *)password, strlen(password));
-
-      ZS_THROW_INVALID_ASSUMPTION_IF(sizeof(key) != md5.DigestSize())
-      md5.Final(&(key[0]));
-
-      BYTE result[OPENPEER_STUN_MESSAGE_INTEGRITY_LENGTH_IN_BYTES];
-      memset(&(result[0]), 0, sizeof(result));
 
-      // we have to smash the original packet length to do calculation then put it back after...
-      WORD originalLength = ((WORD *)mOriginalPacket)[1];
-      // for the sake of message integrity we have to set the length to the original size up to and including the message interity attribute
-      ((WORD *)mOriginalPacket)[1] = htons(static_cast<WORD>(mMessageIntegrityMessageLengthInBytes + sizeof(DWORD) + sizeof(mMessageIntegrity) - OPENPEER_STUN_HEADER_SIZE_IN_BYTES));
-
-      CryptoPP::HMAC<CryptoPP::SHA1> hmac(&(key[0]), sizeof(key));
-      hmac.Update(mOriginalPacket, mMessageIntegrityMessageLengthInBytes);
-      ZS_THROW_INVALID_ASSUMPTION_IF(sizeof(result) != hmac.DigestSize())
-
-      // put back the original value now...
-      ((WORD *)mOriginalPacket)[1] = originalLength;
-
-      hmac.Final(&(result[0]));
-      return (0 == memcmp(&(mMessageIntegrity[0]), &(result[0]), sizeof(result)));
+      return internal::isValidMessageIntegrity(mOriginalPacket, mMessageIntegrityMessageLengthInBytes, &(mMessageIntegrity[0]), *key);
     }
 
     //-------------------------------------------------------------------------
@@ -2697,6 +2828,7 @@ namespace openpeer
         case Attribute_GSNFR:               return (0 != mGSNFR);
         case Attribute_RUDPFlags:           return mReliabilityFlagsIncluded;
         case Attribute_ACKVector:           return (0 != mACKVectorLength);
+        case Attribute_FECBlockSize:        return (0 != mFECBlockSize);
 
         // obsolete attributes
         case Attribute_ReservedResponseAddress:
@@ -2724,18 +2856,7 @@ namespace openpeer
                                                     RFCs rfc
                                                     ) const
     {
-      size_t packetLengthInBytes = OPENPEER_STUN_HEADER_SIZE_IN_BYTES;
-
-      // count the length of all the attributes when they are packetized
-      {
-        for (size_t loop = 0; Attribute_None != internal::gAttributeOrdering[loop]; ++loop) {
-          if (hasAttribute(internal::gAttributeOrdering[loop])) {
-            if (internal::shouldPacketizeAttribute(*this, rfc, internal::gAttributeOrdering[loop])) {
-              packetLengthInBytes += internal::packetizeAttributeLength(*this, rfc, internal::gAttributeOrdering[loop]);
-            }
-          }
-        }
-      }
+      size_t packetLengthInBytes = getPacketizedLength(rfc);
 
       // if not even enough room for the current packet then we report 0 bytes avilable
       if (packetLengthInBytes > maxPacketSizeInBytes) return 0;
@@ -2747,5 +2868,274 @@ namespace openpeer
       // the amount of space available is knocked down by the size of the header
       return remainder - sizeof(DWORD);
     }
+
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    #pragma mark
+    #pragma mark STUNPacketView
+    #pragma mark
+
+    //-------------------------------------------------------------------------
+    STUNPacketView::STUNPacketView() :
+      mPacket(NULL),
+      mPacketLengthInBytes(0),
+      mAllowedRFCs(STUNPacket::RFC_AllowAll),
+      mAllowRFC3489(true),
+      mClass(STUNPacket::Class_Request),
+      mMethod(STUNPacket::Method_Binding),
+      mMagicCookie(0),
+      mTransactionID(NULL),
+      mUsername(NULL),
+      mUsernameLengthInBytes(0),
+      mMessageIntegrity(NULL),
+      mMessageIntegrityMessageLengthInBytes(0),
+      mFingerprintIncluded(false)
+    {
+    }
+
+    //-------------------------------------------------------------------------
+    bool STUNPacketView::parse(
+                               STUNPacketView &outView,
+                               const BYTE *packet,
+                               size_t packetLengthInBytes,
+                               RFCs allowedRFCs,
+                               bool allowRFC3489
+                               )
+    {
+      ZS_THROW_INVALID_USAGE_IF(!packet)
+
+      outView = STUNPacketView();
+
+      // NOTE: The packet is rejected by the same header and attribute layout
+      //       rules as STUNPacket::parseIfSTUN so a packet which is not STUN
+      //       is discarded here without ever allocating.
+
+      if (packetLengthInBytes < OPENPEER_STUN_HEADER_SIZE_IN_BYTES) return false;
+
+      //The most significant 2 bits of every STUN message MUST be zeroes.
+      if (0 != (packet[0] & 0xC0)) return false;
+
+      DWORD magicCookie = internal::Helper::readDWORD(packet + sizeof(DWORD));
+      if ((!allowRFC3489) &&
+          (OPENPEER_STUN_MAGIC_COOKIE != magicCookie)) return false;
+
+      WORD messageType = internal::Helper::readWORD(packet);
+      WORD messageTypeClass = ((messageType & 0x100) >> 7) | ((messageType & 0x10) >> 4);
+      WORD messageTypeMethod = ((messageType & 0x3E00) >> 2) | ((messageType & 0xE0) >> 1) | (messageType & 0xF);
+      WORD messageLengthInBytes = internal::Helper::readWORD(packet + sizeof(WORD));
+
+      if (0 != (messageLengthInBytes & 0x3)) return false;
+      if (packetLengthInBytes < ((size_t)OPENPEER_STUN_HEADER_SIZE_IN_BYTES) + messageLengthInBytes) return false;
+
+      switch (messageTypeClass)
+      {
+        case STUNPacket::Class_Request:       break;
+        case STUNPacket::Class_Indication:    break;
+        case STUNPacket::Class_Response:      break;
+        case STUNPacket::Class_ErrorResponse: break;
+        default:                              return false;
+      }
+
+      if (!internal::isLegalMethod(static_cast<Methods>(messageTypeMethod), static_cast<Classes>(messageTypeClass), allowedRFCs)) return false;
+
+      outView.mPacket = packet;
+      outView.mPacketLengthInBytes = OPENPEER_STUN_HEADER_SIZE_IN_BYTES + messageLengthInBytes;
+      outView.mAllowedRFCs = allowedRFCs;
+      outView.mAllowRFC3489 = allowRFC3489;
+      outView.mClass = static_cast<Classes>(messageTypeClass);
+      outView.mMethod = static_cast<Methods>(messageTypeMethod);
+      outView.mMagicCookie = magicCookie;
+      outView.mTransactionID = packet + (sizeof(DWORD)*2);
+
+      size_t availableBytes = messageLengthInBytes;
+      const BYTE *pos = packet + OPENPEER_STUN_HEADER_SIZE_IN_BYTES;
+
+      while (availableBytes > 0) {
+        WORD attributeType = internal::Helper::readWORD(pos);
+        WORD attributeLength = internal::Helper::readWORD(pos + sizeof(WORD));
+        const BYTE *attributeStart = pos;
+
+        pos += sizeof(DWORD);
+        availableBytes -= sizeof(DWORD);
+
+        size_t fullAttributeLength = internal::dwordBoundary(attributeLength);
+        if (fullAttributeLength > availableBytes) return false; // illegal attribute length?
+
+        const BYTE *dataPos = pos;
+        pos += fullAttributeLength;
+        availableBytes -= fullAttributeLength;
+
+        // nothing after the fingerprint is understood and nothing but the
+        // fingerprint is understood after the integrity
+        if (outView.mFingerprintIncluded) continue;
+        if ((NULL != outView.mMessageIntegrity) &&
+            (STUNPacket::Attribute_FingerPrint != attributeType)) continue;
+
+        if (!internal::isAttributeKnown(allowedRFCs, (Attributes)attributeType)) continue;
+
+        switch (attributeType) {
+          case STUNPacket::Attribute_Username:          {
+            if (attributeLength > (OPENPEER_STUN_MAX_USERNAME*OPENPEER_STUN_MAX_UTF8_UNICODE_ENCODED_CHAR)) return false;
+            const BYTE *terminator = (const BYTE *)memchr(dataPos, 0, attributeLength);
+            outView.mUsername = (const char *)dataPos;
+            outView.mUsernameLengthInBytes = (NULL != terminator ? (size_t)(terminator - dataPos) : attributeLength);
+            break;
+          }
+          case STUNPacket::Attribute_MessageIntegrity:  {
+            if (attributeLength < OPENPEER_STUN_MESSAGE_INTEGRITY_LENGTH_IN_BYTES) return false;
+            outView.mMessageIntegrity = dataPos;
+            outView.mMessageIntegrityMessageLengthInBytes = ((PTRNUMBER)attributeStart) - ((PTRNUMBER)packet);
+            break;
+          }
+          case STUNPacket::Attribute_FingerPrint:       {
+            if (attributeLength < sizeof(DWORD)) return false;
+            if (!internal::isValidFingerprint(packet, attributeStart, dataPos)) return false;
+            outView.mFingerprintIncluded = true;
+            break;
+          }
+          default:                                      break;
+        }
+      }
+
+      return true;
+    }
+
+    //-------------------------------------------------------------------------
+    STUNPacketPtr STUNPacketView::materialize(
+                                              const char *logObject,
+                                              PUID logObjectID
+                                              ) const
+    {
+      if (!mPacket) return STUNPacketPtr();
+      return STUNPacket::parseIfSTUN(mPacket, mPacketLengthInBytes, mAllowedRFCs, mAllowRFC3489, logObject, logObjectID);
+    }
+
+    //-------------------------------------------------------------------------
+    const char *STUNPacketView::classAsString() const
+    {
+      return STUNPacket::toString(mClass);
+    }
+
+    //-------------------------------------------------------------------------
+    const char *STUNPacketView::methodAsString() const
+    {
+      return STUNPacket::toString(mMethod);
+    }
+
+    //-------------------------------------------------------------------------
+    bool STUNPacketView::isRFC3489() const
+    {
+      return OPENPEER_STUN_MAGIC_COOKIE != mMagicCookie;
+    }
+
+    //-------------------------------------------------------------------------
+    bool STUNPacketView::isRFC5389() const
+    {
+      return OPENPEER_STUN_MAGIC_COOKIE == mMagicCookie;
+    }
+
+    //-------------------------------------------------------------------------
+    STUNPacketView::RFCs STUNPacketView::guessRFC(RFCs allowedRFCs) const
+    {
+      return internal::guessRFC(*this, allowedRFCs);
+    }
+
+    //-------------------------------------------------------------------------
+    bool STUNPacketView::hasAttribute(Attributes attribute) const
+    {
+      switch (attribute)
+      {
+        case STUNPacket::Attribute_Username:          return hasUsername();
+        case STUNPacket::Attribute_MessageIntegrity:  return NULL != mMessageIntegrity;
+        case STUNPacket::Attribute_FingerPrint:       return mFingerprintIncluded;
+        default:                                      break;
+      }
+
+      const BYTE *data = NULL;
+      size_t dataLengthInBytes = 0;
+      return findAttribute(attribute, data, dataLengthInBytes);
+    }
+
+    //-------------------------------------------------------------------------
+    bool STUNPacketView::findAttribute(
+                                       Attributes attribute,
+                                       const BYTE * &outData,
+                                       size_t &outDataLengthInBytes
+                                       ) const
+    {
+      outData = NULL;
+      outDataLengthInBytes = 0;
+
+      if (!mPacket) return false;
+      if (!internal::isAttributeKnown(mAllowedRFCs, attribute)) return false;
+
+      // the layout was validated during the parse so the walk cannot overrun
+      const BYTE *pos = mPacket + OPENPEER_STUN_HEADER_SIZE_IN_BYTES;
+      const BYTE *end = mPacket + mPacketLengthInBytes;
+      bool foundIntegrity = false;
+
+      while (pos < end) {
+        WORD attributeType = internal::Helper::readWORD(pos);
+        WORD attributeLength = internal::Helper::readWORD(pos + sizeof(WORD));
+        const BYTE *dataPos = pos + sizeof(DWORD);
+
+        pos = dataPos + internal::dwordBoundary(attributeLength);
+
+        if ((foundIntegrity) &&
+            (STUNPacket::Attribute_FingerPrint != attributeType)) continue;
+
+        if (attribute == attributeType) {
+          outData = dataPos;
+          outDataLengthInBytes = attributeLength;
+          return true;
+        }
+
+        if (STUNPacket::Attribute_FingerPrint == attributeType) break;
+        if (STUNPacket::Attribute_MessageIntegrity == attributeType) foundIntegrity = true;
+      }
+      return false;
+    }
+
+    //-------------------------------------------------------------------------
+    bool STUNPacketView::splitUsername(
+                                       const char * &outLocalUsernameFrag,
+                                       size_t &outLocalUsernameFragLengthInBytes,
+                                       const char * &outRemoteUsernameFrag,
+                                       size_t &outRemoteUsernameFragLengthInBytes
+                                       ) const
+    {
+      outLocalUsernameFrag = NULL;
+      outLocalUsernameFragLengthInBytes = 0;
+      outRemoteUsernameFrag = NULL;
+      outRemoteUsernameFragLengthInBytes = 0;
+
+      if (!hasUsername()) return false;
+
+      const char *separator = (const char *)memchr(mUsername, ':', mUsernameLengthInBytes);
+      if (NULL == separator) return false;
+
+      outLocalUsernameFrag = mUsername;
+      outLocalUsernameFragLengthInBytes = (size_t)(separator - mUsername);
+      outRemoteUsernameFrag = separator + 1;
+      outRemoteUsernameFragLengthInBytes = mUsernameLengthInBytes - outLocalUsernameFragLengthInBytes - 1;
+      return true;
+    }
+
+    //-------------------------------------------------------------------------
+    bool STUNPacketView::isValidMessageIntegrity(
+                                                 const char *password,
+                                                 const char *username,
+                                                 const char *realm
+                                                 ) const
+    {
+      if (!mMessageIntegrity) {
+        ZS_LOG_TRACE(Log::Params("packet does not have message integrity", "STUNPacketView"))
+        return false;
+      }
+
+      return internal::isValidMessageIntegrity(mPacket, mMessageIntegrityMessageLengthInBytes, mMessageIntegrity, password, username, realm);
+    }
   }
 }
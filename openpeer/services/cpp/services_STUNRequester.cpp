@@ -83,7 +83,6 @@ namespace openpeer
         mRequestStartTime(zsLib::now()),
         mMaxTimeout(Duration() != maxTimeout ? maxTimeout : Milliseconds(OPENPEER_SERVICES_STUN_REQUESTER_MAX_REQUEST_TIME_IN_MILLISECONDS))
       {
-        IHelper::setTimerThreadPriority();
       }
 
       //-----------------------------------------------------------------------
@@ -180,14 +179,8 @@ namespace openpeer
         mRequestStartTime = zsLib::now();
         mCurrentTimeout = Milliseconds(OPENPEER_SERVICES_STUN_REQUESTER_FIRST_ATTEMPT_TIMEOUT_IN_MILLISECONDS);
         mTryNumber = 0;
-        if (mTimer) {
-          mTimer->cancel();
-          mTimer.reset();
-        }
-        if (mMaxTimeTimer) {
-          mMaxTimeTimer->cancel();
-          mMaxTimeTimer.reset();
-        }
+        mNextRetransmitTime = Time();
+        mTimeoutTime = Time();
 
         step();
       }
@@ -266,15 +259,7 @@ namespace openpeer
       }
 
       //-----------------------------------------------------------------------
-      //-----------------------------------------------------------------------
-      //-----------------------------------------------------------------------
-      //-----------------------------------------------------------------------
-      #pragma mark
-      #pragma mark STUNRequester => ITimerDelegate
-      #pragma mark
-
-      //-----------------------------------------------------------------------
-      void STUNRequester::onTimer(TimerPtr timer)
+      void STUNRequester::notifyTimeout()
       {
         Time tick = zsLib::now();
         Duration totalTime = tick - mRequestStartTime;
@@ -283,15 +268,17 @@ namespace openpeer
           AutoRecursiveLock lock(mLock);
           if (!mDelegate) return;
 
-          if (timer == mMaxTimeTimer) goto timed_out;
+          if ((Time() != mTimeoutTime) &&
+              (tick >= mTimeoutTime)) goto timed_out;
 
-          if (timer != mTimer) {
-            ZS_LOG_WARNING(Debug, log("received timer event from an obsolete timer"))
+          if ((Time() == mNextRetransmitTime) ||
+              (tick < mNextRetransmitTime)) {
+            ZS_LOG_TRACE(log("ignoring timeout notification that is no longer relevant"))
             return;
           }
 
-          // the timer fired, that means the STUN lookup timed out
-          mTimer.reset();
+          // the retransmission time passed, that means the STUN lookup timed out
+          mNextRetransmitTime = Time();
 
           ++mTryNumber;
 
@@ -302,7 +289,7 @@ namespace openpeer
 
           mCurrentTimeout = mCurrentTimeout + mCurrentTimeout + Milliseconds(OPENPEER_SERVICES_STUN_REQUESTER_FIRST_ATTEMPT_TIMEOUT_IN_MILLISECONDS);
 
-          // create a new timer using the new timeout
+          // schedule a new retransmission using the new timeout
           step();
           return;
         }
@@ -358,14 +345,9 @@ namespace openpeer
           }
         }
 
-        if (mTimer) {
-          mTimer->cancel();
-          mTimer.reset();
-        }
-        if (mMaxTimeTimer) {
-          mMaxTimeTimer->cancel();
-          mMaxTimeTimer.reset();
-        }
+        // any timeout still scheduled is ignored when it fires
+        mNextRetransmitTime = Time();
+        mTimeoutTime = Time();
       }
 
       //-----------------------------------------------------------------------
@@ -377,13 +359,23 @@ namespace openpeer
 
         if (!mSTUNRequest) return;
 
-        if (!mMaxTimeTimer) {
-          mMaxTimeTimer = Timer::create(mThisWeak.lock(), mMaxTimeout, false);
+        UseSTUNRequesterManagerPtr manager = UseSTUNRequesterManager::singleton();
+        if (!manager) {
+          ZS_LOG_WARNING(Detail, log("STUN requester manager is gone thus cannot schedule retransmissions"))
+          return;
+        }
+
+        Time tick = zsLib::now();
+
+        if (Time() == mTimeoutTime) {
+          mTimeoutTime = tick + mMaxTimeout;
+          manager->scheduleTimeout(mThisWeak.lock(), mTimeoutTime);
         }
 
-        if (!mTimer) {
-          // we have a stun request but not a timer, setup the timer now...
-          mTimer = Timer::create(mThisWeak.lock(), mCurrentTimeout, false);
+        if (Time() == mNextRetransmitTime) {
+          // we have a stun request but no retransmission scheduled, schedule it now...
+          mNextRetransmitTime = tick + mCurrentTimeout;
+          manager->scheduleTimeout(mThisWeak.lock(), mNextRetransmitTime);
 
           ZS_LOG_TRACE(log("sending packet now") + ZS_PARAM("ip", mServerIP.string()) + ZS_PARAM("try number", mTryNumber) + ZS_PARAM("timeout duration", mCurrentTimeout.total_milliseconds()) + ZS_PARAM("stun packet", mSTUNRequest->toDebug()))
 
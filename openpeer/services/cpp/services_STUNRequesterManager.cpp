@@ -33,6 +33,8 @@
 #include <openpeer/services/internal/services_STUNRequester.h>
 #include <openpeer/services/IHelper.h>
 
+#include <boost/functional/hash.hpp>
+
 #include <zsLib/Exception.h>
 #include <zsLib/Log.h>
 #include <zsLib/XML.h>
@@ -89,6 +91,24 @@ namespace openpeer
         return STUNRequesterManager::QWORDPair(q1, q2);
       }
 
+      //-----------------------------------------------------------------------
+      static STUNRequesterManager::QWORDPair getKey(const STUNPacketView &stun)
+      {
+        BYTE buffer[sizeof(QWORD)*2];
+        ZS_THROW_INVALID_ASSUMPTION_IF(sizeof(buffer) < (sizeof(stun.mMagicCookie) + OPENPEER_STUN_TRANSACTION_ID_LENGTH_IN_BYTES))
+
+        memset(&(buffer[0]), 0, sizeof(buffer));
+
+        memcpy(&(buffer[0]), &(stun.mMagicCookie), sizeof(stun.mMagicCookie));
+        memcpy(&(buffer[sizeof(stun.mMagicCookie)]), stun.mTransactionID, OPENPEER_STUN_TRANSACTION_ID_LENGTH_IN_BYTES);
+
+        QWORD q1 = 0;
+        QWORD q2 = 0;
+        memcpy(&q1, &(buffer[0]), sizeof(q1));
+        memcpy(&q2, &(buffer[sizeof(q1)]), sizeof(q2));
+        return STUNRequesterManager::QWORDPair(q1, q2);
+      }
+
       //-----------------------------------------------------------------------
       //-----------------------------------------------------------------------
       //-----------------------------------------------------------------------
@@ -99,9 +119,11 @@ namespace openpeer
 
       //-----------------------------------------------------------------------
       STUNRequesterManager::STUNRequesterManager() :
+        MessageQueueAssociator(IHelper::getServiceQueue()),
         mID(zsLib::createPUID())
       {
         ZS_LOG_DETAIL(log("created"))
+        IHelper::setTimerThreadPriority();
       }
 
       STUNRequesterManager::~STUNRequesterManager()
@@ -110,6 +132,12 @@ namespace openpeer
         
         mThisWeak.reset();
         ZS_LOG_DETAIL(log("destroyed"))
+
+        AutoLock lock(mTimerLock);
+        if (mTimer) {
+          mTimer->cancel();
+          mTimer.reset();
+        }
       }
 
       //-----------------------------------------------------------------------
@@ -159,19 +187,20 @@ namespace openpeer
           return ISTUNRequesterPtr();
         }
 
-        QWORDPair key = getKey(stun);
-
         ZS_THROW_INVALID_USAGE_IF(!stun)
 
+        QWORDPair key = getKey(stun);
+        Shard &shard = getShard(key);
+
         UseSTUNRequesterPtr requester;
 
         // scope: we cannot call the requester from within the lock because
         //        the requester might be calling the manager at the same
         //        time (thus trying to obtain the lock)
         {
-          AutoRecursiveLock lock(mLock);
-          STUNRequesterMap::iterator iter = mRequesters.find(key);
-          if (iter == mRequesters.end()) {
+          AutoLock lock(shard.mLock);
+          STUNRequesterMap::iterator iter = shard.mRequesters.find(key);
+          if (iter == shard.mRequesters.end()) {
             ZS_LOG_WARNING(Trace, log("did not find STUN requester for STUN packet") + ZS_PARAM("stun packet", stun->toDebug()))
             return ISTUNRequesterPtr();
           }
@@ -196,17 +225,51 @@ namespace openpeer
         }
 
         if (remove) {
-          AutoRecursiveLock lock(mLock);
+          AutoLock lock(shard.mLock);
 
-          STUNRequesterMap::iterator iter = mRequesters.find(key);
-          if (iter == mRequesters.end())
+          STUNRequesterMap::iterator iter = shard.mRequesters.find(key);
+          if (iter == shard.mRequesters.end())
             return STUNRequester::convert(requester);
 
-          mRequesters.erase(iter);
+          shard.mRequesters.erase(iter);
         }
         return remove ? STUNRequester::convert(requester) : ISTUNRequesterPtr();
       }
 
+      //-----------------------------------------------------------------------
+      ISTUNRequesterPtr STUNRequesterManager::handleSTUNPacket(
+                                                               IPAddress fromIPAddress,
+                                                               const STUNPacketView &stun
+                                                               )
+      {
+        if ((stun.mClass == STUNPacket::Class_Request) ||
+            (stun.mClass == STUNPacket::Class_Indication)) {
+          ZS_LOG_TRACE(log("ignoring STUN packet that are requests or indications"))
+          return ISTUNRequesterPtr();
+        }
+
+        QWORDPair key = getKey(stun);
+        Shard &shard = getShard(key);
+
+        // scope: only pay for decoding the packet if a requester is waiting on it
+        {
+          AutoLock lock(shard.mLock);
+          STUNRequesterMap::iterator iter = shard.mRequesters.find(key);
+          if (iter == shard.mRequesters.end()) {
+            ZS_LOG_TRACE(log("did not find STUN requester for STUN packet view") + ZS_PARAM("class", stun.classAsString()) + ZS_PARAM("method", stun.methodAsString()))
+            return ISTUNRequesterPtr();
+          }
+        }
+
+        STUNPacketPtr packet = stun.materialize("STUNRequesterManager", mID);
+        if (!packet) {
+          ZS_LOG_WARNING(Trace, log("STUN packet view could not be decoded"))
+          return ISTUNRequesterPtr();
+        }
+
+        return handleSTUNPacket(fromIPAddress, packet);
+      }
+
       //-----------------------------------------------------------------------
       //-----------------------------------------------------------------------
       //-----------------------------------------------------------------------
@@ -226,9 +289,10 @@ namespace openpeer
         ZS_THROW_INVALID_USAGE_IF(!requester)
 
         QWORDPair key = getKey(request);
+        Shard &shard = getShard(key);
 
-        AutoRecursiveLock lock(mLock);
-        mRequesters[key] = STUNRequesterPair(requester, requester->getID());
+        AutoLock lock(shard.mLock);
+        shard.mRequesters[key] = STUNRequesterPair(requester, requester->getID());
       }
 
       //-----------------------------------------------------------------------
@@ -236,16 +300,83 @@ namespace openpeer
       {
         UseSTUNRequester &requester = inRequester;
 
-        AutoRecursiveLock lock(mLock);
+        STUNPacketPtr request = requester.getRequest();
+        if (!request) return;
+
+        QWORDPair key = getKey(request);
+        Shard &shard = getShard(key);
+
+        AutoLock lock(shard.mLock);
+
+        STUNRequesterMap::iterator found = shard.mRequesters.find(key);
+        if (found == shard.mRequesters.end()) return;
+
+        // a newer requester might have re-used the same transaction
+        if ((*found).second.second != requester.getID()) return;
+
+        // found the requester, remove it from the monitor map
+        shard.mRequesters.erase(found);
+      }
+
+      //-----------------------------------------------------------------------
+      void STUNRequesterManager::scheduleTimeout(
+                                                 STUNRequesterPtr inRequester,
+                                                 Time expires
+                                                 )
+      {
+        UseSTUNRequesterPtr requester = inRequester;
+
+        ZS_THROW_INVALID_USAGE_IF(!requester)
+
+        AutoLock lock(mTimerLock);
+
+        mTimerWheel.schedule(requester, expires);
 
-        for (STUNRequesterMap::iterator iter = mRequesters.begin(); iter != mRequesters.end(); ++iter) {
-          if ((*iter).second.second == requester.getID()) {
-            // found the requester, remove it from the monitor map
-            mRequesters.erase(iter);
+        if (!mTimer) {
+          mTimer = Timer::create(mThisWeak.lock(), Milliseconds(OPENPEER_SERVICES_STUN_REQUESTER_MANAGER_TIMER_WHEEL_TICK_IN_MILLISECONDS));
+        }
+      }
+
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      #pragma mark
+      #pragma mark STUNRequesterManager => ITimerDelegate
+      #pragma mark
+
+      //-----------------------------------------------------------------------
+      void STUNRequesterManager::onTimer(TimerPtr timer)
+      {
+        TimerWheel::EntryList expired;
+
+        // scope: collect the expired entries but never call the requesters
+        //        from within the lock since they schedule their next
+        //        timeout from inside their own lock
+        {
+          AutoLock lock(mTimerLock);
+          if (timer != mTimer) {
+            ZS_LOG_WARNING(Debug, log("received timer event from an obsolete timer"))
             return;
           }
+
+          mTimerWheel.advance(zsLib::now(), expired);
+
+          if (mTimerWheel.isEmpty()) {
+            ZS_LOG_TRACE(log("no more timeouts scheduled thus stopping timer wheel"))
+            mTimer->cancel();
+            mTimer.reset();
+          }
+        }
+
+        for (TimerWheel::EntryList::iterator iter = expired.begin(); iter != expired.end(); ++iter) {
+          UseSTUNRequesterPtr requester = (*iter).mRequester.lock();
+          if (!requester) continue;
+
+          requester->notifyTimeout();
         }
       }
+
       
       //-----------------------------------------------------------------------
       //-----------------------------------------------------------------------
@@ -268,6 +399,147 @@ namespace openpeer
       {
         return Log::Params(message, "services::STUNRequesterManager");
       }
+
+      //-----------------------------------------------------------------------
+      STUNRequesterManager::Shard &STUNRequesterManager::getShard(const QWORDPair &key)
+      {
+        return mShards[boost::hash_value(key) % OPENPEER_SERVICES_STUN_REQUESTER_MANAGER_TOTAL_SHARDS];
+      }
+
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      #pragma mark
+      #pragma mark STUNRequesterManager::TimerWheel
+      #pragma mark
+
+      //-----------------------------------------------------------------------
+      STUNRequesterManager::TimerWheel::TimerWheel() :
+        mStartTime(zsLib::now()),
+        mCurrentTick(0),
+        mTotalEntries(0)
+      {
+      }
+
+      //-----------------------------------------------------------------------
+      void STUNRequesterManager::TimerWheel::schedule(
+                                                      UseSTUNRequesterPtr requester,
+                                                      Time expires
+                                                      )
+      {
+        if (0 == mTotalEntries) {
+          // the timer stops while the wheel is empty so the current tick
+          // is stale; catch up now (nothing can be skipped over) rather
+          // than walk the whole idle period tick by tick on the next advance
+          mCurrentTick = toTick(zsLib::now(), false);
+        }
+
+        EntryList source;
+        source.push_back(Entry());
+
+        Entry &entry = source.back();
+        entry.mExpiresTick = toTick(expires, true);
+        entry.mRequester = requester;
+
+        // the slot for the current tick was already processed
+        insert(source, source.begin(), mCurrentTick + 1);
+        ++mTotalEntries;
+      }
+
+      //-----------------------------------------------------------------------
+      void STUNRequesterManager::TimerWheel::advance(
+                                                     Time now,
+                                                     EntryList &outExpired
+                                                     )
+      {
+        QWORD targetTick = toTick(now, false);
+
+        while (mCurrentTick < targetTick) {
+          if (0 == mTotalEntries) {
+            // nothing can expire so skip straight to the target
+            mCurrentTick = targetTick;
+            break;
+          }
+
+          ++mCurrentTick;
+
+          if (0 == (mCurrentTick % OPENPEER_SERVICES_STUN_REQUESTER_MANAGER_TIMER_WHEEL_NEAR_SLOTS)) {
+            QWORD block = mCurrentTick / OPENPEER_SERVICES_STUN_REQUESTER_MANAGER_TIMER_WHEEL_NEAR_SLOTS;
+
+            cascade(mFar[block % OPENPEER_SERVICES_STUN_REQUESTER_MANAGER_TIMER_WHEEL_FAR_SLOTS]);
+
+            if (0 == (block % OPENPEER_SERVICES_STUN_REQUESTER_MANAGER_TIMER_WHEEL_FAR_SLOTS)) {
+              cascade(mOverflow);
+            }
+          }
+
+          EntryList &slot = mNear[mCurrentTick % OPENPEER_SERVICES_STUN_REQUESTER_MANAGER_TIMER_WHEEL_NEAR_SLOTS];
+          while (!slot.empty()) {
+            outExpired.splice(outExpired.end(), slot, slot.begin());
+            --mTotalEntries;
+          }
+        }
+      }
+
+      //-----------------------------------------------------------------------
+      QWORD STUNRequesterManager::TimerWheel::toTick(
+                                                     Time when,
+                                                     bool roundUp
+                                                     ) const
+      {
+        if (when <= mStartTime) return 0;
+
+        QWORD milliseconds = static_cast<QWORD>((when - mStartTime).total_milliseconds());
+        if (roundUp) {
+          milliseconds += (OPENPEER_SERVICES_STUN_REQUESTER_MANAGER_TIMER_WHEEL_TICK_IN_MILLISECONDS - 1);
+        }
+        return milliseconds / OPENPEER_SERVICES_STUN_REQUESTER_MANAGER_TIMER_WHEEL_TICK_IN_MILLISECONDS;
+      }
+
+      //-----------------------------------------------------------------------
+      void STUNRequesterManager::TimerWheel::insert(
+                                                    EntryList &source,
+                                                    EntryList::iterator iter,
+                                                    QWORD minimumTick
+                                                    )
+      {
+        if ((*iter).mExpiresTick < minimumTick) {
+          (*iter).mExpiresTick = minimumTick;
+        }
+
+        QWORD tick = (*iter).mExpiresTick;
+
+        if (tick - mCurrentTick < OPENPEER_SERVICES_STUN_REQUESTER_MANAGER_TIMER_WHEEL_NEAR_SLOTS) {
+          EntryList &slot = mNear[tick % OPENPEER_SERVICES_STUN_REQUESTER_MANAGER_TIMER_WHEEL_NEAR_SLOTS];
+          slot.splice(slot.end(), source, iter);
+          return;
+        }
+
+        QWORD block = tick / OPENPEER_SERVICES_STUN_REQUESTER_MANAGER_TIMER_WHEEL_NEAR_SLOTS;
+        QWORD currentBlock = mCurrentTick / OPENPEER_SERVICES_STUN_REQUESTER_MANAGER_TIMER_WHEEL_NEAR_SLOTS;
+
+        if (block - currentBlock < OPENPEER_SERVICES_STUN_REQUESTER_MANAGER_TIMER_WHEEL_FAR_SLOTS) {
+          EntryList &slot = mFar[block % OPENPEER_SERVICES_STUN_REQUESTER_MANAGER_TIMER_WHEEL_FAR_SLOTS];
+          slot.splice(slot.end(), source, iter);
+          return;
+        }
+
+        mOverflow.splice(mOverflow.end(), source, iter);
+      }
+
+      //-----------------------------------------------------------------------
+      void STUNRequesterManager::TimerWheel::cascade(EntryList &source)
+      {
+        EntryList pending;
+        pending.splice(pending.end(), source);
+
+        // entries due on the current tick land in the near slot which is
+        // about to be processed
+        while (!pending.empty()) {
+          insert(pending, pending.begin(), mCurrentTick);
+        }
+      }
     }
 
     //-------------------------------------------------------------------------
@@ -289,8 +561,8 @@ namespace openpeer
       ZS_THROW_INVALID_USAGE_IF(0 == packetLengthInBytes)
       ZS_THROW_INVALID_USAGE_IF(!packet)
 
-      STUNPacketPtr stun = STUNPacket::parseIfSTUN(packet, packetLengthInBytes, allowedRFCs, false);
-      if (!stun) return ISTUNRequesterPtr();
+      STUNPacketView stun;
+      if (!STUNPacketView::parse(stun, packet, packetLengthInBytes, allowedRFCs, false)) return ISTUNRequesterPtr();
 
       return handleSTUNPacket(fromIPAddress, stun);
     }
@@ -305,5 +577,16 @@ namespace openpeer
       if (!manager) return ISTUNRequesterPtr();
       return manager->handleSTUNPacket(fromIPAddress, stun);
     }
+
+    //-------------------------------------------------------------------------
+    ISTUNRequesterPtr ISTUNRequesterManager::handleSTUNPacket(
+                                                              IPAddress fromIPAddress,
+                                                              const STUNPacketView &stun
+                                                              )
+    {
+      internal::STUNRequesterManagerPtr manager = internal::STUNRequesterManager::singleton();
+      if (!manager) return ISTUNRequesterPtr();
+      return manager->handleSTUNPacket(fromIPAddress, stun);
+    }
   }
 }
@@ -575,14 +575,26 @@ namespace openpeer
         setUInt(OPENPEER_SERVICES_SETTING_TURN_CANDIDATES_MUST_REMAIN_ALIVE_AFTER_ICE_WAKE_UP_IN_SECONDS, 60*5);
         setUInt(OPENPEER_SERVICES_SETTING_MAX_REBIND_ATTEMPT_DURATION_IN_SECONDS, 60);
         setBool(OPENPEER_SERVICES_SETTING_ICE_SOCKET_NO_LOCAL_IPS_CAUSES_SOCKET_FAILURE, false);
+        setUInt(OPENPEER_SERVICES_SETTING_ICE_SOCKET_RECEIVE_BATCH_SIZE, 1);
+        setUInt(OPENPEER_SERVICES_SETTING_ICE_SOCKET_SHARDS, 1);
+        setBool(OPENPEER_SERVICES_SETTING_ICE_SOCKET_MTU_SIZED_RECEIVE_BUFFERS, false);
+        setBool(OPENPEER_SERVICES_SETTING_UDP_SEGMENTATION_OFFLOAD, false);
+        setUInt(OPENPEER_SERVICES_SETTING_TURN_TCP_WRITE_QUEUE_WATERMARK_IN_BYTES, 256*1024);
+        setUInt(OPENPEER_SERVICES_SETTING_TURN_RACE_SERVERS, 1);
+        setBool(OPENPEER_SERVICES_SETTING_RUDP_PREFER_DELAY_BASED_CONGESTION_CONTROL, false);
+        setUInt(OPENPEER_SERVICES_SETTING_RUDP_DELAY_BASED_TARGET_DELAY_IN_MILLISECONDS, 100);
+        setBool(OPENPEER_SERVICES_SETTING_RUDP_PACING, false);
+        setUInt(OPENPEER_SERVICES_SETTING_RUDP_FEC_BLOCK_SIZE, 0);
 
         setString(OPENPEER_SERVICES_SETTING_HELPER_SERVICES_THREAD_PRIORITY, "high");
         setString(OPENPEER_SERVICES_SETTING_HELPER_LOGGER_THREAD_PRIORITY, "normal");
         setString(OPENPEER_SERVICES_SETTING_HELPER_SOCKET_MONITOR_THREAD_PRIORITY, "real-time");
         setString(OPENPEER_SERVICES_SETTING_HELPER_TIMER_MONITOR_THREAD_PRIORITY, "normal");
         setString(OPENPEER_SERVICES_SETTING_HELPER_HTTP_THREAD_PRIORITY, "normal");
+        setString(OPENPEER_SERVICES_SETTING_SOCKET_EVENT_BACKEND, OPENPEER_SERVICES_SOCKET_EVENT_BACKEND_ZSLIB);
         setString(OPENPEER_SERVICES_SETTING_ONLY_ALLOW_DATA_SENT_TO_SPECIFIC_IPS, "");
         setString(OPENPEER_SERVICES_SETTING_ONLY_ALLOW_TURN_TO_RELAY_DATA_TO_SPECIFIC_IPS, "");
+        setString(OPENPEER_SERVICES_SETTING_TURN_TCP_WRITE_QUEUE_DROP_POLICY, OPENPEER_SERVICES_TURN_TCP_WRITE_QUEUE_DROP_POLICY_NEWEST);
         setString(OPENPEER_SERVICES_SETTING_INTERFACE_NAME_ORDER, "lo;en;pdp_ip;stf;gif;bbptp;p2p");
       }
 
@@ -0,0 +1,634 @@
+/*
+
+ Copyright (c) 2013, SMB Phone Inc.
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+
+ 1. Redistributions of source code must retain the above copyright notice, this
+ list of conditions and the following disclaimer.
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ The views and conclusions contained in the software and documentation are those
+ of the authors and should not be interpreted as representing official policies,
+ either expressed or implied, of the FreeBSD Project.
+
+ */
+
+#include <openpeer/services/internal/services_SocketEventBackend.h>
+#include <openpeer/services/internal/services_Helper.h>
+
+#include <openpeer/services/IHelper.h>
+#include <openpeer/services/ISettings.h>
+
+#include <zsLib/Exception.h>
+#include <zsLib/Log.h>
+#include <zsLib/XML.h>
+#include <zsLib/MessageQueueThread.h>
+
+#include <boost/thread.hpp>
+
+#include <string.h>
+
+#ifdef __linux__
+#define OPENPEER_SERVICES_SOCKET_EVENT_BACKEND_HAS_EPOLL
+#endif //__linux__
+
+#ifdef OPENPEER_SERVICES_SOCKET_EVENT_BACKEND_HAS_EPOLL
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <poll.h>
+#include <unistd.h>
+#include <errno.h>
+#endif //OPENPEER_SERVICES_SOCKET_EVENT_BACKEND_HAS_EPOLL
+
+#define OPENPEER_SERVICES_SOCKET_EVENT_BACKEND_MAX_EVENTS_PER_WAIT (64)
+#define OPENPEER_SERVICES_SOCKET_EVENT_BACKEND_WAIT_TIMEOUT_IN_MILLISECONDS (1000)
+
+namespace openpeer { namespace services { ZS_DECLARE_SUBSYSTEM(openpeer_services) } }
+
+namespace openpeer
+{
+  namespace services
+  {
+    namespace internal
+    {
+      using zsLib::ISocketDelegateProxy;
+
+      ZS_DECLARE_TYPEDEF_PTR(zsLib::MessageQueueAssociator, UseMessageQueueAssociator)
+
+      typedef zsLib::Socket::Monitor SocketMonitor;
+
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      #pragma mark
+      #pragma mark SocketEventBackend
+      #pragma mark
+
+      //-----------------------------------------------------------------------
+      SocketEventBackend::SocketEventBackend() :
+        SharedRecursiveLock(SharedRecursiveLock::create()),
+        mUseEpoll(false),
+        mShouldShutdown(false),
+        mEpoll(-1),
+        mWakeUpEvent(-1),
+        mTotalWakeUps(0),
+        mTotalEvents(0)
+      {
+        ZS_LOG_DETAIL(log("created"))
+      }
+
+      //-----------------------------------------------------------------------
+      void SocketEventBackend::init()
+      {
+        AutoRecursiveLock lock(*this);
+
+        String backend = ISettings::getString(OPENPEER_SERVICES_SETTING_SOCKET_EVENT_BACKEND);
+        if (OPENPEER_SERVICES_SOCKET_EVENT_BACKEND_EPOLL != backend) {
+          ZS_LOG_DETAIL(log("using zsLib socket monitor") + ZS_PARAM("backend", backend))
+          return;
+        }
+
+#ifdef OPENPEER_SERVICES_SOCKET_EVENT_BACKEND_HAS_EPOLL
+        mEpoll = epoll_create1(EPOLL_CLOEXEC);
+        if (-1 == mEpoll) {
+          ZS_LOG_ERROR(Basic, log("epoll_create1 failed thus using zsLib socket monitor") + ZS_PARAM("error", errno))
+          return;
+        }
+
+        mWakeUpEvent = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (-1 == mWakeUpEvent) {
+          ZS_LOG_ERROR(Basic, log("eventfd failed thus using zsLib socket monitor") + ZS_PARAM("error", errno))
+          close(mEpoll);
+          mEpoll = -1;
+          return;
+        }
+
+        epoll_event event;
+        memset(&event, 0, sizeof(event));
+        event.events = EPOLLIN;
+        event.data.fd = mWakeUpEvent;
+        if (0 != epoll_ctl(mEpoll, EPOLL_CTL_ADD, mWakeUpEvent, &event)) {
+          ZS_LOG_ERROR(Basic, log("unable to monitor wake up event thus using zsLib socket monitor") + ZS_PARAM("error", errno))
+          close(mWakeUpEvent);
+          close(mEpoll);
+          mWakeUpEvent = -1;
+          mEpoll = -1;
+          return;
+        }
+
+        mUseEpoll = true;
+
+        mThread = ThreadPtr(new boost::thread(boost::ref(*this)));
+        zsLib::setThreadPriority(*mThread, zsLib::threadPriorityFromString(ISettings::getString(OPENPEER_SERVICES_SETTING_HELPER_SOCKET_MONITOR_THREAD_PRIORITY)));
+
+        ZS_LOG_DETAIL(log("using epoll socket event backend"))
+#else
+        ZS_LOG_WARNING(Detail, log("epoll is not available on this platform thus using zsLib socket monitor"))
+#endif //OPENPEER_SERVICES_SOCKET_EVENT_BACKEND_HAS_EPOLL
+      }
+
+      //-----------------------------------------------------------------------
+      SocketEventBackend::~SocketEventBackend()
+      {
+        if (isNoop()) return;
+
+        mThisWeak.reset();
+        ZS_LOG_DETAIL(log("destroyed"))
+        cancel();
+      }
+
+      //-----------------------------------------------------------------------
+      void SocketEventBackend::attach(
+                                      SocketPtr socket,
+                                      ISocketDelegatePtr delegate,
+                                      zsLib::Socket::Monitor::Options options
+                                      )
+      {
+        ZS_THROW_INVALID_ARGUMENT_IF(!socket)
+
+        SocketEventBackendPtr pThis = singleton();
+        if ((!pThis) ||
+            (!pThis->isEpoll())) {
+          socket->setDelegate(delegate);
+          if (SocketMonitor::All != options) {
+            socket->monitor(options);
+          }
+          return;
+        }
+
+        pThis->internalAttach(socket, delegate, options);
+      }
+
+      //-----------------------------------------------------------------------
+      void SocketEventBackend::monitor(
+                                       SocketPtr socket,
+                                       zsLib::Socket::Monitor::Options options
+                                       )
+      {
+        ZS_THROW_INVALID_ARGUMENT_IF(!socket)
+
+        SocketEventBackendPtr pThis = singleton();
+        if ((!pThis) ||
+            (!pThis->isEpoll())) {
+          socket->monitor(options);
+          return;
+        }
+
+        pThis->internalMonitor(socket, options);
+      }
+
+      //-----------------------------------------------------------------------
+      void SocketEventBackend::detach(SocketPtr socket)
+      {
+        if (!socket) return;
+
+        SocketEventBackendPtr pThis = singleton();
+        if ((!pThis) ||
+            (!pThis->isEpoll())) return;  // zsLib stops monitoring when the socket is closed
+
+        pThis->internalDetach(socket);
+      }
+
+      //-----------------------------------------------------------------------
+      ElementPtr SocketEventBackend::toDebug()
+      {
+        SocketEventBackendPtr pThis = singleton();
+        if (!pThis) return ElementPtr();
+        return pThis->internalToDebug();
+      }
+
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      #pragma mark
+      #pragma mark SocketEventBackend => (internal)
+      #pragma mark
+
+      //-----------------------------------------------------------------------
+      SocketEventBackendPtr SocketEventBackend::singleton()
+      {
+        static SingletonLazySharedPtr<SocketEventBackend> singleton(SocketEventBackend::create());
+        SocketEventBackendPtr result = singleton.singleton();
+        if (!result) {
+          ZS_LOG_WARNING(Detail, slog("singleton gone"))
+        }
+        return result;
+      }
+
+      //-----------------------------------------------------------------------
+      SocketEventBackendPtr SocketEventBackend::create()
+      {
+        SocketEventBackendPtr pThis(new SocketEventBackend);
+        pThis->mThisWeak = pThis;
+        pThis->init();
+        return pThis;
+      }
+
+      //-----------------------------------------------------------------------
+      Log::Params SocketEventBackend::log(const char *message) const
+      {
+        ElementPtr objectEl = Element::create("SocketEventBackend");
+        IHelper::debugAppend(objectEl, "id", mID);
+        return Log::Params(message, objectEl);
+      }
+
+      //-----------------------------------------------------------------------
+      Log::Params SocketEventBackend::slog(const char *message)
+      {
+        return Log::Params(message, "SocketEventBackend");
+      }
+
+      //-----------------------------------------------------------------------
+      void SocketEventBackend::cancel()
+      {
+        ThreadPtr thread;
+        {
+          AutoRecursiveLock lock(*this);
+          thread = mThread;
+
+          mShouldShutdown = true;
+          wakeUp();
+        }
+
+        if (thread) {
+          thread->join();
+        }
+
+        AutoRecursiveLock lock(*this);
+        mThread.reset();
+
+        mEntries.clear();
+
+#ifdef OPENPEER_SERVICES_SOCKET_EVENT_BACKEND_HAS_EPOLL
+        if (-1 != mWakeUpEvent) {
+          close(mWakeUpEvent);
+          mWakeUpEvent = -1;
+        }
+        if (-1 != mEpoll) {
+          close(mEpoll);
+          mEpoll = -1;
+        }
+#endif //OPENPEER_SERVICES_SOCKET_EVENT_BACKEND_HAS_EPOLL
+      }
+
+      //-----------------------------------------------------------------------
+      void SocketEventBackend::internalAttach(
+                                              SocketPtr socket,
+                                              ISocketDelegatePtr delegate,
+                                              zsLib::Socket::Monitor::Options options
+                                              )
+      {
+        UseMessageQueueAssociatorPtr associator = dynamic_pointer_cast<UseMessageQueueAssociator>(delegate);
+        if (!associator) {
+          ZS_LOG_WARNING(Detail, log("delegate is not associated to a message queue thus using zsLib socket monitor") + ZS_PARAM("handle", socket->getSocket()))
+          socket->setDelegate(delegate);
+          if (SocketMonitor::All != options) {
+            socket->monitor(options);
+          }
+          return;
+        }
+
+        AutoRecursiveLock lock(*this);
+
+        SocketHandle handle = socket->getSocket();
+
+        socket->setOptionFlag(zsLib::Socket::SetOptionFlag::NonBlocking, true);
+
+        // handles are reused by the OS so an existing entry is always stale
+        bool add = true;
+        EntryMap::iterator found = mEntries.find(handle);
+        if (found != mEntries.end()) {
+          ZS_LOG_WARNING(Debug, log("replacing stale entry for reused socket handle") + ZS_PARAM("handle", handle))
+          mEntries.erase(found);
+          add = false;
+        }
+
+        EntryPtr entry(new Entry);
+        entry->mThisWeak = entry;
+        entry->mOuter = mThisWeak;
+        entry->mHandle = handle;
+        entry->mSocket = socket;
+        entry->mDelegate = delegate;
+        entry->mQueue = associator->getAssociatedMessageQueue();
+        entry->mOptions = options;
+
+        mEntries[handle] = entry;
+
+        if (!updateEpoll(handle, options, add)) {
+          // the handle may or may not have been known to epoll, try again with the other operation
+          if (!updateEpoll(handle, options, !add)) {
+            ZS_LOG_ERROR(Detail, log("unable to register socket with epoll") + ZS_PARAM("handle", handle))
+            mEntries.erase(handle);
+            return;
+          }
+        }
+
+        ZS_LOG_TRACE(log("socket attached") + ZS_PARAM("handle", handle) + ZS_PARAM("options", (ULONG)options))
+      }
+
+      //-----------------------------------------------------------------------
+      void SocketEventBackend::internalMonitor(
+                                               SocketPtr socket,
+                                               zsLib::Socket::Monitor::Options options
+                                               )
+      {
+        AutoRecursiveLock lock(*this);
+
+        SocketHandle handle = socket->getSocket();
+
+        EntryMap::iterator found = mEntries.find(handle);
+        if (found == mEntries.end()) {
+          ZS_LOG_WARNING(Debug, log("socket is not attached to backend thus using zsLib socket monitor") + ZS_PARAM("handle", handle))
+          socket->monitor(options);
+          return;
+        }
+
+        EntryPtr &entry = (*found).second;
+        if (entry->mOptions == options) return;
+
+        entry->mOptions = options;
+
+        // modifying the registration re-evaluates readiness so newly enabled events fire immediately
+        updateEpoll(handle, options, false);
+      }
+
+      //-----------------------------------------------------------------------
+      void SocketEventBackend::internalDetach(SocketPtr socket)
+      {
+        AutoRecursiveLock lock(*this);
+
+        SocketHandle handle = socket->getSocket();
+
+        EntryMap::iterator found = mEntries.find(handle);
+        if (found == mEntries.end()) return;
+
+        EntryPtr entry = (*found).second;
+        if (entry->mSocket.lock() != socket) return;
+
+        mEntries.erase(found);
+
+#ifdef OPENPEER_SERVICES_SOCKET_EVENT_BACKEND_HAS_EPOLL
+        epoll_event event;
+        memset(&event, 0, sizeof(event));
+        epoll_ctl(mEpoll, EPOLL_CTL_DEL, handle, &event);
+#endif //OPENPEER_SERVICES_SOCKET_EVENT_BACKEND_HAS_EPOLL
+
+        ZS_LOG_TRACE(log("socket detached") + ZS_PARAM("handle", handle))
+      }
+
+      //-----------------------------------------------------------------------
+      ElementPtr SocketEventBackend::internalToDebug() const
+      {
+        AutoRecursiveLock lock(*this);
+
+        ElementPtr resultEl = Element::create("SocketEventBackend");
+
+        IHelper::debugAppend(resultEl, "id", mID);
+        IHelper::debugAppend(resultEl, "backend", mUseEpoll ? OPENPEER_SERVICES_SOCKET_EVENT_BACKEND_EPOLL : OPENPEER_SERVICES_SOCKET_EVENT_BACKEND_ZSLIB);
+        IHelper::debugAppend(resultEl, "thread", (bool)mThread);
+        IHelper::debugAppend(resultEl, "should shutdown", mShouldShutdown);
+        IHelper::debugAppend(resultEl, "sockets", mEntries.size());
+        IHelper::debugAppend(resultEl, "total wake ups", mTotalWakeUps);
+        IHelper::debugAppend(resultEl, "total events", mTotalEvents);
+
+        return resultEl;
+      }
+
+      //-----------------------------------------------------------------------
+      bool SocketEventBackend::updateEpoll(
+                                           SocketHandle handle,
+                                           zsLib::Socket::Monitor::Options options,
+                                           bool add
+                                           )
+      {
+#ifdef OPENPEER_SERVICES_SOCKET_EVENT_BACKEND_HAS_EPOLL
+        epoll_event event;
+        memset(&event, 0, sizeof(event));
+
+        event.events = EPOLLET;
+        if (0 != (options & SocketMonitor::Read)) event.events |= (EPOLLIN | EPOLLRDHUP);
+        if (0 != (options & SocketMonitor::Write)) event.events |= EPOLLOUT;
+        event.data.fd = handle;
+
+        if (0 != epoll_ctl(mEpoll, add ? EPOLL_CTL_ADD : EPOLL_CTL_MOD, handle, &event)) {
+          ZS_LOG_WARNING(Debug, log("epoll_ctl failed") + ZS_PARAM("handle", handle) + ZS_PARAM("add", add) + ZS_PARAM("error", errno))
+          return false;
+        }
+        return true;
+#else
+        return false;
+#endif //OPENPEER_SERVICES_SOCKET_EVENT_BACKEND_HAS_EPOLL
+      }
+
+      //-----------------------------------------------------------------------
+      void SocketEventBackend::wakeUp()
+      {
+#ifdef OPENPEER_SERVICES_SOCKET_EVENT_BACKEND_HAS_EPOLL
+        if (-1 == mWakeUpEvent) return;
+
+        eventfd_t value = 1;
+        if (0 != eventfd_write(mWakeUpEvent, value)) {
+          ZS_LOG_ERROR(Basic, log("could not wake up socket event backend") + ZS_PARAM("error", errno))
+        }
+#endif //OPENPEER_SERVICES_SOCKET_EVENT_BACKEND_HAS_EPOLL
+      }
+
+      //-----------------------------------------------------------------------
+      void SocketEventBackend::notify(
+                                      EntryPtr entry,
+                                      ULONG events
+                                      )
+      {
+#ifdef OPENPEER_SERVICES_SOCKET_EVENT_BACKEND_HAS_EPOLL
+        SocketPtr socket = entry->mSocket.lock();
+        ISocketDelegatePtr delegate = entry->mDelegate.lock();
+
+        if ((!socket) ||
+            (!delegate) ||
+            (socket->getSocket() != entry->mHandle)) {
+          ZS_LOG_TRACE(log("removing entry for socket that is gone") + ZS_PARAM("handle", entry->mHandle))
+          mEntries.erase(entry->mHandle);
+          return;
+        }
+
+        if ((0 != (events & (EPOLLERR | EPOLLHUP))) &&
+            (0 != (entry->mOptions & SocketMonitor::Exception))) {
+          ISocketDelegateProxy::create(entry->mQueue, delegate)->onException(socket);
+        }
+
+        if ((0 != (events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))) &&
+            (0 != (entry->mOptions & SocketMonitor::Read))) {
+          notifyReadReady(entry);
+        }
+
+        if ((0 != (events & EPOLLOUT)) &&
+            (0 != (entry->mOptions & SocketMonitor::Write))) {
+          ISocketDelegateProxy::create(entry->mQueue, delegate)->onWriteReady(socket);
+        }
+#endif //OPENPEER_SERVICES_SOCKET_EVENT_BACKEND_HAS_EPOLL
+      }
+
+      //-----------------------------------------------------------------------
+      void SocketEventBackend::notifyReadReady(EntryPtr entry)
+      {
+        if (entry->mReadPending) return;  // the queued re-check will notice any additional data
+
+        SocketPtr socket = entry->mSocket.lock();
+        ISocketDelegatePtr delegate = entry->mDelegate.lock();
+        if ((!socket) || (!delegate)) return;
+
+        entry->mReadPending = true;
+        ++(entry->mTotalReadNotifications);
+
+        // both go to the same queue so the re-check runs after the delegate has read
+        ISocketDelegateProxy::create(entry->mQueue, delegate)->onReadReady(socket);
+        ISocketEventBackendAsyncProxy::create(entry->mQueue, entry)->onSocketEventBackendCheckReadReady();
+      }
+
+      //-----------------------------------------------------------------------
+      void SocketEventBackend::checkReadReady(EntryPtr entry)
+      {
+        SocketHandle handle = zsLib::INVALID_SOCKET;
+
+        {
+          AutoRecursiveLock lock(*this);
+
+          // clear before checking so data arriving after the check raises a new edge
+          entry->mReadPending = false;
+
+          EntryMap::iterator found = mEntries.find(entry->mHandle);
+          if (found == mEntries.end()) return;
+          if ((*found).second != entry) return;
+
+          if (0 == (entry->mOptions & SocketMonitor::Read)) return;
+
+          handle = entry->mHandle;
+        }
+
+        if (!isReadable(handle)) return;
+
+        AutoRecursiveLock lock(*this);
+        ++(entry->mTotalReadRechecks);
+        notifyReadReady(entry);
+      }
+
+      //-----------------------------------------------------------------------
+      bool SocketEventBackend::isReadable(SocketHandle handle)
+      {
+#ifdef OPENPEER_SERVICES_SOCKET_EVENT_BACKEND_HAS_EPOLL
+        pollfd check;
+        memset(&check, 0, sizeof(check));
+        check.fd = handle;
+        check.events = POLLIN;
+
+        if (poll(&check, 1, 0) < 1) return false;
+        if (0 != (check.revents & POLLNVAL)) return false;
+
+        return (0 != (check.revents & (POLLIN | POLLHUP | POLLERR)));
+#else
+        return false;
+#endif //OPENPEER_SERVICES_SOCKET_EVENT_BACKEND_HAS_EPOLL
+      }
+
+      //-----------------------------------------------------------------------
+      void SocketEventBackend::operator()()
+      {
+#ifdef OPENPEER_SERVICES_SOCKET_EVENT_BACKEND_HAS_EPOLL
+        ZS_LOG_BASIC(log("socket event backend thread started"))
+
+        epoll_event events[OPENPEER_SERVICES_SOCKET_EVENT_BACKEND_MAX_EVENTS_PER_WAIT];
+
+        bool shouldShutdown = false;
+
+        do
+        {
+          int total = epoll_wait(mEpoll, &(events[0]), OPENPEER_SERVICES_SOCKET_EVENT_BACKEND_MAX_EVENTS_PER_WAIT, OPENPEER_SERVICES_SOCKET_EVENT_BACKEND_WAIT_TIMEOUT_IN_MILLISECONDS);
+
+          AutoRecursiveLock lock(*this);
+          shouldShutdown = mShouldShutdown;
+          if (shouldShutdown) break;
+
+          if (total < 0) {
+            if (EINTR == errno) continue;
+            ZS_LOG_ERROR(Basic, log("epoll_wait failed") + ZS_PARAM("error", errno))
+            continue;
+          }
+
+          ++mTotalWakeUps;
+
+          for (int index = 0; index < total; ++index) {
+            epoll_event &event = events[index];
+
+            if (event.data.fd == mWakeUpEvent) {
+              eventfd_t value = 0;
+              eventfd_read(mWakeUpEvent, &value);
+              continue;
+            }
+
+            ++mTotalEvents;
+
+            EntryMap::iterator found = mEntries.find(event.data.fd);
+            if (found == mEntries.end()) {
+              ZS_LOG_TRACE(log("event for socket no longer attached") + ZS_PARAM("handle", event.data.fd))
+              continue;
+            }
+
+            EntryPtr entry = (*found).second;
+            notify(entry, event.events);
+          }
+        } while (!shouldShutdown);
+
+        ZS_LOG_BASIC(log("socket event backend thread stopped"))
+#endif //OPENPEER_SERVICES_SOCKET_EVENT_BACKEND_HAS_EPOLL
+      }
+
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      #pragma mark
+      #pragma mark SocketEventBackend::Entry
+      #pragma mark
+
+      //-----------------------------------------------------------------------
+      SocketEventBackend::Entry::Entry() :
+        mHandle(zsLib::INVALID_SOCKET),
+        mOptions(SocketMonitor::All),
+        mReadPending(false),
+        mTotalReadNotifications(0),
+        mTotalReadRechecks(0)
+      {
+      }
+
+      //-----------------------------------------------------------------------
+      void SocketEventBackend::Entry::onSocketEventBackendCheckReadReady()
+      {
+        SocketEventBackendPtr outer = mOuter.lock();
+        if (!outer) return;
+
+        EntryPtr pThis = mThisWeak.lock();
+        if (!pThis) return;
+
+        outer->checkReadReady(pThis);
+      }
+    }
+  }
+}
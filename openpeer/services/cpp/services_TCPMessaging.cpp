@@ -31,6 +31,7 @@
 
 #include <openpeer/services/internal/services_TCPMessaging.h>
 #include <openpeer/services/internal/services_Helper.h>
+#include <openpeer/services/internal/services_SocketEventBackend.h>
 #include <openpeer/services/IHTTP.h>
 #include <openpeer/services/ISettings.h>
 
@@ -167,7 +168,7 @@ namespace openpeer
           pThis->shutdown(Seconds(0));
         } else {
           pThis->mSocket->setOptionFlag(Socket::SetOptionFlag::NonBlocking, true);
-          pThis->mSocket->setDelegate(pThis);
+          SocketEventBackend::attach(pThis->mSocket, pThis);
           ZS_LOG_DEBUG(pThis->log("accepted") + ZS_PARAM("client IP", pThis->mRemoteIP.string()))
         }
         pThis->init();
@@ -204,7 +205,7 @@ namespace openpeer
         pThis->mSocket = Socket::createTCP();
         pThis->mSocket->setOptionFlag(Socket::SetOptionFlag::NonBlocking, true);
         pThis->mSocket->connect(remoteIP, &wouldBlock, &errorCode);
-        pThis->mSocket->setDelegate(pThis);   // set delegate must happen after the connect()
+        SocketEventBackend::attach(pThis->mSocket, pThis);   // attach must happen after the connect()
         ZS_LOG_DEBUG(pThis->log("attempting to connect") + ZS_PARAM("server IP", remoteIP.string()) + ZS_PARAM("handle", pThis->mSocket->getSocket()))
         if (0 != errorCode) {
           ZS_LOG_ERROR(Detail, pThis->log("failed to connect socket") + ZS_PARAM("error code", errorCode))
@@ -677,6 +678,7 @@ namespace openpeer
         mSendStreamSubscription->cancel();
 
         if (mSocket) {
+          SocketEventBackend::detach(mSocket);
           mSocket->close();
           mSocket.reset();
         }
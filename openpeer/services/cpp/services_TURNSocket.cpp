@@ -30,7 +30,10 @@
  */
 
 #include <openpeer/services/internal/services_TURNSocket.h>
+#include <openpeer/services/internal/services_SocketEventBackend.h>
 #include <openpeer/services/internal/services_Helper.h>
+#include <openpeer/services/internal/services_MessageIntegrityKeyCache.h>
+#include <openpeer/services/internal/services_UDPBatch.h>
 #include <openpeer/services/internal/services_wire.h>
 
 #include <openpeer/services/ISettings.h>
@@ -47,8 +50,6 @@
 
 #include <algorithm>
 
-#define OPENPEER_SERVICES_TURNSOCKET_RECYCLE_BUFFER_SIZE (1 << (sizeof(WORD)*8))
-#define OPENPEER_SERVICES_TURNSOCKET_MAX_RECYLCE_BUFFERS 4
 
 #define OPENPEER_SERVICES_TURN_MINIMUM_KEEP_ALIVE_FOR_TURN_IN_SECONDS (20)             // keep alive should be 20 because ICE sends its keep alives every 15 seconds
 #define OPENPEER_SERVICES_TURN_MINIMUM_LIFETIME_FOR_TURN_IN_SECONDS (15)               // do not allow server to dictate a LIFETIME lower than 15 seconds
@@ -90,6 +91,102 @@ namespace openpeer
         return length + (sizeof(DWORD) - (length % sizeof(DWORD)));
       }
 
+      //-----------------------------------------------------------------------
+      static size_t fillParts(
+                              TURNSocket::PacketPart *parts,
+                              const BYTE *prefix,
+                              size_t prefixLengthInBytes,
+                              const BYTE *data,
+                              size_t dataLengthInBytes,
+                              const BYTE *suffix,
+                              size_t suffixLengthInBytes
+                              )
+      {
+        static const BYTE zeros[sizeof(DWORD)] = {0, 0, 0, 0};
+
+        size_t totalParts = 0;
+
+        parts[totalParts].mBuffer = prefix;
+        parts[totalParts].mBufferLengthInBytes = prefixLengthInBytes;
+        ++totalParts;
+
+        parts[totalParts].mBuffer = data;
+        parts[totalParts].mBufferLengthInBytes = dataLengthInBytes;
+        ++totalParts;
+
+        size_t paddingLength = dwordBoundary(dataLengthInBytes) - dataLengthInBytes;
+        if (0 != paddingLength) {
+          parts[totalParts].mBuffer = &(zeros[0]);
+          parts[totalParts].mBufferLengthInBytes = paddingLength;
+          ++totalParts;
+        }
+
+        if (0 != suffixLengthInBytes) {
+          parts[totalParts].mBuffer = suffix;
+          parts[totalParts].mBufferLengthInBytes = suffixLengthInBytes;
+          ++totalParts;
+        }
+
+        return totalParts;
+      }
+
+      //-----------------------------------------------------------------------
+      static size_t getTotalLength(
+                                   const TURNSocket::PacketPart *parts,
+                                   size_t totalParts
+                                   )
+      {
+        size_t length = 0;
+        for (size_t index = 0; index < totalParts; ++index) {
+          length += parts[index].mBufferLengthInBytes;
+        }
+        return length;
+      }
+
+      //-----------------------------------------------------------------------
+      static void copyParts(
+                            BYTE *destination,
+                            const TURNSocket::PacketPart *parts,
+                            size_t totalParts,
+                            size_t skipBytes
+                            )
+      {
+        for (size_t index = 0; index < totalParts; ++index) {
+          const TURNSocket::PacketPart &part = parts[index];
+          if (skipBytes >= part.mBufferLengthInBytes) {
+            skipBytes -= part.mBufferLengthInBytes;
+            continue;
+          }
+
+          size_t length = part.mBufferLengthInBytes - skipBytes;
+          memcpy(destination, &(part.mBuffer[skipBytes]), length);
+          destination += length;
+          skipBytes = 0;
+        }
+      }
+
+      //-----------------------------------------------------------------------
+      static size_t sendParts(
+                              SocketPtr socket,
+                              const TURNSocket::PacketPart *parts,
+                              size_t totalParts,
+                              bool *outWouldBlock
+                              )
+      {
+        if (1 == totalParts) {
+          return socket->send(parts[0].mBuffer, parts[0].mBufferLengthInBytes, outWouldBlock);
+        }
+
+        ZS_THROW_INVALID_ARGUMENT_IF(totalParts > OPENPEER_SERVICES_UDPBATCH_MAX_GATHERED_BUFFERS)
+
+        UDPBatch::SendBuffer buffers[OPENPEER_SERVICES_UDPBATCH_MAX_GATHERED_BUFFERS];
+        for (size_t index = 0; index < totalParts; ++index) {
+          buffers[index].mBuffer = parts[index].mBuffer;
+          buffers[index].mBufferLengthInBytes = parts[index].mBufferLengthInBytes;
+        }
+        return UDPBatch::sendGathered(socket, IPAddress(), &(buffers[0]), totalParts, outWouldBlock);
+      }
+
       static const char *toString(ITURNSocket::TURNSocketStates state)
       {
         switch (state)
@@ -152,9 +249,12 @@ namespace openpeer
         mLifetime(0),
         mLastSentDataToServer(zsLib::now()),
         mLastRefreshTimerWasSentAt(zsLib::now()),
+        mRaceServers(ISettings::getUInt(OPENPEER_SERVICES_SETTING_TURN_RACE_SERVERS)),
         mPermissionRequesterMaxCapacity(0),
         mForceTURNUseUDP(ISettings::getBool(OPENPEER_SERVICES_SETTING_FORCE_TURN_TO_USE_UDP)),
-        mForceTURNUseTCP(ISettings::getBool(OPENPEER_SERVICES_SETTING_FORCE_TURN_TO_USE_UDP))
+        mForceTURNUseTCP(ISettings::getBool(OPENPEER_SERVICES_SETTING_FORCE_TURN_TO_USE_TCP)),
+        mTCPWriteQueueWatermarkInBytes(ISettings::getUInt(OPENPEER_SERVICES_SETTING_TURN_TCP_WRITE_QUEUE_WATERMARK_IN_BYTES)),
+        mTCPWriteQueueDropOldest(OPENPEER_SERVICES_TURN_TCP_WRITE_QUEUE_DROP_POLICY_OLDEST == ISettings::getString(OPENPEER_SERVICES_SETTING_TURN_TCP_WRITE_QUEUE_DROP_POLICY))
       {
         ZS_THROW_INVALID_USAGE_IF(mLimitChannelToRangeStart > mLimitChannelToRangeEnd)
         ZS_LOG_DETAIL(log("created"))
@@ -187,9 +287,12 @@ namespace openpeer
         mLifetime(0),
         mLastSentDataToServer(zsLib::now()),
         mLastRefreshTimerWasSentAt(zsLib::now()),
+        mRaceServers(ISettings::getUInt(OPENPEER_SERVICES_SETTING_TURN_RACE_SERVERS)),
         mPermissionRequesterMaxCapacity(0),
         mForceTURNUseUDP(ISettings::getBool(OPENPEER_SERVICES_SETTING_FORCE_TURN_TO_USE_UDP)),
-        mForceTURNUseTCP(ISettings::getBool(OPENPEER_SERVICES_SETTING_FORCE_TURN_TO_USE_UDP))
+        mForceTURNUseTCP(ISettings::getBool(OPENPEER_SERVICES_SETTING_FORCE_TURN_TO_USE_TCP)),
+        mTCPWriteQueueWatermarkInBytes(ISettings::getUInt(OPENPEER_SERVICES_SETTING_TURN_TCP_WRITE_QUEUE_WATERMARK_IN_BYTES)),
+        mTCPWriteQueueDropOldest(OPENPEER_SERVICES_TURN_TCP_WRITE_QUEUE_DROP_POLICY_OLDEST == ISettings::getString(OPENPEER_SERVICES_SETTING_TURN_TCP_WRITE_QUEUE_DROP_POLICY))
       {
         ZS_THROW_INVALID_USAGE_IF(mLimitChannelToRangeStart > mLimitChannelToRangeEnd)
         ZS_LOG_BASIC(log("created"))
@@ -365,7 +468,13 @@ namespace openpeer
           return false;  // illegal to be so large
         }
 
-        SecureByteBlockPtr packet;
+        // the headers are built on the stack and the caller's buffer is sent
+        // as is (i.e. without copying it into a larger packet)
+        DWORD prefix[OPENPEER_SERVICES_TURN_MAX_SEND_PREFIX_IN_BYTES / sizeof(DWORD)];  // DWORD aligned for the header fields
+        DWORD suffix[OPENPEER_SERVICES_TURN_MAX_SEND_SUFFIX_IN_BYTES / sizeof(DWORD)];
+        PacketBufferPtr packet;   // only used if the headers do not fit on the stack
+        PacketPart parts[OPENPEER_SERVICES_TURN_MAX_PACKET_PARTS];
+        size_t totalParts = 0;
         ServerPtr server;
 
         do
@@ -385,21 +494,19 @@ namespace openpeer
 
           // scope: first, we check if there is a binded channel to this address
           {
-            ChannelIPMap::iterator found = mChannelIPMap.find(destination);
-            if (found != mChannelIPMap.end()) {
+            ChannelInfoPtr *found = mChannelIPTable.find(destination);
+            if (found) {
               // we found, but is it activated yet?
-              ChannelInfoPtr info = (*found).second;
+              ChannelInfo *info = (*found).get();
               if (info->mBound) {
                 // yes, it is active, so we can packetize this in a special way to send to the remote peer
-                packet = SecureByteBlockPtr(new SecureByteBlock(sizeof(DWORD)+dwordBoundary(bufferLengthInBytes)));
-
-                ((WORD *)(packet->BytePtr()))[0] = htons(info->mChannelNumber);
-                ((WORD *)(packet->BytePtr()))[1] = htons((WORD)bufferLengthInBytes);
+                ((WORD *)(&(prefix[0])))[0] = htons(info->mChannelNumber);
+                ((WORD *)(&(prefix[0])))[1] = htons((WORD)bufferLengthInBytes);
 
                 info->mLastSentDataAt = zsLib::now();
 
-                // copy the entire buffer into the packet
-                memcpy(&((packet->BytePtr())[sizeof(DWORD)]), buffer, bufferLengthInBytes);
+                // the channel header, the buffer and the padding go out as one packet
+                totalParts = fillParts(&(parts[0]), (const BYTE *)(&(prefix[0])), sizeof(DWORD), buffer, bufferLengthInBytes, NULL, 0);
                 OPENPEER_SERVICES_WIRE_LOG_TRACE(log("sending packet via bound channel") + ZS_PARAM("channel", info->mChannelNumber) + ZS_PARAM("destination", destination.string()) + ZS_PARAM("buffer length", bufferLengthInBytes) + ZS_PARAM("bind channel", bindChannelIfPossible))
                 break;
               }
@@ -419,8 +526,7 @@ namespace openpeer
                 ChannelInfoPtr info = ChannelInfo::create();
                 info->mChannelNumber = freeChannelNumber;
                 info->mPeerAddress = destination;
-                mChannelIPMap[destination] = info;
-                mChannelNumberMap[freeChannelNumber] = info;
+                addChannel(info);
 
                 IWakeDelegateProxy::create(mThisWeak.lock())->onWake();
               }
@@ -433,42 +539,57 @@ namespace openpeer
           sendData->mData = buffer;
           sendData->mDataLength = bufferLengthInBytes;
 
-          packet = sendData->packetize(STUNPacket::RFC_5766_TURN);
-
           // scope: we need to check if there is a permission set to be able to even contact this address
           {
-            PermissionMap::iterator found = mPermissions.find(destination);
-            if (found == mPermissions.end()) {
+            PermissionPtr *found = mPermissionTable.find(destination);
+            if (!found) {
               ZS_LOG_DEBUG(log("will attempt to create permision") + ZS_PARAM("ip", destination.string()))
 
               // we do not have a permission yet to send to this address so we need to create one...
               PermissionPtr permission = Permission::create();
 
               permission->mPeerAddress = destination;
-              permission->mPendingData.push_back(packet);
+              permission->mPendingData.push_back(sendData->packetize(STUNPacket::RFC_5766_TURN));
 
-              mPermissions[destination] = permission;
+              addPermission(permission);
 
               // since the permission isn't installed yet we can't send the data just yet... best kick start that permission now...
               (IWakeDelegateProxy::create(mThisWeak.lock()))->onWake();
               return true;
             }
 
-            PermissionPtr permission = (*found).second;
+            Permission *permission = (*found).get();
             permission->mLastSentDataAt = zsLib::now();
 
             if (!permission->mInstalled) {
               // the permission hasn't been installed yet so we still can't send the data...
-              permission->mPendingData.push_back(packet);
+              permission->mPendingData.push_back(sendData->packetize(STUNPacket::RFC_5766_TURN));
               return true;
             }
           }
+
+          // packetize everything but the data itself (which is sent from where it lives)
+          size_t prefixLengthInBytes = 0;
+          size_t suffixLengthInBytes = 0;
+          if (sendData->packetizeAroundData((BYTE *)(&(prefix[0])), sizeof(prefix), prefixLengthInBytes, (BYTE *)(&(suffix[0])), sizeof(suffix), suffixLengthInBytes, STUNPacket::RFC_5766_TURN)) {
+            totalParts = fillParts(&(parts[0]), (const BYTE *)(&(prefix[0])), prefixLengthInBytes, buffer, bufferLengthInBytes, (const BYTE *)(&(suffix[0])), suffixLengthInBytes);
+            break;
+          }
+
+          // packetize straight into a pooled send buffer rather than a freshly allocated block
+          size_t packetLengthInBytes = sendData->getPacketizedLength(STUNPacket::RFC_5766_TURN);
+          packet = PacketBufferPool::allocate(packetLengthInBytes);
+          sendData->packetizeInto(packet->data(), packet->capacity(), STUNPacket::RFC_5766_TURN);
+
+          parts[0].mBuffer = packet->data();
+          parts[0].mBufferLengthInBytes = packetLengthInBytes;
+          totalParts = 1;
         } while(false);
 
-        ZS_THROW_BAD_STATE_IF(!packet)  // how is this possible?
+        ZS_THROW_BAD_STATE_IF(0 == totalParts)  // how is this possible?
 
         // we are free to send the data now since there is a permission installed...
-        return sendPacketOrDopPacketIfBufferFull(server, *packet, packet->SizeInBytes());
+        return sendPacketOrDopPacketIfBufferFull(server, &(parts[0]), totalParts);
       }
 
       //-----------------------------------------------------------------------
@@ -553,8 +674,8 @@ namespace openpeer
 
         if (bufferLengthInBytes < sizeof(DWORD)) return false;
 
-        WORD channel = ntohs(((WORD *)buffer)[0]);
-        WORD length = ntohs(((WORD *)buffer)[1]);
+        WORD channel = internal::Helper::readWORD(buffer);
+        WORD length = internal::Helper::readWORD(buffer + sizeof(WORD));
 
         if ((channel < mLimitChannelToRangeStart) ||
             (channel > mLimitChannelToRangeEnd)) return false;        // this can't be legal channel data
@@ -576,13 +697,12 @@ namespace openpeer
 
           delegate = mDelegate;
 
-          ChannelNumberMap::iterator found = mChannelNumberMap.find(channel);
-          if (mChannelNumberMap.end() == found) {
+          ChannelInfo *info = findChannel(channel);
+          if (!info) {
             OPENPEER_SERVICES_WIRE_LOG_WARNING(Detail, log("channel packet received for non-existant channel") + ZS_PARAM("ip", fromIPAddress.string()) + ZS_PARAM("channel", channel))
             return false;                             // this isn't any bound channel we know about...
           }
 
-          ChannelInfoPtr info = (*found).second;
           peerAddress = info->mPeerAddress;
         }
 
@@ -664,7 +784,18 @@ namespace openpeer
               }
             }
           } else {
-            server = mActiveServer;
+            for (ServerList::iterator iter = mRaceLosers.begin(); iter != mRaceLosers.end(); ++iter)
+            {
+              ServerPtr &serverCompare = (*iter);
+              if (serverCompare->mReleaseRequester == requester) {
+                server = serverCompare;
+                break;
+              }
+            }
+
+            if (!server) {
+              server = mActiveServer;
+            }
           }
 
           if (!server) {
@@ -694,6 +825,8 @@ namespace openpeer
 
           if (handleDeallocRequester(requester, response)) return true;
 
+          if (handleRaceLoserRequester(requester)) return true;
+
           // this could be a respond to a channel bind request... check so now...
           if (handleChannelRequester(requester, response)) return true;
         }
@@ -727,6 +860,8 @@ namespace openpeer
           }
         }
 
+        if (handleRaceLoserRequester(requester)) return;
+
         if (requester == mRefreshRequester) {
           ZS_LOG_WARNING(Detail, log("refresh requester timed out thus issuing shutdown"))
           clearRefreshRequester();
@@ -743,7 +878,7 @@ namespace openpeer
           return;
         }
 
-        if (requester == mPermissionRequester) {
+        if (removePermissionRequester(requester)) {
           ZS_LOG_WARNING(Detail, log("permission requester timed out"))
           // clear out any permissions which were hopefully to become installed...
           for (PermissionMap::iterator iter = mPermissions.begin(); iter != mPermissions.end(); ++iter) {
@@ -753,7 +888,8 @@ namespace openpeer
           }
 
           // we aren't going to treat as fatal but we will try immediately again (perhaps it should be fatal)
-          clearPermissionRequester();
+          requester->cancel();
+          clearBackgroundingNotifierIfPossible();
 
           step();
           return;
@@ -888,8 +1024,7 @@ namespace openpeer
               parseAgain = false;
 
               STUNPacketPtr stun;
-              boost::shared_array<BYTE> buffer;
-              AutoRecycleBuffer autoRecycle(*this, buffer);
+              PacketBufferPtr buffer;
               STUNPacket::ParseLookAheadStates ahead = STUNPacket::ParseLookAheadState_InsufficientDataToDeterimine;
 
               // scope: parse out the buffer
@@ -901,19 +1036,18 @@ namespace openpeer
                 if (0 != consumedBytes) {
                   // the STUN packet is going to have it's parsed pointing into the read buffer which is about to be consumed, fix the pointers now...
                   ZS_THROW_INVALID_ASSUMPTION_IF(!stun)
-                  ZS_THROW_INVALID_ASSUMPTION_IF(consumedBytes > OPENPEER_SERVICES_TURNSOCKET_RECYCLE_BUFFER_SIZE)
 
-                  getBuffer(buffer);
+                  buffer = PacketBufferPool::allocate(consumedBytes);
 
                   // make a duplicate of the data buffer
-                  memcpy(buffer.get(), &(server->mReadBuffer[0]), consumedBytes);
+                  memcpy(buffer->data(), &(server->mReadBuffer[0]), consumedBytes);
 
                   // fix the STUN pointers to now point to the copied buffer instead of the original TCP read buffer...
                   if (stun->mOriginalPacket) {
-                    stun->mOriginalPacket = buffer.get() + (stun->mOriginalPacket - &(server->mReadBuffer[0]));
+                    stun->mOriginalPacket = buffer->data() + (stun->mOriginalPacket - &(server->mReadBuffer[0]));
                   }
                   if (stun->mData) {
-                    stun->mData = buffer.get() + (stun->mData - &(server->mReadBuffer[0]));
+                    stun->mData = buffer->data() + (stun->mData - &(server->mReadBuffer[0]));
                   }
 
                   // consume from the read buffer now since it is safe to destroy overtop where the STUN packet was located...
@@ -957,27 +1091,27 @@ namespace openpeer
                       continue;
                     }
 
-                    ChannelNumberMap::iterator iter = mChannelNumberMap.find(channel);
-                    if (iter == mChannelNumberMap.end()) {
+                    ChannelInfo *info = findChannel(channel);
+                    if (!info) {
                       // we have to consume the buffer because it is for a channel that no longer exists
                       consumeBuffer(server, sizeof(DWORD) + dwordBoundary(length));
                       parseAgain = true;
                       continue;
                     }
 
-                    peer = (*iter).second->mPeerAddress;
+                    peer = info->mPeerAddress;
 
-                    getBuffer(buffer);
+                    buffer = PacketBufferPool::allocate(length);
 
                     // we now have channel data, parse it out by making a copy to the temporary buffer
-                    memcpy(buffer.get(), &(((WORD *)&(server->mReadBuffer[0]))[2]), length);
+                    memcpy(buffer->data(), &(((WORD *)&(server->mReadBuffer[0]))[2]), length);
 
                     // now we have a copy it is safe to consume from the original buffer
                     consumeBuffer(server, sizeof(DWORD) + dwordBoundary(length));
                   }
 
                   // this is a legal channel so tell the delegate about the received data...
-                  delegate->handleTURNSocketReceivedPacket(mThisWeak.lock(), peer, buffer.get(), length);
+                  delegate->handleTURNSocketReceivedPacket(mThisWeak.lock(), peer, buffer->data(), length);
 
                   parseAgain = true;
                   continue;
@@ -1111,6 +1245,7 @@ namespace openpeer
           return;
         }
 
+        SocketEventBackend::detach(server->mTCPSocket);
         server->mTCPSocket->close();
         server->mTCPSocket.reset();
 
@@ -1174,7 +1309,7 @@ namespace openpeer
         }
 
         if (timer == mPermissionTimer) {
-          requestPermissionsNow();
+          requestPermissionsNow(true);
           step();
           return;
         }
@@ -1185,28 +1320,9 @@ namespace openpeer
           return;
         }
 
-        // check if it is one of the channel timers...
-        for (ChannelNumberMap::iterator iter = mChannelNumberMap.begin(); iter != mChannelNumberMap.end(); ++iter) {
-          ChannelInfoPtr info = (*iter).second;
-          if (timer == info->mRefreshTimer) {
-            if (info->mChannelBindRequester) return;  // already have an outstanding request so do nothing...
-
-            ZS_LOG_DEBUG(log("channel bind starting now"))
-
-            ZS_THROW_INVALID_ASSUMPTION_IF(!mActiveServer)
-
-            STUNPacketPtr newRequest = STUNPacket::createRequest(STUNPacket::Method_ChannelBind);
-            fix(newRequest);
-            newRequest->mUsername = mUsername;
-            newRequest->mPassword = mPassword;
-            newRequest->mRealm = mRealm;
-            newRequest->mNonce = mNonce;
-            newRequest->mCredentialMechanism = STUNPacket::CredentialMechanisms_LongTerm;
-            newRequest->mChannelNumber = info->mChannelNumber;
-            newRequest->mPeerAddressList.push_back(info->mPeerAddress);
-            info->mChannelBindRequester = ISTUNRequester::create(getAssociatedMessageQueue(), mThisWeak.lock(), mActiveServer->mServerIP, newRequest, STUNPacket::RFC_5766_TURN);
-            return;
-          }
+        if (timer == mChannelRefreshTimer) {
+          refreshDueChannels();
+          return;
         }
       }
 
@@ -1229,7 +1345,7 @@ namespace openpeer
         ZS_LOG_DEBUG(log("going to background thus will attempt to refresh TURN socket now to ensure we have the maximum lifetime before the TURN server deletes this client's bindings"))
 
         if (mPermissionTimer) {
-          requestPermissionsNow();
+          requestPermissionsNow(true);
         }
 
         refreshNow();
@@ -1247,7 +1363,7 @@ namespace openpeer
         ZS_LOG_DEBUG(log("going to the background immediately thus cancel any pending refresh requester"))
 
         clearRefreshRequester();
-        clearPermissionRequester();
+        clearPermissionRequesters();
 
         mBackgroundingNotifier.reset();
       }
@@ -1279,7 +1395,7 @@ namespace openpeer
         refreshNow();
 
         if (mPermissionTimer) {
-          requestPermissionsNow();
+          requestPermissionsNow(true);
         }
 
         // perform routine maintanence
@@ -1321,6 +1437,26 @@ namespace openpeer
         stun->mLogObjectID = mID;
       }
 
+      //-----------------------------------------------------------------------
+      void TURNSocket::fixCredentials(STUNPacketPtr stun) const
+      {
+        stun->mUsername = mUsername;
+        stun->mPassword = mPassword;
+        stun->mRealm = mRealm;
+        stun->mNonce = mNonce;
+        stun->mMessageIntegrityKey = mMessageIntegrityKey;
+        stun->mCredentialMechanism = STUNPacket::CredentialMechanisms_LongTerm;
+      }
+
+      //-----------------------------------------------------------------------
+      bool TURNSocket::isValidMessageIntegrity(STUNPacketPtr response) const
+      {
+        // the pinned key matches the current credentials so a response is
+        // validated with a single HMAC pass
+        if (mMessageIntegrityKey) return response->isValidMessageIntegrity(mMessageIntegrityKey);
+        return response->isValidMessageIntegrity(mPassword, mUsername, mRealm);
+      }
+
       //-----------------------------------------------------------------------
       ElementPtr TURNSocket::toDebug() const
       {
@@ -1342,6 +1478,7 @@ namespace openpeer
         IHelper::debugAppend(resultEl, "username", mUsername);
         IHelper::debugAppend(resultEl, "password", mPassword);
         IHelper::debugAppend(resultEl, "realm", mRealm);
+        IHelper::debugAppend(resultEl, "message integrity key", (bool)mMessageIntegrityKey);
         IHelper::debugAppend(resultEl, "nonce", mNonce);
         IHelper::debugAppend(resultEl, "udp dns query", (bool)mTURNUDPQuery);
         IHelper::debugAppend(resultEl, "tcp dns query", (bool)mTURNTCPQuery);
@@ -1359,9 +1496,18 @@ namespace openpeer
           IHelper::debugAppend(activeServerEl, "connected", mActiveServer->mIsConnected);
           IHelper::debugAppend(activeServerEl, "write ready", mActiveServer->mInformedWriteReady);
           IHelper::debugAppend(activeServerEl, "activate after", mActiveServer->mActivateAfter);
+          IHelper::debugAppend(activeServerEl, "allocate started at", mActiveServer->mAllocateStartedAt);
+          IHelper::debugAppend(activeServerEl, "allocate rtt", mActiveServer->mAllocateRTT);
           IHelper::debugAppend(activeServerEl, "allocate requestor", (bool)mActiveServer->mAllocateRequester);
           IHelper::debugAppend(activeServerEl, "read buffer fill size", mActiveServer->mReadBufferFilledSizeInBytes);
           IHelper::debugAppend(activeServerEl, "write buffer fill size", mActiveServer->mWriteBufferFilledSizeInBytes);
+          IHelper::debugAppend(activeServerEl, "write queue frames", mActiveServer->getTotalQueuedFrames());
+          IHelper::debugAppend(activeServerEl, "write queue frames queued", mActiveServer->mTotalFramesQueued);
+          IHelper::debugAppend(activeServerEl, "write queue frames written", mActiveServer->mTotalFramesWritten);
+          IHelper::debugAppend(activeServerEl, "write queue writes", mActiveServer->mTotalWrites);
+          IHelper::debugAppend(activeServerEl, "write queue frames per write", (0 != mActiveServer->mTotalWrites ? ((DOUBLE)mActiveServer->mTotalFramesWritten) / ((DOUBLE)mActiveServer->mTotalWrites) : 0.0));
+          IHelper::debugAppend(activeServerEl, "write queue frames dropped", mActiveServer->mTotalFramesDropped);
+          IHelper::debugAppend(activeServerEl, "write queue bytes dropped", mActiveServer->mTotalBytesDropped);
           IHelper::debugAppend(resultEl, activeServerEl);
         }
         IHelper::debugAppend(resultEl, "lifetime", mLifetime);
@@ -1372,14 +1518,18 @@ namespace openpeer
         IHelper::debugAppend(resultEl, "deallocate requester", (bool)mDeallocateRequester);
         IHelper::debugAppend(resultEl, "deallocate timer", (bool)mDeallocTimer);
         IHelper::debugAppend(resultEl, "servers", mServers.size());
+        IHelper::debugAppend(resultEl, "race servers", mRaceServers);
+        IHelper::debugAppend(resultEl, "race losers", mRaceLosers.size());
         IHelper::debugAppend(resultEl, "activation timer", (bool)mActivationTimer);
         IHelper::debugAppend(resultEl, "permissions", mPermissions.size());
         IHelper::debugAppend(resultEl, "permission timer", (bool)mPermissionTimer);
-        IHelper::debugAppend(resultEl, "permission requester", (bool)mPermissionRequester);
+        IHelper::debugAppend(resultEl, "permission requesters", mPermissionRequesters.size());
         IHelper::debugAppend(resultEl, "permission max capacity", mPermissionRequesterMaxCapacity);
-        IHelper::debugAppend(resultEl, "channel IP map", mChannelIPMap.size());
+        IHelper::debugAppend(resultEl, "channel IP table", mChannelIPTable.size());
         IHelper::debugAppend(resultEl, "channel number map", mChannelNumberMap.size());
-        IHelper::debugAppend(resultEl, "recycle buffers", mRecycledBuffers.size());
+        IHelper::debugAppend(resultEl, "channel refresh timer", (bool)mChannelRefreshTimer);
+        IHelper::debugAppend(resultEl, "tcp write queue watermark", mTCPWriteQueueWatermarkInBytes);
+        IHelper::debugAppend(resultEl, "tcp write queue drop oldest", mTCPWriteQueueDropOldest);
 
         return resultEl;
       }
@@ -1446,8 +1596,12 @@ namespace openpeer
 
         Time activateAfter = zsLib::now();
 
+        // the first "race" servers all activate at once and the fastest
+        // allocation wins, any others are staggered as fallbacks
+        size_t raceServers = (mRaceServers > 1 ? mRaceServers : 1);
+
         ULONG count = 0;
-        while ((!udpExhausted) &&
+        while ((!udpExhausted) ||
                (!tcpExhausted))
         {
           bool toggle = (0 == count ? true : ((count % 2) == 1)); // true, true, false, true, false, true, false, ...
@@ -1470,9 +1624,11 @@ namespace openpeer
           server->mServerIP = result;
           server->mActivateAfter = activateAfter;
 
-          activateAfter += Seconds(OPENPEER_SERVICES_TURN_ACTIVATE_NEXT_SERVER_IN_SECONDS);
-
           mServers.push_back(server);
+
+          if (mServers.size() >= raceServers) {
+            activateAfter += Seconds(OPENPEER_SERVICES_TURN_ACTIVATE_NEXT_SERVER_IN_SECONDS);
+          }
         }
 
         return mServers.size() > 0;
@@ -1545,6 +1701,11 @@ namespace openpeer
               break;
             }
 
+            if (Time() == server->mAllocateStartedAt) {
+              // the allocation time includes the TCP connect so UDP and TCP candidates race fairly
+              server->mAllocateStartedAt = tick;
+            }
+
             if (!server->mIsUDP) {
               if (!server->mTCPSocket) {
                 ZS_LOG_DEBUG(log("creating socket for TCP") + ZS_PARAM("server IP", server->mServerIP.string()))
@@ -1565,7 +1726,7 @@ namespace openpeer
                   cancel();
                   return;
                 }
-                server->mTCPSocket->setDelegate(mThisWeak.lock());  // set delegate must happen after the connect request
+                SocketEventBackend::attach(server->mTCPSocket, mThisWeak.lock());  // attach must happen after the connect request
               }
 
               if (!server->mIsConnected) {
@@ -1619,7 +1780,7 @@ namespace openpeer
 
           if (found) {
             ZS_LOG_DEBUG(log("will create permisson request now"))
-            requestPermissionsNow();
+            requestPermissionsNow(false);
           }
         }
 
@@ -1654,24 +1815,28 @@ namespace openpeer
         }
 
         mServers.clear();
+        mRaceLosers.clear();
 
         clearRefreshRequester();
-        clearPermissionRequester();
+        clearPermissionRequesters();
 
         mPermissions.clear();
-        for (ChannelIPMap::iterator iter = mChannelIPMap.begin(); iter != mChannelIPMap.end(); ++iter) {
+        mPermissionTable.clear();
+        for (ChannelNumberMap::iterator iter = mChannelNumberMap.begin(); iter != mChannelNumberMap.end(); ++iter) {
           ChannelInfoPtr info = (*iter).second;
-          if (info->mRefreshTimer) {
-            info->mRefreshTimer->cancel();
-            info->mRefreshTimer.reset();
-          }
           if (info->mChannelBindRequester) {
             info->mChannelBindRequester->cancel();
             info->mChannelBindRequester.reset();
           }
         }
-        mChannelIPMap.clear();
+        mChannelIPTable.clear();
         mChannelNumberMap.clear();
+        mChannelNumberTable.clear();
+
+        if (mChannelRefreshTimer) {
+          mChannelRefreshTimer->cancel();
+          mChannelRefreshTimer.reset();
+        }
 
         if (mActivationTimer) {
           mActivationTimer->cancel();
@@ -1711,13 +1876,9 @@ namespace openpeer
               // we need to shutdown gracefully... start the process now...
               STUNPacketPtr deallocRequest = STUNPacket::createRequest(STUNPacket::Method_Refresh);
               fix(deallocRequest);
-              deallocRequest->mUsername = mUsername;
-              deallocRequest->mPassword = mPassword;
-              deallocRequest->mRealm = mRealm;
-              deallocRequest->mNonce = mNonce;
+              fixCredentials(deallocRequest);
               deallocRequest->mLifetimeIncluded = true;
               deallocRequest->mLifetime = 0;
-              deallocRequest->mCredentialMechanism = STUNPacket::CredentialMechanisms_LongTerm;
               mDeallocateRequester = ISTUNRequester::create(getAssociatedMessageQueue(), mThisWeak.lock(), mActiveServer->mServerIP, deallocRequest, STUNPacket::RFC_5766_TURN);
 
               if (!mDeallocTimer) {
@@ -1867,7 +2028,7 @@ namespace openpeer
         }
 
         // if this was a proper successful response then it should be signed with integrity
-        if (!response->isValidMessageIntegrity(mPassword, mUsername, mRealm)) {
+        if (!isValidMessageIntegrity(response)) {
           ZS_LOG_ERROR(Detail, log("alloc response did not pass integrity check") + ZS_PARAM("server IP", server->mServerIP.string()))
           return false; // this didn't have valid message integrity so it's not a valid response
         }
@@ -1876,17 +2037,32 @@ namespace openpeer
           mLifetime = response->mLifetime;
         }
 
+        if (Time() != server->mAllocateStartedAt) {
+          server->mAllocateRTT = zsLib::now() - server->mAllocateStartedAt;
+        }
+
+        // servers racing in parallel each challenge with their own nonce so
+        // continue with the credentials the winning server accepted
+        if (!request->mNonce.isEmpty()) {
+          if (request->mRealm != mRealm) {
+            mRealm = request->mRealm;
+            mMessageIntegrityKey = MessageIntegrityKeyCache::find(mPassword, mUsername, mRealm);
+          }
+          mNonce = request->mNonce;
+        }
+
         mAllocateResponseIP = fromIPAddress;
         mRelayedIP = response->mRelayedAddress;
         mReflectedIP = response->mMappedAddress;
         mActiveServer = server;
+        tearDownRaceLosers(server);
         mServers.clear();
         if (mActivationTimer) {
           mActivationTimer->cancel();
           mActivationTimer.reset();
         }
 
-        ZS_LOG_DETAIL(log("alloc request completed") + ZS_PARAM("relayed ip", mRelayedIP.string()) + ZS_PARAM("reflected", mReflectedIP.string()) + ZS_PARAM("username", mUsername) + ZS_PARAM("password", mPassword) + ZS_PARAM("server IP", server->mServerIP.string()))
+        ZS_LOG_DETAIL(log("alloc request completed") + ZS_PARAM("relayed ip", mRelayedIP.string()) + ZS_PARAM("reflected", mReflectedIP.string()) + ZS_PARAM("username", mUsername) + ZS_PARAM("password", mPassword) + ZS_PARAM("server IP", server->mServerIP.string()) + ZS_PARAM("allocate rtt (ms)", server->mAllocateRTT.total_milliseconds()))
 
         setState(TURNSocketState_Ready);
 
@@ -1926,6 +2102,60 @@ namespace openpeer
         return true;
       }
 
+      //-----------------------------------------------------------------------
+      bool TURNSocket::handleRaceLoserRequester(ISTUNRequesterPtr requester)
+      {
+        for (ServerList::iterator iter = mRaceLosers.begin(); iter != mRaceLosers.end(); ++iter)
+        {
+          ServerPtr &server = (*iter);
+          if (requester != server->mReleaseRequester) continue;
+
+          // the release is best effort (the allocation expires by itself
+          // if it fails) so any response or a timeout completes it
+          ZS_LOG_DEBUG(log("race loser released") + ZS_PARAM("server IP", server->mServerIP.string()))
+          server->mReleaseRequester.reset();
+          mRaceLosers.erase(iter);
+          return true;
+        }
+        return false;
+      }
+
+      //-----------------------------------------------------------------------
+      void TURNSocket::tearDownRaceLosers(ServerPtr winner)
+      {
+        for (ServerList::iterator iter = mServers.begin(); iter != mServers.end(); ++iter)
+        {
+          ServerPtr &server = (*iter);
+          if (server == winner) continue;
+          if (!server->mAllocateRequester) continue;
+
+          STUNPacketPtr request = server->mAllocateRequester->getRequest();
+
+          server->mAllocateRequester->cancel();
+          server->mAllocateRequester.reset();
+
+          // a TCP allocation is released when its connection closes and the
+          // server cannot have allocated for a request without credentials
+          if (!server->mIsUDP) continue;
+          if (request->mNonce.isEmpty()) continue;
+
+          ZS_LOG_DEBUG(log("releasing allocation of race loser") + ZS_PARAM("server IP", server->mServerIP.string()))
+
+          STUNPacketPtr releaseRequest = STUNPacket::createRequest(STUNPacket::Method_Refresh);
+          fix(releaseRequest);
+          releaseRequest->mUsername = mUsername;
+          releaseRequest->mPassword = mPassword;
+          releaseRequest->mRealm = request->mRealm;
+          releaseRequest->mNonce = request->mNonce;
+          releaseRequest->mLifetimeIncluded = true;
+          releaseRequest->mLifetime = 0;
+          releaseRequest->mCredentialMechanism = STUNPacket::CredentialMechanisms_LongTerm;
+          server->mReleaseRequester = ISTUNRequester::create(getAssociatedMessageQueue(), mThisWeak.lock(), server->mServerIP, releaseRequest, STUNPacket::RFC_5766_TURN);
+
+          mRaceLosers.push_back(server);
+        }
+      }
+
       //-----------------------------------------------------------------------
       bool TURNSocket::handleRefreshRequester(
                                               ISTUNRequesterPtr requester,
@@ -1954,7 +2184,7 @@ namespace openpeer
         }
 
         // if this was a proper successful response then it should be signed with integrity
-        if (!response->isValidMessageIntegrity(mPassword, mUsername, mRealm)) {
+        if (!isValidMessageIntegrity(response)) {
           ZS_LOG_ERROR(Detail, log("refresh response did not pass integrity check"))
           return false; // this didn't have valid message integrity so it's not a valid response
         }
@@ -1978,18 +2208,21 @@ namespace openpeer
         // scope; we can't be in the context of a lock when we call that send routine
         {
           AutoRecursiveLock lock(mLock);
-          if (requester != mPermissionRequester) return false;
+          PermissionRequesterList::iterator foundRequester = std::find(mPermissionRequesters.begin(), mPermissionRequesters.end(), requester);
+          if (foundRequester == mPermissionRequesters.end()) return false;
 
           ZS_THROW_INVALID_ASSUMPTION_IF(!mActiveServer)
 
-          mPermissionRequester = handleAuthorizationErrors(requester, response);
-          if (mPermissionRequester) {
-            ZS_LOG_TRACE(log("replacement permission requester created") + ZS_PARAM("requester", mPermissionRequester->getID()))
+          ISTUNRequesterPtr replacementRequester = handleAuthorizationErrors(requester, response);
+          if (replacementRequester) {
+            ZS_LOG_TRACE(log("replacement permission requester created") + ZS_PARAM("requester", replacementRequester->getID()))
+
+            (*foundRequester) = replacementRequester;
 
             // failed to install permission... but we are trying again
             for (PermissionMap::iterator iter = mPermissions.begin(); iter != mPermissions.end(); ++iter) {
               if ((*iter).second->mInstallingWithRequester == requester) {
-                (*iter).second->mInstallingWithRequester = mPermissionRequester;
+                (*iter).second->mInstallingWithRequester = replacementRequester;
               }
             }
             return true;
@@ -1998,14 +2231,15 @@ namespace openpeer
           if ((0 != response->mErrorCode) ||
               (STUNPacket::Class_ErrorResponse == response->mClass)) {
 
+            mPermissionRequesters.erase(foundRequester);
+            clearBackgroundingNotifierIfPossible();
+
             // we can't install persmission... oh well... try again later...
             if (STUNPacket::ErrorCode_InsufficientCapacity == response->mErrorCode) {
-              STUNPacketPtr packet = requester->getRequest();
-              if (packet) {
-                if (packet->mPeerAddressList.size() > 1) {
-                  mPermissionRequesterMaxCapacity = packet->mPeerAddressList.size() - 1;
-                  IWakeDelegateProxy::create(mThisWeak.lock())->onWake();
-                }
+              // the permissions are spread over several requests so the capacity is counted across all of them
+              if (mPermissions.size() > 1) {
+                mPermissionRequesterMaxCapacity = mPermissions.size() - 1;
+                IWakeDelegateProxy::create(mThisWeak.lock())->onWake();
               }
             }
 
@@ -2021,13 +2255,16 @@ namespace openpeer
           }
 
           // if this was a proper successful response then it should be signed with integrity
-          if (!response->isValidMessageIntegrity(mPassword, mUsername, mRealm)) {
+          if (!isValidMessageIntegrity(response)) {
             ZS_LOG_ERROR(Detail, log("permission response did not pass integrity check"))
             return false; // this didn't have valid message integrity so it's not a valid response
           }
 
           ZS_LOG_DEBUG(log("permission requester completed"))
 
+          mPermissionRequesters.erase(foundRequester);
+          clearBackgroundingNotifierIfPossible();
+
           for (PermissionMap::iterator iter = mPermissions.begin(); iter != mPermissions.end(); ++iter) {
             if ((*iter).second->mInstallingWithRequester == requester) {
 
@@ -2088,7 +2325,7 @@ namespace openpeer
         }
 
         // if this was a proper successful response then it should be signed with integrity
-        if (!response->isValidMessageIntegrity(mPassword, mUsername, mRealm)) {
+        if (!isValidMessageIntegrity(response)) {
           ZS_LOG_ERROR(Detail, log("channel bind response did not pass integrity check"))
           return false; // this didn't have valid message integrity so it's not a valid response
         }
@@ -2101,13 +2338,15 @@ namespace openpeer
       }
 
       //-----------------------------------------------------------------------
-      void TURNSocket::requestPermissionsNow()
+      void TURNSocket::requestPermissionsNow(bool refreshAll)
       {
-        // we don't care of the previous permissions succeeded or not, we are going to send one right now
-        clearPermissionRequester();
+        if (refreshAll) {
+          // we don't care of the previous permissions succeeded or not, we are going to send new ones right now
+          clearPermissionRequesters();
+        }
 
         // scope: clear our permissions that have not seen data sent out in a long time
-        {
+        if (refreshAll) {
           bool found = false;
 
           Time time = zsLib::now();
@@ -2117,7 +2356,7 @@ namespace openpeer
             ++permIter;
 
             if (time > ((*current).second->mLastSentDataAt + Seconds(OPENPEER_SERVICES_TURN_REMOVE_PERMISSION_IF_NO_DATA_IN_SECONDS))) {
-              mPermissions.erase(current);
+              removePermission(current);
             } else
               found = true;
           }
@@ -2126,7 +2365,7 @@ namespace openpeer
             return;
         }
 
-        ZS_LOG_DEBUG(log("starting permission requester now"))
+        ZS_LOG_DEBUG(log("starting permission requester now") + ZS_PARAM("refresh all", refreshAll))
 
         while ((mPermissions.size() > mPermissionRequesterMaxCapacity) &&
                (0 != mPermissionRequesterMaxCapacity))
@@ -2146,35 +2385,101 @@ namespace openpeer
             break;
           }
 
-          mPermissions.erase(oldestFound);
+          removePermission(oldestFound);
         }
 
-        STUNPacketPtr permissionRequest = STUNPacket::createRequest(STUNPacket::Method_CreatePermission);
-        fix(permissionRequest);
-
-        // scope: add permissions for all the peers
+        // scope: batch the peers into as few requests as fit within the size limit
         {
+          STUNPacketPtr permissionRequest = createPermissionRequest();
+
+          size_t baseLength = permissionRequest->getPacketizedLength(STUNPacket::RFC_5766_TURN);
+          size_t requestLength = baseLength;
+
           for (PermissionMap::iterator iter = mPermissions.begin(); iter != mPermissions.end(); ++iter) {
             PermissionPtr permission = (*iter).second;
+
+            if (!refreshAll) {
+              // leave the batches already in flight alone and only request the permissions nobody is installing
+              if (permission->mInstalled) continue;
+              if (permission->mInstallingWithRequester) continue;
+            }
+
+            size_t peerLength = sizeof(DWORD) + (permission->mPeerAddress.isIPv4() ? sizeof(DWORD)*2 : sizeof(DWORD)*5);   // XOR-PEER-ADDRESS header plus family, port and address
+
+            if ((permissionRequest->mPeerAddressList.size() > 0) &&
+                (requestLength + peerLength > OPENPEER_SERVICES_TURN_MAX_PERMISSION_REQUEST_SIZE_IN_BYTES)) {
+              createPermissionRequester(permissionRequest);
+
+              permissionRequest = createPermissionRequest();
+              requestLength = baseLength;
+            }
+
             permissionRequest->mPeerAddressList.push_back(permission->mPeerAddress);
+            requestLength += peerLength;
+          }
+
+          if (permissionRequest->mPeerAddressList.size() > 0) {
+            createPermissionRequester(permissionRequest);
           }
         }
-        permissionRequest->mUsername = mUsername;
-        permissionRequest->mPassword = mPassword;
-        permissionRequest->mRealm = mRealm;
-        permissionRequest->mNonce = mNonce;
-        permissionRequest->mCredentialMechanism = STUNPacket::CredentialMechanisms_LongTerm;
-        mPermissionRequester = ISTUNRequester::create(getAssociatedMessageQueue(), mThisWeak.lock(), mActiveServer->mServerIP, permissionRequest, STUNPacket::RFC_5766_TURN);
+
+        ZS_LOG_DEBUG(log("permission requesters started") + ZS_PARAM("permissions", mPermissions.size()) + ZS_PARAM("requesters", mPermissionRequesters.size()))
+      }
+
+      //-----------------------------------------------------------------------
+      STUNPacketPtr TURNSocket::createPermissionRequest()
+      {
+        STUNPacketPtr permissionRequest = STUNPacket::createRequest(STUNPacket::Method_CreatePermission);
+        fix(permissionRequest);
+
+        fixCredentials(permissionRequest);
+        return permissionRequest;
+      }
+
+      //-----------------------------------------------------------------------
+      ISTUNRequesterPtr TURNSocket::createPermissionRequester(STUNPacketPtr permissionRequest)
+      {
+        ISTUNRequesterPtr requester = ISTUNRequester::create(getAssociatedMessageQueue(), mThisWeak.lock(), mActiveServer->mServerIP, permissionRequest, STUNPacket::RFC_5766_TURN);
+
+        mPermissionRequesters.push_back(requester);
 
         // scope: remember which ones will become marked as having permission based on this request completing...
         {
-          for (PermissionMap::iterator iter = mPermissions.begin(); iter != mPermissions.end(); ++iter) {
-            PermissionPtr permission = (*iter).second;
+          for (STUNPacket::PeerAddressList::iterator iter = permissionRequest->mPeerAddressList.begin(); iter != permissionRequest->mPeerAddressList.end(); ++iter) {
+            PermissionMap::iterator found = mPermissions.find(*iter);
+            if (found == mPermissions.end()) continue;
+
+            PermissionPtr permission = (*found).second;
             if (!permission->mInstalled) {
-              permission->mInstallingWithRequester = mPermissionRequester;
+              permission->mInstallingWithRequester = requester;
             }
           }
         }
+
+        return requester;
+      }
+
+      //-----------------------------------------------------------------------
+      bool TURNSocket::removePermissionRequester(ISTUNRequesterPtr requester)
+      {
+        for (PermissionRequesterList::iterator iter = mPermissionRequesters.begin(); iter != mPermissionRequesters.end(); ++iter) {
+          if (requester != (*iter)) continue;
+
+          mPermissionRequesters.erase(iter);
+          return true;
+        }
+        return false;
+      }
+
+      //-----------------------------------------------------------------------
+      void TURNSocket::clearPermissionRequesters()
+      {
+        for (PermissionRequesterList::iterator iter = mPermissionRequesters.begin(); iter != mPermissionRequesters.end(); ++iter) {
+          (*iter)->cancel();
+        }
+        mPermissionRequesters.clear();
+
+        clearBackgroundingNotifierIfPossible();
       }
 
       //-----------------------------------------------------------------------
@@ -2199,11 +2504,7 @@ namespace openpeer
         // this is the refresh timer... time to perform another refresh now...
         STUNPacketPtr newRequest = STUNPacket::createRequest(STUNPacket::Method_Refresh);
         fix(newRequest);
-        newRequest->mUsername = mUsername;
-        newRequest->mPassword = mPassword;
-        newRequest->mRealm = mRealm;
-        newRequest->mNonce = mNonce;
-        newRequest->mCredentialMechanism = STUNPacket::CredentialMechanisms_LongTerm;
+        fixCredentials(newRequest);
         mRefreshRequester = ISTUNRequester::create(getAssociatedMessageQueue(), mThisWeak.lock(), mActiveServer->mServerIP, newRequest, STUNPacket::RFC_5766_TURN);
       }
       
@@ -2231,43 +2532,82 @@ namespace openpeer
           {
             for (InfoList::iterator iter = infoList.begin(); iter != infoList.end(); ++iter) {
               ChannelInfoPtr info = (*iter);
-              ChannelIPMap::iterator found1 = mChannelIPMap.find(info->mPeerAddress);
-              ChannelNumberMap::iterator found2 = mChannelNumberMap.find(info->mChannelNumber);
-
-              if (info->mRefreshTimer) {
-                info->mRefreshTimer->cancel();
-                info->mRefreshTimer.reset();
-              }
 
               if (info->mChannelBindRequester) {
                 info->mChannelBindRequester->cancel();
                 info->mChannelBindRequester.reset();
               }
 
-              if (found1 != mChannelIPMap.end())
-                mChannelIPMap.erase(found1);
-              if (found2 != mChannelNumberMap.end())
-                mChannelNumberMap.erase(found2);
+              removeChannel(info);
             }
           }
         }
 
-        // we now have cleaned out expired channels... now we should request channel bindings for those channels which have not expired
+        // we now have cleaned out expired channels... now we should request channel bindings for those channels which are not bound yet (the bound ones are refreshed as they become due)
         {
           for (ChannelNumberMap::iterator iter = mChannelNumberMap.begin(); iter != mChannelNumberMap.end(); ++iter) {
             ChannelInfoPtr info = (*iter).second;
-            if (! (info->mRefreshTimer)) {
-              info->mRefreshTimer = Timer::create(mThisWeak.lock(), Seconds(9*10)); // channel bindings last for 10 minutes so refresh at 9 minutes
-            }
 
             if ((!info->mBound) &&
                 (!(info->mChannelBindRequester))) {
-              // cause a fake timer event to fire immediately to cause the channel to be bound now...
-              ITimerDelegatePtr delegate = ITimerDelegateProxy::create(mThisWeak.lock());
-              delegate->onTimer(info->mRefreshTimer);
+              bindChannel(info);
             }
           }
         }
+
+        if (mChannelNumberMap.size() < 1) {
+          if (mChannelRefreshTimer) {
+            mChannelRefreshTimer->cancel();
+            mChannelRefreshTimer.reset();
+          }
+          return;
+        }
+
+        // one timer drives the refresh of every channel
+        if (!mChannelRefreshTimer) {
+          mChannelRefreshTimer = Timer::create(mThisWeak.lock(), Seconds(OPENPEER_SERVICES_TURN_CHANNEL_REFRESH_TICK_IN_SECONDS));
+        }
+      }
+
+      //-----------------------------------------------------------------------
+      void TURNSocket::refreshDueChannels()
+      {
+        Time tick = zsLib::now();
+        size_t totalRefreshed = 0;
+
+        for (ChannelNumberMap::iterator iter = mChannelNumberMap.begin(); iter != mChannelNumberMap.end(); ++iter) {
+          ChannelInfoPtr info = (*iter).second;
+          if (info->mChannelBindRequester) continue;  // already have an outstanding request so do nothing...
+          if (tick < info->mRefreshAt) continue;
+
+          // limit the burst of requests per tick, the remaining due channels are picked up on the next tick
+          if (totalRefreshed >= OPENPEER_SERVICES_TURN_MAX_CHANNEL_REFRESHES_PER_TICK) {
+            ZS_LOG_TRACE(log("more channels are due for refresh than allowed per tick"))
+            break;
+          }
+
+          bindChannel(info);
+          ++totalRefreshed;
+        }
+      }
+
+      //-----------------------------------------------------------------------
+      void TURNSocket::bindChannel(ChannelInfoPtr info)
+      {
+        ZS_LOG_DEBUG(log("channel bind starting now") + ZS_PARAM("channel", info->mChannelNumber))
+
+        ZS_THROW_INVALID_ASSUMPTION_IF(!mActiveServer)
+
+        STUNPacketPtr newRequest = STUNPacket::createRequest(STUNPacket::Method_ChannelBind);
+        fix(newRequest);
+        fixCredentials(newRequest);
+        newRequest->mChannelNumber = info->mChannelNumber;
+        newRequest->mPeerAddressList.push_back(info->mPeerAddress);
+        info->mChannelBindRequester = ISTUNRequester::create(getAssociatedMessageQueue(), mThisWeak.lock(), mActiveServer->mServerIP, newRequest, STUNPacket::RFC_5766_TURN);
+
+        // the next refresh lands somewhere within the spread window before it is due (staggered by channel number) so channels bound together do not stay in lock step
+        DWORD spreadInMilliseconds = (((DWORD)info->mChannelNumber) * 7919) % (OPENPEER_SERVICES_TURN_CHANNEL_REFRESH_SPREAD_IN_SECONDS * 1000);
+        info->mRefreshAt = zsLib::now() + Seconds(OPENPEER_SERVICES_TURN_CHANNEL_REFRESH_IN_SECONDS - OPENPEER_SERVICES_TURN_CHANNEL_REFRESH_SPREAD_IN_SECONDS) + Milliseconds(spreadInMilliseconds);
       }
 
       //-----------------------------------------------------------------------
@@ -2276,6 +2616,19 @@ namespace openpeer
                                                          const BYTE *buffer,
                                                          size_t bufferSizeInBytes
                                                          )
+      {
+        PacketPart part;
+        part.mBuffer = buffer;
+        part.mBufferLengthInBytes = bufferSizeInBytes;
+        return sendPacketOrDopPacketIfBufferFull(server, &part, 1);
+      }
+
+      //-----------------------------------------------------------------------
+      bool TURNSocket::sendPacketOrDopPacketIfBufferFull(
+                                                         ServerPtr server,
+                                                         const PacketPart *parts,
+                                                         size_t totalParts
+                                                         )
       {
         ITURNSocketDelegatePtr delegate;
         TURNSocketPtr pThis;
@@ -2294,7 +2647,7 @@ namespace openpeer
           if (!server->mIsUDP) {
             if ((server->mTCPSocket) &&
                 (server->mIsConnected)) {
-              return sendPacketOverTCPOrDropIfBufferFull(server, buffer, bufferSizeInBytes);
+              return sendPacketOverTCPOrDropIfBufferFull(server, parts, totalParts);
             }
             OPENPEER_SERVICES_WIRE_LOG_WARNING(Detail, log("cannot send packet to server as TCP connection is not connected") + ZS_PARAM("server IP", server->mServerIP.string()))
             return false;
@@ -2309,7 +2662,10 @@ namespace openpeer
         }
 
         try {
-          return delegate->notifyTURNSocketSendPacket(pThis, serverIP, buffer, bufferSizeInBytes);
+          if (1 == totalParts) {
+            return delegate->notifyTURNSocketSendPacket(pThis, serverIP, parts[0].mBuffer, parts[0].mBufferLengthInBytes);
+          }
+          return delegate->notifyTURNSocketSendPacketParts(pThis, serverIP, parts, totalParts);
         } catch(ITURNSocketDelegateProxy::Exceptions::DelegateGone &) {
           OPENPEER_SERVICES_WIRE_LOG_WARNING(Debug, log("send packet failed as TURN delegate is gone"))
           cancel();
@@ -2320,12 +2676,14 @@ namespace openpeer
       //-----------------------------------------------------------------------
       bool TURNSocket::sendPacketOverTCPOrDropIfBufferFull(
                                                            ServerPtr server,
-                                                           const BYTE *buffer,
-                                                           size_t bufferSizeInBytes
+                                                           const PacketPart *parts,
+                                                           size_t totalParts
                                                            )
       {
         ZS_THROW_INVALID_ARGUMENT_IF(!server)
 
+        size_t bufferSizeInBytes = getTotalLength(parts, totalParts);
+
         if (isShutdown()) {
           OPENPEER_SERVICES_WIRE_LOG_WARNING(Debug, log("send packet failed as TURN socket is shutdown") + ZS_PARAM("server IP", server->mServerIP.string()))
           return false;
@@ -2340,98 +2698,155 @@ namespace openpeer
           return false;
         }
 
-        // never allow the buffer to overflow
-        if (bufferSizeInBytes > sizeof(server->mWriteBuffer)) {
-          OPENPEER_SERVICES_WIRE_LOG_WARNING(Debug, log("send packet failed as sending data is over capacity to write buffer") + ZS_PARAM("server IP", server->mServerIP.string()) + ZS_PARAM("sending bytes", bufferSizeInBytes) + ZS_PARAM("capacity", sizeof(server->mWriteBuffer)))
+        // never allow a single frame larger than the largest legal frame
+        if (bufferSizeInBytes > OPENPEER_SERVICES_TURN_MAX_CHANNEL_DATA_IN_BYTES+sizeof(DWORD)) {
+          OPENPEER_SERVICES_WIRE_LOG_WARNING(Debug, log("send packet failed as sending data is over capacity of a frame") + ZS_PARAM("server IP", server->mServerIP.string()) + ZS_PARAM("sending bytes", bufferSizeInBytes) + ZS_PARAM("capacity", OPENPEER_SERVICES_TURN_MAX_CHANNEL_DATA_IN_BYTES+sizeof(DWORD)))
           return false;
         }
 
-        // first try to send the data directly into TCP socket buffer (if possible) - to bypass unrequired copy when the buffer is fully empty
-        if (0 == server->mWriteBufferFilledSizeInBytes) {
-          if ((NULL != buffer) && (0 != bufferSizeInBytes)) {
-            try {
-              bool wouldBlock = false;
-              mLastSentDataToServer = zsLib::now();
-              size_t sent = server->mTCPSocket->send(buffer, bufferSizeInBytes, &wouldBlock);
-              if (sent != bufferSizeInBytes) {
-                server->mWriteBufferFilledSizeInBytes = (bufferSizeInBytes - sent);
-
-                // we were unable to send the entire data, we should buffer the remainer of the packet to send later...
-                memcpy(&(server->mWriteBuffer[0]), &(buffer[sent]), server->mWriteBufferFilledSizeInBytes);
-              } else {
-                if (server == mActiveServer) {
-                  informWriteReady();
-                }
-              }
-            } catch(Socket::Exceptions::Unspecified &error) {
-              OPENPEER_SERVICES_WIRE_LOG_WARNING(Debug, log("TCP socket send failure") + ZS_PARAM("error", error.errorCode()))
-
-              cancel();
-              return false;
-            }
-          }
-
-          // nothing more we can do right now...
-          return true;
+        if ((NULL == parts) || (0 == bufferSizeInBytes)) {
+          // nothing to add, just send what was queued...
+          return flushTCPWriteQueue(server);
         }
 
-        bool wasRoom = false;
+        if (0 != server->getTotalQueuedFrames()) {
+          // the frame waits in the queue and goes out with the other queued
+          // frames in a single write when the socket is write ready
+          if (!queueTCPFrame(server, parts, totalParts, bufferSizeInBytes)) return false;
+          if (server->mWriteBlocked) return true;
 
-        // if there is room in the end of the buffer for this new packet, tack it on...
-        if (bufferSizeInBytes + server->mWriteBufferFilledSizeInBytes < sizeof(server->mWriteBuffer)) {
-          if ((NULL != buffer) && (0 != bufferSizeInBytes)) {
-            // yup, there's room - tack it on the end...
-            memcpy(&(server->mWriteBuffer[server->mWriteBufferFilledSizeInBytes]), buffer, bufferSizeInBytes);
-            server->mWriteBufferFilledSizeInBytes += bufferSizeInBytes;
-            wasRoom = true;
-          }
+          // the last write was short without blocking so the socket may never report write ready
+          return flushTCPWriteQueue(server);
         }
 
-        if (0 == server->mWriteBufferFilledSizeInBytes) {
-          // if nothing in the buffer then nothing to do...
-          if (server == mActiveServer) {
-            informWriteReady();
-          }
-          if (!wasRoom) {
-            OPENPEER_SERVICES_WIRE_LOG_WARNING(Debug, log("another case of send packet failed as there was not enough buffer space (but yet it seemed to have been sent - strange??)"))
-          }
-          return wasRoom;
-        }
-
-        // we should see if we can send more of the buffer now...
+        // first try to send the data directly into TCP socket buffer (if possible) - to bypass unrequired copy when the queue is fully empty
         try {
           bool wouldBlock = false;
           mLastSentDataToServer = zsLib::now();
-          size_t sent = server->mTCPSocket->send(&(server->mWriteBuffer[0]), server->mWriteBufferFilledSizeInBytes, &wouldBlock);
-          if (sent == server->mWriteBufferFilledSizeInBytes) {
-            // we have exhasted the send buffer - horray! nothing more to do now...
-            server->mWriteBufferFilledSizeInBytes = 0;
-            if (!wasRoom) {
-              OPENPEER_SERVICES_WIRE_LOG_WARNING(Debug, log("data was sent over the wire but buffer capacity was reached"))
+          size_t sent = sendParts(server->mTCPSocket, parts, totalParts, &wouldBlock);
+          ++(server->mTotalWrites);
+          server->mWriteBlocked = wouldBlock;
+
+          if (sent == bufferSizeInBytes) {
+            ++(server->mTotalFramesWritten);
+            if (server == mActiveServer) {
+              informWriteReady();
             }
-            return wasRoom;
+            return true;
           }
 
-          if (0 != sent) {
-            // we have to consume what was sent from the write buffer
-            server->mWriteBufferFilledSizeInBytes -= sent;
-            memcpy(&(server->mWriteBuffer[0]), &(server->mWriteBuffer[sent]), server->mWriteBufferFilledSizeInBytes);
-            if (0 == server->mWriteBufferFilledSizeInBytes) {
-              if (server == mActiveServer) {
-                informWriteReady();
-              }
-            }
-          }
+          // we were unable to send the entire frame, we must queue the remainder of the frame to send later...
+          bool queued = queueTCPFrame(server, parts, totalParts, bufferSizeInBytes);
+          ZS_THROW_BAD_STATE_IF(!queued)  // an empty queue always has room for one frame
+          server->mWriteQueueHeadSentInBytes = sent;
+          server->mWriteBufferFilledSizeInBytes -= sent;
         } catch(Socket::Exceptions::Unspecified &error) {
           OPENPEER_SERVICES_WIRE_LOG_WARNING(Debug, log("TCP socket send failure") + ZS_PARAM("error", error.errorCode()))
 
           cancel();
           return false;
         }
-        if (!wasRoom) {
-          OPENPEER_SERVICES_WIRE_LOG_WARNING(Debug, log("data was not completely sent over the wire and buffer capacity was reached"))
+
+        // nothing more we can do right now...
+        return true;
+      }
+
+      //-----------------------------------------------------------------------
+      bool TURNSocket::queueTCPFrame(
+                                     ServerPtr server,
+                                     const PacketPart *parts,
+                                     size_t totalParts,
+                                     size_t frameLengthInBytes
+                                     )
+      {
+        size_t watermark = (mTCPWriteQueueWatermarkInBytes > frameLengthInBytes ? mTCPWriteQueueWatermarkInBytes : frameLengthInBytes);
+
+        while ((server->mWriteBufferFilledSizeInBytes + frameLengthInBytes > watermark) ||
+               (server->getTotalQueuedFrames() >= OPENPEER_SERVICES_TURN_MAX_TCP_WRITE_QUEUE_FRAMES)) {
+
+          if (!mTCPWriteQueueDropOldest) break;
+          if (!server->dropOldestFrame()) break;
+        }
+
+        if ((server->mWriteBufferFilledSizeInBytes + frameLengthInBytes > watermark) ||
+            (server->getTotalQueuedFrames() >= OPENPEER_SERVICES_TURN_MAX_TCP_WRITE_QUEUE_FRAMES)) {
+          ++(server->mTotalFramesDropped);
+          server->mTotalBytesDropped += frameLengthInBytes;
+          OPENPEER_SERVICES_WIRE_LOG_WARNING(Debug, log("send packet dropped as TCP write queue is full") + ZS_PARAM("server IP", server->mServerIP.string()) + ZS_PARAM("queued bytes", server->mWriteBufferFilledSizeInBytes) + ZS_PARAM("queued frames", server->getTotalQueuedFrames()) + ZS_PARAM("sending bytes", frameLengthInBytes))
+          return false;
         }
-        return wasRoom;
+
+        Server::QueuedFrame &frame = server->getQueuedFrame(server->mWriteQueueTail);
+        frame.mBuffer = PacketBufferPool::allocate(frameLengthInBytes);
+        frame.mLengthInBytes = frameLengthInBytes;
+        copyParts(frame.mBuffer->data(), parts, totalParts, 0);
+
+        ++(server->mWriteQueueTail);
+        ++(server->mTotalFramesQueued);
+        server->mWriteBufferFilledSizeInBytes += frameLengthInBytes;
+        return true;
+      }
+
+      //-----------------------------------------------------------------------
+      bool TURNSocket::flushTCPWriteQueue(ServerPtr server)
+      {
+        while (0 != server->getTotalQueuedFrames()) {
+          PacketPart parts[OPENPEER_SERVICES_TURN_MAX_TCP_COALESCED_FRAMES_PER_WRITE];
+          size_t totalParts = 0;
+          size_t totalLength = 0;
+
+          for (size_t index = server->mWriteQueueHead; (index != server->mWriteQueueTail) && (totalParts < OPENPEER_SERVICES_TURN_MAX_TCP_COALESCED_FRAMES_PER_WRITE); ++index, ++totalParts) {
+            Server::QueuedFrame &frame = server->getQueuedFrame(index);
+            size_t skip = (index == server->mWriteQueueHead ? server->mWriteQueueHeadSentInBytes : 0);
+
+            parts[totalParts].mBuffer = &((frame.mBuffer->data())[skip]);
+            parts[totalParts].mBufferLengthInBytes = frame.mLengthInBytes - skip;
+            totalLength += parts[totalParts].mBufferLengthInBytes;
+          }
+
+          size_t sent = 0;
+
+          try {
+            bool wouldBlock = false;
+            mLastSentDataToServer = zsLib::now();
+            sent = sendParts(server->mTCPSocket, &(parts[0]), totalParts, &wouldBlock);
+            ++(server->mTotalWrites);
+            server->mWriteBlocked = wouldBlock;
+          } catch(Socket::Exceptions::Unspecified &error) {
+            OPENPEER_SERVICES_WIRE_LOG_WARNING(Debug, log("TCP socket send failure") + ZS_PARAM("error", error.errorCode()))
+
+            cancel();
+            return false;
+          }
+
+          server->mWriteBufferFilledSizeInBytes -= sent;
+
+          // consume what was sent from the write queue
+          while (0 != sent) {
+            Server::QueuedFrame &frame = server->getQueuedFrame(server->mWriteQueueHead);
+            size_t remaining = frame.mLengthInBytes - server->mWriteQueueHeadSentInBytes;
+            if (sent < remaining) {
+              server->mWriteQueueHeadSentInBytes += sent;
+              break;
+            }
+
+            sent -= remaining;
+            frame.mBuffer.reset();
+            frame.mLengthInBytes = 0;
+            server->mWriteQueueHeadSentInBytes = 0;
+            ++(server->mWriteQueueHead);
+            ++(server->mTotalFramesWritten);
+          }
+
+          if (sent != totalLength) break;   // the socket will notify when there is room for more
+        }
+
+        if (0 == server->getTotalQueuedFrames()) {
+          if (server == mActiveServer) {
+            informWriteReady();
+          }
+        }
+        return true;
       }
 
       //-----------------------------------------------------------------------
@@ -2478,6 +2893,56 @@ namespace openpeer
         return channel;
       }
 
+      //-----------------------------------------------------------------------
+      void TURNSocket::addChannel(ChannelInfoPtr info)
+      {
+        mChannelIPTable.insert(info->mPeerAddress, info);
+        mChannelNumberMap[info->mChannelNumber] = info;
+
+        if (mChannelNumberTable.empty()) {
+          // the channel range is small and dense so a flat table indexed by
+          // channel number gives the receive path a single array lookup
+          mChannelNumberTable.resize(((size_t)(mLimitChannelToRangeEnd - mLimitChannelToRangeStart)) + 1, NULL);
+        }
+        mChannelNumberTable[info->mChannelNumber - mLimitChannelToRangeStart] = info.get();
+      }
+
+      //-----------------------------------------------------------------------
+      void TURNSocket::removeChannel(ChannelInfoPtr info)
+      {
+        ChannelNumberMap::iterator found = mChannelNumberMap.find(info->mChannelNumber);
+        if (found == mChannelNumberMap.end()) return;
+        if ((*found).second != info) return;
+
+        mChannelIPTable.erase(info->mPeerAddress);
+        mChannelNumberTable[info->mChannelNumber - mLimitChannelToRangeStart] = NULL;
+        mChannelNumberMap.erase(found);
+      }
+
+      //-----------------------------------------------------------------------
+      TURNSocket::ChannelInfo *TURNSocket::findChannel(WORD channel) const
+      {
+        if ((channel < mLimitChannelToRangeStart) ||
+            (channel > mLimitChannelToRangeEnd)) return NULL;
+        if (mChannelNumberTable.empty()) return NULL;
+
+        return mChannelNumberTable[channel - mLimitChannelToRangeStart];
+      }
+
+      //-----------------------------------------------------------------------
+      void TURNSocket::addPermission(PermissionPtr permission)
+      {
+        mPermissions[permission->mPeerAddress] = permission;
+        mPermissionTable.insert(permission->mPeerAddress, permission);
+      }
+
+      //-----------------------------------------------------------------------
+      void TURNSocket::removePermission(PermissionMap::iterator iter)
+      {
+        mPermissionTable.erase((*iter).first);
+        mPermissions.erase(iter);
+      }
+
       //-----------------------------------------------------------------------
       ISTUNRequesterPtr TURNSocket::handleAuthorizationErrors(ISTUNRequesterPtr requester, STUNPacketPtr response)
       {
@@ -2497,11 +2962,8 @@ namespace openpeer
             }
             mRealm = response->mRealm;
             mNonce = response->mNonce;
-            newRequest->mUsername = mUsername;
-            newRequest->mPassword = mPassword;
-            newRequest->mNonce = mNonce;
-            newRequest->mRealm = mRealm;
-            newRequest->mCredentialMechanism = STUNPacket::CredentialMechanisms_LongTerm;
+            mMessageIntegrityKey = MessageIntegrityKeyCache::find(mPassword, mUsername, mRealm);
+            fixCredentials(newRequest);
             break;
           }
           case STUNPacket::ErrorCode_StaleNonce:                    {
@@ -2511,13 +2973,16 @@ namespace openpeer
               break;
             }
             mNonce = response->mNonce;
-            if (!response->mRealm.isEmpty())
+            if (!response->mRealm.isEmpty()) {
               mRealm = response->mRealm;
+              mMessageIntegrityKey = MessageIntegrityKeyCache::find(mPassword, mUsername, mRealm);
+            }
 
             newRequest = (requester->getRequest())->clone(true);
             newRequest->mTotalRetries = ((requester->getRequest())->mTotalRetries) + 1;
             newRequest->mNonce = mNonce;
             newRequest->mRealm = mRealm;
+            newRequest->mMessageIntegrityKey = mMessageIntegrityKey;
             newRequest->mCredentialMechanism = STUNPacket::CredentialMechanisms_LongTerm;
             break;
           }
@@ -2533,39 +2998,13 @@ namespace openpeer
         if (!mBackgroundingNotifier) return;
         if (mRefreshRequester) return;
         if (mDeallocateRequester) return;
-        if (mPermissionRequester) return;
+        if (mPermissionRequesters.size() > 0) return;
 
         ZS_LOG_DEBUG(log("ready to go to the background"))
 
         mBackgroundingNotifier.reset();
       }
       
-      //-------------------------------------------------------------------------
-      void TURNSocket::getBuffer(RecycledPacketBuffer &outBuffer)
-      {
-        AutoRecursiveLock lock(mLock);
-        if (mRecycledBuffers.size() < 1) {
-          outBuffer = RecycledPacketBuffer(new BYTE[OPENPEER_SERVICES_TURNSOCKET_RECYCLE_BUFFER_SIZE]);
-          return;
-        }
-
-        outBuffer = mRecycledBuffers.front();
-        mRecycledBuffers.pop_front();
-      }
-
-      //-------------------------------------------------------------------------
-      void TURNSocket::recycleBuffer(RecycledPacketBuffer &buffer)
-      {
-        AutoRecursiveLock lock(mLock);
-        if (!buffer) return;
-
-        if (mRecycledBuffers.size() >= OPENPEER_SERVICES_TURNSOCKET_MAX_RECYLCE_BUFFERS) {
-          buffer.reset();
-          return;
-        }
-        mRecycledBuffers.push_back(buffer);
-      }
-
       //-----------------------------------------------------------------------
       //-----------------------------------------------------------------------
       //-----------------------------------------------------------------------
@@ -2580,16 +3019,28 @@ namespace openpeer
         mIsConnected(false),
         mInformedWriteReady(false),
         mReadBufferFilledSizeInBytes(0),
-        mWriteBufferFilledSizeInBytes(0)
+        mWriteBlocked(false),
+        mWriteQueueHead(0),
+        mWriteQueueTail(0),
+        mWriteQueueHeadSentInBytes(0),
+        mWriteBufferFilledSizeInBytes(0),
+        mTotalFramesQueued(0),
+        mTotalFramesWritten(0),
+        mTotalWrites(0),
+        mTotalFramesDropped(0),
+        mTotalBytesDropped(0)
       {
         memset(&(mReadBuffer[0]), 0, sizeof(mReadBuffer));
-        memset(&(mWriteBuffer[0]), 0, sizeof(mWriteBuffer));
+        for (size_t index = 0; index < OPENPEER_SERVICES_TURN_MAX_TCP_WRITE_QUEUE_FRAMES; ++index) {
+          mWriteQueue[index].mLengthInBytes = 0;
+        }
       }
 
       //-----------------------------------------------------------------------
       TURNSocket::Server::~Server()
       {
         if (mTCPSocket) {
+          SocketEventBackend::detach(mTCPSocket);
           mTCPSocket->close();
           mTCPSocket.reset();
         }
@@ -2597,6 +3048,10 @@ namespace openpeer
           mAllocateRequester->cancel();
           mAllocateRequester.reset();
         }
+        if (mReleaseRequester) {
+          mReleaseRequester->cancel();
+          mReleaseRequester.reset();
+        }
       }
 
       //-----------------------------------------------------------------------
@@ -2606,6 +3061,43 @@ namespace openpeer
         return pThis;
       }
 
+      //-----------------------------------------------------------------------
+      bool TURNSocket::Server::dropOldestFrame()
+      {
+        size_t total = getTotalQueuedFrames();
+        if (0 == total) return false;
+
+        size_t dropIndex = mWriteQueueHead;
+        if (0 != mWriteQueueHeadSentInBytes) {
+          // the oldest frame is partially written and must be completed to
+          // keep the stream framed; drop the frame behind it instead
+          if (total < 2) return false;
+
+          dropIndex = mWriteQueueHead + 1;
+        }
+
+        QueuedFrame &dropFrame = getQueuedFrame(dropIndex);
+
+        ++mTotalFramesDropped;
+        mTotalBytesDropped += dropFrame.mLengthInBytes;
+        mWriteBufferFilledSizeInBytes -= dropFrame.mLengthInBytes;
+
+        if (dropIndex != mWriteQueueHead) {
+          // move the partially written frame into the dropped frame's slot
+          QueuedFrame &headFrame = getQueuedFrame(mWriteQueueHead);
+          dropFrame.mBuffer = headFrame.mBuffer;
+          dropFrame.mLengthInBytes = headFrame.mLengthInBytes;
+          headFrame.mBuffer.reset();
+          headFrame.mLengthInBytes = 0;
+        } else {
+          dropFrame.mBuffer.reset();
+          dropFrame.mLengthInBytes = 0;
+        }
+
+        ++mWriteQueueHead;
+        return true;
+      }
+
       //-----------------------------------------------------------------------
       //-----------------------------------------------------------------------
       //-----------------------------------------------------------------------
@@ -2702,5 +3194,40 @@ namespace openpeer
       return internal::TURNSocket::toDebug(socket);
     }
 
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    #pragma mark
+    #pragma mark ITURNSocketDelegate
+    #pragma mark
+
+    //-------------------------------------------------------------------------
+    bool ITURNSocketDelegate::notifyTURNSocketSendPacketParts(
+                                                              ITURNSocketPtr socket,
+                                                              IPAddress destination,
+                                                              const PacketPart *parts,
+                                                              size_t totalParts
+                                                              )
+    {
+      size_t packetLengthInBytes = 0;
+      for (size_t index = 0; index < totalParts; ++index) {
+        packetLengthInBytes += parts[index].mBufferLengthInBytes;
+      }
+
+      if (0 == packetLengthInBytes) return false;
+
+      SecureByteBlock packet(packetLengthInBytes);
+
+      BYTE *pos = packet.BytePtr();
+      for (size_t index = 0; index < totalParts; ++index) {
+        if (0 == parts[index].mBufferLengthInBytes) continue;
+        memcpy(pos, parts[index].mBuffer, parts[index].mBufferLengthInBytes);
+        pos += parts[index].mBufferLengthInBytes;
+      }
+
+      return notifyTURNSocketSendPacket(socket, destination, packet.BytePtr(), packet.SizeInBytes());
+    }
+
   }
 }
@@ -0,0 +1,672 @@
+/*
+
+ Copyright (c) 2013, SMB Phone Inc.
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+
+ 1. Redistributions of source code must retain the above copyright notice, this
+ list of conditions and the following disclaimer.
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ The views and conclusions contained in the software and documentation are those
+ of the authors and should not be interpreted as representing official policies,
+ either expressed or implied, of the FreeBSD Project.
+
+ */
+
+#include <openpeer/services/internal/services_UDPBatch.h>
+#include <openpeer/services/internal/services_PacketBuffer.h>
+#include <openpeer/services/internal/services_wire.h>
+
+#include <zsLib/Exception.h>
+#include <zsLib/Log.h>
+#include <zsLib/XML.h>
+
+#ifdef OPENPEER_SERVICES_UDPBATCH_HAS_MMSG
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <errno.h>
+#include <string.h>
+#endif //OPENPEER_SERVICES_UDPBATCH_HAS_MMSG
+
+#ifdef OPENPEER_SERVICES_UDPBATCH_HAS_SEGMENTATION_OFFLOAD
+#include <netinet/udp.h>
+#include <stdint.h>
+
+#ifndef SOL_UDP
+#define SOL_UDP (17)
+#endif //ndef SOL_UDP
+
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT (103)
+#endif //ndef UDP_SEGMENT
+
+#ifndef UDP_GRO
+#define UDP_GRO (104)
+#endif //ndef UDP_GRO
+#endif //OPENPEER_SERVICES_UDPBATCH_HAS_SEGMENTATION_OFFLOAD
+
+namespace openpeer { namespace services { ZS_DECLARE_SUBSYSTEM(openpeer_services_ice) } }
+
+namespace openpeer
+{
+  namespace services
+  {
+    namespace internal
+    {
+#ifdef OPENPEER_SERVICES_UDPBATCH_HAS_MMSG
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      #pragma mark
+      #pragma mark (helpers)
+      #pragma mark
+
+      //-----------------------------------------------------------------------
+      // NOTE: set from whichever thread first sees the kernel refuse and
+      //       read from every socket thread thus only accessed atomically
+      static DWORD &mmsgDisabledFlag()
+      {
+        static DWORD disabled = 0;      // set once if the kernel reports ENOSYS
+        return disabled;
+      }
+
+      //-----------------------------------------------------------------------
+      static bool mmsgDisabled()
+      {
+        return 0 != zsLib::atomicGetValue32(mmsgDisabledFlag());
+      }
+
+      //-----------------------------------------------------------------------
+      static void disableMMSG()
+      {
+        zsLib::atomicSetValue32(mmsgDisabledFlag(), 1);
+      }
+
+#ifdef OPENPEER_SERVICES_UDPBATCH_HAS_SEGMENTATION_OFFLOAD
+      //-----------------------------------------------------------------------
+      static DWORD &segmentationDisabledFlag()
+      {
+        static DWORD disabled = 0;      // set once if the kernel does not know UDP_SEGMENT
+        return disabled;
+      }
+
+      //-----------------------------------------------------------------------
+      static bool segmentationDisabled()
+      {
+        return 0 != zsLib::atomicGetValue32(segmentationDisabledFlag());
+      }
+
+      //-----------------------------------------------------------------------
+      static void disableSegmentation()
+      {
+        zsLib::atomicSetValue32(segmentationDisabledFlag(), 1);
+      }
+#endif //OPENPEER_SERVICES_UDPBATCH_HAS_SEGMENTATION_OFFLOAD
+
+      //-----------------------------------------------------------------------
+      static socklen_t toSockAddr(
+                                  const IPAddress &ip,
+                                  sockaddr_storage &outAddress
+                                  )
+      {
+        memset(&outAddress, 0, sizeof(outAddress));
+
+        if (ip.isIPv4()) {
+          ip.getIPv4(*((sockaddr_in *)&outAddress));
+          return sizeof(sockaddr_in);
+        }
+
+        ip.getIPv6(*((sockaddr_in6 *)&outAddress));
+        return sizeof(sockaddr_in6);
+      }
+
+      //-----------------------------------------------------------------------
+      static IPAddress fromSockAddr(const sockaddr_storage &address)
+      {
+        switch (address.ss_family) {
+          case AF_INET:   return IPAddress(*((const sockaddr_in *)&address));
+          case AF_INET6:  return IPAddress(*((const sockaddr_in6 *)&address));
+          default:        break;
+        }
+        return IPAddress();
+      }
+#endif //OPENPEER_SERVICES_UDPBATCH_HAS_MMSG
+
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      #pragma mark
+      #pragma mark UDPBatch
+      #pragma mark
+
+      //-----------------------------------------------------------------------
+      bool UDPBatch::isSupported()
+      {
+#ifdef OPENPEER_SERVICES_UDPBATCH_HAS_MMSG
+        return !mmsgDisabled();
+#else
+        return false;
+#endif //OPENPEER_SERVICES_UDPBATCH_HAS_MMSG
+      }
+
+      //-----------------------------------------------------------------------
+      bool UDPBatch::isSegmentationSupported()
+      {
+#ifdef OPENPEER_SERVICES_UDPBATCH_HAS_SEGMENTATION_OFFLOAD
+        return (!mmsgDisabled()) && (!segmentationDisabled());
+#else
+        return false;
+#endif //OPENPEER_SERVICES_UDPBATCH_HAS_SEGMENTATION_OFFLOAD
+      }
+
+      //-----------------------------------------------------------------------
+      bool UDPBatch::enableReceiveCoalescing(SocketPtr socket)
+      {
+        ZS_THROW_INVALID_ARGUMENT_IF(!socket)
+
+#ifdef OPENPEER_SERVICES_UDPBATCH_HAS_SEGMENTATION_OFFLOAD
+        // the segment size is only reported by recvmmsg
+        if (mmsgDisabled()) return false;
+
+        int enabled = 1;
+        if (0 == ::setsockopt(socket->getSocket(), SOL_UDP, UDP_GRO, &enabled, sizeof(enabled))) return true;
+
+        ZS_LOG_DEBUG(log("kernel refused to coalesce received datagrams") + ZS_PARAM("error", errno))
+#endif //OPENPEER_SERVICES_UDPBATCH_HAS_SEGMENTATION_OFFLOAD
+
+        return false;
+      }
+
+      //-----------------------------------------------------------------------
+      size_t UDPBatch::receiveFrom(
+                                   SocketPtr socket,
+                                   ReceiveBuffer *buffers,
+                                   size_t totalBuffers,
+                                   bool *outWouldBlock
+                                   )
+      {
+        ZS_THROW_INVALID_ARGUMENT_IF(!socket)
+        ZS_THROW_INVALID_ARGUMENT_IF(!buffers)
+
+        if (outWouldBlock) *outWouldBlock = false;
+        if (0 == totalBuffers) return 0;
+
+        if (totalBuffers > OPENPEER_SERVICES_UDPBATCH_MAX_PACKETS) totalBuffers = OPENPEER_SERVICES_UDPBATCH_MAX_PACKETS;
+
+#ifdef OPENPEER_SERVICES_UDPBATCH_HAS_MMSG
+        // used even for a single buffer as only recvmmsg reports the segment
+        // size of a coalesced read
+        if (!mmsgDisabled()) {
+
+          mmsghdr messages[OPENPEER_SERVICES_UDPBATCH_MAX_PACKETS];
+          iovec vectors[OPENPEER_SERVICES_UDPBATCH_MAX_PACKETS];
+          sockaddr_storage addresses[OPENPEER_SERVICES_UDPBATCH_MAX_PACKETS];
+#ifdef OPENPEER_SERVICES_UDPBATCH_HAS_SEGMENTATION_OFFLOAD
+          char controls[OPENPEER_SERVICES_UDPBATCH_MAX_PACKETS][CMSG_SPACE(sizeof(int))];
+#endif //OPENPEER_SERVICES_UDPBATCH_HAS_SEGMENTATION_OFFLOAD
+
+          memset(&(messages[0]), 0, sizeof(mmsghdr)*totalBuffers);
+
+          for (size_t index = 0; index < totalBuffers; ++index) {
+            vectors[index].iov_base = buffers[index].mBuffer;
+            vectors[index].iov_len = buffers[index].mBufferSizeInBytes;
+
+            messages[index].msg_hdr.msg_iov = &(vectors[index]);
+            messages[index].msg_hdr.msg_iovlen = 1;
+            messages[index].msg_hdr.msg_name = &(addresses[index]);
+            messages[index].msg_hdr.msg_namelen = sizeof(sockaddr_storage);
+#ifdef OPENPEER_SERVICES_UDPBATCH_HAS_SEGMENTATION_OFFLOAD
+            messages[index].msg_hdr.msg_control = &(controls[index][0]);
+            messages[index].msg_hdr.msg_controllen = sizeof(controls[index]);
+#endif //OPENPEER_SERVICES_UDPBATCH_HAS_SEGMENTATION_OFFLOAD
+
+            buffers[index].mBytesRead = 0;
+            buffers[index].mSegmentSizeInBytes = 0;
+            buffers[index].mTruncated = false;
+          }
+
+          int result = ::recvmmsg(socket->getSocket(), &(messages[0]), static_cast<unsigned int>(totalBuffers), MSG_DONTWAIT, NULL);
+          if (result >= 0) {
+            for (int index = 0; index < result; ++index) {
+              buffers[index].mSource = fromSockAddr(addresses[index]);
+              buffers[index].mBytesRead = messages[index].msg_len;
+              buffers[index].mTruncated = (0 != (messages[index].msg_hdr.msg_flags & MSG_TRUNC));
+
+#ifdef OPENPEER_SERVICES_UDPBATCH_HAS_SEGMENTATION_OFFLOAD
+              msghdr &header = messages[index].msg_hdr;
+              for (cmsghdr *control = CMSG_FIRSTHDR(&header); NULL != control; control = CMSG_NXTHDR(&header, control)) {
+                if ((SOL_UDP != control->cmsg_level) ||
+                    (UDP_GRO != control->cmsg_type)) continue;
+
+                int segmentSize = 0;
+                memcpy(&segmentSize, CMSG_DATA(control), sizeof(segmentSize));
+                if (segmentSize > 0) buffers[index].mSegmentSizeInBytes = static_cast<size_t>(segmentSize);
+              }
+#endif //OPENPEER_SERVICES_UDPBATCH_HAS_SEGMENTATION_OFFLOAD
+            }
+            return static_cast<size_t>(result);
+          }
+
+          int error = errno;
+          if ((EAGAIN == error) ||
+              (EWOULDBLOCK == error)) {
+            if (outWouldBlock) *outWouldBlock = true;
+            return 0;
+          }
+
+          if (ENOSYS == error) {
+            ZS_LOG_WARNING(Detail, log("recvmmsg is not supported by the kernel (thus falling back to one datagram per read)"))
+            disableMMSG();
+          }
+
+          // fall through so the regular read can report the error (if any)
+          // in the usual manner
+        }
+#endif //OPENPEER_SERVICES_UDPBATCH_HAS_MMSG
+
+        return receiveFromEach(socket, buffers, totalBuffers, outWouldBlock);
+      }
+
+      //-----------------------------------------------------------------------
+      size_t UDPBatch::sendTo(
+                              SocketPtr socket,
+                              const IPAddress &destination,
+                              const SendBuffer *buffers,
+                              size_t totalBuffers,
+                              bool *outWouldBlock,
+                              bool allowSegmentation
+                              )
+      {
+        ZS_THROW_INVALID_ARGUMENT_IF(!socket)
+        ZS_THROW_INVALID_ARGUMENT_IF(!buffers)
+
+        if (outWouldBlock) *outWouldBlock = false;
+        if (0 == totalBuffers) return 0;
+
+#ifdef OPENPEER_SERVICES_UDPBATCH_HAS_SEGMENTATION_OFFLOAD
+        if ((allowSegmentation) &&
+            (totalBuffers > 1) &&
+            (!segmentationDisabled())) {
+
+          size_t totalSent = 0;       // every buffer before this one went to the kernel
+
+          size_t runStart = 0;        // the run of equal sized datagrams being extended
+          size_t segmentSize = 0;
+          size_t runBytes = 0;
+          bool runClosed = true;      // no further datagram can join the run
+
+          // one pass over the buffers; each datagram either extends the
+          // current run or ends it (sending it if it can be segmented) and
+          // starts the next run
+          for (size_t index = 0; index <= totalBuffers; ++index) {
+            if (index < totalBuffers) {
+              size_t length = buffers[index].mBufferLengthInBytes;
+              if ((!runClosed) &&
+                  (0 != length) &&
+                  (length <= segmentSize) &&
+                  (index - runStart < OPENPEER_SERVICES_UDPBATCH_MAX_SEGMENTS) &&
+                  (runBytes + length <= OPENPEER_SERVICES_UDPBATCH_MAX_SEGMENTED_SIZE_IN_BYTES)) {
+                runBytes += length;
+                runClosed = (length < segmentSize);   // only the last segment is allowed to be shorter
+                continue;
+              }
+            }
+
+            size_t totalInRun = index - runStart;
+            if (totalInRun > 1) {
+              // anything before the run is sent as individual datagrams
+              if (runStart > totalSent) {
+                size_t totalUnsegmented = runStart - totalSent;
+                size_t sent = sendToMultiple(socket, destination, &(buffers[totalSent]), totalUnsegmented, outWouldBlock);
+                totalSent += sent;
+                if (sent != totalUnsegmented) return totalSent;
+              }
+
+              bool failed = false;
+              size_t sent = sendSegmented(socket, destination, &(buffers[runStart]), totalInRun, outWouldBlock, failed);
+              if (failed) {
+                // allow the regular send to deliver the rest (and report the
+                // error in the usual manner if it persists)
+                return totalSent + sendToMultiple(socket, destination, &(buffers[totalSent]), totalBuffers - totalSent, outWouldBlock);
+              }
+
+              totalSent += sent;
+              if (sent != totalInRun) return totalSent;
+            }
+
+            if (index == totalBuffers) break;
+
+            runStart = index;
+            segmentSize = buffers[index].mBufferLengthInBytes;
+            runBytes = segmentSize;
+            runClosed = ((0 == segmentSize) ||
+                         (segmentSize > OPENPEER_SERVICES_UDPBATCH_MAX_SEGMENTED_SIZE_IN_BYTES));
+          }
+
+          if (totalSent < totalBuffers) {
+            totalSent += sendToMultiple(socket, destination, &(buffers[totalSent]), totalBuffers - totalSent, outWouldBlock);
+          }
+
+          return totalSent;
+        }
+#endif //OPENPEER_SERVICES_UDPBATCH_HAS_SEGMENTATION_OFFLOAD
+
+        return sendToMultiple(socket, destination, buffers, totalBuffers, outWouldBlock);
+      }
+
+      //-----------------------------------------------------------------------
+      size_t UDPBatch::sendGathered(
+                                    SocketPtr socket,
+                                    const IPAddress &destination,
+                                    const SendBuffer *buffers,
+                                    size_t totalBuffers,
+                                    bool *outWouldBlock
+                                    )
+      {
+        ZS_THROW_INVALID_ARGUMENT_IF(!socket)
+        ZS_THROW_INVALID_ARGUMENT_IF(!buffers)
+        ZS_THROW_INVALID_ARGUMENT_IF(totalBuffers > OPENPEER_SERVICES_UDPBATCH_MAX_GATHERED_BUFFERS)
+
+        if (outWouldBlock) *outWouldBlock = false;
+        if (0 == totalBuffers) return 0;
+
+        size_t totalLength = 0;
+        for (size_t index = 0; index < totalBuffers; ++index) {
+          totalLength += buffers[index].mBufferLengthInBytes;
+        }
+
+#ifdef OPENPEER_SERVICES_UDPBATCH_HAS_MMSG
+        {
+          iovec vectors[OPENPEER_SERVICES_UDPBATCH_MAX_GATHERED_BUFFERS];
+          sockaddr_storage address;
+
+          msghdr header;
+          memset(&header, 0, sizeof(header));
+
+          for (size_t index = 0; index < totalBuffers; ++index) {
+            vectors[index].iov_base = const_cast<BYTE *>(buffers[index].mBuffer);
+            vectors[index].iov_len = buffers[index].mBufferLengthInBytes;
+          }
+
+          header.msg_iov = &(vectors[0]);
+          header.msg_iovlen = totalBuffers;
+
+          if (!destination.isEmpty()) {
+            header.msg_name = &address;
+            header.msg_namelen = toSockAddr(destination, address);
+          }
+
+          ssize_t result = ::sendmsg(socket->getSocket(), &header, MSG_DONTWAIT | MSG_NOSIGNAL);
+          if (result >= 0) return static_cast<size_t>(result);
+
+          int error = errno;
+          if ((EAGAIN == error) ||
+              (EWOULDBLOCK == error)) {
+            if (outWouldBlock) *outWouldBlock = true;
+            return 0;
+          }
+
+          // fall through so the regular send can report the error (if any)
+          // in the usual manner
+        }
+#endif //OPENPEER_SERVICES_UDPBATCH_HAS_MMSG
+
+        const BYTE *buffer = buffers[0].mBuffer;
+
+        PacketBufferPtr gathered;
+        if (totalBuffers > 1) {
+          gathered = PacketBufferPool::allocate(totalLength);
+
+          BYTE *pos = gathered->data();
+          for (size_t index = 0; index < totalBuffers; ++index) {
+            if (0 == buffers[index].mBufferLengthInBytes) continue;
+            memcpy(pos, buffers[index].mBuffer, buffers[index].mBufferLengthInBytes);
+            pos += buffers[index].mBufferLengthInBytes;
+          }
+          buffer = gathered->data();
+        }
+
+        if (destination.isEmpty()) {
+          return socket->send(buffer, totalLength, outWouldBlock);
+        }
+        return socket->sendTo(destination, buffer, totalLength, outWouldBlock);
+      }
+
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      #pragma mark
+      #pragma mark UDPBatch => (internal)
+      #pragma mark
+
+      //-----------------------------------------------------------------------
+      Log::Params UDPBatch::log(const char *message)
+      {
+        return Log::Params(message, "UDPBatch");
+      }
+
+      //-----------------------------------------------------------------------
+      size_t UDPBatch::receiveFromEach(
+                                       SocketPtr socket,
+                                       ReceiveBuffer *buffers,
+                                       size_t totalBuffers,
+                                       bool *outWouldBlock
+                                       )
+      {
+        size_t totalRead = 0;
+
+        for (size_t index = 0; index < totalBuffers; ++index) {
+          ReceiveBuffer &buffer = buffers[index];
+
+          bool wouldBlock = false;
+          buffer.mBytesRead = socket->receiveFrom(buffer.mSource, buffer.mBuffer, buffer.mBufferSizeInBytes, &wouldBlock);
+          buffer.mSegmentSizeInBytes = 0;
+
+          // a plain read does not say if the datagram was cut short, only
+          // that it filled the buffer
+          buffer.mTruncated = (buffer.mBytesRead >= buffer.mBufferSizeInBytes);
+
+          if ((wouldBlock) ||
+              (0 == buffer.mBytesRead)) {
+            if (outWouldBlock) *outWouldBlock = wouldBlock;
+            break;
+          }
+
+          ++totalRead;
+        }
+
+        return totalRead;
+      }
+
+      //-----------------------------------------------------------------------
+      size_t UDPBatch::sendToEach(
+                                  SocketPtr socket,
+                                  const IPAddress &destination,
+                                  const SendBuffer *buffers,
+                                  size_t totalBuffers,
+                                  bool *outWouldBlock
+                                  )
+      {
+        size_t totalSent = 0;
+
+        for (size_t index = 0; index < totalBuffers; ++index) {
+          const SendBuffer &buffer = buffers[index];
+
+          bool wouldBlock = false;
+          size_t bytesSent = socket->sendTo(destination, buffer.mBuffer, buffer.mBufferLengthInBytes, &wouldBlock);
+
+          if ((wouldBlock) ||
+              (bytesSent != buffer.mBufferLengthInBytes)) {
+            if (outWouldBlock) *outWouldBlock = wouldBlock;
+            break;
+          }
+
+          ++totalSent;
+        }
+
+        return totalSent;
+      }
+
+      //-----------------------------------------------------------------------
+      size_t UDPBatch::sendToMultiple(
+                                      SocketPtr socket,
+                                      const IPAddress &destination,
+                                      const SendBuffer *buffers,
+                                      size_t totalBuffers,
+                                      bool *outWouldBlock
+                                      )
+      {
+#ifdef OPENPEER_SERVICES_UDPBATCH_HAS_MMSG
+        if ((totalBuffers > 1) &&
+            (!mmsgDisabled())) {
+
+          mmsghdr messages[OPENPEER_SERVICES_UDPBATCH_MAX_PACKETS];
+          iovec vectors[OPENPEER_SERVICES_UDPBATCH_MAX_PACKETS];
+
+          sockaddr_storage address;
+          socklen_t addressLength = toSockAddr(destination, address);
+
+          size_t totalSent = 0;
+
+          while (totalSent < totalBuffers) {
+            size_t totalThisPass = totalBuffers - totalSent;
+            if (totalThisPass > OPENPEER_SERVICES_UDPBATCH_MAX_PACKETS) totalThisPass = OPENPEER_SERVICES_UDPBATCH_MAX_PACKETS;
+
+            memset(&(messages[0]), 0, sizeof(mmsghdr)*totalThisPass);
+
+            for (size_t index = 0; index < totalThisPass; ++index) {
+              const SendBuffer &buffer = buffers[totalSent + index];
+
+              vectors[index].iov_base = const_cast<BYTE *>(buffer.mBuffer);
+              vectors[index].iov_len = buffer.mBufferLengthInBytes;
+
+              messages[index].msg_hdr.msg_iov = &(vectors[index]);
+              messages[index].msg_hdr.msg_iovlen = 1;
+              messages[index].msg_hdr.msg_name = &address;
+              messages[index].msg_hdr.msg_namelen = addressLength;
+            }
+
+            int result = ::sendmmsg(socket->getSocket(), &(messages[0]), static_cast<unsigned int>(totalThisPass), MSG_DONTWAIT | MSG_NOSIGNAL);
+            if (result < 0) {
+              int error = errno;
+              if ((EAGAIN == error) ||
+                  (EWOULDBLOCK == error)) {
+                if (outWouldBlock) *outWouldBlock = true;
+                return totalSent;
+              }
+
+              if (ENOSYS == error) {
+                ZS_LOG_WARNING(Detail, log("sendmmsg is not supported by the kernel (thus falling back to one datagram per send)"))
+                disableMMSG();
+              }
+
+              // allow the regular send to report the error in the usual manner
+              return totalSent + sendToEach(socket, destination, &(buffers[totalSent]), totalBuffers - totalSent, outWouldBlock);
+            }
+
+            totalSent += static_cast<size_t>(result);
+
+            if (static_cast<size_t>(result) < totalThisPass) {
+              // kernel stopped early (typically because the send buffer is full)
+              if (outWouldBlock) *outWouldBlock = true;
+              return totalSent;
+            }
+          }
+
+          return totalSent;
+        }
+#endif //OPENPEER_SERVICES_UDPBATCH_HAS_MMSG
+
+        return sendToEach(socket, destination, buffers, totalBuffers, outWouldBlock);
+      }
+
+      //-----------------------------------------------------------------------
+      size_t UDPBatch::sendSegmented(
+                                     SocketPtr socket,
+                                     const IPAddress &destination,
+                                     const SendBuffer *buffers,
+                                     size_t totalBuffers,
+                                     bool *outWouldBlock,
+                                     bool &outFailed
+                                     )
+      {
+        outFailed = false;
+
+#ifdef OPENPEER_SERVICES_UDPBATCH_HAS_SEGMENTATION_OFFLOAD
+        iovec vectors[OPENPEER_SERVICES_UDPBATCH_MAX_SEGMENTS];
+        char control[CMSG_SPACE(sizeof(uint16_t))];
+
+        sockaddr_storage address;
+        socklen_t addressLength = toSockAddr(destination, address);
+
+        for (size_t index = 0; index < totalBuffers; ++index) {
+          vectors[index].iov_base = const_cast<BYTE *>(buffers[index].mBuffer);
+          vectors[index].iov_len = buffers[index].mBufferLengthInBytes;
+        }
+
+        msghdr message;
+        memset(&message, 0, sizeof(message));
+        memset(&(control[0]), 0, sizeof(control));
+
+        message.msg_name = &address;
+        message.msg_namelen = addressLength;
+        message.msg_iov = &(vectors[0]);
+        message.msg_iovlen = totalBuffers;
+        message.msg_control = &(control[0]);
+        message.msg_controllen = sizeof(control);
+
+        cmsghdr *header = CMSG_FIRSTHDR(&message);
+        header->cmsg_level = SOL_UDP;
+        header->cmsg_type = UDP_SEGMENT;
+        header->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+
+        uint16_t segmentSize = static_cast<uint16_t>(buffers[0].mBufferLengthInBytes);
+        memcpy(CMSG_DATA(header), &segmentSize, sizeof(segmentSize));
+
+        ssize_t result = ::sendmsg(socket->getSocket(), &message, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (result >= 0) return totalBuffers;   // a segmented write is all or nothing
+
+        int error = errno;
+        if ((EAGAIN == error) ||
+            (EWOULDBLOCK == error)) {
+          if (outWouldBlock) *outWouldBlock = true;
+          return 0;
+        }
+
+        if ((ENOPROTOOPT == error) ||
+            (EOPNOTSUPP == error)) {
+          ZS_LOG_WARNING(Detail, log("UDP segmentation offload is not supported by the kernel (thus falling back to one datagram per message)"))
+          disableSegmentation();
+        } else {
+          // EIO / EINVAL depend on the route (e.g. no checksum offload or the
+          // segment exceeds the path MTU) so only this write falls back
+          ZS_LOG_TRACE(log("segmented write refused") + ZS_PARAM("error", error) + ZS_PARAM("segment size", segmentSize) + ZS_PARAM("segments", totalBuffers))
+        }
+#endif //OPENPEER_SERVICES_UDPBATCH_HAS_SEGMENTATION_OFFLOAD
+
+        outFailed = true;
+        return 0;
+      }
+    }
+  }
+}
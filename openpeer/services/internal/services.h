@@ -41,21 +41,26 @@
 #include <openpeer/services/internal/services_DHPublicKey.h>
 #include <openpeer/services/internal/services_DNS.h>
 #include <openpeer/services/internal/services_DNSMonitor.h>
+#include <openpeer/services/internal/services_FastCRC32.h>
 #include <openpeer/services/internal/services_Helper.h>
 #include <openpeer/services/internal/services_HTTP.h>
 #include <openpeer/services/internal/services_ICESocket.h>
 #include <openpeer/services/internal/services_ICESocketSession.h>
 #include <openpeer/services/internal/services_Logger.h>
+#include <openpeer/services/internal/services_MessageIntegrityKeyCache.h>
 #include <openpeer/services/internal/services_MessageLayerSecurityChannel.h>
 #include <openpeer/services/internal/services_MessageQueueManager.h>
+#include <openpeer/services/internal/services_PacketBuffer.h>
 #include <openpeer/services/internal/services_RSAPrivateKey.h>
 #include <openpeer/services/internal/services_RSAPublicKey.h>
 #include <openpeer/services/internal/services_RUDPChannel.h>
 #include <openpeer/services/internal/services_RUDPChannelStream.h>
+#include <openpeer/services/internal/services_RUDPCongestionControl.h>
 #include <openpeer/services/internal/services_RUDPListener.h>
 #include <openpeer/services/internal/services_RUDPMessaging.h>
 #include <openpeer/services/internal/services_RUDPTransport.h>
 #include <openpeer/services/internal/services_Settings.h>
+#include <openpeer/services/internal/services_SocketEventBackend.h>
 #include <openpeer/services/internal/services_STUNDiscovery.h>
 #include <openpeer/services/internal/services_STUNRequester.h>
 #include <openpeer/services/internal/services_STUNRequesterManager.h>
@@ -0,0 +1,90 @@
+/*
+
+ Copyright (c) 2013, SMB Phone Inc.
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+
+ 1. Redistributions of source code must retain the above copyright notice, this
+ list of conditions and the following disclaimer.
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ The views and conclusions contained in the software and documentation are those
+ of the authors and should not be interpreted as representing official policies,
+ either expressed or implied, of the FreeBSD Project.
+
+ */
+
+#pragma once
+
+#include <openpeer/services/internal/types.h>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define OPENPEER_SERVICES_CRC32_HAS_PCLMUL
+#endif //defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+
+namespace openpeer
+{
+  namespace services
+  {
+    namespace internal
+    {
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      #pragma mark
+      #pragma mark FastCRC32
+      #pragma mark
+
+      // CRC-32 using the IEEE 802.3 polynomial (the CRC required for the
+      // STUN FINGERPRINT attribute). Large buffers are folded with carry-less
+      // multiplication when the CPU supports PCLMULQDQ, everything else is
+      // calculated eight bytes at a time from slicing-by-8 tables.
+      class FastCRC32
+      {
+      public:
+        //---------------------------------------------------------------------
+        // PURPOSE: calculate the CRC-32 of the buffer
+        // NOTE:    pass the result of a previous call as "crc" to continue
+        //          the calculation over a following buffer
+        static DWORD calculate(
+                               const BYTE *buffer,
+                               size_t bufferLengthInBytes,
+                               DWORD crc = 0
+                               );
+
+        static bool isAccelerated();
+
+      protected:
+        static DWORD calculateSliced(
+                                     DWORD state,
+                                     const BYTE *buffer,
+                                     size_t bufferLengthInBytes
+                                     );
+
+#ifdef OPENPEER_SERVICES_CRC32_HAS_PCLMUL
+        static DWORD calculateFolded(
+                                     DWORD state,
+                                     const BYTE *buffer,
+                                     size_t bufferLengthInBytes
+                                     );
+#endif //OPENPEER_SERVICES_CRC32_HAS_PCLMUL
+      };
+    }
+  }
+}
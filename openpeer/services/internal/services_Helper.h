@@ -231,6 +231,18 @@ namespace openpeer
 
         static Log::Params log(const char *message);
 
+        //---------------------------------------------------------------------
+        #pragma mark
+        #pragma mark (wire)
+        #pragma mark
+
+        // NOTE: reads a network byte order value from any position in a
+        //       datagram (which can start at any offset inside a coalesced
+        //       read) thus the value is assembled from bytes rather than
+        //       loaded through a cast pointer
+        static WORD readWORD(const BYTE *pos)   {return static_cast<WORD>((((WORD)pos[0]) << 8) | ((WORD)pos[1]));}
+        static DWORD readDWORD(const BYTE *pos) {return (((DWORD)pos[0]) << 24) | (((DWORD)pos[1]) << 16) | (((DWORD)pos[2]) << 8) | ((DWORD)pos[3]);}
+
         //---------------------------------------------------------------------
         #pragma mark
         #pragma mark (other)
@@ -33,6 +33,8 @@
 
 #include <openpeer/services/internal/types.h>
 #include <openpeer/services/internal/services_Helper.h>
+#include <openpeer/services/internal/services_PacketBuffer.h>
+#include <openpeer/services/internal/services_UDPBatch.h>
 
 #include <openpeer/services/IICESocket.h>
 #include <openpeer/services/IDNS.h>
@@ -48,7 +50,10 @@
 #include <zsLib/Log.h>
 
 #include <list>
+#include <map>
 #include <boost/tuple/tuple.hpp>
+#include <boost/unordered_map.hpp>
+#include <boost/shared_ptr.hpp>
 
 #define OPENPEER_SERVICES_SETTING_TURN_CANDIDATES_MUST_REMAIN_ALIVE_AFTER_ICE_WAKE_UP_IN_SECONDS  "openpeer/services/turn-candidates-must-remain-alive-after-ice-wake-up-in-seconds"
 
@@ -60,9 +65,15 @@
 
 #define OPENPEER_SERVICES_SETTING_MAX_REBIND_ATTEMPT_DURATION_IN_SECONDS        "openpeer/services/max-ice-socket-rebind-attempt-duration-in-seconds"
 #define OPENPEER_SERVICES_SETTING_ICE_SOCKET_NO_LOCAL_IPS_CAUSES_SOCKET_FAILURE "openpeer/services/ice-socket-fail-when-no-local-ips"
+#define OPENPEER_SERVICES_SETTING_ICE_SOCKET_RECEIVE_BATCH_SIZE                 "openpeer/services/ice-socket-receive-batch-size"
+#define OPENPEER_SERVICES_SETTING_ICE_SOCKET_SHARDS                             "openpeer/services/ice-socket-shards"
+#define OPENPEER_SERVICES_SETTING_ICE_SOCKET_MTU_SIZED_RECEIVE_BUFFERS          "openpeer/services/ice-socket-mtu-sized-receive-buffers"
 
 #define OPENPEER_SERVICES_SETTING_INTERFACE_SUPPORT_IPV6                        "openpeer/services/support-ipv6"
 
+#define OPENPEER_SERVICES_ICESOCKET_MAX_RECEIVE_BATCH_SIZE  (32)
+#define OPENPEER_SERVICES_ICESOCKET_MAX_SHARDS  (16)
+
 namespace openpeer
 {
   namespace services
@@ -83,6 +94,8 @@ namespace openpeer
       {
         ZS_DECLARE_TYPEDEF_PTR(IICESocketForICESocketSession, ForICESocketSession)
 
+        typedef UDPBatch::SendBuffer SendBuffer;
+
         virtual IMessageQueuePtr getMessageQueue() const = 0;
 
         virtual bool attach(ICESocketSessionPtr session) = 0;
@@ -95,6 +108,15 @@ namespace openpeer
                             bool isUserData
                             ) = 0;
 
+        // RETURNS: the number of whole packets sent (in order)
+        virtual size_t sendBatchTo(
+                                   const IICESocket::Candidate &viaLocalCandidate,
+                                   const IPAddress &destination,
+                                   const SendBuffer *buffers,
+                                   size_t totalBuffers,
+                                   bool isUserData
+                                   ) = 0;
+
         virtual void addRoute(
                               ICESocketSessionPtr session,
                               const IPAddress &viaIP,
@@ -106,6 +128,35 @@ namespace openpeer
         virtual void onICESocketSessionClosed(PUID sessionID) = 0;
       };
 
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      #pragma mark
+      #pragma mark IICESocketAsync
+      #pragma mark
+
+      interaction IICESocketAsync
+      {
+        ZS_DECLARE_STRUCT_PTR(ShardBatch)
+
+        // datagrams read on one shard's thread, forwarded to the queue of the
+        // shard that must deliver them (index 0 is the ICE socket's queue)
+        struct ShardBatch
+        {
+          IPAddress               mBindIP;
+          SocketPtr               mSocket;
+
+          PacketBufferPtr         mBuffers[OPENPEER_SERVICES_ICESOCKET_MAX_RECEIVE_BATCH_SIZE];
+          UDPBatch::ReceiveBuffer mReceived[OPENPEER_SERVICES_ICESOCKET_MAX_RECEIVE_BATCH_SIZE];
+          size_t                  mTotalReceived;
+
+          ShardBatch() : mTotalReceived(0) {}
+        };
+
+        virtual void onICESocketShardBatchReceived(ShardBatchPtr batch) = 0;
+      };
+
       //-----------------------------------------------------------------------
       //-----------------------------------------------------------------------
       //-----------------------------------------------------------------------
@@ -122,6 +173,7 @@ namespace openpeer
                         public ITURNSocketDelegate,
                         public ISTUNDiscoveryDelegate,
                         public IICESocketForICESocketSession,
+                        public IICESocketAsync,
                         public ITimerDelegate
       {
       public:
@@ -133,9 +185,9 @@ namespace openpeer
         ZS_DECLARE_STRUCT_PTR(TURNInfo)
         ZS_DECLARE_STRUCT_PTR(STUNInfo)
         ZS_DECLARE_STRUCT_PTR(LocalSocket)
+        ZS_DECLARE_CLASS_PTR(Shard)
 
-        typedef boost::shared_array<BYTE> RecycledPacketBuffer;
-        typedef std::list<RecycledPacketBuffer> RecycledPacketBufferList;
+        friend class Shard;
 
         typedef std::list<IPAddress> IPAddressList;
 
@@ -146,25 +198,84 @@ namespace openpeer
         typedef IPAddress SourceIP;
         typedef boost::tuple<ViaIP, ViaLocalIP, SourceIP> RouteTuple;
 
-        struct RouteLess : public std::binary_function<RouteTuple, RouteTuple, bool>
+        struct RouteHash : public std::unary_function<RouteTuple, size_t>
+        {
+          size_t operator() (const RouteTuple &tuple) const;
+        };
+
+        struct RouteEqual : public std::binary_function<RouteTuple, RouteTuple, bool>
         {
           bool operator() (const RouteTuple& __x, const RouteTuple& __y) const
           {
-            if (boost::get<2>(__x) < boost::get<2>(__y)) return true;   // compare source IP first
-            if (boost::get<2>(__x) > boost::get<2>(__y)) return false;
-            if (boost::get<0>(__x) < boost::get<0>(__y)) return true;   // compare ViaIP next
-            if (boost::get<0>(__x) > boost::get<0>(__y)) return false;
-            if (boost::get<1>(__x) < boost::get<1>(__y)) return true;   // compare ViaLocalIP next
-            if (boost::get<1>(__x) > boost::get<1>(__y)) return false;
-
-            return false; // they are equal, so not less than
+            return ((boost::get<2>(__x) == boost::get<2>(__y)) &&
+                    (boost::get<0>(__x) == boost::get<0>(__y)) &&
+                    (boost::get<1>(__x) == boost::get<1>(__y)));
           }
         };
 
-        typedef std::map<RouteTuple, UseICESocketSessionPtr, RouteLess> QuickRouteMap;
+        typedef boost::unordered_map<RouteTuple, UseICESocketSessionPtr, RouteHash, RouteEqual> QuickRouteMap;
+
+        // route tables are published read-copy-update style; a published
+        // table is never modified so it can be read without the socket's
+        // lock (boost::atomic_load/atomic_store still take a short lived
+        // spinlock from boost's pool for the shared_ptr itself); every
+        // change copies the whole table so adding a route is O(n)
+        typedef boost::shared_ptr<const QuickRouteMap> QuickRouteMapPtr;
+        typedef boost::shared_ptr<QuickRouteMap> QuickRouteMapCopyPtr;
+
+        typedef String ICEUsername;                   // "<local username frag>:<remote username frag>"
+
+        struct ICEUsernameHash : public std::unary_function<ICEUsername, size_t>
+        {
+          size_t operator() (const ICEUsername &username) const;
+        };
+
+        typedef boost::unordered_multimap<ICEUsername, UseICESocketSessionPtr, ICEUsernameHash> ICESocketSessionUsernameMap;
 
         typedef Helper::IPAddressMap IPAddressMap;
 
+        struct PacketRoute
+        {
+          ITURNSocketPtr          mTURNSocket;      // TURN socket whose server sent the packet (if any)
+        };
+
+        typedef std::map<PUID, size_t> SessionShardMap;  // session ID -> index of the shard the session is pinned to
+
+        // published read-copy-update style exactly like the route tables
+        typedef boost::shared_ptr<const SessionShardMap> SessionShardMapPtr;
+        typedef boost::shared_ptr<SessionShardMap> SessionShardMapCopyPtr;
+
+        // Buffers handed to a batched read. Only the buffers of the slots
+        // which were filled are handed off with the packets, the rest stay
+        // in place for the next read. Buffers are large enough for any
+        // datagram unless MTU sized buffers are enabled (so a retained packet
+        // is referenced rather than copied), in which case any datagram larger
+        // than the MTU is dropped as truncated.
+        struct ReceiveSlots
+        {
+          size_t                  mBufferSizeInBytes;
+          size_t                  mReservedBuffers;   // held against the pool's large buffer class
+
+          PacketBufferPtr         mBuffers[OPENPEER_SERVICES_ICESOCKET_MAX_RECEIVE_BATCH_SIZE];
+          UDPBatch::ReceiveBuffer mReceived[OPENPEER_SERVICES_ICESOCKET_MAX_RECEIVE_BATCH_SIZE];
+
+          ReceiveSlots();
+          ~ReceiveSlots();
+
+          void configure(
+                         bool receiveCoalescing,
+                         bool mtuSizedBuffers,
+                         size_t totalSlots
+                         );
+
+          void prepare(size_t totalSlots);
+          void takeFilled(
+                          size_t totalFilled,
+                          PacketBufferPtr *outBuffers,
+                          UDPBatch::ReceiveBuffer *outReceived
+                          );
+        };
+
         struct TURNInfo
         {
           TURNServerInfoPtr mServerInfo;
@@ -204,10 +315,14 @@ namespace openpeer
         typedef std::map<STUNInfoPtr, STUNInfoPtr> STUNInfoMap;
         typedef std::map<ISTUNDiscoveryPtr, STUNInfoPtr> STUNInfoDiscoveryMap;
 
+        typedef std::list<ShardPtr> ShardList;
+
         struct LocalSocket
         {
           AutoPUID              mID;
           SocketPtr             mSocket;
+          ShardList             mShards;                      // additional SO_REUSEPORT sockets bound to the same local IP/port
+          ReceiveSlots          mReceiveSlots;
 
           CandidatePtr          mLocal;
 
@@ -325,6 +440,14 @@ namespace openpeer
                             bool isUserData
                             );
 
+        virtual size_t sendBatchTo(
+                                   const Candidate &viaLocalCandidate,
+                                   const IPAddress &destination,
+                                   const SendBuffer *buffers,
+                                   size_t totalBuffers,
+                                   bool isUserData
+                                   );
+
         virtual void addRoute(
                               ICESocketSessionPtr session,
                               const IPAddress &viaIP,
@@ -335,6 +458,13 @@ namespace openpeer
 
         virtual void onICESocketSessionClosed(PUID sessionID);
         
+        //---------------------------------------------------------------------
+        #pragma mark
+        #pragma mark ICESocket => IICESocketAsync
+        #pragma mark
+
+        virtual void onICESocketShardBatchReceived(ShardBatchPtr batch);
+
         //---------------------------------------------------------------------
         #pragma mark
         #pragma mark ICESocket => ISocketDelegate
@@ -368,6 +498,13 @@ namespace openpeer
                                                 size_t packetLengthInBytes
                                                 );
 
+        virtual bool notifyTURNSocketSendPacketParts(
+                                                     ITURNSocketPtr socket,
+                                                     IPAddress destination,
+                                                     const PacketPart *parts,
+                                                     size_t totalParts
+                                                     );
+
         virtual void onTURNSocketWriteReady(ITURNSocketPtr socket);
 
         //---------------------------------------------------------------------
@@ -425,6 +562,92 @@ namespace openpeer
         void clearTURN(ITURNSocketPtr turn);
         void clearSTUN(ISTUNDiscoveryPtr stun);
 
+        void createShards(LocalSocketPtr localSocket);
+        bool hasAllShards(LocalSocketPtr localSocket) const;
+        void closeShards(LocalSocketPtr localSocket);
+
+        static ICEUsername getUsername(UseICESocketSessionPtr session);
+
+        void removeLearnedRoutes(PUID sessionID);
+
+        //---------------------------------------------------------------------
+        // PURPOSE: pin the session to the shard unless it is already pinned
+        // RETURNS: the index of the shard the session is pinned to
+        // NOTE:    Safe to call without a lock (only takes the lock the first
+        //          time a session is seen).
+        size_t pinSession(
+                          UseICESocketSessionPtr session,
+                          size_t shardIndex
+                          );
+        void unpinSession(PUID sessionID);
+
+        static QuickRouteMapCopyPtr copyRoutes(const QuickRouteMapPtr &routes);
+        static bool removeRoutes(
+                                 QuickRouteMapPtr &ioRoutes,
+                                 const IPAddress *viaLocalIP,
+                                 PUID sessionID
+                                 );
+
+        //---------------------------------------------------------------------
+        // NOTE:  Safe to call without a lock.
+        static UseICESocketSessionPtr findRoute(
+                                                const QuickRouteMapPtr &routes,
+                                                const Candidate &viaCandidate,
+                                                const Candidate &viaLocalCandidate,
+                                                const IPAddress &source
+                                                );
+
+        //---------------------------------------------------------------------
+        // NOTE:  Must be called while in a lock.
+        void findSessionsByUsername(
+                                    const ICEUsername &username,
+                                    ICESocketSessionMap &outSessions
+                                    );
+
+        void learnRoute(
+                        const Candidate &viaCandidate,
+                        const Candidate &viaLocalCandidate,
+                        const IPAddress &source,
+                        UseICESocketSessionPtr session
+                        );
+
+        //---------------------------------------------------------------------
+        // NOTE:  Must be called while in a lock. Resolves every lookup
+        //        needed to demultiplex a packet that requires the lock.
+        void resolveRoute(
+                          const Candidate &viaCandidate,
+                          const Candidate &viaLocalCandidate,
+                          const IPAddress &source,
+                          PacketRoute &outRoute
+                          );
+
+        CandidatePtr getShardLocalCandidate(const IPAddress &bindIP);
+
+        //---------------------------------------------------------------------
+        // NOTE:  Do NOT call this method while in a lock because it must
+        //        deliver data to delegates synchronously. Datagrams for a
+        //        session pinned to the calling shard are delivered on the
+        //        calling thread, every other datagram is forwarded to the
+        //        queue of the shard that must deliver it.
+        void dispatchBatch(
+                           size_t shardIndex,
+                           const Candidate &viaLocalCandidate,
+                           SocketPtr socket,
+                           const PacketBufferPtr *buffers,
+                           const UDPBatch::ReceiveBuffer *received,
+                           size_t totalReceived
+                           );
+
+        //---------------------------------------------------------------------
+        // NOTE:  Do NOT call this method while in a lock because it must
+        //        deliver data to delegates synchronously.
+        void internalReceivedBatch(
+                                   const Candidate &viaLocalCandidate,
+                                   SocketPtr socket,
+                                   const UDPBatch::ReceiveBuffer *received,
+                                   size_t totalReceived
+                                   );
+
         //---------------------------------------------------------------------
         // NOTE:  Do NOT call this method while in a lock because it must
         //        deliver data to delegates synchronously.
@@ -436,25 +659,103 @@ namespace openpeer
                                   size_t bufferLengthInBytes
                                   );
 
-        void getBuffer(RecycledPacketBuffer &outBuffer);
-        void recycleBuffer(RecycledPacketBuffer &buffer);
-
         void clearRebindTimer() { if (mRebindTimer) {mRebindTimer->cancel(); mRebindTimer.reset();} }
 
       public:
+        //---------------------------------------------------------------------
+        //---------------------------------------------------------------------
+        //---------------------------------------------------------------------
         //---------------------------------------------------------------------
         #pragma mark
-        #pragma mark ICESocket::AutoRecycleBuffer
+        #pragma mark ICESocket => class Shard
         #pragma mark
 
-        class AutoRecycleBuffer
+        // Receives on one of several sockets bound to the same local IP/port
+        // via SO_REUSEPORT. The kernel hashes each remote 5-tuple to one of
+        // the sockets so the reads are spread over the shard threads. A
+        // session is pinned to the shard which first receives a datagram on
+        // one of its routes (normally the nominated 5-tuple) and from then
+        // on its routed datagrams are delivered from that shard's thread
+        // only; datagrams a shard reads for a session pinned elsewhere are
+        // forwarded to that shard's queue. Datagrams without a session route
+        // (connectivity checks, TURN and unknown sources) are forwarded to
+        // the ICE socket's queue exactly as if read by the primary socket.
+        class Shard : public MessageQueueAssociator,
+                      public SharedRecursiveLock,
+                      public ISocketDelegate
         {
+        protected:
+          Shard(
+                IMessageQueuePtr queue,
+                ICESocketPtr outer,
+                size_t shardIndex,
+                const IPAddress &bindIP,
+                SocketPtr socket,
+                bool receiveCoalescing
+                );
+
+          void init();
+
         public:
-          AutoRecycleBuffer(ICESocket &outer, RecycledPacketBuffer &buffer) : mOuter(outer), mBuffer(buffer) {}
-          ~AutoRecycleBuffer() {mOuter.recycleBuffer(mBuffer);}
-        private:
-          ICESocket &mOuter;
-          RecycledPacketBuffer &mBuffer;
+          ~Shard();
+
+          //-------------------------------------------------------------------
+          #pragma mark
+          #pragma mark ICESocket::Shard => friend ICESocket
+          #pragma mark
+
+          static ShardPtr create(
+                                 IMessageQueuePtr queue,
+                                 ICESocketPtr outer,
+                                 size_t shardIndex,
+                                 const IPAddress &bindIP,
+                                 SocketPtr socket,
+                                 bool receiveCoalescing
+                                 );
+
+          PUID getID() const {return mID;}
+
+          bool isClosed() const;
+          void close();
+
+          ElementPtr toDebug() const;
+
+          //-------------------------------------------------------------------
+          #pragma mark
+          #pragma mark ICESocket::Shard => ISocketDelegate
+          #pragma mark
+
+          virtual void onReadReady(SocketPtr socket);
+          virtual void onWriteReady(SocketPtr socket);
+          virtual void onException(SocketPtr socket);
+
+        protected:
+          //-------------------------------------------------------------------
+          #pragma mark
+          #pragma mark ICESocket::Shard => (internal)
+          #pragma mark
+
+          Log::Params log(const char *message) const;
+
+        protected:
+          //-------------------------------------------------------------------
+          #pragma mark
+          #pragma mark ICESocket::Shard => (data)
+          #pragma mark
+
+          AutoPUID mID;
+          ShardWeakPtr mThisWeak;
+          ICESocketWeakPtr mOuter;
+
+          size_t mShardIndex;
+          IPAddress mBindIP;
+          SocketPtr mSocket;
+
+          size_t mReceiveBatchSize;
+          ReceiveSlots mReceiveSlots;
+
+          ULONG mTotalPacketsReceived;
+          ULONG mTotalBatchesReceived;
         };
 
       protected:
@@ -499,10 +800,18 @@ namespace openpeer
         Duration            mTURNShutdownIfNotUsedBy;         // when will TURN be shutdown if it is not used by this time
 
         ICESocketSessionMap mSessions;
+        ICESocketSessionUsernameMap mSessionsByUsername;
+
+        QuickRouteMapPtr    mRoutes;                          // WARNING: access only via boost::atomic_load/atomic_store
+        QuickRouteMapPtr    mLearnedRoutes;                   // WARNING: access only via boost::atomic_load/atomic_store
 
-        QuickRouteMap       mRoutes;
+        size_t              mReceiveBatchSize;
 
-        RecycledPacketBufferList mRecycledBuffers;
+        size_t              mTotalShards;                     // total sockets bound per local IP (1 = sharding disabled)
+        IMessageQueuePtr    mShardQueues[OPENPEER_SERVICES_ICESOCKET_MAX_SHARDS];   // index 0 is the ICE socket's own queue
+        SessionShardMapPtr  mSessionShards;                   // WARNING: access only via boost::atomic_load/atomic_store
+        bool                mSegmentationOffload;             // send bursts as segmented writes and read coalesced datagrams
+        bool                mMTUSizedReceiveBuffers;          // read into MTU sized buffers (larger datagrams are dropped)
 
         AutoBool            mNotifiedCandidateChanged;
         DWORD               mLastCandidateCRC;
@@ -543,14 +852,21 @@ namespace openpeer
   }
 }
 
+ZS_DECLARE_PROXY_BEGIN(openpeer::services::internal::IICESocketAsync)
+ZS_DECLARE_PROXY_TYPEDEF(openpeer::services::internal::IICESocketAsync::ShardBatchPtr, ShardBatchPtr)
+ZS_DECLARE_PROXY_METHOD_1(onICESocketShardBatchReceived, ShardBatchPtr)
+ZS_DECLARE_PROXY_END()
+
 ZS_DECLARE_PROXY_BEGIN(openpeer::services::internal::IICESocketForICESocketSession)
 ZS_DECLARE_PROXY_TYPEDEF(zsLib::IMessageQueuePtr, IMessageQueuePtr)
 ZS_DECLARE_PROXY_TYPEDEF(openpeer::services::internal::ICESocketSessionPtr, ICESocketSessionPtr)
 ZS_DECLARE_PROXY_TYPEDEF(openpeer::services::IICESocketPtr, IICESocketPtr)
 ZS_DECLARE_PROXY_TYPEDEF(openpeer::services::IICESocket, IICESocket)
+ZS_DECLARE_PROXY_TYPEDEF(openpeer::services::internal::IICESocketForICESocketSession::SendBuffer, SendBuffer)
 ZS_DECLARE_PROXY_METHOD_SYNC_CONST_RETURN_0(getMessageQueue, IMessageQueuePtr)
 ZS_DECLARE_PROXY_METHOD_SYNC_RETURN_1(attach, bool, ICESocketSessionPtr)
 ZS_DECLARE_PROXY_METHOD_SYNC_RETURN_5(sendTo, bool, const IICESocket::Candidate &, const IPAddress &, const BYTE *, size_t, bool)
+ZS_DECLARE_PROXY_METHOD_SYNC_RETURN_5(sendBatchTo, size_t, const IICESocket::Candidate &, const IPAddress &, const SendBuffer *, size_t, bool)
 ZS_DECLARE_PROXY_METHOD_1(onICESocketSessionClosed, PUID)
 ZS_DECLARE_PROXY_METHOD_SYNC_4(addRoute, openpeer::services::internal::ICESocketSessionPtr, const IPAddress &, const IPAddress &, const IPAddress &)
 ZS_DECLARE_PROXY_METHOD_SYNC_1(removeRoute, openpeer::services::internal::ICESocketSessionPtr)
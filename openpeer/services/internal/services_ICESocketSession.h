@@ -74,6 +74,9 @@ namespace openpeer
         virtual PUID getID() const = 0;
         virtual void close() = 0;
 
+        virtual String getLocalUsernameFrag() const = 0;
+        virtual String getRemoteUsernameFrag() const = 0;
+
         virtual void updateRemoteCandidates(const CandidateList &remoteCandidates) = 0;
 
         virtual bool handleSTUNPacket(
@@ -94,6 +97,27 @@ namespace openpeer
         virtual void notifyRelayWriteReady(const IICESocket::Candidate &viaLocalCandidate) = 0;
       };
 
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      #pragma mark
+      #pragma mark IICESocketSessionForRUDPTransport
+      #pragma mark
+
+      interaction IICESocketSessionForRUDPTransport
+      {
+        ZS_DECLARE_TYPEDEF_PTR(IICESocketSessionForRUDPTransport, ForRUDPTransport)
+
+        typedef UDPBatch::SendBuffer SendBuffer;
+
+        // RETURNS: the number of whole packets sent (in order)
+        virtual size_t sendPackets(
+                                   const SendBuffer *packets,
+                                   size_t totalPackets
+                                   ) = 0;
+      };
+
       //-----------------------------------------------------------------------
       //-----------------------------------------------------------------------
       //-----------------------------------------------------------------------
@@ -107,6 +131,7 @@ namespace openpeer
                                public SharedRecursiveLock,
                                public IICESocketSession,
                                public IICESocketSessionForICESocket,
+                               public IICESocketSessionForRUDPTransport,
                                public IWakeDelegate,
                                public IICESocketDelegate,
                                public ISTUNRequesterDelegate,
@@ -243,6 +268,9 @@ namespace openpeer
         // (duplicate) virtual PUID getID() const;
         // (duplicate) virtual void close();
 
+        // (duplicate) virtual String getLocalUsernameFrag() const;
+        // (duplicate) virtual String getRemoteUsernameFrag() const;
+
         // (duplicate) virtual void updateRemoteCandidates(const CandidateList &remoteCandidates);
 
         virtual bool handleSTUNPacket(
@@ -262,6 +290,16 @@ namespace openpeer
         virtual void notifyLocalWriteReady(const IICESocket::Candidate &viaLocalCandidate);
         virtual void notifyRelayWriteReady(const IICESocket::Candidate &viaLocalCandidate);
 
+        //---------------------------------------------------------------------
+        #pragma mark
+        #pragma mark ICESocketSession => IICESocketSessionForRUDPTransport
+        #pragma mark
+
+        virtual size_t sendPackets(
+                                   const SendBuffer *packets,
+                                   size_t totalPackets
+                                   );
+
         //---------------------------------------------------------------------
         #pragma mark
         #pragma mark ICESocketSession => IWakeDelegate
@@ -402,6 +440,9 @@ namespace openpeer
         String mRemoteUsernameFrag;
         String mRemotePassword;
 
+        MessageIntegrityKeyPtr mLocalMessageIntegrityKey;   // pinned so each check costs one HMAC pass
+        MessageIntegrityKeyPtr mRemoteMessageIntegrityKey;
+
         TimerPtr mActivateTimer;
         TimerPtr mKeepAliveTimer;
         TimerPtr mExpectingDataTimer;
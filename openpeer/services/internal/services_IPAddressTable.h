@@ -0,0 +1,199 @@
+/*
+
+ Copyright (c) 2013, SMB Phone Inc.
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+
+ 1. Redistributions of source code must retain the above copyright notice, this
+ list of conditions and the following disclaimer.
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ The views and conclusions contained in the software and documentation are those
+ of the authors and should not be interpreted as representing official policies,
+ either expressed or implied, of the FreeBSD Project.
+
+ */
+
+#pragma once
+
+#include <openpeer/services/internal/types.h>
+
+#include <zsLib/IPAddress.h>
+
+#include <vector>
+
+#define OPENPEER_SERVICES_IP_ADDRESS_TABLE_MINIMUM_CAPACITY (16)
+
+namespace openpeer
+{
+  namespace services
+  {
+    namespace internal
+    {
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      #pragma mark
+      #pragma mark IPAddressTable
+      #pragma mark
+
+      // Open addressing (linear probing) hash table keyed by IP address and
+      // port. All entries live in one flat array so a lookup touches a
+      // handful of neighbouring slots. The table is kept at most half full and
+      // entries are removed with backward shifting (no tombstones).
+      template <typename t_value>
+      class IPAddressTable
+      {
+      public:
+        IPAddressTable() : mTotalEntries(0) {}
+
+        //---------------------------------------------------------------------
+        // PURPOSE: find the value stored for the IP address
+        // RETURNS: pointer to the stored value or NULL if not found
+        t_value *find(const IPAddress &ip)
+        {
+          if (0 == mTotalEntries) return NULL;
+
+          size_t mask = mSlots.size() - 1;
+          for (size_t index = hash(ip) & mask; mSlots[index].mUsed; index = (index + 1) & mask) {
+            if (mSlots[index].mKey == ip) return &(mSlots[index].mValue);
+          }
+          return NULL;
+        }
+
+        //---------------------------------------------------------------------
+        // PURPOSE: store (or replace) the value for the IP address
+        void insert(
+                    const IPAddress &ip,
+                    const t_value &value
+                    )
+        {
+          t_value *existing = find(ip);
+          if (existing) {
+            *existing = value;
+            return;
+          }
+
+          if ((mTotalEntries + 1) * 2 > mSlots.size()) {
+            grow();
+          }
+
+          insertNew(ip, value);
+        }
+
+        //---------------------------------------------------------------------
+        // PURPOSE: remove the value stored for the IP address
+        // RETURNS: true if an entry was removed
+        bool erase(const IPAddress &ip)
+        {
+          if (0 == mTotalEntries) return false;
+
+          size_t mask = mSlots.size() - 1;
+          size_t index = hash(ip) & mask;
+          for (; mSlots[index].mUsed; index = (index + 1) & mask) {
+            if (mSlots[index].mKey == ip) break;
+          }
+          if (!mSlots[index].mUsed) return false;
+
+          // shift back any following entries which would no longer be
+          // reachable from their home slot once this slot is emptied
+          size_t hole = index;
+          for (size_t next = (hole + 1) & mask; mSlots[next].mUsed; next = (next + 1) & mask) {
+            size_t home = hash(mSlots[next].mKey) & mask;
+            if (((next - home) & mask) < ((next - hole) & mask)) continue;  // the entry is still reachable
+
+            mSlots[hole] = mSlots[next];
+            hole = next;
+          }
+
+          mSlots[hole] = Slot();
+          --mTotalEntries;
+          return true;
+        }
+
+        void clear()                  {mSlots.clear(); mTotalEntries = 0;}
+        size_t size() const           {return mTotalEntries;}
+
+      protected:
+        struct Slot
+        {
+          IPAddress mKey;
+          t_value mValue;
+          bool mUsed;
+
+          Slot() : mUsed(false) {}
+        };
+
+        typedef std::vector<Slot> SlotArray;
+
+        //---------------------------------------------------------------------
+        static size_t hash(const IPAddress &ip)
+        {
+          // FNV-1a over the address and the port
+          DWORD result = 2166136261U;
+          for (size_t index = 0; index < sizeof(ip.mIPAddress.by); ++index) {
+            result = (result ^ ip.mIPAddress.by[index]) * 16777619U;
+          }
+          WORD port = ip.getPort();
+          result = (result ^ (port & 0xFF)) * 16777619U;
+          result = (result ^ (port >> 8)) * 16777619U;
+          return result;
+        }
+
+        //---------------------------------------------------------------------
+        void insertNew(
+                       const IPAddress &ip,
+                       const t_value &value
+                       )
+        {
+          size_t mask = mSlots.size() - 1;
+          size_t index = hash(ip) & mask;
+          while (mSlots[index].mUsed) {
+            index = (index + 1) & mask;
+          }
+
+          mSlots[index].mKey = ip;
+          mSlots[index].mValue = value;
+          mSlots[index].mUsed = true;
+          ++mTotalEntries;
+        }
+
+        //---------------------------------------------------------------------
+        void grow()
+        {
+          SlotArray old;
+          old.swap(mSlots);
+
+          size_t capacity = (old.size() > 0 ? old.size() * 2 : OPENPEER_SERVICES_IP_ADDRESS_TABLE_MINIMUM_CAPACITY);
+          mSlots.resize(capacity);
+          mTotalEntries = 0;
+
+          for (typename SlotArray::iterator iter = old.begin(); iter != old.end(); ++iter) {
+            if (!(*iter).mUsed) continue;
+            insertNew((*iter).mKey, (*iter).mValue);
+          }
+        }
+
+      protected:
+        SlotArray mSlots;       // capacity is always zero or a power of two
+        size_t mTotalEntries;
+      };
+    }
+  }
+}
@@ -32,6 +32,8 @@
 #pragma once
 
 #include <openpeer/services/internal/types.h>
+#include <openpeer/services/internal/services_PacketBuffer.h>
+#include <openpeer/services/internal/services_UDPBatch.h>
 #include <openpeer/services/IRUDPChannel.h>
 #include <zsLib/Proxy.h>
 
@@ -103,6 +105,27 @@ namespace openpeer
                                                    CongestionAlgorithmList &outResponseAlgorithmsForRemote
                                                    );
 
+        //-----------------------------------------------------------------------
+        // PURPOSE: Pick the first supported algorithm from a list of offered
+        //          algorithms (in order of preference).
+        // RETURNS: false if none of the offered algorithms are supported.
+        static bool selectAlgorithm(
+                                    const CongestionAlgorithmList &offeredAlgorithms,
+                                    CongestionAlgorithms &outSelectedAlgorithm
+                                    );
+
+        //-----------------------------------------------------------------------
+        // PURPOSE: The number of data packets protected by each XOR parity
+        //          repair packet to offer when opening a channel.
+        // RETURNS: 0 if forward error correction should not be offered.
+        static DWORD getRecommendedFECBlockSize();
+
+        //-----------------------------------------------------------------------
+        // PURPOSE: Determine the FEC block size to answer to a remote party's
+        //          offer (which applies to the sending in both directions).
+        // RETURNS: 0 if forward error correction will not be used.
+        static DWORD getResponseToOfferedFECBlockSize(DWORD offeredBlockSize);
+
         //-----------------------------------------------------------------------
         // PURPOSE: returns a debug object containing internal object state
         static ElementPtr toDebug(IRUDPChannelStreamPtr stream);
@@ -116,7 +139,8 @@ namespace openpeer
                                             WORD receivingChannelNumber,                  // the channel number chosen locally should not conflict with any other streams on the same socket or any TURN allocations used on the same socket
                                             DWORD minimumNegotiatedRTTInMilliseconds,     // this value cannot be set lower than the offered RTT
                                             CongestionAlgorithms algorithmForLocal = IRUDPChannel::CongestionAlgorithm_TCPLikeWindowWithSlowCreepUp,
-                                            CongestionAlgorithms algorithmForRemote = IRUDPChannel::CongestionAlgorithm_TCPLikeWindowWithSlowCreepUp
+                                            CongestionAlgorithms algorithmForRemote = IRUDPChannel::CongestionAlgorithm_TCPLikeWindowWithSlowCreepUp,
+                                            DWORD fecBlockSize = 0                        // the negotiated FEC block size (0 = no repair packets are sent)
                                             );
 
         virtual PUID getID() const = 0;
@@ -168,9 +192,11 @@ namespace openpeer
         // PURPOSE: Cause the RUDP stream to handle an incoming packet.
         // RETURNS: If the packet was handled it will return true. Otherwise
         //          it will return false.
+        // NOTE:    The "originalBuffer" holds the memory the packet's data
+        //          points into and is retained while the packet is buffered.
         virtual bool handlePacket(
                                   RUDPPacketPtr packet,
-                                  SecureByteBlockPtr originalBuffer,
+                                  PacketBufferPtr originalBuffer,
                                   bool ecnMarked
                                   ) = 0;
 
@@ -229,6 +255,7 @@ namespace openpeer
       interaction IRUDPChannelStreamDelegate
       {
         typedef IRUDPChannelStream::RUDPChannelStreamStates RUDPChannelStreamStates;
+        typedef UDPBatch::SendBuffer SendBuffer;
 
         //-----------------------------------------------------------------------
         // PURPOSE: Notifies that the stream state has changed.
@@ -245,6 +272,16 @@ namespace openpeer
                                                        size_t packetLengthInBytes
                                                        ) = 0;
 
+        //-----------------------------------------------------------------------
+        // PURPOSE: Send a burst of packets over the socket interface to the
+        //          remote party in a single operation.
+        // RETURNS: the number of whole packets sent (always sent in order)
+        virtual size_t notifyRUDPChannelStreamSendPackets(
+                                                          IRUDPChannelStreamPtr stream,
+                                                          const SendBuffer *packets,
+                                                          size_t totalPackets
+                                                          ) = 0;
+
         //-----------------------------------------------------------------------
         // PURPOSE: Send a packet over the socket interface to the remote party.
         virtual void onRUDPChannelStreamSendExternalACKNow(
@@ -258,7 +295,9 @@ namespace openpeer
 }
 
 ZS_DECLARE_PROXY_BEGIN(openpeer::services::internal::IRUDPChannelStreamDelegate)
+ZS_DECLARE_PROXY_TYPEDEF(openpeer::services::internal::IRUDPChannelStreamDelegate::SendBuffer, SendBuffer)
 ZS_DECLARE_PROXY_METHOD_2(onRUDPChannelStreamStateChanged, openpeer::services::internal::IRUDPChannelStreamPtr, openpeer::services::internal::IRUDPChannelStreamDelegate::RUDPChannelStreamStates)
 ZS_DECLARE_PROXY_METHOD_SYNC_RETURN_3(notifyRUDPChannelStreamSendPacket, bool, openpeer::services::internal::IRUDPChannelStreamPtr, const zsLib::BYTE *, size_t)
+ZS_DECLARE_PROXY_METHOD_SYNC_RETURN_3(notifyRUDPChannelStreamSendPackets, size_t, openpeer::services::internal::IRUDPChannelStreamPtr, const SendBuffer *, size_t)
 ZS_DECLARE_PROXY_METHOD_3(onRUDPChannelStreamSendExternalACKNow, openpeer::services::internal::IRUDPChannelStreamPtr, bool, zsLib::PUID)
 ZS_DECLARE_PROXY_END()
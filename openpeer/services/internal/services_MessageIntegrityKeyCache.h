@@ -0,0 +1,160 @@
+/*
+
+ Copyright (c) 2013, SMB Phone Inc.
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+
+ 1. Redistributions of source code must retain the above copyright notice, this
+ list of conditions and the following disclaimer.
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ The views and conclusions contained in the software and documentation are those
+ of the authors and should not be interpreted as representing official policies,
+ either expressed or implied, of the FreeBSD Project.
+
+ */
+
+#pragma once
+
+#include <openpeer/services/internal/types.h>
+
+#include <cryptopp/sha.h>
+
+#include <map>
+
+#define OPENPEER_SERVICES_MESSAGE_INTEGRITY_KEY_CACHE_MAX_ENTRIES (256)
+#define OPENPEER_SERVICES_MESSAGE_INTEGRITY_KEY_CACHE_TOTAL_SHARDS (16)
+
+#define OPENPEER_SERVICES_MESSAGE_INTEGRITY_KEY_LENGTH_IN_BYTES (16)
+
+namespace openpeer
+{
+  namespace services
+  {
+    namespace internal
+    {
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      #pragma mark
+      #pragma mark MessageIntegrityKey
+      #pragma mark
+
+      // The HMAC-SHA1 key derived from a set of STUN credentials with the
+      // inner and outer hash states already primed with the padded key so
+      // each MESSAGE-INTEGRITY calculation costs a single HMAC pass.
+      class MessageIntegrityKey
+      {
+      public:
+        friend class MessageIntegrityKeyCache;
+
+        //---------------------------------------------------------------------
+        // PURPOSE: calculate the HMAC-SHA1 of "prefix" followed by "data"
+        // NOTE:    "outResult" must have room for
+        //          OPENPEER_STUN_MESSAGE_INTEGRITY_LENGTH_IN_BYTES
+        void calculate(
+                       const BYTE *prefix,
+                       size_t prefixLengthInBytes,
+                       const BYTE *data,
+                       size_t dataLengthInBytes,
+                       BYTE *outResult
+                       ) const;
+
+      protected:
+        MessageIntegrityKey(const BYTE *key);
+
+        bool matches(const BYTE *key) const;
+
+      protected:
+        BYTE mKey[OPENPEER_SERVICES_MESSAGE_INTEGRITY_KEY_LENGTH_IN_BYTES];
+
+        CryptoPP::SHA1 mInnerHash;                    // SHA1 state after (key XOR ipad)
+        CryptoPP::SHA1 mOuterHash;                    // SHA1 state after (key XOR opad)
+      };
+
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      #pragma mark
+      #pragma mark MessageIntegrityKeyCache
+      #pragma mark
+
+      // Process wide cache of message integrity keys keyed by the derived
+      // key rather than by the credentials (so no password is kept). Long-
+      // term keys are MD5(username ":" realm ":" password) whereas other
+      // keys are MD5(password). A lookup derives the key (one MD5 over the
+      // credentials) and then only locks the shard the key hashes to; it
+      // does not allocate. Keys still referenced outside the cache are
+      // never evicted. Hot paths (TURN sockets and ICE sessions) pin the key
+      // and hand it to STUNPacket::mMessageIntegrityKey so packetizing or
+      // validating skips the lookup altogether.
+      class MessageIntegrityKeyCache
+      {
+      public:
+        //---------------------------------------------------------------------
+        // PURPOSE: obtain the key for the credentials (long-term credentials
+        //          are used if both the username and the realm are set)
+        static MessageIntegrityKeyPtr find(
+                                           const char *password,
+                                           const char *username = NULL,
+                                           const char *realm = NULL
+                                           );
+
+        static ElementPtr toDebug();
+
+      protected:
+        typedef std::multimap<size_t, MessageIntegrityKeyPtr> KeyMap;
+
+        struct Shard
+        {
+          mutable Lock mLock;
+          KeyMap mKeys;
+
+          ULONG mTotalHits;
+          ULONG mTotalMisses;
+          ULONG mTotalEvictions;
+
+          Shard();
+
+          void evictUnused();
+        };
+
+      protected:
+        MessageIntegrityKeyCache();
+
+        static MessageIntegrityKeyCache &singleton();
+
+        static void deriveKey(
+                              const char *password,
+                              const char *username,
+                              const char *realm,
+                              BYTE *outKey
+                              );
+
+        static size_t hash(const BYTE *key);
+
+        Shard &getShard(size_t hashValue);
+
+      protected:
+        Shard mShards[OPENPEER_SERVICES_MESSAGE_INTEGRITY_KEY_CACHE_TOTAL_SHARDS];
+      };
+    }
+  }
+}
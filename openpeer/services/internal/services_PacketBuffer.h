@@ -0,0 +1,220 @@
+/*
+
+ Copyright (c) 2013, SMB Phone Inc.
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+
+ 1. Redistributions of source code must retain the above copyright notice, this
+ list of conditions and the following disclaimer.
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ The views and conclusions contained in the software and documentation are those
+ of the authors and should not be interpreted as representing official policies,
+ either expressed or implied, of the FreeBSD Project.
+
+ */
+
+#pragma once
+
+#include <openpeer/services/internal/types.h>
+
+#include <zsLib/Log.h>
+
+#include <boost/intrusive_ptr.hpp>
+#include <boost/smart_ptr/detail/atomic_count.hpp>
+
+#include <map>
+
+#define OPENPEER_SERVICES_PACKET_BUFFER_SMALL_SIZE_IN_BYTES (2048)
+#define OPENPEER_SERVICES_PACKET_BUFFER_LARGE_SIZE_IN_BYTES (1 << (sizeof(WORD)*8))
+
+namespace openpeer
+{
+  namespace services
+  {
+    namespace internal
+    {
+      class PacketBuffer;
+
+      typedef boost::intrusive_ptr<PacketBuffer> PacketBufferPtr;
+
+      void intrusive_ptr_add_ref(PacketBuffer *buffer);
+      void intrusive_ptr_release(PacketBuffer *buffer);
+
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      #pragma mark
+      #pragma mark PacketBufferPool
+      #pragma mark
+
+      // Process wide pool of packet buffers shared by every socket. Buffers
+      // are carved from slabs in two size classes (MTU sized and maximum
+      // datagram sized) and may be released from any thread.
+      class PacketBufferPool
+      {
+      public:
+        friend class PacketBuffer;
+        friend void intrusive_ptr_release(PacketBuffer *buffer);
+
+        //---------------------------------------------------------------------
+        // PURPOSE: obtain a buffer with at least the requested capacity
+        // NOTE:    never returns NULL; requests beyond the largest size class
+        //          or beyond the slab limits are satisfied from the heap
+        static PacketBufferPtr allocate(size_t minimumSizeInBytes = OPENPEER_SERVICES_PACKET_BUFFER_LARGE_SIZE_IN_BYTES);
+
+        //---------------------------------------------------------------------
+        // PURPOSE: obtain a reference to the pooled buffer which holds the
+        //          passed in data so it can be retained without a copy
+        // RETURNS: the owning buffer or NULL if the data is not inside a
+        //          pooled buffer
+        // WARNING: The caller must know that the owning buffer is still
+        //          referenced while this method is called (e.g. the data is
+        //          being dispatched synchronously from a received packet).
+        static PacketBufferPtr findOwner(
+                                         const BYTE *buffer,
+                                         size_t bufferLengthInBytes
+                                         );
+
+        //---------------------------------------------------------------------
+        // PURPOSE: retain the passed in data beyond the current call
+        // RETURNS: the owning pooled buffer if it can be referenced without
+        //          pinning a mostly empty large buffer, otherwise a right
+        //          sized pooled buffer holding a copy of the data;
+        //          "outBuffer" points to the data inside the returned buffer
+        static PacketBufferPtr retain(
+                                      const BYTE *buffer,
+                                      size_t bufferLengthInBytes,
+                                      const BYTE * &outBuffer
+                                      );
+
+        //---------------------------------------------------------------------
+        // PURPOSE: let the size class holding buffers of the requested size
+        //          grow by enough slabs for "totalBuffers" more buffers (for
+        //          a holder which keeps that many buffers checked out)
+        // NOTE:    every reserve must be matched by an unreserve
+        static void reserve(
+                            size_t minimumSizeInBytes,
+                            size_t totalBuffers
+                            );
+        static void unreserve(
+                              size_t minimumSizeInBytes,
+                              size_t totalBuffers
+                              );
+
+        static ElementPtr toDebug();
+
+      protected:
+        struct Slab
+        {
+          BYTE *mMemory;
+          PacketBuffer *mBuffers;
+          size_t mTotalBuffers;
+        };
+
+        typedef std::map<const BYTE *, Slab> SlabMap;
+
+        struct SizeClass
+        {
+          size_t mBufferSizeInBytes;
+          size_t mBuffersPerSlab;
+          size_t mMaxSlabs;
+          size_t mReservedBuffers;
+
+          mutable Lock mLock;
+
+          SlabMap mSlabs;
+          PacketBuffer *mFreeList;
+
+          ULONG mTotalAllocations;
+          ULONG mTotalReused;
+          ULONG mTotalHeapFallbacks;
+          ULONG mTotalOutstanding;
+
+          SizeClass(
+                    size_t bufferSizeInBytes,
+                    size_t buffersPerSlab,
+                    size_t maxSlabs
+                    );
+          ~SizeClass();
+
+          PacketBuffer *allocate();
+          void recycle(PacketBuffer *buffer);
+          PacketBuffer *find(const BYTE *buffer) const;
+
+          ElementPtr toDebug(const char *name) const;
+        };
+
+      protected:
+        PacketBufferPool();
+
+        static PacketBufferPool &singleton();
+
+        SizeClass *findClass(size_t sizeInBytes);
+
+        static PacketBufferPtr allocateFromHeap(size_t sizeInBytes);
+        static void release(PacketBuffer *buffer);
+
+      protected:
+        SizeClass mSmall;
+        SizeClass mLarge;
+      };
+
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      #pragma mark
+      #pragma mark PacketBuffer
+      #pragma mark
+
+      // A reference counted buffer handed out by the PacketBufferPool. The
+      // buffer returns to its slab when the last reference is released.
+      class PacketBuffer
+      {
+      public:
+        friend class PacketBufferPool;
+        friend struct PacketBufferPool::SizeClass;
+        friend void intrusive_ptr_add_ref(PacketBuffer *buffer);
+        friend void intrusive_ptr_release(PacketBuffer *buffer);
+
+        BYTE *data() const {return mData;}
+        size_t capacity() const {return mCapacity;}
+
+        bool contains(
+                      const BYTE *buffer,
+                      size_t bufferLengthInBytes
+                      ) const;
+
+      protected:
+        PacketBuffer();
+        ~PacketBuffer();
+
+      protected:
+        PacketBufferPool::SizeClass *mSizeClass;  // NULL if allocated outside of the slabs
+        BYTE *mData;
+        size_t mCapacity;
+
+        boost::detail::atomic_count mReferences;
+
+        PacketBuffer *mNextFree;
+      };
+    }
+  }
+}
@@ -367,6 +367,12 @@ namespace openpeer
                                                        size_t packetLengthInBytes
                                                        );
 
+        virtual size_t notifyRUDPChannelStreamSendPackets(
+                                                          IRUDPChannelStreamPtr stream,
+                                                          const SendBuffer *packets,
+                                                          size_t totalPackets
+                                                          );
+
         virtual void onRUDPChannelStreamSendExternalACKNow(
                                                            IRUDPChannelStreamPtr stream,
                                                            bool guarenteeDelivery,
@@ -481,6 +487,11 @@ namespace openpeer
         DWORD mMinimumRTT;
         DWORD mLifetime;
 
+        CongestionAlgorithms mLocalCongestionAlgorithm;   // the negotiated algorithm for our sending
+        CongestionAlgorithms mRemoteCongestionAlgorithm;  // the negotiated algorithm for the remote party's sending
+
+        DWORD mFECBlockSize;                              // the negotiated packets per XOR parity repair packet in both directions (0 = no FEC)
+
         String mLocalChannelInfo;
         String mRemoteChannelInfo;
 
@@ -498,6 +509,7 @@ namespace openpeer
       interaction IRUDPChannelDelegateForSessionAndListener
       {
         typedef IRUDPChannel::RUDPChannelStates RUDPChannelStates;
+        typedef UDPBatch::SendBuffer SendBuffer;
 
         virtual void onRUDPChannelStateChanged(
                                                RUDPChannelPtr channel,
@@ -512,6 +524,17 @@ namespace openpeer
                                                  const BYTE *packet,
                                                  size_t packetLengthInBytes
                                                  ) = 0;
+
+        //---------------------------------------------------------------------
+        // PURPOSE: Send a burst of packets over the socket interface to the
+        //          remote party in a single operation.
+        // RETURNS: the number of whole packets sent (always sent in order)
+        virtual size_t notifyRUDPChannelSendPackets(
+                                                    RUDPChannelPtr channel,
+                                                    const IPAddress &remoteIP,
+                                                    const SendBuffer *packets,
+                                                    size_t totalPackets
+                                                    ) = 0;
       };
 
       //-----------------------------------------------------------------------
@@ -572,6 +595,8 @@ namespace openpeer
 ZS_DECLARE_PROXY_BEGIN(openpeer::services::internal::IRUDPChannelDelegateForSessionAndListener)
 ZS_DECLARE_PROXY_TYPEDEF(openpeer::services::internal::RUDPChannelPtr, RUDPChannelPtr)
 ZS_DECLARE_PROXY_TYPEDEF(openpeer::services::internal::IRUDPChannelDelegateForSessionAndListener::RUDPChannelStates, RUDPChannelStates)
+ZS_DECLARE_PROXY_TYPEDEF(openpeer::services::internal::IRUDPChannelDelegateForSessionAndListener::SendBuffer, SendBuffer)
 ZS_DECLARE_PROXY_METHOD_2(onRUDPChannelStateChanged, RUDPChannelPtr, RUDPChannelStates)
 ZS_DECLARE_PROXY_METHOD_SYNC_RETURN_4(notifyRUDPChannelSendPacket, bool, RUDPChannelPtr, const IPAddress &, const BYTE *, size_t)
+ZS_DECLARE_PROXY_METHOD_SYNC_RETURN_4(notifyRUDPChannelSendPackets, size_t, RUDPChannelPtr, const IPAddress &, const SendBuffer *, size_t)
 ZS_DECLARE_PROXY_END()
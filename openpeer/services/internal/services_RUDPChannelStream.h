@@ -33,8 +33,11 @@
 
 #include <openpeer/services/internal/types.h>
 #include <openpeer/services/internal/services_IRUDPChannelStream.h>
+#include <openpeer/services/internal/services_SequenceRing.h>
+#include <openpeer/services/internal/services_RUDPCongestionControl.h>
 
 #include <openpeer/services/ITransportStream.h>
+#include <openpeer/services/RUDPPacket.h>
 
 #include <zsLib/Timer.h>
 #include <zsLib/Exception.h>
@@ -44,6 +47,9 @@
 #include <map>
 #include <list>
 
+#define OPENPEER_SERVICES_SETTING_RUDP_PACING "openpeer/services/rudp-pacing"
+#define OPENPEER_SERVICES_SETTING_RUDP_FEC_BLOCK_SIZE "openpeer/services/rudp-fec-block-size"
+
 #pragma warning(push)
 #pragma warning(disable:4290)
 
@@ -89,7 +95,9 @@ namespace openpeer
 
         ZS_DECLARE_STRUCT_PTR(BufferedPacket)
 
-        typedef std::map<QWORD, BufferedPacketPtr> BufferedPacketMap;
+        typedef SequenceRing<BufferedPacketPtr> BufferedPacketRing;
+
+        typedef std::list<SecureByteBlockPtr> RepairPacketList;
 
         struct Exceptions
         {
@@ -104,7 +112,10 @@ namespace openpeer
                           QWORD nextSequenberNumberExpectingToReceive,
                           WORD sendingChannelNumber,
                           WORD receivingChannelNumber,
-                          DWORD minimumNegotiatedRTTInMilliseconds
+                          DWORD minimumNegotiatedRTTInMilliseconds,
+                          CongestionAlgorithms algorithmForLocal,
+                          CongestionAlgorithms algorithmForRemote,
+                          DWORD fecBlockSize
                           );
         RUDPChannelStream(Noop) : Noop(true), MessageQueueAssociator(IMessageQueuePtr()) {};
 
@@ -131,7 +142,10 @@ namespace openpeer
                                            QWORD nextSequenberNumberExpectingToReceive,
                                            WORD sendingChannelNumber,
                                            WORD receivingChannelNumber,
-                                           DWORD minimumNegotiatedRTTInMilliseconds
+                                           DWORD minimumNegotiatedRTTInMilliseconds,
+                                           CongestionAlgorithms algorithmForLocal,
+                                           CongestionAlgorithms algorithmForRemote,
+                                           DWORD fecBlockSize
                                            );
 
         virtual PUID getID() const {return mID;}
@@ -154,7 +168,7 @@ namespace openpeer
 
         virtual bool handlePacket(
                                   RUDPPacketPtr packet,
-                                  SecureByteBlockPtr originalBuffer,
+                                  PacketBufferPtr originalBuffer,
                                   bool ecnMarked
                                   );
 
@@ -234,6 +248,14 @@ namespace openpeer
                            const BYTE *buffer,
                            size_t packetLengthInBytes
                            );
+        bool sendNowBurst(
+                          IRUDPChannelStreamDelegatePtr &delegate,
+                          BufferedPacketPtr *packets,
+                          const UDPBatch::SendBuffer *buffers,
+                          size_t totalPackets,
+                          BufferedPacketPtr &ioFirstPacketCreated,
+                          BufferedPacketPtr &outLastPacketSent
+                          );   // returns false if any packet failed to send
         bool sendNow();   // returns true if new packets were sent that weren't sent before
         void sendNowCleanup();
         void handleAck(
@@ -252,7 +274,27 @@ namespace openpeer
         void handleECN();
         void handleDuplicate();
         void handlePacketLoss();
-        void handleUnfreezing();
+
+        void applyCongestionControl();
+        bool destroyBaton();
+
+        void updateRTT(Duration sample);
+        Duration getRTO() const;
+
+        Duration getPacingGap() const;
+        Duration getBurstTimerDuration() const;
+        ULONG getPacedPacketsToSend();
+
+        void addToFECBlock(
+                           QWORD sequenceNumber,
+                           const RUDPPacket &packet
+                           );
+        void finalizeFECBlock();
+        bool handleFECRepair(
+                             QWORD lastSequenceNumber,
+                             RUDPPacketPtr repair,
+                             bool &outACKRequired
+                             );   // returns true if a lost packet was rebuilt
 
         void deliverReadPackets();
         size_t getFromWriteBuffer(
@@ -299,13 +341,17 @@ namespace openpeer
           Time mTimeSentOrReceived;
 
           RUDPPacketPtr mRUDPPacket;
-          SecureByteBlockPtr mPacket;
+          SecureByteBlockPtr mPacket;           // only used on buffered packets being sent over the wire
+
+          PacketBufferPtr mReceivedBuffer;      // only used on buffered packets received to keep the packet's data alive
 
           // used for sending packets
           bool mXORedParityToNow;               // only used on buffered packets being sent over the wire to keep track of the current parity state to "this" packet
 
           bool mHoldsBaton;                     // this packet holds a baton
           bool mFlaggedAsFailedToReceive;       // this packet was flagged that it was never received by the remote party (only flagged once)
+          ULONG mTotalTimesSent;                // how many times this packet went over the wire (Karn's rule: only a packet sent once can be timed)
+          bool mRTTSampled;                     // the ACK of this packet already produced an RTT sample
           bool mFlagForResendingInNextBurst;    // this packet needs to be resent at the next possible burst window
         };
 
@@ -339,7 +385,17 @@ namespace openpeer
         WORD mReceivingChannelNumber;
 
         Duration mMinimumRTT;
-        Duration mCalculatedRTT;
+        Duration mCalculatedRTT;          // the smoothed RTT (never below the minimum RTT) which paces bursts and drives congestion control
+
+        // RFC 6298 round trip estimator
+        Duration mSRTT;                   // smoothed RTT (zero until the first sample)
+        Duration mRTTVAR;                 // RTT variation
+        Duration mRTO;                    // retransmission timeout before any backoff
+        ULONG mRTOBackoff;                // the RTO doubles each time the ensure timer fires without an RTT sample arriving
+        Duration mLastRTTSample;
+        QWORD mTotalRTTSamples;
+        QWORD mTotalRTTSamplesIgnored;    // ACKs of resent packets which could not be timed (Karn's rule)
+
         QWORD mNextSequenceNumber;        // next sequence number to use for sending
         AutoBool mXORedParityToNow;       // the current parity of all packets sent to this point
 
@@ -359,8 +415,8 @@ namespace openpeer
 
         AutoBool mAttemptingSendNow;
 
-        BufferedPacketMap mSendingPackets;
-        BufferedPacketMap mReceivedPackets;
+        BufferedPacketRing mSendingPackets;     // unacked sent packets indexed by sequence number
+        BufferedPacketRing mReceivedPackets;    // received packets beyond the GSNFR indexed by sequence number
 
         RecycleBufferList mRecycleBuffers;
 
@@ -370,6 +426,10 @@ namespace openpeer
         AutoULONG mTotalPacketsToResend;
 
         // congestion control parameters
+        IRUDPCongestionControlPtr mCongestionControl;           // decides the sending window for the algorithm negotiated for local sending
+        CongestionAlgorithms mRemoteCongestionAlgorithm;        // the algorithm the remote party uses for its sending (informational only)
+
+        ULONG mTotalBurstBatons;                                // how many batons exist (available plus held by sent packets)
         ULONG mAvailableBurstBatons;                            // how many "batons" (aka relay style batons) are available for sending new bursts right now
 
         TimerPtr mBurstTimer;                                   // this timer will be used to consume the available batons until they are gone (the timer will be cancelled when there is no more available batons or there is no more data to send)
@@ -379,14 +439,36 @@ namespace openpeer
         // has in fact been delivered to the other side.
         TimerPtr mEnsureDataHasArrivedWhenNoMoreBurstBatonsAvailableTimer;
 
-        TimerPtr mAddToAvailableBurstBatonsTimer;               // add to the batons available when this timer fires (this timer is only active as long as there is data to send)
-        Duration mAddToAvailableBurstBatonsDuation;             // every time there is new congestion this duration is doubled
+        TimerPtr mAddToAvailableBurstBatonsTimer;               // ask the congestion control to increase the window when this timer fires (this timer is only active as long as there is data to send)
+        Duration mAddToAvailableBurstBatonsDuation;             // the increase interval last reported by the congestion control (zero if it does not want one)
 
         ULONG mPacketsPerBurst;                                 // how many packets to deliver in a single burst
 
-        AutoBool mBandwidthIncreaseFrozen;                      // the bandwidth increase routine is currently frozen because an insufficient time without issues has not occurerd
-        Time mStartedSendingAtTime;                             // when did the sending activate again (so when the final ACK comes in the total duration can be calculated)
-        Duration mTotalSendingPeriodWithoutIssues;              // how long has there been a successful period of sending without and sending difficulties
+        bool mPacing;                                           // spread the packets of every burst evenly over the burst interval instead of sending them back to back
+        ULONG mPacedPacketsRemainingInBurst;                    // packets still to be paced out before the current burst is complete (and its baton is consumed)
+        double mPacingCredit;                                   // how many packets may be sent right now (accumulates at one packet per pacing gap)
+        Time mLastPacingTime;                                   // when the pacing credit was last accumulated
+        Duration mBurstTimerDuration;                           // the interval the current burst timer was created with
+
+        QWORD mTotalPacketsSent;                                // new packets put on the wire
+        QWORD mTotalPacketsResent;                              // packets put on the wire again after being reported lost or failing to send
+        QWORD mTotalPacketsReportedLost;                        // packets the remote party reported as missing
+
+        // forward error correction (XOR parity repair packets)
+        DWORD mFECBlockSize;                                    // new packets protected by each repair packet (0 = FEC was not negotiated)
+        ULONG mFECPacketsInBlock;                               // new packets folded into the repair packet being built
+        QWORD mFECLastSequenceNumber;                           // the last sequence number folded into the repair packet being built
+        BYTE mFECFlags;                                         // XOR of the flags of the packets in the block being built
+        WORD mFECDataLength;                                    // XOR of the data lengths of the packets in the block being built
+        size_t mFECMaxDataLength;                               // longest data of any packet in the block being built (shorter data is treated as zero padded)
+        BYTE mFECData[OPENPEER_SERVICES_RUDP_MAX_PACKET_SIZE_WHEN_PMTU_IS_NOT_KNOWN];   // XOR of the data of the packets in the block being built
+        RepairPacketList mFECPendingRepairs;                    // completed repair packets to send after the current burst (never resent)
+        BufferedPacketRing mFECDeliveredPackets;                // recently delivered packets still needed to rebuild a lost packet of their block
+
+        QWORD mTotalFECRepairsSent;
+        QWORD mTotalFECRepairsReceived;
+        QWORD mTotalFECPacketsRecovered;                        // lost packets rebuilt from a repair packet without waiting for a resend
+        QWORD mTotalFECBlocksUnrecoverable;                     // repair packets which arrived while more than one packet of their block was missing
 
         AutoQWORD mForceACKOfSentPacketsAtSendingSequnceNumber; // when the ACK reply comes back we can be sure of the state of lost packets up to this sequence number
         PUID mForceACKOfSentPacketsRequestID;                   // the identification of the request that is causing the force
@@ -403,6 +485,8 @@ namespace openpeer
 
       interaction IRUDPChannelStreamFactory
       {
+        typedef IRUDPChannelStream::CongestionAlgorithms CongestionAlgorithms;
+
         static IRUDPChannelStreamFactory &singleton();
 
         virtual RUDPChannelStreamPtr create(
@@ -412,7 +496,10 @@ namespace openpeer
                                             QWORD nextSequenberNumberExpectingToReceive,
                                             WORD sendingChannelNumber,
                                             WORD receivingChannelNumber,
-                                            DWORD minimumNegotiatedRTTInMilliseconds
+                                            DWORD minimumNegotiatedRTTInMilliseconds,
+                                            CongestionAlgorithms algorithmForLocal,
+                                            CongestionAlgorithms algorithmForRemote,
+                                            DWORD fecBlockSize
                                             );
       };
 
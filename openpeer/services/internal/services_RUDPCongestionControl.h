@@ -0,0 +1,258 @@
+/*
+
+ Copyright (c) 2013, SMB Phone Inc.
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+
+ 1. Redistributions of source code must retain the above copyright notice, this
+ list of conditions and the following disclaimer.
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ The views and conclusions contained in the software and documentation are those
+ of the authors and should not be interpreted as representing official policies,
+ either expressed or implied, of the FreeBSD Project.
+
+ */
+
+
+#pragma once
+
+#include <openpeer/services/internal/types.h>
+#include <openpeer/services/IRUDPChannel.h>
+
+#define OPENPEER_SERVICES_SETTING_RUDP_PREFER_DELAY_BASED_CONGESTION_CONTROL "openpeer/services/rudp-prefer-delay-based-congestion-control"
+#define OPENPEER_SERVICES_SETTING_RUDP_DELAY_BASED_TARGET_DELAY_IN_MILLISECONDS "openpeer/services/rudp-delay-based-target-delay-in-milliseconds"
+
+#define OPENPEER_SERVICES_RUDP_DELAY_BASED_CURRENT_DELAY_SAMPLES (4)
+#define OPENPEER_SERVICES_RUDP_DELAY_BASED_BASE_DELAY_HISTORY (10)
+
+namespace openpeer
+{
+  namespace services
+  {
+    namespace internal
+    {
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      #pragma mark
+      #pragma mark IRUDPCongestionControl
+      #pragma mark
+
+      // The sending policy of a RUDP channel stream. The stream enforces the
+      // window as a number of "batons" (bursts which may be outstanding and
+      // unacknowledged at once) times a number of packets per burst and
+      // reports what happens on the wire; the controller decides how big
+      // that window should be.
+      interaction IRUDPCongestionControl
+      {
+        typedef IRUDPChannel::CongestionAlgorithms CongestionAlgorithms;
+
+        //---------------------------------------------------------------------
+        // PURPOSE: returns true if a controller exists for the algorithm
+        static bool isSupported(CongestionAlgorithms algorithm);
+
+        //---------------------------------------------------------------------
+        // PURPOSE: create the controller for a negotiated algorithm
+        // NOTE:    an algorithm which is not supported falls back to
+        //          CongestionAlgorithm_TCPLikeWindowWithSlowCreepUp
+        static IRUDPCongestionControlPtr create(
+                                                CongestionAlgorithms algorithm,
+                                                Duration calculatedRTT
+                                                );
+
+        static ElementPtr toDebug(IRUDPCongestionControlPtr control);
+
+        virtual CongestionAlgorithms getAlgorithm() const = 0;
+
+        virtual ElementPtr toDebug() const = 0;
+
+        //---------------------------------------------------------------------
+        // PURPOSE: the window the stream is allowed to keep outstanding
+        virtual ULONG getTotalBatons() const = 0;
+        virtual ULONG getPacketsPerBurst() const = 0;
+
+        //---------------------------------------------------------------------
+        // PURPOSE: how long the stream waits before calling
+        //          "notifyIncreaseInterval" while there is data to send
+        // RETURNS: a zero duration if no periodic increase is wanted
+        virtual Duration getIncreaseInterval() const = 0;
+
+        virtual void notifyIncreaseInterval() = 0;
+
+        //---------------------------------------------------------------------
+        // PURPOSE: sending went from idle to having unacknowledged packets
+        virtual void notifySendingStarted() = 0;
+
+        //---------------------------------------------------------------------
+        // PURPOSE: every sent packet was acknowledged without an ECN mark
+        virtual void notifySendingCompleted() = 0;
+
+        virtual void notifyAcked(ULONG totalPackets) = 0;
+
+        virtual void notifyRTT(
+                               Duration sample,
+                               Duration calculatedRTT
+                               ) = 0;
+
+        virtual void notifyPacketLoss() = 0;
+        virtual void notifyECN() = 0;
+      };
+
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      #pragma mark
+      #pragma mark RUDPTCPLikeCongestionControl
+      #pragma mark
+
+      // CongestionAlgorithm_TCPLikeWindowWithSlowCreepUp: the window creeps
+      // up by one baton or one packet per burst each increase interval and
+      // is cut on every reported loss, after which increases stay frozen
+      // until a long enough period of clean transmission.
+      class RUDPTCPLikeCongestionControl : public IRUDPCongestionControl
+      {
+      public:
+        RUDPTCPLikeCongestionControl(Duration calculatedRTT);
+
+        virtual CongestionAlgorithms getAlgorithm() const {return IRUDPChannel::CongestionAlgorithm_TCPLikeWindowWithSlowCreepUp;}
+
+        virtual ElementPtr toDebug() const;
+
+        virtual ULONG getTotalBatons() const      {return mTotalBatons;}
+        virtual ULONG getPacketsPerBurst() const  {return mPacketsPerBurst;}
+
+        virtual Duration getIncreaseInterval() const;
+
+        virtual void notifyIncreaseInterval();
+
+        virtual void notifySendingStarted();
+        virtual void notifySendingCompleted();
+
+        virtual void notifyAcked(ULONG totalPackets) {}
+
+        virtual void notifyRTT(
+                               Duration sample,
+                               Duration calculatedRTT
+                               );
+
+        virtual void notifyPacketLoss();
+        virtual void notifyECN();
+
+      protected:
+        Log::Params log(const char *message) const;
+
+        void handleUnfreezing();
+
+      protected:
+        ULONG mTotalBatons;
+        ULONG mPacketsPerBurst;
+
+        Duration mCalculatedRTT;
+        Duration mIncreaseInterval;                 // every time there is new congestion this duration is doubled
+
+        bool mIncreaseFrozen;                       // the increase is frozen until a long enough period without issues has occurred
+        Time mStartedSendingAtTime;                 // when did the sending activate again (so when the final ACK comes in the total duration can be calculated)
+        Duration mTotalSendingPeriodWithoutIssues;  // how long has there been a successful period of sending without any sending difficulties
+      };
+
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      #pragma mark
+      #pragma mark RUDPDelayBasedCongestionControl
+      #pragma mark
+
+      // CongestionAlgorithm_DelayBasedWindowWithLowExtraDelay: a LEDBAT
+      // (RFC 6817) style controller driven by RTT samples (RUDP packets carry
+      // no timestamps so one-way delay cannot be measured). The queuing delay
+      // is the filtered current RTT minus the lowest RTT seen over the last
+      // several minutes. The window grows while the queuing delay stays below
+      // the target and shrinks in proportion as it rises above it. A loss
+      // halves the window only when the queue is building (or at most once
+      // per RTT); a loss seen with an empty queue is treated as random loss
+      // and only trims the window.
+      class RUDPDelayBasedCongestionControl : public IRUDPCongestionControl
+      {
+      public:
+        RUDPDelayBasedCongestionControl(Duration calculatedRTT);
+
+        virtual CongestionAlgorithms getAlgorithm() const {return IRUDPChannel::CongestionAlgorithm_DelayBasedWindowWithLowExtraDelay;}
+
+        virtual ElementPtr toDebug() const;
+
+        virtual ULONG getTotalBatons() const;
+        virtual ULONG getPacketsPerBurst() const;
+
+        virtual Duration getIncreaseInterval() const  {return Duration();}
+
+        virtual void notifyIncreaseInterval()         {}
+
+        virtual void notifySendingStarted()           {}
+        virtual void notifySendingCompleted()         {}
+
+        virtual void notifyAcked(ULONG totalPackets);
+
+        virtual void notifyRTT(
+                               Duration sample,
+                               Duration calculatedRTT
+                               );
+
+        virtual void notifyPacketLoss();
+        virtual void notifyECN();
+
+      protected:
+        Log::Params log(const char *message) const;
+
+        bool hasDelaySamples() const                  {return 0 != mTotalCurrentDelays;}
+        Duration getCurrentDelay() const;
+        Duration getBaseDelay() const;
+        Duration getQueuingDelay() const;
+
+        bool decrease(
+                      double factor,
+                      const char *reason
+                      );
+
+      protected:
+        double mWindow;                               // congestion window in packets
+        bool mSlowStart;                              // grow by one packet per acked packet until the first decrease or until the queue starts building
+
+        Duration mTargetDelay;
+        Duration mCalculatedRTT;
+
+        Duration mCurrentDelays[OPENPEER_SERVICES_RUDP_DELAY_BASED_CURRENT_DELAY_SAMPLES];
+        size_t mCurrentDelayPos;
+        size_t mTotalCurrentDelays;
+
+        Duration mBaseDelays[OPENPEER_SERVICES_RUDP_DELAY_BASED_BASE_DELAY_HISTORY];   // lowest delay per minute, most recent minute at "mBaseDelayPos"
+        size_t mBaseDelayPos;
+        size_t mTotalBaseDelays;
+        Time mBaseDelayMinuteStarted;
+
+        Time mLastDecrease;
+
+        ULONG mTotalCongestionDecreases;
+        ULONG mTotalRandomLossDecreases;
+      };
+    }
+  }
+}
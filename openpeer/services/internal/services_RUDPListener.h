@@ -33,6 +33,7 @@
 
 #include <openpeer/services/internal/types.h>
 #include <openpeer/services/IRUDPListener.h>
+#include <openpeer/services/internal/services_PacketBuffer.h>
 #include <openpeer/services/internal/services_RUDPChannel.h>
 
 #include <zsLib/Socket.h>
@@ -71,9 +72,6 @@ namespace openpeer
 
         ZS_DECLARE_TYPEDEF_PTR(IRUDPChannelForRUDPListener, UseRUDPChannel)
 
-        typedef boost::shared_array<BYTE> RecycledPacketBuffer;
-        typedef std::list<RecycledPacketBuffer> RecycledPacketBufferList;
-
         class CompareChannelPair;
 
         typedef IPAddress RemoteIP;
@@ -151,6 +149,13 @@ namespace openpeer
                                                  size_t packetLengthInBytes
                                                  );
 
+        virtual size_t notifyRUDPChannelSendPackets(
+                                                    RUDPChannelPtr channel,
+                                                    const IPAddress &remoteIP,
+                                                    const SendBuffer *packets,
+                                                    size_t totalPackets
+                                                    );
+
       protected:
         //---------------------------------------------------------------------
         #pragma mark
@@ -191,25 +196,7 @@ namespace openpeer
                                   STUNPacketPtr &outResponse
                                   );
 
-        void getBuffer(RecycledPacketBuffer &outBuffer);
-        void recycleBuffer(RecycledPacketBuffer &buffer);
-
       public:
-        //---------------------------------------------------------------------
-        #pragma mark
-        #pragma mark RUDPListener::AutoRecycleBuffer
-        #pragma mark
-
-        class AutoRecycleBuffer
-        {
-        public:
-          AutoRecycleBuffer(RUDPListener &outer, RecycledPacketBuffer &buffer) : mOuter(outer), mBuffer(buffer) {}
-          ~AutoRecycleBuffer() {mOuter.recycleBuffer(mBuffer);}
-        private:
-          RUDPListener &mOuter;
-          RecycledPacketBuffer &mBuffer;
-        };
-
         //---------------------------------------------------------------------
         #pragma mark
         #pragma mark RUDPListener::CompareChannelPair
@@ -238,14 +225,13 @@ namespace openpeer
         WORD mBindPort;
 
         SocketPtr mUDPSocket;
+        bool mSegmentationOffload;
 
         SessionMap mLocalChannelNumberSessions;   // local channel numbers are the channel numbers we expect to receive from the remote party
         SessionMap mRemoteChannelNumberSessions;  // remote channel numbers are the channel numbers we expect to send to the remote party
 
         PendingSessionList mPendingSessions;
 
-        RecycledPacketBufferList mRecycledBuffers;
-
         BYTE mMagic[16];
         String mRealm;
       };
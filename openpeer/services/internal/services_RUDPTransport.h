@@ -47,6 +47,7 @@ namespace openpeer
     namespace internal
     {
       interaction IRUDPChannelForRUDPTransport;
+      interaction IICESocketSessionForRUDPTransport;
 
       //-----------------------------------------------------------------------
       //-----------------------------------------------------------------------
@@ -67,6 +68,7 @@ namespace openpeer
         friend interaction IRUDPTransport;
 
         ZS_DECLARE_TYPEDEF_PTR(IRUDPChannelForRUDPTransport, UseRUDPChannel)
+        ZS_DECLARE_TYPEDEF_PTR(IICESocketSessionForRUDPTransport, UseICESocketSession)
 
         typedef IICESocket::CandidateList CandidateList;
         typedef IICESocket::ICEControls ICEControls;
@@ -176,6 +178,13 @@ namespace openpeer
                                                  size_t packetLengthInBytes
                                                  );
 
+        virtual size_t notifyRUDPChannelSendPackets(
+                                                    RUDPChannelPtr channel,
+                                                    const IPAddress &remoteIP,
+                                                    const SendBuffer *packets,
+                                                    size_t totalPackets
+                                                    );
+
       protected:
         //---------------------------------------------------------------------
         #pragma mark
@@ -35,7 +35,6 @@
 #include <openpeer/services/ISTUNRequester.h>
 #include <openpeer/services/STUNPacket.h>
 #include <zsLib/MessageQueueAssociator.h>
-#include <zsLib/Timer.h>
 #include <zsLib/Proxy.h>
 
 namespace openpeer
@@ -60,10 +59,14 @@ namespace openpeer
 
         virtual PUID getID() const = 0;
 
+        virtual STUNPacketPtr getRequest() const = 0;
+
         virtual bool handleSTUNPacket(
                                       IPAddress fromIPAddress,
                                       STUNPacketPtr packet
                                       ) = 0;
+
+        virtual void notifyTimeout() = 0;
       };
 
       //-----------------------------------------------------------------------
@@ -77,8 +80,7 @@ namespace openpeer
       class STUNRequester : public Noop,
                             public MessageQueueAssociator,
                             public ISTUNRequester,
-                            public ISTUNRequesterForSTUNRequesterManager,
-                            public ITimerDelegate
+                            public ISTUNRequesterForSTUNRequesterManager
       {
       public:
         friend interaction ISTUNRequesterFactory;
@@ -140,17 +142,14 @@ namespace openpeer
 
         // (duplicate) virtual PUID getID() const;
 
+        // (duplicate) virtual STUNPacketPtr getRequest() const;
+
         virtual bool handleSTUNPacket(
                                       IPAddress fromIPAddress,
                                       STUNPacketPtr packet
                                       );
 
-        //---------------------------------------------------------------------
-        #pragma mark
-        #pragma mark STUNRequester => ITimerDelegate
-        #pragma mark
-
-        virtual void onTimer(TimerPtr timer);
+        virtual void notifyTimeout();
 
       protected:
         //---------------------------------------------------------------------
@@ -178,8 +177,8 @@ namespace openpeer
 
         IPAddress mServerIP;
 
-        TimerPtr mTimer;
-        TimerPtr mMaxTimeTimer;
+        Time mNextRetransmitTime;                                 // Time() when no retransmission is pending
+        Time mTimeoutTime;                                        // Time() when the overall timeout is not yet started
 
         Duration mCurrentTimeout;
         ULONG mTryNumber;
@@ -34,9 +34,20 @@
 #include <openpeer/services/internal/types.h>
 #include <openpeer/services/ISTUNRequesterManager.h>
 
-#include <map>
+#include <zsLib/MessageQueueAssociator.h>
+#include <zsLib/Timer.h>
+
+#include <boost/unordered_map.hpp>
+
+#include <list>
 #include <utility>
 
+#define OPENPEER_SERVICES_STUN_REQUESTER_MANAGER_TOTAL_SHARDS (16)
+
+#define OPENPEER_SERVICES_STUN_REQUESTER_MANAGER_TIMER_WHEEL_TICK_IN_MILLISECONDS (10)
+#define OPENPEER_SERVICES_STUN_REQUESTER_MANAGER_TIMER_WHEEL_NEAR_SLOTS (256)
+#define OPENPEER_SERVICES_STUN_REQUESTER_MANAGER_TIMER_WHEEL_FAR_SLOTS (64)
+
 namespace openpeer
 {
   namespace services
@@ -64,6 +75,16 @@ namespace openpeer
                                   STUNPacketPtr stunRequest
                                   ) = 0;
         virtual void monitorStop(STUNRequester &requester) = 0;
+
+        //---------------------------------------------------------------------
+        // PURPOSE: ask for "notifyTimeout" to be called on the requester at
+        //          (or shortly after) the time specified
+        // NOTE:    scheduled timeouts are never cancelled; the requester
+        //          must ignore a notification that is no longer relevant
+        virtual void scheduleTimeout(
+                                     STUNRequesterPtr requester,
+                                     Time expires
+                                     ) = 0;
       };
 
       //-----------------------------------------------------------------------
@@ -75,8 +96,10 @@ namespace openpeer
       #pragma mark
 
       class STUNRequesterManager : public Noop,
+                                   public MessageQueueAssociator,
                                    public ISTUNRequesterManager,
-                                   public ISTUNRequesterManagerForSTUNRequester
+                                   public ISTUNRequesterManagerForSTUNRequester,
+                                   public ITimerDelegate
       {
       public:
         friend interaction ISTUNRequesterManagerFactory;
@@ -87,10 +110,87 @@ namespace openpeer
 
         typedef std::pair<QWORD, QWORD> QWORDPair;
 
+        typedef PUID STUNRequesterID;
+        typedef std::pair<UseSTUNRequesterWeakPtr, STUNRequesterID> STUNRequesterPair;
+        typedef boost::unordered_map<QWORDPair, STUNRequesterPair> STUNRequesterMap;
+
+        //---------------------------------------------------------------------
+        #pragma mark
+        #pragma mark STUNRequesterManager::Shard
+        #pragma mark
+
+        // transactions are spread over multiple independently locked tables
+        // so concurrent lookups and registrations rarely contend
+        struct Shard
+        {
+          mutable Lock mLock;
+          STUNRequesterMap mRequesters;
+        };
+
+        //---------------------------------------------------------------------
+        #pragma mark
+        #pragma mark STUNRequesterManager::TimerWheel
+        #pragma mark
+
+        // Two level hierarchical timer wheel driving the retransmissions of
+        // every outstanding request from a single timer. The near wheel has
+        // one slot per tick, the far wheel one slot per turn of the near
+        // wheel and anything further out waits in an overflow list.
+        class TimerWheel
+        {
+        public:
+          struct Entry
+          {
+            QWORD mExpiresTick;
+            UseSTUNRequesterWeakPtr mRequester;
+          };
+
+          typedef std::list<Entry> EntryList;
+
+        public:
+          TimerWheel();
+
+          void schedule(
+                        UseSTUNRequesterPtr requester,
+                        Time expires
+                        );
+
+          void advance(
+                       Time now,
+                       EntryList &outExpired
+                       );
+
+          bool isEmpty() const {return 0 == mTotalEntries;}
+          size_t getTotalEntries() const {return mTotalEntries;}
+
+        protected:
+          QWORD toTick(
+                       Time when,
+                       bool roundUp
+                       ) const;
+
+          void insert(
+                      EntryList &source,
+                      EntryList::iterator iter,
+                      QWORD minimumTick
+                      );
+
+          void cascade(EntryList &source);
+
+        protected:
+          Time mStartTime;
+          QWORD mCurrentTick;
+          size_t mTotalEntries;
+
+          EntryList mNear[OPENPEER_SERVICES_STUN_REQUESTER_MANAGER_TIMER_WHEEL_NEAR_SLOTS];
+          EntryList mFar[OPENPEER_SERVICES_STUN_REQUESTER_MANAGER_TIMER_WHEEL_FAR_SLOTS];
+          EntryList mOverflow;
+        };
+
       protected:
         STUNRequesterManager();
         
-        STUNRequesterManager(Noop) : Noop(true) {};
+        STUNRequesterManager(Noop) : Noop(true), MessageQueueAssociator(IMessageQueuePtr()) {};
 
       public:
         ~STUNRequesterManager();
@@ -114,6 +214,10 @@ namespace openpeer
                                                    IPAddress fromIPAddress,
                                                    STUNPacketPtr stun
                                                    );
+        virtual ISTUNRequesterPtr handleSTUNPacket(
+                                                   IPAddress fromIPAddress,
+                                                   const STUNPacketView &stun
+                                                   );
 
         //---------------------------------------------------------------------
         #pragma mark
@@ -128,6 +232,18 @@ namespace openpeer
                                   );
         virtual void monitorStop(STUNRequester &requester);
 
+        virtual void scheduleTimeout(
+                                     STUNRequesterPtr requester,
+                                     Time expires
+                                     );
+
+        //---------------------------------------------------------------------
+        #pragma mark
+        #pragma mark STUNRequesterManager => ITimerDelegate
+        #pragma mark
+
+        virtual void onTimer(TimerPtr timer);
+
       protected:
         //---------------------------------------------------------------------
         #pragma mark
@@ -137,20 +253,22 @@ namespace openpeer
         Log::Params log(const char *message) const;
         static Log::Params slog(const char *message);
 
+        Shard &getShard(const QWORDPair &key);
+
       protected:
         //---------------------------------------------------------------------
         #pragma mark
         #pragma mark STUNRequesterManager => (data)
         #pragma mark
 
-        RecursiveLock mLock;
         PUID mID;
         STUNRequesterManagerWeakPtr mThisWeak;
 
-        typedef PUID STUNRequesterID;
-        typedef std::pair<UseSTUNRequesterWeakPtr, STUNRequesterID> STUNRequesterPair;
-        typedef std::map<QWORDPair, STUNRequesterPair> STUNRequesterMap;
-        STUNRequesterMap mRequesters;
+        Shard mShards[OPENPEER_SERVICES_STUN_REQUESTER_MANAGER_TOTAL_SHARDS];
+
+        Lock mTimerLock;
+        TimerWheel mTimerWheel;
+        TimerPtr mTimer;
       };
 
       //-----------------------------------------------------------------------
@@ -0,0 +1,272 @@
+/*
+
+ Copyright (c) 2013, SMB Phone Inc.
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+
+ 1. Redistributions of source code must retain the above copyright notice, this
+ list of conditions and the following disclaimer.
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ The views and conclusions contained in the software and documentation are those
+ of the authors and should not be interpreted as representing official policies,
+ either expressed or implied, of the FreeBSD Project.
+
+ */
+
+
+#pragma once
+
+#include <openpeer/services/internal/types.h>
+
+#include <vector>
+
+#define OPENPEER_SERVICES_SEQUENCE_RING_MINIMUM_CAPACITY (16)
+
+namespace openpeer
+{
+  namespace services
+  {
+    namespace internal
+    {
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      #pragma mark
+      #pragma mark SequenceRing
+      #pragma mark
+
+      // Ring buffer keyed by a (never wrapping) 64 bit sequence number. The
+      // slot for a sequence number is "sequence & (capacity - 1)" so insert,
+      // find and erase are O(1) and iterating walks one contiguous array in
+      // sequence order. The capacity is a power of two which always covers
+      // the span between the lowest and highest stored sequence number; the
+      // ring doubles if an insert falls outside that span.
+      template <typename t_value>
+      class SequenceRing
+      {
+      protected:
+        struct Slot;
+
+      public:
+        //---------------------------------------------------------------------
+        // PURPOSE: walks the stored entries in ascending sequence order
+        // NOTE:    only the entry currently pointed to may be erased while
+        //          iterating, and the iterator must not be used afterwards
+        class iterator
+        {
+        public:
+          iterator() : mRing(NULL), mSequenceNumber(0) {}
+
+          QWORD sequenceNumber() const        {return mSequenceNumber;}
+
+          t_value &operator*() const          {return mRing->slot(mSequenceNumber).mValue;}
+          t_value *operator->() const         {return &(mRing->slot(mSequenceNumber).mValue);}
+
+          iterator &operator++()              {mSequenceNumber = mRing->nextUsed(mSequenceNumber + 1); return *this;}
+
+          bool operator==(const iterator &rValue) const {return mSequenceNumber == rValue.mSequenceNumber;}
+          bool operator!=(const iterator &rValue) const {return mSequenceNumber != rValue.mSequenceNumber;}
+
+        protected:
+          friend class SequenceRing;
+
+          iterator(
+                   SequenceRing *ring,
+                   QWORD sequenceNumber
+                   ) : mRing(ring), mSequenceNumber(sequenceNumber) {}
+
+        protected:
+          SequenceRing *mRing;
+          QWORD mSequenceNumber;
+        };
+
+      public:
+        SequenceRing(size_t minimumCapacity = OPENPEER_SERVICES_SEQUENCE_RING_MINIMUM_CAPACITY) :
+          mMinimumCapacity(roundUpCapacity(minimumCapacity)),
+          mFirst(0),
+          mLast(0),
+          mTotalEntries(0)
+        {}
+
+        //---------------------------------------------------------------------
+        // PURPOSE: find the value stored for the sequence number
+        // RETURNS: pointer to the stored value or NULL if not found
+        t_value *find(QWORD sequenceNumber)
+        {
+          if (!contains(sequenceNumber)) return NULL;
+          return &(slot(sequenceNumber).mValue);
+        }
+
+        //---------------------------------------------------------------------
+        // PURPOSE: store (or replace) the value for the sequence number
+        void insert(
+                    QWORD sequenceNumber,
+                    const t_value &value
+                    )
+        {
+          if (0 == mTotalEntries) {
+            if (mSlots.size() < 1) mSlots.resize(mMinimumCapacity);
+            mFirst = mLast = sequenceNumber;
+          } else {
+            QWORD first = (sequenceNumber < mFirst ? sequenceNumber : mFirst);
+            QWORD last = (sequenceNumber > mLast ? sequenceNumber : mLast);
+            if ((last - first) >= static_cast<QWORD>(mSlots.size())) {
+              grow(last - first + 1);
+            }
+            mFirst = first;
+            mLast = last;
+          }
+
+          Slot &entry = slot(sequenceNumber);
+          if (!entry.mUsed) {
+            entry.mUsed = true;
+            ++mTotalEntries;
+          }
+          entry.mValue = value;
+        }
+
+        //---------------------------------------------------------------------
+        // PURPOSE: remove the value stored for the sequence number
+        // RETURNS: true if an entry was removed
+        bool erase(QWORD sequenceNumber)
+        {
+          if (!contains(sequenceNumber)) return false;
+
+          slot(sequenceNumber) = Slot();
+          --mTotalEntries;
+
+          if (0 == mTotalEntries) return true;
+
+          if (sequenceNumber == mFirst) {
+            mFirst = nextUsed(mFirst + 1);
+          } else if (sequenceNumber == mLast) {
+            while (!slot(mLast).mUsed) {
+              --mLast;
+            }
+          }
+          return true;
+        }
+
+        //---------------------------------------------------------------------
+        // PURPOSE: remove the entry with the lowest sequence number
+        void popFront()                     {if (0 != mTotalEntries) erase(mFirst);}
+
+        //---------------------------------------------------------------------
+        // PURPOSE: release every stored value and the slot array
+        void clear()
+        {
+          SlotArray empty;
+          mSlots.swap(empty);
+          mFirst = mLast = 0;
+          mTotalEntries = 0;
+        }
+
+        //---------------------------------------------------------------------
+        // PURPOSE: position an iterator at the sequence number
+        // RETURNS: the iterator or end() if the sequence number is not stored
+        iterator at(QWORD sequenceNumber)   {return (contains(sequenceNumber) ? iterator(this, sequenceNumber) : end());}
+
+        iterator begin()                    {return (0 != mTotalEntries ? iterator(this, mFirst) : end());}
+        iterator end()                      {return iterator(this, (0 != mTotalEntries ? mLast + 1 : 0));}
+
+        t_value &front()                    {return slot(mFirst).mValue;}   // only legal when not empty
+
+        size_t size() const                 {return mTotalEntries;}
+        size_t capacity() const             {return mSlots.size();}
+
+      protected:
+        friend class iterator;
+
+        struct Slot
+        {
+          t_value mValue;
+          bool mUsed;
+
+          Slot() : mValue(), mUsed(false) {}
+        };
+
+        typedef std::vector<Slot> SlotArray;
+
+        //---------------------------------------------------------------------
+        static size_t roundUpCapacity(size_t capacity)
+        {
+          size_t result = OPENPEER_SERVICES_SEQUENCE_RING_MINIMUM_CAPACITY;
+          while (result < capacity) {
+            result <<= 1;
+          }
+          return result;
+        }
+
+        //---------------------------------------------------------------------
+        Slot &slot(QWORD sequenceNumber)
+        {
+          return mSlots[static_cast<size_t>(sequenceNumber & static_cast<QWORD>(mSlots.size() - 1))];
+        }
+
+        //---------------------------------------------------------------------
+        bool contains(QWORD sequenceNumber)
+        {
+          if (0 == mTotalEntries) return false;
+          if ((sequenceNumber < mFirst) || (sequenceNumber > mLast)) return false;
+          return slot(sequenceNumber).mUsed;
+        }
+
+        //---------------------------------------------------------------------
+        // PURPOSE: find the first stored sequence number at or after the one
+        //          passed in
+        // RETURNS: the sequence number found or "mLast + 1" if there is none
+        QWORD nextUsed(QWORD sequenceNumber)
+        {
+          for (; sequenceNumber <= mLast; ++sequenceNumber) {
+            if (slot(sequenceNumber).mUsed) return sequenceNumber;
+          }
+          return mLast + 1;
+        }
+
+        //---------------------------------------------------------------------
+        void grow(QWORD span)
+        {
+          size_t capacity = mSlots.size();
+          while (static_cast<QWORD>(capacity) < span) {
+            capacity <<= 1;
+          }
+
+          SlotArray old(capacity);
+          old.swap(mSlots);
+
+          size_t oldMask = old.size() - 1;
+          for (QWORD sequenceNumber = mFirst; sequenceNumber <= mLast; ++sequenceNumber) {
+            Slot &oldSlot = old[static_cast<size_t>(sequenceNumber & static_cast<QWORD>(oldMask))];
+            if (!oldSlot.mUsed) continue;
+            slot(sequenceNumber) = oldSlot;
+          }
+        }
+
+      protected:
+        SlotArray mSlots;       // capacity is always zero or a power of two
+        size_t mMinimumCapacity;
+
+        QWORD mFirst;           // lowest stored sequence number (only valid when not empty)
+        QWORD mLast;            // highest stored sequence number (only valid when not empty)
+        size_t mTotalEntries;
+      };
+    }
+  }
+}
@@ -0,0 +1,246 @@
+/*
+
+ Copyright (c) 2013, SMB Phone Inc.
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+
+ 1. Redistributions of source code must retain the above copyright notice, this
+ list of conditions and the following disclaimer.
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ The views and conclusions contained in the software and documentation are those
+ of the authors and should not be interpreted as representing official policies,
+ either expressed or implied, of the FreeBSD Project.
+
+ */
+
+#pragma once
+
+#include <openpeer/services/internal/types.h>
+
+#include <zsLib/Socket.h>
+#include <zsLib/Proxy.h>
+
+#include <map>
+
+#define OPENPEER_SERVICES_SETTING_SOCKET_EVENT_BACKEND "openpeer/services/socket-event-backend"
+
+#define OPENPEER_SERVICES_SOCKET_EVENT_BACKEND_ZSLIB "zslib"
+#define OPENPEER_SERVICES_SOCKET_EVENT_BACKEND_EPOLL "epoll"
+
+namespace openpeer
+{
+  namespace services
+  {
+    namespace internal
+    {
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      #pragma mark
+      #pragma mark ISocketEventBackendAsync
+      #pragma mark
+
+      interaction ISocketEventBackendAsync
+      {
+        virtual void onSocketEventBackendCheckReadReady() = 0;
+      };
+
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      #pragma mark
+      #pragma mark SocketEventBackend
+      #pragma mark
+
+      // Delivers socket readiness to ISocketDelegate objects. By default
+      // sockets are handed straight to the zsLib socket monitor. When the
+      // "epoll" backend is selected (Linux only) every attached socket is
+      // registered edge-triggered with a single epoll instance so the cost
+      // of a wake-up is proportional to the number of ready sockets rather
+      // than the number of monitored sockets.
+      //
+      // Edge-triggered notification only fires when new data arrives so
+      // after each read notification a re-check is queued behind it on the
+      // delegate's message queue; if the delegate left data unread it is
+      // notified again (matching the level style the delegates expect).
+      class SocketEventBackend : public Noop,
+                                 public SharedRecursiveLock
+      {
+      public:
+        ZS_DECLARE_STRUCT_PTR(Entry)
+
+        friend struct Entry;
+
+        typedef SOCKET SocketHandle;
+        typedef std::map<SocketHandle, EntryPtr> EntryMap;
+
+      protected:
+        SocketEventBackend();
+        SocketEventBackend(Noop) :
+          Noop(true),
+          SharedRecursiveLock(SharedRecursiveLock::create())
+        {}
+
+        void init();
+
+      public:
+        ~SocketEventBackend();
+
+        //---------------------------------------------------------------------
+        // PURPOSE: deliver events for the socket to the delegate
+        // NOTE:    replaces Socket::setDelegate() (and Socket::monitor()); the
+        //          delegate must be a MessageQueueAssociator
+        static void attach(
+                           SocketPtr socket,
+                           ISocketDelegatePtr delegate,
+                           zsLib::Socket::Monitor::Options options = zsLib::Socket::Monitor::All
+                           );
+
+        //---------------------------------------------------------------------
+        // PURPOSE: change the events monitored on an attached socket
+        // NOTE:    replaces Socket::monitor()
+        static void monitor(
+                            SocketPtr socket,
+                            zsLib::Socket::Monitor::Options options
+                            );
+
+        //---------------------------------------------------------------------
+        // PURPOSE: stop delivering events for a socket
+        // NOTE:    must be called before the socket is closed
+        static void detach(SocketPtr socket);
+
+        static ElementPtr toDebug();
+
+      protected:
+        //---------------------------------------------------------------------
+        #pragma mark
+        #pragma mark SocketEventBackend => (internal)
+        #pragma mark
+
+        static SocketEventBackendPtr singleton();
+        static SocketEventBackendPtr create();
+
+        Log::Params log(const char *message) const;
+        static Log::Params slog(const char *message);
+
+        bool isEpoll() const {return mUseEpoll;}
+
+        void cancel();
+
+        void internalAttach(
+                            SocketPtr socket,
+                            ISocketDelegatePtr delegate,
+                            zsLib::Socket::Monitor::Options options
+                            );
+        void internalMonitor(
+                             SocketPtr socket,
+                             zsLib::Socket::Monitor::Options options
+                             );
+        void internalDetach(SocketPtr socket);
+
+        ElementPtr internalToDebug() const;
+
+        bool updateEpoll(
+                         SocketHandle handle,
+                         zsLib::Socket::Monitor::Options options,
+                         bool add
+                         );
+
+        void wakeUp();
+
+        void notify(
+                    EntryPtr entry,
+                    ULONG events
+                    );
+        void notifyReadReady(EntryPtr entry);
+        void checkReadReady(EntryPtr entry);
+
+        static bool isReadable(SocketHandle handle);
+
+      public:
+        void operator()();
+
+      public:
+        //---------------------------------------------------------------------
+        //---------------------------------------------------------------------
+        //---------------------------------------------------------------------
+        //---------------------------------------------------------------------
+        #pragma mark
+        #pragma mark SocketEventBackend::Entry
+        #pragma mark
+
+        struct Entry : public ISocketEventBackendAsync
+        {
+          EntryWeakPtr mThisWeak;
+          SocketEventBackendWeakPtr mOuter;
+
+          SocketHandle mHandle;
+          SocketWeakPtr mSocket;
+          ISocketDelegateWeakPtr mDelegate;
+          IMessageQueuePtr mQueue;
+
+          zsLib::Socket::Monitor::Options mOptions;
+
+          bool mReadPending;                      // a read notification (and its re-check) is queued on the delegate's queue
+
+          ULONG mTotalReadNotifications;
+          ULONG mTotalReadRechecks;
+
+          Entry();
+
+          //-------------------------------------------------------------------
+          #pragma mark
+          #pragma mark SocketEventBackend::Entry => ISocketEventBackendAsync
+          #pragma mark
+
+          virtual void onSocketEventBackendCheckReadReady();
+        };
+
+      protected:
+        //---------------------------------------------------------------------
+        #pragma mark
+        #pragma mark SocketEventBackend => (data)
+        #pragma mark
+
+        AutoPUID mID;
+        SocketEventBackendWeakPtr mThisWeak;
+        SocketEventBackendPtr mGracefulShutdownReference;
+
+        bool mUseEpoll;
+
+        ThreadPtr mThread;
+        bool mShouldShutdown;
+
+        int mEpoll;
+        int mWakeUpEvent;
+
+        EntryMap mEntries;
+
+        ULONG mTotalWakeUps;
+        ULONG mTotalEvents;
+      };
+    }
+  }
+}
+
+ZS_DECLARE_PROXY_BEGIN(openpeer::services::internal::ISocketEventBackendAsync)
+ZS_DECLARE_PROXY_METHOD_0(onSocketEventBackendCheckReadReady)
+ZS_DECLARE_PROXY_END()
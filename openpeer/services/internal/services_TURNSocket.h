@@ -33,6 +33,8 @@
 
 #include <openpeer/services/internal/types.h>
 #include <openpeer/services/internal/services_Helper.h>
+#include <openpeer/services/internal/services_PacketBuffer.h>
+#include <openpeer/services/internal/services_IPAddressTable.h>
 
 #include <openpeer/services/IBackgrounding.h>
 #include <openpeer/services/ITURNSocket.h>
@@ -45,10 +47,22 @@
 #include <zsLib/Timer.h>
 
 #define OPENPEER_SERVICES_TURN_MAX_CHANNEL_DATA_IN_BYTES ((1 << (sizeof(WORD)*8)) - 1)
+#define OPENPEER_SERVICES_TURN_MAX_PACKET_PARTS (4)
+#define OPENPEER_SERVICES_TURN_MAX_SEND_PREFIX_IN_BYTES (128)
+#define OPENPEER_SERVICES_TURN_MAX_SEND_SUFFIX_IN_BYTES (32)
+#define OPENPEER_SERVICES_TURN_MAX_TCP_WRITE_QUEUE_FRAMES (256)              // must be a power of two
+#define OPENPEER_SERVICES_TURN_MAX_TCP_COALESCED_FRAMES_PER_WRITE (32)
+
+#define OPENPEER_SERVICES_TURN_MAX_PERMISSION_REQUEST_SIZE_IN_BYTES (1200)     // keep each CreatePermission request within a typical path MTU
+#define OPENPEER_SERVICES_TURN_CHANNEL_REFRESH_IN_SECONDS (90)                 // a channel bind also refreshes the permission (which lasts 5 minutes)
+#define OPENPEER_SERVICES_TURN_CHANNEL_REFRESH_SPREAD_IN_SECONDS (30)          // channel refreshes are spread over this window before they are due
+#define OPENPEER_SERVICES_TURN_CHANNEL_REFRESH_TICK_IN_SECONDS (2)
+#define OPENPEER_SERVICES_TURN_MAX_CHANNEL_REFRESHES_PER_TICK (16)
 
 #include <list>
 #include <map>
 #include <utility>
+#include <vector>
 
 #define OPENPEER_SERVICES_SETTING_TURN_BACKGROUNDING_PHASE "openpeer/services/backgrounding-phase-turn"
 
@@ -56,6 +70,14 @@
 #define OPENPEER_SERVICES_SETTING_FORCE_TURN_TO_USE_TCP "openpeer/services/debug/force-turn-to-use-tcp"
 #define OPENPEER_SERVICES_SETTING_ONLY_ALLOW_TURN_TO_RELAY_DATA_TO_SPECIFIC_IPS "openpeer/services/debug/only-allow-turn-to-relay-data-sent-to-specific-ips"
 
+#define OPENPEER_SERVICES_SETTING_TURN_TCP_WRITE_QUEUE_WATERMARK_IN_BYTES "openpeer/services/turn-tcp-write-queue-watermark-in-bytes"
+#define OPENPEER_SERVICES_SETTING_TURN_TCP_WRITE_QUEUE_DROP_POLICY "openpeer/services/turn-tcp-write-queue-drop-policy"
+
+#define OPENPEER_SERVICES_SETTING_TURN_RACE_SERVERS "openpeer/services/turn-race-servers"
+
+#define OPENPEER_SERVICES_TURN_TCP_WRITE_QUEUE_DROP_POLICY_NEWEST "newest"
+#define OPENPEER_SERVICES_TURN_TCP_WRITE_QUEUE_DROP_POLICY_OLDEST "oldest"
+
 namespace openpeer
 {
   namespace services
@@ -84,8 +106,6 @@ namespace openpeer
         friend interaction ITURNSocket;
         friend interaction ITURNSocketFactory;
 
-        typedef boost::shared_array<BYTE> RecycledPacketBuffer;
-        typedef std::list<RecycledPacketBuffer> RecycledPacketBufferList;
         typedef std::list<IPAddress> IPAddressList;
         typedef IDNS::SRVResultPtr SRVResultPtr;
 
@@ -99,11 +119,18 @@ namespace openpeer
 
         typedef std::map<IPAddress, PermissionPtr, CompareIP> PermissionMap;
 
-        typedef std::map<IPAddress, ChannelInfoPtr, CompareIP> ChannelIPMap;
+        typedef IPAddressTable<PermissionPtr> PermissionTable;
+
+        typedef IPAddressTable<ChannelInfoPtr> ChannelIPTable;
         typedef std::map<WORD, ChannelInfoPtr> ChannelNumberMap;
+        typedef std::vector<ChannelInfo *> ChannelNumberTable;
+
+        typedef std::list<ISTUNRequesterPtr> PermissionRequesterList;
 
         typedef Helper::IPAddressMap IPAddressMap;
 
+        typedef ITURNSocketDelegate::PacketPart PacketPart;
+
       protected:
 
         TURNSocket(
@@ -282,6 +309,8 @@ namespace openpeer
         virtual ElementPtr toDebug() const;
 
         void fix(STUNPacketPtr stun) const;
+        void fixCredentials(STUNPacketPtr stun) const;
+        bool isValidMessageIntegrity(STUNPacketPtr response) const;
 
         IPAddress stepGetNextServer(
                                     IPAddressList &previouslyAdded,
@@ -314,6 +343,10 @@ namespace openpeer
                                     STUNPacketPtr response
                                     );
 
+        bool handleRaceLoserRequester(ISTUNRequesterPtr requester);
+
+        void tearDownRaceLosers(ServerPtr winner);
+
         bool handlePermissionRequester(
                                        ISTUNRequesterPtr requester,
                                        STUNPacketPtr response
@@ -324,11 +357,16 @@ namespace openpeer
                                     STUNPacketPtr response
                                     );
 
-        void requestPermissionsNow();
+        void requestPermissionsNow(bool refreshAll);
+        STUNPacketPtr createPermissionRequest();
+        ISTUNRequesterPtr createPermissionRequester(STUNPacketPtr permissionRequest);
+        bool removePermissionRequester(ISTUNRequesterPtr requester);
 
         void refreshNow();
 
         void refreshChannels();
+        void refreshDueChannels();
+        void bindChannel(ChannelInfoPtr info);
 
         bool sendPacketOrDopPacketIfBufferFull(
                                                ServerPtr server,
@@ -336,42 +374,46 @@ namespace openpeer
                                                size_t bufferSizeInBytes
                                                );
 
+        bool sendPacketOrDopPacketIfBufferFull(
+                                               ServerPtr server,
+                                               const PacketPart *parts,
+                                               size_t totalParts
+                                               );
+
         bool sendPacketOverTCPOrDropIfBufferFull(
                                                  ServerPtr server,
-                                                 const BYTE *buffer,
-                                                 size_t bufferSizeInBytes
+                                                 const PacketPart *parts,
+                                                 size_t totalParts
                                                  );
 
+        bool queueTCPFrame(
+                           ServerPtr server,
+                           const PacketPart *parts,
+                           size_t totalParts,
+                           size_t frameLengthInBytes
+                           );
+
+        bool flushTCPWriteQueue(ServerPtr server);
+
         void informWriteReady();
 
         WORD getNextChannelNumber();
 
+        void addChannel(ChannelInfoPtr info);
+        void removeChannel(ChannelInfoPtr info);
+        ChannelInfo *findChannel(WORD channel) const;
+
+        void addPermission(PermissionPtr permission);
+        void removePermission(PermissionMap::iterator iter);
+
         ISTUNRequesterPtr handleAuthorizationErrors(ISTUNRequesterPtr requester, STUNPacketPtr response);
 
         void clearBackgroundingNotifierIfPossible();
         void clearRefreshRequester()      {if (mRefreshRequester) { mRefreshRequester->cancel(); mRefreshRequester.reset(); } clearBackgroundingNotifierIfPossible();}
-        void clearPermissionRequester()   {if (mPermissionRequester) { mPermissionRequester->cancel(); mPermissionRequester.reset(); } clearBackgroundingNotifierIfPossible();}
+        void clearPermissionRequesters();
         void clearDeallocateRequester()   {if (mDeallocateRequester) { mDeallocateRequester->cancel(); mDeallocateRequester.reset(); } clearBackgroundingNotifierIfPossible();}
 
-        void getBuffer(RecycledPacketBuffer &outBuffer);
-        void recycleBuffer(RecycledPacketBuffer &buffer);
-
       public:
-        //---------------------------------------------------------------------
-        #pragma mark
-        #pragma mark TURNSocket::AutoRecycleBuffer
-        #pragma mark
-
-        class AutoRecycleBuffer
-        {
-        public:
-          AutoRecycleBuffer(TURNSocket &outer, RecycledPacketBuffer &buffer) : mOuter(outer), mBuffer(buffer) {}
-          ~AutoRecycleBuffer() {mOuter.recycleBuffer(mBuffer);}
-        private:
-          TURNSocket &mOuter;
-          RecycledPacketBuffer &mBuffer;
-        };
-
         //---------------------------------------------------------------------
         #pragma mark
         #pragma mark TURNSocket::Server
@@ -392,14 +434,41 @@ namespace openpeer
           bool mInformedWriteReady;
 
           Time mActivateAfter;
+          Time mAllocateStartedAt;
+          Duration mAllocateRTT;
 
           ISTUNRequesterPtr mAllocateRequester;
+          ISTUNRequesterPtr mReleaseRequester;  // releases a possible allocation after losing a race
 
           BYTE mReadBuffer[OPENPEER_SERVICES_TURN_MAX_CHANNEL_DATA_IN_BYTES+sizeof(DWORD)];
           size_t mReadBufferFilledSizeInBytes;
 
-          BYTE mWriteBuffer[OPENPEER_SERVICES_TURN_MAX_CHANNEL_DATA_IN_BYTES+sizeof(DWORD)];
-          size_t mWriteBufferFilledSizeInBytes;
+          // frames waiting to be written to the TCP socket, written out
+          // together (as one gathered write) when the socket is write ready
+          struct QueuedFrame
+          {
+            PacketBufferPtr mBuffer;
+            size_t mLengthInBytes;
+          };
+
+          bool mWriteBlocked;                     // true if the last write would have blocked (i.e. write ready will be notified)
+
+          QueuedFrame mWriteQueue[OPENPEER_SERVICES_TURN_MAX_TCP_WRITE_QUEUE_FRAMES];
+          size_t mWriteQueueHead;                 // oldest frame (masked when indexing)
+          size_t mWriteQueueTail;                 // next free slot (masked when indexing)
+          size_t mWriteQueueHeadSentInBytes;      // part of the oldest frame already written (such a frame can never be dropped)
+          size_t mWriteBufferFilledSizeInBytes;   // bytes still to be written
+
+          ULONG mTotalFramesQueued;
+          ULONG mTotalFramesWritten;
+          ULONG mTotalWrites;
+          ULONG mTotalFramesDropped;
+          ULONG mTotalBytesDropped;
+
+          size_t getTotalQueuedFrames() const     {return mWriteQueueTail - mWriteQueueHead;}
+          QueuedFrame &getQueuedFrame(size_t index) {return mWriteQueue[index & (OPENPEER_SERVICES_TURN_MAX_TCP_WRITE_QUEUE_FRAMES - 1)];}
+
+          bool dropOldestFrame();
         };
 
         //---------------------------------------------------------------------
@@ -443,7 +512,7 @@ namespace openpeer
           WORD mChannelNumber;
           IPAddress mPeerAddress;
           Time mLastSentDataAt;
-          TimerPtr mRefreshTimer;
+          Time mRefreshAt;
           ISTUNRequesterPtr mChannelBindRequester;
         };
 
@@ -474,6 +543,7 @@ namespace openpeer
         String mPassword;
         String mRealm;
         String mNonce;
+        MessageIntegrityKeyPtr mMessageIntegrityKey;  // long-term key for the current credentials (given to requests and used to validate responses)
 
         IDNSQueryPtr mTURNUDPQuery;
         IDNSQueryPtr mTURNTCPQuery;
@@ -503,19 +573,26 @@ namespace openpeer
         ServerList mServers;
         TimerPtr mActivationTimer;
 
-        PermissionMap mPermissions;
+        ULONG mRaceServers;                     // how many servers to allocate against in parallel
+        ServerList mRaceLosers;                 // servers releasing an allocation that lost the race
+
+        PermissionMap mPermissions;             // owns the permissions (walked by the timers)
+        PermissionTable mPermissionTable;       // hashed index of mPermissions for the send path
         TimerPtr mPermissionTimer;
-        ISTUNRequesterPtr mPermissionRequester;
+        PermissionRequesterList mPermissionRequesters;
         ULONG mPermissionRequesterMaxCapacity;
 
-        ChannelIPMap mChannelIPMap;
-        ChannelNumberMap mChannelNumberMap;
-
-        RecycledPacketBufferList mRecycledBuffers;
+        ChannelIPTable mChannelIPTable;         // outbound lookup by peer address
+        ChannelNumberMap mChannelNumberMap;     // owns the channels (walked by the timers)
+        ChannelNumberTable mChannelNumberTable; // inbound lookup indexed by (channel - mLimitChannelToRangeStart)
+        TimerPtr mChannelRefreshTimer;
 
         bool          mForceTURNUseTCP;
         bool          mForceTURNUseUDP;
         IPAddressMap  mRestrictedIPs;
+
+        size_t        mTCPWriteQueueWatermarkInBytes;
+        bool          mTCPWriteQueueDropOldest;
       };
 
       //-----------------------------------------------------------------------
@@ -0,0 +1,200 @@
+/*
+
+ Copyright (c) 2013, SMB Phone Inc.
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+
+ 1. Redistributions of source code must retain the above copyright notice, this
+ list of conditions and the following disclaimer.
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ The views and conclusions contained in the software and documentation are those
+ of the authors and should not be interpreted as representing official policies,
+ either expressed or implied, of the FreeBSD Project.
+
+ */
+
+#pragma once
+
+#include <openpeer/services/internal/types.h>
+
+#include <zsLib/IPAddress.h>
+#include <zsLib/Socket.h>
+
+#if defined(__linux__) && !defined(_ANDROID)
+#define OPENPEER_SERVICES_UDPBATCH_HAS_MMSG
+#endif //defined(__linux__) && !defined(_ANDROID)
+
+#ifdef OPENPEER_SERVICES_UDPBATCH_HAS_MMSG
+#define OPENPEER_SERVICES_UDPBATCH_HAS_SEGMENTATION_OFFLOAD
+#endif //OPENPEER_SERVICES_UDPBATCH_HAS_MMSG
+
+#define OPENPEER_SERVICES_SETTING_UDP_SEGMENTATION_OFFLOAD "openpeer/services/udp-segmentation-offload"
+
+#define OPENPEER_SERVICES_UDPBATCH_MAX_PACKETS (64)
+#define OPENPEER_SERVICES_UDPBATCH_MAX_SEGMENTS (64)
+#define OPENPEER_SERVICES_UDPBATCH_MAX_GATHERED_BUFFERS (32)
+#define OPENPEER_SERVICES_UDPBATCH_MAX_SEGMENTED_SIZE_IN_BYTES (0xFFFF - 48)
+
+namespace openpeer
+{
+  namespace services
+  {
+    namespace internal
+    {
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      #pragma mark
+      #pragma mark UDPBatch
+      #pragma mark
+
+      class UDPBatch
+      {
+      public:
+        struct ReceiveBuffer
+        {
+          BYTE *mBuffer;
+          size_t mBufferSizeInBytes;
+
+          IPAddress mSource;        // filled in when read
+          size_t mBytesRead;        // filled in when read
+          size_t mSegmentSizeInBytes; // filled in when read (non-zero if the kernel coalesced several datagrams into the buffer)
+          bool mTruncated;            // filled in when read (the datagram did not fit into the buffer)
+
+          ReceiveBuffer() : mBuffer(NULL), mBufferSizeInBytes(0), mBytesRead(0), mSegmentSizeInBytes(0), mTruncated(false) {}
+
+          // length of each datagram held in the buffer (the last datagram of
+          // a coalesced read may be shorter)
+          size_t segmentSize() const {return ((0 != mSegmentSizeInBytes) && (mSegmentSizeInBytes < mBytesRead)) ? mSegmentSizeInBytes : mBytesRead;}
+        };
+
+        struct SendBuffer
+        {
+          const BYTE *mBuffer;
+          size_t mBufferLengthInBytes;
+
+          SendBuffer() : mBuffer(NULL), mBufferLengthInBytes(0) {}
+        };
+
+        //---------------------------------------------------------------------
+        // PURPOSE: returns true if the platform can read/write multiple
+        //          datagrams in a single system call
+        static bool isSupported();
+
+        //---------------------------------------------------------------------
+        // PURPOSE: returns true if the platform can send a run of equal sized
+        //          datagrams as a single segmented write (UDP_SEGMENT) and
+        //          can read coalesced datagrams (UDP_GRO)
+        static bool isSegmentationSupported();
+
+        //---------------------------------------------------------------------
+        // PURPOSE: ask the kernel to coalesce datagrams arriving on the
+        //          socket from the same source into a single read
+        // RETURNS: true if coalescing was enabled
+        // NOTE:    a socket with coalescing enabled must only be read with
+        //          "receiveFrom" (which reports the segment size of each
+        //          buffer) and the buffers must be large enough to hold a
+        //          coalesced read
+        static bool enableReceiveCoalescing(SocketPtr socket);
+
+        //---------------------------------------------------------------------
+        // PURPOSE: read up to "totalBuffers" datagrams from a non-blocking
+        //          UDP socket
+        // RETURNS: the number of buffers filled (always filled in order)
+        // NOTE:    throws Socket::Exceptions::Unspecified on socket errors
+        //          exactly like Socket::receiveFrom does
+        static size_t receiveFrom(
+                                  SocketPtr socket,
+                                  ReceiveBuffer *buffers,
+                                  size_t totalBuffers,
+                                  bool *outWouldBlock = NULL
+                                  );
+
+        //---------------------------------------------------------------------
+        // PURPOSE: send up to "totalBuffers" datagrams to the same
+        //          destination on a non-blocking UDP socket
+        // RETURNS: the number of whole datagrams sent (always sent in order)
+        // NOTE:    throws Socket::Exceptions::Unspecified on socket errors
+        //          exactly like Socket::sendTo does; when "allowSegmentation"
+        //          is set, runs of equal sized datagrams are handed to the
+        //          kernel as a single segmented write where supported
+        static size_t sendTo(
+                             SocketPtr socket,
+                             const IPAddress &destination,
+                             const SendBuffer *buffers,
+                             size_t totalBuffers,
+                             bool *outWouldBlock = NULL,
+                             bool allowSegmentation = false
+                             );
+
+        //---------------------------------------------------------------------
+        // PURPOSE: send the passed in buffers (in order) as one datagram (or
+        //          as one write on a connected stream socket) without first
+        //          copying them into a single buffer
+        // RETURNS: the number of bytes sent
+        // NOTE:    "destination" must be empty for a connected socket; throws
+        //          Socket::Exceptions::Unspecified on socket errors exactly
+        //          like Socket::sendTo / Socket::send does
+        static size_t sendGathered(
+                                   SocketPtr socket,
+                                   const IPAddress &destination,
+                                   const SendBuffer *buffers,
+                                   size_t totalBuffers,
+                                   bool *outWouldBlock = NULL
+                                   );
+
+      protected:
+        static Log::Params log(const char *message);
+
+        static size_t receiveFromEach(
+                                      SocketPtr socket,
+                                      ReceiveBuffer *buffers,
+                                      size_t totalBuffers,
+                                      bool *outWouldBlock
+                                      );
+
+        static size_t sendToEach(
+                                 SocketPtr socket,
+                                 const IPAddress &destination,
+                                 const SendBuffer *buffers,
+                                 size_t totalBuffers,
+                                 bool *outWouldBlock
+                                 );
+
+        static size_t sendToMultiple(
+                                     SocketPtr socket,
+                                     const IPAddress &destination,
+                                     const SendBuffer *buffers,
+                                     size_t totalBuffers,
+                                     bool *outWouldBlock
+                                     );
+
+        static size_t sendSegmented(
+                                    SocketPtr socket,
+                                    const IPAddress &destination,
+                                    const SendBuffer *buffers,
+                                    size_t totalBuffers,
+                                    bool *outWouldBlock,
+                                    bool &outFailed
+                                    );
+      };
+    }
+  }
+}
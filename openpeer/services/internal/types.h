@@ -115,11 +115,14 @@ namespace openpeer
       ZS_DECLARE_CLASS_PTR(RSAPublicKey)
       ZS_DECLARE_CLASS_PTR(RUDPChannel)
       ZS_DECLARE_CLASS_PTR(RUDPChannelStream)
+      ZS_DECLARE_CLASS_PTR(RUDPDelayBasedCongestionControl)
       ZS_DECLARE_CLASS_PTR(RUDPICESocket)
       ZS_DECLARE_CLASS_PTR(RUDPTransport)
       ZS_DECLARE_CLASS_PTR(RUDPListener)
       ZS_DECLARE_CLASS_PTR(RUDPMessaging)
+      ZS_DECLARE_CLASS_PTR(RUDPTCPLikeCongestionControl)
       ZS_DECLARE_CLASS_PTR(Settings)
+      ZS_DECLARE_CLASS_PTR(SocketEventBackend)
       ZS_DECLARE_CLASS_PTR(STUNDiscovery)
       ZS_DECLARE_CLASS_PTR(STUNRequester)
       ZS_DECLARE_CLASS_PTR(STUNRequesterManager)
@@ -128,12 +131,15 @@ namespace openpeer
       ZS_DECLARE_CLASS_PTR(TURNSocket)
 
       ZS_DECLARE_INTERACTION_PTR(IRUDPChannelStream)
+      ZS_DECLARE_INTERACTION_PTR(IRUDPCongestionControl)
 
+      ZS_DECLARE_INTERACTION_PROXY(IICESocketAsync)
       ZS_DECLARE_INTERACTION_PROXY(IICESocketForICESocketSession)
       ZS_DECLARE_INTERACTION_PROXY(IRUDPChannelDelegateForSessionAndListener)
       ZS_DECLARE_INTERACTION_PROXY(IRUDPChannelStreamDelegate)
       ZS_DECLARE_INTERACTION_PROXY(IRUDPChannelStreamAsync)
       ZS_DECLARE_INTERACTION_PROXY(IRUDPICESocketForRUDPTransport)
+      ZS_DECLARE_INTERACTION_PROXY(ISocketEventBackendAsync)
     }
   }
 }
@@ -0,0 +1,488 @@
+/*
+ 
+ Copyright (c) 2013, SMB Phone Inc.
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ 1. Redistributions of source code must retain the above copyright notice, this
+ list of conditions and the following disclaimer.
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ 
+ The views and conclusions contained in the software and documentation are those
+ of the authors and should not be interpreted as representing official policies,
+ either expressed or implied, of the FreeBSD Project.
+ 
+ */
+
+#include <openpeer/services/STUNPacket.h>
+#include <openpeer/services/RUDPPacket.h>
+#include <openpeer/services/IHelper.h>
+
+#include <zsLib/helpers.h>
+#include <zsLib/Stringize.h>
+
+#include <boost/shared_array.hpp>
+
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <list>
+#include <new>
+
+#include "config.h"
+#include "boost_replacement.h"
+
+using zsLib::BYTE;
+using zsLib::ULONG;
+using zsLib::QWORD;
+using zsLib::String;
+using zsLib::Time;
+using zsLib::IPAddress;
+using openpeer::services::IHelper;
+using openpeer::services::STUNPacket;
+using openpeer::services::STUNPacketPtr;
+using openpeer::services::STUNPacketView;
+using openpeer::services::RUDPPacket;
+using openpeer::services::RUDPPacketPtr;
+using openpeer::services::SecureByteBlock;
+using openpeer::services::SecureByteBlockPtr;
+
+#define OPENPEER_SERVICE_TEST_CODEC_BENCHMARK_DATA_SIZE_IN_BYTES (1000)
+
+#if OPENPEER_SERVICE_TEST_DO_CODEC_BENCHMARK
+
+// Replacing the global allocator is the only way to observe allocations made
+// deep inside the codecs; it is only compiled in when the benchmark is. The
+// count is process wide so threads left running by other tests add noise.
+static ULONG gCodecBenchmarkTotalAllocations = 0;
+
+void *operator new(size_t size)
+{
+  zsLib::atomicIncrement(gCodecBenchmarkTotalAllocations);
+  void *result = malloc(0 == size ? 1 : size);
+  if (!result) throw std::bad_alloc();
+  return result;
+}
+
+void *operator new[](size_t size)
+{
+  zsLib::atomicIncrement(gCodecBenchmarkTotalAllocations);
+  void *result = malloc(0 == size ? 1 : size);
+  if (!result) throw std::bad_alloc();
+  return result;
+}
+
+void operator delete(void *pointer)
+{
+  free(pointer);
+}
+
+void operator delete[](void *pointer)
+{
+  free(pointer);
+}
+
+static ULONG getTotalAllocations()
+{
+  return zsLib::atomicGetValue(gCodecBenchmarkTotalAllocations);
+}
+
+#else
+
+static ULONG getTotalAllocations()
+{
+  return 0;
+}
+
+#endif //OPENPEER_SERVICE_TEST_DO_CODEC_BENCHMARK
+
+namespace openpeer
+{
+  namespace services
+  {
+    namespace test
+    {
+      //-----------------------------------------------------------------------
+      struct CodecCorpusEntry
+      {
+        const char *mName;
+        STUNPacket::RFCs mRFC;       // used when packetizing; parsing always allows all RFCs as received packets do
+        const char *mPassword;       // set if the message integrity is checked when parsed
+        SecureByteBlockPtr mPacket;
+        STUNPacketPtr mSTUN;
+        RUDPPacketPtr mRUDP;
+      };
+
+      //-----------------------------------------------------------------------
+      class CodecBenchmark
+      {
+      public:
+        //---------------------------------------------------------------------
+        CodecBenchmark() :
+          mIterations(OPENPEER_SERVICE_TEST_CODEC_BENCHMARK_ITERATIONS)
+        {
+          for (size_t loop = 0; loop < sizeof(mData); ++loop) {
+            mData[loop] = static_cast<BYTE>(loop * 7);
+          }
+        }
+
+        //---------------------------------------------------------------------
+        void buildCorpus()
+        {
+          IPAddress peer("192.168.1.17:5000");
+
+          // ICE connectivity check (short term credentials with fingerprint)
+          {
+            STUNPacketPtr stun = STUNPacket::createRequest(STUNPacket::Method_Binding);
+            stun->mUsername = "a8Fq2wZk:Pp73Lmx0";
+            stun->mPassword = "Ma81nBzq0plXc2Wv7rT4yUe9";
+            stun->mCredentialMechanism = STUNPacket::CredentialMechanisms_ShortTerm;
+            stun->mPriorityIncluded = true;
+            stun->mPriority = 1853824767;
+            stun->mIceControllingIncluded = true;
+            stun->mIceControlling = 0x1122334455667788ULL;
+            stun->mUseCandidateIncluded = true;
+            stun->mFingerprintIncluded = true;
+            add("ice-binding-request", stun, STUNPacket::RFC_5245_ICE, "Ma81nBzq0plXc2Wv7rT4yUe9");
+
+            STUNPacketPtr response = STUNPacket::createResponse(stun);
+            response->mMappedAddress = peer;
+            response->mPassword = "Ma81nBzq0plXc2Wv7rT4yUe9";
+            response->mCredentialMechanism = STUNPacket::CredentialMechanisms_ShortTerm;
+            response->mFingerprintIncluded = true;
+            add("ice-binding-response", response, STUNPacket::RFC_5245_ICE, "Ma81nBzq0plXc2Wv7rT4yUe9");
+          }
+
+          // TURN data relayed in both directions
+          {
+            STUNPacketPtr send = STUNPacket::createIndication(STUNPacket::Method_Send, NULL);
+            send->mPeerAddressList.push_back(peer);
+            send->mData = &(mData[0]);
+            send->mDataLength = OPENPEER_SERVICE_TEST_CODEC_BENCHMARK_DATA_SIZE_IN_BYTES;
+            add("turn-send-indication", send, STUNPacket::RFC_5766_TURN, NULL);
+
+            STUNPacketPtr data = STUNPacket::createIndication(STUNPacket::Method_Data, NULL);
+            data->mPeerAddressList.push_back(peer);
+            data->mData = &(mData[0]);
+            data->mDataLength = OPENPEER_SERVICE_TEST_CODEC_BENCHMARK_DATA_SIZE_IN_BYTES;
+            add("turn-data-indication", data, STUNPacket::RFC_5766_TURN, NULL);
+          }
+
+          // RUDP data carrying an ACK vector with a few losses
+          {
+            RUDPPacketPtr rudp = RUDPPacket::create();
+            rudp->mChannelNumber = RUDPPacket::LegalChannelNumber_StartRange + 1;
+            rudp->setSequenceNumber(0x12345);
+            rudp->setGSN(0x10080, 0x10010);
+            rudp->setFlag(RUDPPacket::Flag_PS_ParitySending);
+
+            RUDPPacket::VectorEncoderState state;
+            rudp->vectorEncoderStart(state, 0x10080, 0x10010, false);
+            for (QWORD sequenceNumber = 0x10011; sequenceNumber < 0x10080; ++sequenceNumber) {
+              RUDPPacket::VectorStates vectorState = (0 == (sequenceNumber % 13) ? RUDPPacket::VectorState_NotReceived : RUDPPacket::VectorState_Received);
+              if (!RUDPPacket::vectorEncoderAdd(state, vectorState, 0 != (sequenceNumber % 3))) break;
+            }
+            rudp->vectorEncoderFinalize(state);
+
+            rudp->mData = &(mData[0]);
+            rudp->mDataLength = OPENPEER_SERVICE_TEST_CODEC_BENCHMARK_DATA_SIZE_IN_BYTES;
+            add("rudp-data-with-ack-vector", rudp);
+          }
+
+          // RUDP external ACK sent as a STUN indication
+          {
+            BYTE vector[64];
+            bool vpFlag = false;
+            size_t vectorLengthInBytes = 0;
+
+            RUDPPacket::VectorEncoderState state;
+            RUDPPacket::vectorEncoderStart(state, 0x2040, 0x2000, false, &(vector[0]), sizeof(vector));
+            for (QWORD sequenceNumber = 0x2001; sequenceNumber < 0x2040; ++sequenceNumber) {
+              RUDPPacket::VectorStates vectorState = (0 == (sequenceNumber % 9) ? RUDPPacket::VectorState_NotReceived : RUDPPacket::VectorState_Received);
+              if (!RUDPPacket::vectorEncoderAdd(state, vectorState, 0 != (sequenceNumber % 2))) break;
+            }
+            RUDPPacket::vectorEncoderFinalize(state, vpFlag, vectorLengthInBytes);
+
+            STUNPacketPtr ack = STUNPacket::createIndication(STUNPacket::Method_ReliableChannelACK, NULL);
+            ack->mChannelNumber = RUDPPacket::LegalChannelNumber_StartRange + 1;
+            ack->mNextSequenceNumber = 0x3000;
+            ack->mGSNR = 0x2040;
+            ack->mGSNFR = 0x2000;
+            ack->mReliabilityFlagsIncluded = true;
+            ack->mReliabilityFlags = (vpFlag ? RUDPPacket::Flag_VP_VectorParity : 0);
+            if (0 != vectorLengthInBytes) {
+              ack->mACKVector = boost::shared_array<BYTE>(new BYTE[vectorLengthInBytes]);
+              memcpy(ack->mACKVector.get(), &(vector[0]), vectorLengthInBytes);
+              ack->mACKVectorLength = vectorLengthInBytes;
+            }
+            add("rudp-ack-indication", ack, STUNPacket::RFC_draft_RUDP, NULL);
+          }
+        }
+
+        //---------------------------------------------------------------------
+        void writeCorpus(const char *path)
+        {
+          if (!path) return;
+          if ('\0' == *path) return;
+
+          for (CorpusList::iterator iter = mCorpus.begin(); iter != mCorpus.end(); ++iter) {
+            CodecCorpusEntry &entry = (*iter);
+            String fileName = String(path) + "/" + entry.mName + ".bin";
+
+            std::ofstream file(fileName.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+            if (!file.is_open()) {
+              BOOST_STDOUT() << "CORPUS:       unable to write " << fileName.c_str() << "\n";
+              continue;
+            }
+            file.write(reinterpret_cast<const char *>(entry.mPacket->BytePtr()), entry.mPacket->SizeInBytes());
+          }
+        }
+
+        //---------------------------------------------------------------------
+        void run()
+        {
+          for (CorpusList::iterator iter = mCorpus.begin(); iter != mCorpus.end(); ++iter) {
+            CodecCorpusEntry &entry = (*iter);
+            if (entry.mSTUN) {
+              runSTUN(entry);
+            } else {
+              runRUDP(entry);
+            }
+          }
+
+          runVectorCodec();
+        }
+
+      protected:
+        typedef std::list<CodecCorpusEntry> CorpusList;
+
+        //---------------------------------------------------------------------
+        void add(
+                 const char *name,
+                 STUNPacketPtr stun,
+                 STUNPacket::RFCs rfc,
+                 const char *password
+                 )
+        {
+          CodecCorpusEntry entry;
+          entry.mName = name;
+          entry.mRFC = rfc;
+          entry.mPassword = password;
+          entry.mSTUN = stun;
+          entry.mPacket = stun->packetize(rfc);
+          mCorpus.push_back(entry);
+        }
+
+        //---------------------------------------------------------------------
+        void add(
+                 const char *name,
+                 RUDPPacketPtr rudp
+                 )
+        {
+          CodecCorpusEntry entry;
+          entry.mName = name;
+          entry.mRFC = STUNPacket::RFC_draft_RUDP;
+          entry.mPassword = NULL;
+          entry.mRUDP = rudp;
+          entry.mPacket = rudp->packetize();
+          mCorpus.push_back(entry);
+        }
+
+        //---------------------------------------------------------------------
+        void report(
+                    const char *name,
+                    const char *operation,
+                    Time start,
+                    ULONG startAllocations
+                    )
+        {
+          Time end = zsLib::now();
+          ULONG totalAllocations = getTotalAllocations() - startAllocations;
+
+          double nsPerPacket = (static_cast<double>((end - start).total_microseconds()) * 1000.0) / static_cast<double>(mIterations);
+          double allocationsPerPacket = static_cast<double>(totalAllocations) / static_cast<double>(mIterations);
+
+          BOOST_STDOUT() << "BENCHMARK:    " << name << " " << operation << " ns/packet=" << nsPerPacket << " allocations/packet=" << allocationsPerPacket << "\n";
+        }
+
+        //---------------------------------------------------------------------
+        void runSTUN(CodecCorpusEntry &entry)
+        {
+          const BYTE *packet = entry.mPacket->BytePtr();
+          size_t packetLengthInBytes = entry.mPacket->SizeInBytes();
+
+          // sanity check the corpus decodes before timing anything
+          {
+            STUNPacketPtr stun = STUNPacket::parseIfSTUN(packet, packetLengthInBytes, STUNPacket::RFC_AllowAll, false);
+            BOOST_CHECK((bool)stun)
+            if (!stun) return;
+            if (entry.mPassword) {
+              BOOST_CHECK(stun->isValidMessageIntegrity(entry.mPassword))
+            }
+          }
+
+          {
+            ULONG allocations = getTotalAllocations();
+            Time start = zsLib::now();
+            for (ULONG loop = 0; loop < mIterations; ++loop) {
+              STUNPacketPtr stun = STUNPacket::parseIfSTUN(packet, packetLengthInBytes, STUNPacket::RFC_AllowAll, false);
+            }
+            report(entry.mName, "parseIfSTUN", start, allocations);
+          }
+
+          {
+            ULONG allocations = getTotalAllocations();
+            Time start = zsLib::now();
+            for (ULONG loop = 0; loop < mIterations; ++loop) {
+              STUNPacketView view;
+              STUNPacketView::parse(view, packet, packetLengthInBytes, STUNPacket::RFC_AllowAll, false);
+            }
+            report(entry.mName, "STUNPacketView::parse", start, allocations);
+          }
+
+          if (entry.mPassword) {
+            STUNPacketView view;
+            STUNPacketView::parse(view, packet, packetLengthInBytes, STUNPacket::RFC_AllowAll, false);
+
+            ULONG allocations = getTotalAllocations();
+            Time start = zsLib::now();
+            for (ULONG loop = 0; loop < mIterations; ++loop) {
+              view.isValidMessageIntegrity(entry.mPassword);
+            }
+            report(entry.mName, "isValidMessageIntegrity", start, allocations);
+          }
+
+          {
+            ULONG allocations = getTotalAllocations();
+            Time start = zsLib::now();
+            for (ULONG loop = 0; loop < mIterations; ++loop) {
+              SecureByteBlockPtr result = entry.mSTUN->packetize(entry.mRFC);
+            }
+            report(entry.mName, "packetize", start, allocations);
+          }
+
+          {
+            SecureByteBlock buffer(entry.mSTUN->getPacketizedLength(entry.mRFC));
+
+            ULONG allocations = getTotalAllocations();
+            Time start = zsLib::now();
+            for (ULONG loop = 0; loop < mIterations; ++loop) {
+              entry.mSTUN->packetizeInto(buffer.BytePtr(), buffer.SizeInBytes(), entry.mRFC);
+            }
+            report(entry.mName, "packetizeInto", start, allocations);
+          }
+        }
+
+        //---------------------------------------------------------------------
+        void runRUDP(CodecCorpusEntry &entry)
+        {
+          const BYTE *packet = entry.mPacket->BytePtr();
+          size_t packetLengthInBytes = entry.mPacket->SizeInBytes();
+
+          {
+            RUDPPacketPtr rudp = RUDPPacket::parseIfRUDP(packet, packetLengthInBytes);
+            BOOST_CHECK((bool)rudp)
+            if (!rudp) return;
+          }
+
+          {
+            ULONG allocations = getTotalAllocations();
+            Time start = zsLib::now();
+            for (ULONG loop = 0; loop < mIterations; ++loop) {
+              RUDPPacketPtr rudp = RUDPPacket::parseIfRUDP(packet, packetLengthInBytes);
+            }
+            report(entry.mName, "parseIfRUDP", start, allocations);
+          }
+
+          {
+            ULONG allocations = getTotalAllocations();
+            Time start = zsLib::now();
+            for (ULONG loop = 0; loop < mIterations; ++loop) {
+              SecureByteBlockPtr result = entry.mRUDP->packetize();
+            }
+            report(entry.mName, "packetize", start, allocations);
+          }
+        }
+
+        //---------------------------------------------------------------------
+        void runVectorCodec()
+        {
+          BYTE vector[128];
+          size_t vectorLengthInBytes = 0;
+
+          {
+            ULONG allocations = getTotalAllocations();
+            Time start = zsLib::now();
+            for (ULONG loop = 0; loop < mIterations; ++loop) {
+              bool vpFlag = false;
+
+              RUDPPacket::VectorEncoderState state;
+              RUDPPacket::vectorEncoderStart(state, 0x5400, 0x5000, false, &(vector[0]), sizeof(vector));
+              for (QWORD sequenceNumber = 0x5001; sequenceNumber < 0x5400; ++sequenceNumber) {
+                RUDPPacket::VectorStates vectorState = (0 == (sequenceNumber % 17) ? RUDPPacket::VectorState_NotReceived : RUDPPacket::VectorState_Received);
+                if (!RUDPPacket::vectorEncoderAdd(state, vectorState, 0 != (sequenceNumber % 5))) break;
+              }
+              RUDPPacket::vectorEncoderFinalize(state, vpFlag, vectorLengthInBytes);
+            }
+            report("ack-vector", "vectorEncoder", start, allocations);
+          }
+
+          BOOST_CHECK(0 != vectorLengthInBytes)
+
+          {
+            ULONG totalStates = 0;
+
+            ULONG allocations = getTotalAllocations();
+            Time start = zsLib::now();
+            for (ULONG loop = 0; loop < mIterations; ++loop) {
+              RUDPPacket::VectorDecoderState state;
+              RUDPPacket::vectorDecoderStart(state, &(vector[0]), vectorLengthInBytes, 0x5400, 0x5000);
+              while (RUDPPacket::VectorState_NoMoreData != RUDPPacket::vectorDecoderGetNextPacketState(state)) {
+                ++totalStates;
+              }
+            }
+            report("ack-vector", "vectorDecoder", start, allocations);
+
+            BOOST_CHECK(0 != totalStates)
+          }
+        }
+
+      protected:
+        ULONG mIterations;
+        BYTE mData[OPENPEER_SERVICE_TEST_CODEC_BENCHMARK_DATA_SIZE_IN_BYTES];
+        CorpusList mCorpus;
+      };
+    }
+  }
+}
+
+using openpeer::services::test::CodecBenchmark;
+
+void doTestCodecBenchmark()
+{
+  if (!OPENPEER_SERVICE_TEST_DO_CODEC_BENCHMARK) return;
+
+  // logging is deliberately not installed as it would dominate the timings
+  {
+    CodecBenchmark benchmark;
+    benchmark.buildCorpus();
+    benchmark.writeCorpus(OPENPEER_SERVICE_TEST_CODEC_CORPUS_PATH);
+    benchmark.run();
+  }
+}
@@ -0,0 +1,1291 @@
+/*
+ 
+ Copyright (c) 2013, SMB Phone Inc.
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+ 
+ 1. Redistributions of source code must retain the above copyright notice, this
+ list of conditions and the following disclaimer.
+ 2. Redistributions in binary form must reproduce the above copyright notice,
+ this list of conditions and the following disclaimer in the documentation
+ and/or other materials provided with the distribution.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ 
+ The views and conclusions contained in the software and documentation are those
+ of the authors and should not be interpreted as representing official policies,
+ either expressed or implied, of the FreeBSD Project.
+ 
+ */
+
+
+#include <zsLib/MessageQueueThread.h>
+#include <zsLib/Exception.h>
+#include <zsLib/Socket.h>
+#include <zsLib/helpers.h>
+#include <openpeer/services/ITURNSocket.h>
+#include <openpeer/services/ISettings.h>
+#include <openpeer/services/STUNPacket.h>
+#include <openpeer/services/internal/services_TURNSocket.h>
+#include <openpeer/services/internal/services_UDPBatch.h>
+
+#include "config.h"
+#include "boost_replacement.h"
+
+#include <ctime>
+#include <list>
+#include <map>
+#include <vector>
+#include <iostream>
+
+using zsLib::BYTE;
+using zsLib::WORD;
+using zsLib::DWORD;
+using zsLib::ULONG;
+using zsLib::Time;
+using zsLib::Duration;
+using zsLib::Seconds;
+using zsLib::Milliseconds;
+using zsLib::IMessageQueue;
+using zsLib::MessageQueueThread;
+using zsLib::MessageQueueThreadPtr;
+using openpeer::services::ISettings;
+
+#define OPENPEER_SERVICE_TEST_TURN_LOOPBACK_REALM "loopback"
+#define OPENPEER_SERVICE_TEST_TURN_LOOPBACK_NONCE "a3f1c9e07b2d4e58"
+
+#define OPENPEER_SERVICE_TEST_TURN_LOOPBACK_MAX_PACKET_IN_BYTES (2048)
+#define OPENPEER_SERVICE_TEST_TURN_LOOPBACK_MAX_STREAM_FRAME_IN_BYTES (OPENPEER_SERVICES_TURN_MAX_CHANNEL_DATA_IN_BYTES + sizeof(DWORD))
+#define OPENPEER_SERVICE_TEST_TURN_LOOPBACK_CHANNEL_START (0x4000)
+#define OPENPEER_SERVICE_TEST_TURN_LOOPBACK_CHANNEL_END (0x7FFF)
+#define OPENPEER_SERVICE_TEST_TURN_LOOPBACK_DEFAULT_LIFETIME_IN_SECONDS (600)
+
+namespace openpeer
+{
+  namespace services
+  {
+    namespace test
+    {
+      static const char *gLoopbackUsername = OPENPEER_SERVICE_TEST_TURN_USERNAME;
+      static const char *gLoopbackPassword = OPENPEER_SERVICE_TEST_TURN_PASSWORD;
+
+      class LoopbackTURNServer;
+      typedef boost::shared_ptr<LoopbackTURNServer> LoopbackTURNServerPtr;
+      typedef boost::weak_ptr<LoopbackTURNServer> LoopbackTURNServerWeakPtr;
+
+      class TestTURNLoopbackClient;
+      typedef boost::shared_ptr<TestTURNLoopbackClient> TestTURNLoopbackClientPtr;
+      typedef boost::weak_ptr<TestTURNLoopbackClient> TestTURNLoopbackClientWeakPtr;
+
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      #pragma mark
+      #pragma mark LoopbackTURNServer
+      #pragma mark
+
+      // A minimal in-process RFC 5766 TURN server (UDP and TCP transports,
+      // long term credentials, permissions and channels) so TURNSocket can be
+      // measured without a real server. It also hosts an echo peer which
+      // bounces every datagram back to the relayed address it came from.
+      //
+      // Being a stand-in it never expires allocations, permissions or
+      // channels and drops writes to a TCP client which would block.
+      class LoopbackTURNServer : public zsLib::MessageQueueAssociator,
+                                 public zsLib::ISocketDelegate
+      {
+      public:
+        typedef zsLib::IPAddress IPAddress;
+        typedef zsLib::Socket Socket;
+        typedef zsLib::SocketPtr SocketPtr;
+        typedef zsLib::IMessageQueuePtr IMessageQueuePtr;
+        typedef zsLib::AutoRecursiveLock AutoRecursiveLock;
+        typedef zsLib::RecursiveLock RecursiveLock;
+        typedef zsLib::String String;
+
+        struct Allocation;
+        typedef boost::shared_ptr<Allocation> AllocationPtr;
+
+        struct Connection;
+        typedef boost::shared_ptr<Connection> ConnectionPtr;
+
+        typedef std::list<IPAddress> IPAddressList;
+        typedef std::pair<WORD, IPAddress> ChannelPair;
+        typedef std::list<ChannelPair> ChannelList;
+
+        struct Allocation
+        {
+          IPAddress mClientIP;
+          SocketPtr mTCPSocket;           // set if the client connected over TCP
+          SocketPtr mRelaySocket;
+          IPAddress mRelayedIP;
+          IPAddressList mPermissions;     // only the address part is compared
+          ChannelList mChannels;
+        };
+
+        struct Connection
+        {
+          SocketPtr mSocket;
+          IPAddress mRemoteIP;
+          BYTE mReadBuffer[OPENPEER_SERVICE_TEST_TURN_LOOPBACK_MAX_STREAM_FRAME_IN_BYTES];
+          size_t mReadBufferFilledSizeInBytes;
+          AllocationPtr mAllocation;
+        };
+
+        typedef std::map<WORD, AllocationPtr> UDPAllocationMap;   // keyed by client port as every client is on the loopback address
+        typedef std::map<SocketPtr, ConnectionPtr> ConnectionMap;
+        typedef std::map<SocketPtr, AllocationPtr> RelayMap;
+
+      private:
+        LoopbackTURNServer(IMessageQueuePtr queue) :
+          zsLib::MessageQueueAssociator(queue),
+          mUsername(gLoopbackUsername),
+          mPassword(gLoopbackPassword),
+          mRealm(OPENPEER_SERVICE_TEST_TURN_LOOPBACK_REALM),
+          mNonce(OPENPEER_SERVICE_TEST_TURN_LOOPBACK_NONCE),
+          mTotalAllocations(0),
+          mTotalRelayedToPeer(0),
+          mTotalRelayedToClient(0),
+          mTotalEchoed(0),
+          mTotalDropped(0)
+        {
+        }
+
+        void init()
+        {
+          AutoRecursiveLock lock(mLock);
+
+          mUDPSocket = createUDPSocket(mUDPIP);
+          mPeerSocket = createUDPSocket(mPeerIP);
+
+          mListenSocket = Socket::createTCP();
+          mListenSocket->setOptionFlag(Socket::SetOptionFlag::NonBlocking, true);
+          mListenSocket->bind(IPAddress::loopbackV4());
+          mListenSocket->listen();
+          mListenSocket->setDelegate(mThisWeak.lock());
+          mTCPIP = mListenSocket->getLocalAddress();
+        }
+
+      public:
+        static LoopbackTURNServerPtr create(IMessageQueuePtr queue)
+        {
+          LoopbackTURNServerPtr pThis(new LoopbackTURNServer(queue));
+          pThis->mThisWeak = pThis;
+          pThis->init();
+          return pThis;
+        }
+
+        ~LoopbackTURNServer()
+        {
+          shutdown();
+        }
+
+        void shutdown()
+        {
+          AutoRecursiveLock lock(mLock);
+          for (RelayMap::iterator iter = mRelays.begin(); iter != mRelays.end(); ++iter) {
+            (*iter).first->close();
+          }
+          for (ConnectionMap::iterator iter = mConnections.begin(); iter != mConnections.end(); ++iter) {
+            (*iter).first->close();
+          }
+          mRelays.clear();
+          mConnections.clear();
+          mUDPAllocations.clear();
+
+          if (mUDPSocket) {mUDPSocket->close(); mUDPSocket.reset();}
+          if (mPeerSocket) {mPeerSocket->close(); mPeerSocket.reset();}
+          if (mListenSocket) {mListenSocket->close(); mListenSocket.reset();}
+        }
+
+        IPAddress getUDPIP() const                  {AutoRecursiveLock lock(mLock); return mUDPIP;}
+        IPAddress getTCPIP() const                  {AutoRecursiveLock lock(mLock); return mTCPIP;}
+        IPAddress getEchoPeerIP() const             {AutoRecursiveLock lock(mLock); return mPeerIP;}
+
+        ULONG getTotalAllocations() const           {AutoRecursiveLock lock(mLock); return mTotalAllocations;}
+        ULONG getTotalRelayed() const               {AutoRecursiveLock lock(mLock); return mTotalRelayedToPeer + mTotalRelayedToClient;}
+        ULONG getTotalEchoed() const                {AutoRecursiveLock lock(mLock); return mTotalEchoed;}
+        ULONG getTotalDropped() const               {AutoRecursiveLock lock(mLock); return mTotalDropped;}
+
+        //---------------------------------------------------------------------
+        #pragma mark
+        #pragma mark LoopbackTURNServer => ISocketDelegate
+        #pragma mark
+
+        virtual void onReadReady(SocketPtr socket)
+        {
+          AutoRecursiveLock lock(mLock);
+
+          if (socket == mListenSocket) {
+            accept();
+            return;
+          }
+
+          if (socket == mUDPSocket) {
+            BYTE buffer[OPENPEER_SERVICE_TEST_TURN_LOOPBACK_MAX_PACKET_IN_BYTES];
+            while (true) {
+              IPAddress from;
+              size_t length = receiveFrom(socket, from, &(buffer[0]), sizeof(buffer));
+              if (0 == length) break;
+              handleClientPacket(from, ConnectionPtr(), &(buffer[0]), length);
+            }
+            return;
+          }
+
+          if (socket == mPeerSocket) {
+            BYTE buffer[OPENPEER_SERVICE_TEST_TURN_LOOPBACK_MAX_PACKET_IN_BYTES];
+            while (true) {
+              IPAddress from;
+              size_t length = receiveFrom(socket, from, &(buffer[0]), sizeof(buffer));
+              if (0 == length) break;
+
+              bool wouldBlock = false;
+              mPeerSocket->sendTo(from, &(buffer[0]), length, &wouldBlock);
+              if (wouldBlock) {
+                ++mTotalDropped;
+                continue;
+              }
+              ++mTotalEchoed;
+            }
+            return;
+          }
+
+          ConnectionMap::iterator foundConnection = mConnections.find(socket);
+          if (foundConnection != mConnections.end()) {
+            readConnection((*foundConnection).second);
+            return;
+          }
+
+          RelayMap::iterator foundRelay = mRelays.find(socket);
+          if (foundRelay != mRelays.end()) {
+            AllocationPtr allocation = (*foundRelay).second;
+            BYTE buffer[OPENPEER_SERVICE_TEST_TURN_LOOPBACK_MAX_PACKET_IN_BYTES];
+            while (true) {
+              IPAddress from;
+              size_t length = receiveFrom(socket, from, &(buffer[0]), sizeof(buffer));
+              if (0 == length) break;
+              handlePeerPacket(allocation, from, &(buffer[0]), length);
+            }
+            return;
+          }
+        }
+
+        virtual void onWriteReady(SocketPtr socket)
+        {
+        }
+
+        virtual void onException(SocketPtr socket)
+        {
+          AutoRecursiveLock lock(mLock);
+          closeConnection(socket);
+        }
+
+      protected:
+        //---------------------------------------------------------------------
+        #pragma mark
+        #pragma mark LoopbackTURNServer => (internal)
+        #pragma mark
+
+        //---------------------------------------------------------------------
+        SocketPtr createUDPSocket(IPAddress &outLocalIP)
+        {
+          SocketPtr socket = Socket::createUDP();
+          socket->bind(IPAddress::loopbackV4());
+          socket->setBlocking(false);
+          socket->setDelegate(mThisWeak.lock());
+          outLocalIP = socket->getLocalAddress();
+          return socket;
+        }
+
+        //---------------------------------------------------------------------
+        static size_t receiveFrom(
+                                  SocketPtr socket,
+                                  IPAddress &outFrom,
+                                  BYTE *buffer,
+                                  size_t bufferLengthInBytes
+                                  )
+        {
+          bool wouldBlock = false;
+          try {
+            return socket->receiveFrom(outFrom, buffer, bufferLengthInBytes, &wouldBlock);
+          } catch (Socket::Exceptions::Unspecified &) {
+          }
+          return 0;
+        }
+
+        //---------------------------------------------------------------------
+        void accept()
+        {
+          while (true) {
+            ConnectionPtr connection(new Connection);
+            connection->mReadBufferFilledSizeInBytes = 0;
+
+            int noThrowError = 0;
+            connection->mSocket = mListenSocket->accept(connection->mRemoteIP, &noThrowError);
+            if (!connection->mSocket) return;
+
+            connection->mSocket->setOptionFlag(Socket::SetOptionFlag::NonBlocking, true);
+            connection->mSocket->setDelegate(mThisWeak.lock());
+            mConnections[connection->mSocket] = connection;
+          }
+        }
+
+        //---------------------------------------------------------------------
+        void closeConnection(SocketPtr socket)
+        {
+          ConnectionMap::iterator found = mConnections.find(socket);
+          if (found == mConnections.end()) return;
+
+          // closing the TCP connection releases its allocation
+          ConnectionPtr connection = (*found).second;
+          if (connection->mAllocation) {
+            releaseAllocation(connection->mAllocation);
+          }
+
+          mConnections.erase(found);
+          socket->close();
+        }
+
+        //---------------------------------------------------------------------
+        void readConnection(ConnectionPtr connection)
+        {
+          while (true) {
+            size_t available = sizeof(connection->mReadBuffer) - connection->mReadBufferFilledSizeInBytes;
+
+            bool wouldBlock = false;
+            size_t length = 0;
+            try {
+              length = connection->mSocket->receive(&(connection->mReadBuffer[connection->mReadBufferFilledSizeInBytes]), available, &wouldBlock);
+            } catch (Socket::Exceptions::Unspecified &) {
+              closeConnection(connection->mSocket);
+              return;
+            }
+
+            if (0 == length) {
+              if (!wouldBlock) closeConnection(connection->mSocket);
+              return;
+            }
+
+            connection->mReadBufferFilledSizeInBytes += length;
+
+            size_t consumed = 0;
+            while (true) {
+              const BYTE *frame = &(connection->mReadBuffer[consumed]);
+              size_t remaining = connection->mReadBufferFilledSizeInBytes - consumed;
+              if (remaining < sizeof(DWORD)) break;
+
+              if (0x40 == (frame[0] & 0xC0)) {
+                // channel data is padded to a DWORD boundary over TCP
+                size_t dataLength = ntohs(((WORD *)frame)[1]);
+                size_t frameLength = sizeof(DWORD) + ((dataLength + sizeof(DWORD) - 1) & ~(sizeof(DWORD) - 1));
+                if (remaining < frameLength) break;
+
+                handleClientPacket(connection->mRemoteIP, connection, frame, sizeof(DWORD) + dataLength);
+                consumed += frameLength;
+                continue;
+              }
+
+              STUNPacketPtr stun;
+              size_t frameLength = 0;
+              STUNPacket::ParseLookAheadStates state = STUNPacket::parseStreamIfSTUN(stun, frameLength, frame, remaining, STUNPacket::RFC_5766_TURN);
+              if (STUNPacket::ParseLookAheadState_NotSTUN == state) {
+                closeConnection(connection->mSocket);   // the stream can no longer be framed
+                return;
+              }
+              if (0 == frameLength) break;
+
+              if (stun) {
+                handleSTUN(connection->mRemoteIP, connection, stun);   // the packet points into the read buffer so it is handled before being consumed
+              }
+              consumed += frameLength;
+            }
+
+            if (0 != consumed) {
+              memmove(&(connection->mReadBuffer[0]), &(connection->mReadBuffer[consumed]), connection->mReadBufferFilledSizeInBytes - consumed);
+              connection->mReadBufferFilledSizeInBytes -= consumed;
+            }
+          }
+        }
+
+        //---------------------------------------------------------------------
+        void sendToClient(
+                          const IPAddress &clientIP,
+                          ConnectionPtr connection,
+                          const BYTE *buffer,
+                          size_t bufferLengthInBytes
+                          )
+        {
+          bool wouldBlock = false;
+          size_t sent = 0;
+          try {
+            if (connection) {
+              sent = connection->mSocket->send(buffer, bufferLengthInBytes, &wouldBlock);
+            } else {
+              sent = mUDPSocket->sendTo(clientIP, buffer, bufferLengthInBytes, &wouldBlock);
+            }
+          } catch (Socket::Exceptions::Unspecified &) {
+          }
+
+          if (sent != bufferLengthInBytes) {
+            // a partially written TCP frame breaks the stream framing so the client will notice
+            ++mTotalDropped;
+          }
+        }
+
+        //---------------------------------------------------------------------
+        void sendSTUN(
+                      const IPAddress &clientIP,
+                      ConnectionPtr connection,
+                      STUNPacketPtr stun
+                      )
+        {
+          SecureByteBlockPtr packet = stun->packetize(STUNPacket::RFC_5766_TURN);
+          sendToClient(clientIP, connection, packet->BytePtr(), packet->SizeInBytes());
+        }
+
+        //---------------------------------------------------------------------
+        void sendError(
+                       const IPAddress &clientIP,
+                       ConnectionPtr connection,
+                       STUNPacketPtr request,
+                       WORD errorCode
+                       )
+        {
+          request->mErrorCode = errorCode;
+          STUNPacketPtr response = STUNPacket::createErrorResponse(request, NULL);
+          response->mRealm = mRealm;
+          response->mNonce = mNonce;
+          sendSTUN(clientIP, connection, response);
+        }
+
+        //---------------------------------------------------------------------
+        STUNPacketPtr createSuccessResponse(STUNPacketPtr request)
+        {
+          STUNPacketPtr response = STUNPacket::createResponse(request, NULL);
+          response->mUsername = mUsername;
+          response->mPassword = mPassword;
+          response->mRealm = mRealm;
+          response->mCredentialMechanism = STUNPacket::CredentialMechanisms_LongTerm;
+          return response;
+        }
+
+        //---------------------------------------------------------------------
+        AllocationPtr findAllocation(
+                                     const IPAddress &clientIP,
+                                     ConnectionPtr connection
+                                     )
+        {
+          if (connection) return connection->mAllocation;
+
+          UDPAllocationMap::iterator found = mUDPAllocations.find(clientIP.getPort());
+          if (found == mUDPAllocations.end()) return AllocationPtr();
+          return (*found).second;
+        }
+
+        //---------------------------------------------------------------------
+        void releaseAllocation(AllocationPtr allocation)
+        {
+          if (!allocation->mTCPSocket) {
+            mUDPAllocations.erase(allocation->mClientIP.getPort());
+          }
+          mRelays.erase(allocation->mRelaySocket);
+          allocation->mRelaySocket->close();
+        }
+
+        //---------------------------------------------------------------------
+        static bool hasPermission(
+                                  AllocationPtr allocation,
+                                  const IPAddress &peer
+                                  )
+        {
+          for (IPAddressList::iterator iter = allocation->mPermissions.begin(); iter != allocation->mPermissions.end(); ++iter) {
+            if ((*iter).isAddressEqual(peer)) return true;
+          }
+          return false;
+        }
+
+        //---------------------------------------------------------------------
+        static void addPermission(
+                                  AllocationPtr allocation,
+                                  const IPAddress &peer
+                                  )
+        {
+          if (hasPermission(allocation, peer)) return;
+          allocation->mPermissions.push_back(peer);
+        }
+
+        //---------------------------------------------------------------------
+        void handleClientPacket(
+                                const IPAddress &clientIP,
+                                ConnectionPtr connection,
+                                const BYTE *buffer,
+                                size_t bufferLengthInBytes
+                                )
+        {
+          if ((bufferLengthInBytes >= sizeof(DWORD)) &&
+              (0x40 == (buffer[0] & 0xC0))) {
+            WORD channel = ntohs(((WORD *)buffer)[0]);
+            size_t dataLength = ntohs(((WORD *)buffer)[1]);
+            if (dataLength > bufferLengthInBytes - sizeof(DWORD)) return;
+
+            AllocationPtr allocation = findAllocation(clientIP, connection);
+            if (!allocation) return;
+
+            for (ChannelList::iterator iter = allocation->mChannels.begin(); iter != allocation->mChannels.end(); ++iter) {
+              if (channel != (*iter).first) continue;
+              relayToPeer(allocation, (*iter).second, buffer + sizeof(DWORD), dataLength);
+              return;
+            }
+            return;
+          }
+
+          STUNPacketPtr stun = STUNPacket::parseIfSTUN(buffer, bufferLengthInBytes, static_cast<STUNPacket::RFCs>(STUNPacket::RFC_5766_TURN | STUNPacket::RFC_5389_STUN), false);
+          if (!stun) return;
+
+          handleSTUN(clientIP, connection, stun);
+        }
+
+        //---------------------------------------------------------------------
+        void relayToPeer(
+                         AllocationPtr allocation,
+                         const IPAddress &peer,
+                         const BYTE *buffer,
+                         size_t bufferLengthInBytes
+                         )
+        {
+          if (!hasPermission(allocation, peer)) return;
+
+          bool wouldBlock = false;
+          try {
+            allocation->mRelaySocket->sendTo(peer, buffer, bufferLengthInBytes, &wouldBlock);
+          } catch (Socket::Exceptions::Unspecified &) {
+            wouldBlock = true;
+          }
+          if (wouldBlock) {
+            ++mTotalDropped;
+            return;
+          }
+          ++mTotalRelayedToPeer;
+        }
+
+        //---------------------------------------------------------------------
+        void handlePeerPacket(
+                              AllocationPtr allocation,
+                              const IPAddress &peer,
+                              BYTE *buffer,
+                              size_t bufferLengthInBytes
+                              )
+        {
+          if (!hasPermission(allocation, peer)) return;
+
+          ConnectionPtr connection;
+          if (allocation->mTCPSocket) {
+            ConnectionMap::iterator found = mConnections.find(allocation->mTCPSocket);
+            if (found == mConnections.end()) return;
+            connection = (*found).second;
+          }
+
+          for (ChannelList::iterator iter = allocation->mChannels.begin(); iter != allocation->mChannels.end(); ++iter) {
+            if (peer != (*iter).second) continue;
+
+            BYTE frame[OPENPEER_SERVICE_TEST_TURN_LOOPBACK_MAX_PACKET_IN_BYTES + sizeof(DWORD)];
+            ((WORD *)(&(frame[0])))[0] = htons((*iter).first);
+            ((WORD *)(&(frame[0])))[1] = htons((WORD)bufferLengthInBytes);
+            memcpy(&(frame[sizeof(DWORD)]), buffer, bufferLengthInBytes);
+
+            size_t frameLength = sizeof(DWORD) + bufferLengthInBytes;
+            if (connection) {
+              size_t padding = ((bufferLengthInBytes + sizeof(DWORD) - 1) & ~(sizeof(DWORD) - 1)) - bufferLengthInBytes;
+              memset(&(frame[frameLength]), 0, padding);
+              frameLength += padding;
+            }
+
+            sendToClient(allocation->mClientIP, connection, &(frame[0]), frameLength);
+            ++mTotalRelayedToClient;
+            return;
+          }
+
+          STUNPacketPtr indication = STUNPacket::createIndication(STUNPacket::Method_Data, NULL);
+          indication->mPeerAddressList.push_back(peer);
+          indication->mData = buffer;
+          indication->mDataLength = bufferLengthInBytes;
+          sendSTUN(allocation->mClientIP, connection, indication);
+          ++mTotalRelayedToClient;
+        }
+
+        //---------------------------------------------------------------------
+        bool authenticate(
+                          const IPAddress &clientIP,
+                          ConnectionPtr connection,
+                          STUNPacketPtr request
+                          )
+        {
+          if ((!request->hasAttribute(STUNPacket::Attribute_MessageIntegrity)) ||
+              (request->mUsername != mUsername) ||
+              (request->mRealm != mRealm)) {
+            sendError(clientIP, connection, request, STUNPacket::ErrorCode_Unauthorized);
+            return false;
+          }
+
+          if (request->mNonce != mNonce) {
+            sendError(clientIP, connection, request, STUNPacket::ErrorCode_StaleNonce);
+            return false;
+          }
+
+          if (!request->isValidMessageIntegrity(mPassword, mUsername, mRealm)) {
+            sendError(clientIP, connection, request, STUNPacket::ErrorCode_Unauthorized);
+            return false;
+          }
+          return true;
+        }
+
+        //---------------------------------------------------------------------
+        void handleSTUN(
+                        const IPAddress &clientIP,
+                        ConnectionPtr connection,
+                        STUNPacketPtr stun
+                        )
+        {
+          AllocationPtr allocation = findAllocation(clientIP, connection);
+
+          if (STUNPacket::Class_Indication == stun->mClass) {
+            if (STUNPacket::Method_Send != stun->mMethod) return;
+            if (!allocation) return;
+            if (stun->mPeerAddressList.size() < 1) return;
+            if (!stun->mData) return;
+
+            relayToPeer(allocation, stun->mPeerAddressList.front(), stun->mData, stun->mDataLength);
+            return;
+          }
+
+          if (STUNPacket::Class_Request != stun->mClass) return;
+
+          if (!authenticate(clientIP, connection, stun)) return;
+
+          switch (stun->mMethod) {
+            case STUNPacket::Method_Allocate: {
+              if (!allocation) {
+                allocation = AllocationPtr(new Allocation);
+                allocation->mClientIP = clientIP;
+                allocation->mRelaySocket = createUDPSocket(allocation->mRelayedIP);
+                mRelays[allocation->mRelaySocket] = allocation;
+
+                if (connection) {
+                  allocation->mTCPSocket = connection->mSocket;
+                  connection->mAllocation = allocation;
+                } else {
+                  mUDPAllocations[clientIP.getPort()] = allocation;
+                }
+                ++mTotalAllocations;
+              }
+
+              // a retransmitted allocate gets the same answer again
+              STUNPacketPtr response = createSuccessResponse(stun);
+              response->mRelayedAddress = allocation->mRelayedIP;
+              response->mMappedAddress = clientIP;
+              response->mLifetimeIncluded = true;
+              response->mLifetime = OPENPEER_SERVICE_TEST_TURN_LOOPBACK_DEFAULT_LIFETIME_IN_SECONDS;
+              sendSTUN(clientIP, connection, response);
+              return;
+            }
+            case STUNPacket::Method_Refresh: {
+              if (!allocation) {
+                sendError(clientIP, connection, stun, STUNPacket::ErrorCode_AllocationMismatch);
+                return;
+              }
+
+              DWORD lifetime = (stun->mLifetimeIncluded ? stun->mLifetime : OPENPEER_SERVICE_TEST_TURN_LOOPBACK_DEFAULT_LIFETIME_IN_SECONDS);
+              if (0 == lifetime) {
+                releaseAllocation(allocation);
+                if (connection) connection->mAllocation.reset();
+              }
+
+              STUNPacketPtr response = createSuccessResponse(stun);
+              response->mLifetimeIncluded = true;
+              response->mLifetime = lifetime;
+              sendSTUN(clientIP, connection, response);
+              return;
+            }
+            case STUNPacket::Method_CreatePermission: {
+              if ((!allocation) ||
+                  (stun->mPeerAddressList.size() < 1)) {
+                sendError(clientIP, connection, stun, (allocation ? STUNPacket::ErrorCode_BadRequest : STUNPacket::ErrorCode_AllocationMismatch));
+                return;
+              }
+
+              for (STUNPacket::PeerAddressList::iterator iter = stun->mPeerAddressList.begin(); iter != stun->mPeerAddressList.end(); ++iter) {
+                addPermission(allocation, *iter);
+              }
+              sendSTUN(clientIP, connection, createSuccessResponse(stun));
+              return;
+            }
+            case STUNPacket::Method_ChannelBind: {
+              if ((!allocation) ||
+                  (stun->mPeerAddressList.size() < 1) ||
+                  (stun->mChannelNumber < OPENPEER_SERVICE_TEST_TURN_LOOPBACK_CHANNEL_START) ||
+                  (stun->mChannelNumber > OPENPEER_SERVICE_TEST_TURN_LOOPBACK_CHANNEL_END)) {
+                sendError(clientIP, connection, stun, (allocation ? STUNPacket::ErrorCode_BadRequest : STUNPacket::ErrorCode_AllocationMismatch));
+                return;
+              }
+
+              IPAddress peer = stun->mPeerAddressList.front();
+
+              bool found = false;
+              for (ChannelList::iterator iter = allocation->mChannels.begin(); iter != allocation->mChannels.end(); ++iter) {
+                if ((stun->mChannelNumber != (*iter).first) &&
+                    (peer != (*iter).second)) continue;
+
+                if ((stun->mChannelNumber != (*iter).first) ||
+                    (peer != (*iter).second)) {
+                  // the channel or the peer is already bound to something else
+                  sendError(clientIP, connection, stun, STUNPacket::ErrorCode_BadRequest);
+                  return;
+                }
+                found = true;   // a refresh of an existing binding
+              }
+
+              if (!found) {
+                allocation->mChannels.push_back(ChannelPair(stun->mChannelNumber, peer));
+              }
+              addPermission(allocation, peer);
+
+              sendSTUN(clientIP, connection, createSuccessResponse(stun));
+              return;
+            }
+            default: break;
+          }
+
+          sendError(clientIP, connection, stun, STUNPacket::ErrorCode_BadRequest);
+        }
+
+      private:
+        mutable RecursiveLock mLock;
+        LoopbackTURNServerWeakPtr mThisWeak;
+
+        String mUsername;
+        String mPassword;
+        String mRealm;
+        String mNonce;
+
+        SocketPtr mUDPSocket;
+        SocketPtr mListenSocket;
+        SocketPtr mPeerSocket;
+
+        IPAddress mUDPIP;
+        IPAddress mTCPIP;
+        IPAddress mPeerIP;
+
+        UDPAllocationMap mUDPAllocations;
+        ConnectionMap mConnections;
+        RelayMap mRelays;
+
+        ULONG mTotalAllocations;
+        ULONG mTotalRelayedToPeer;
+        ULONG mTotalRelayedToClient;
+        ULONG mTotalEchoed;
+        ULONG mTotalDropped;
+      };
+
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      #pragma mark
+      #pragma mark TestTURNLoopbackClient
+      #pragma mark
+
+      // One TURNSocket allocation driven by the benchmark. Packets are sent
+      // through the relay to the echo peer and counted when they return.
+      class TestTURNLoopbackClient : public zsLib::MessageQueueAssociator,
+                                     public ITURNSocketDelegate,
+                                     public zsLib::ISocketDelegate
+      {
+      public:
+        typedef zsLib::IPAddress IPAddress;
+        typedef zsLib::Socket Socket;
+        typedef zsLib::SocketPtr SocketPtr;
+        typedef zsLib::IMessageQueuePtr IMessageQueuePtr;
+        typedef zsLib::AutoRecursiveLock AutoRecursiveLock;
+        typedef zsLib::RecursiveLock RecursiveLock;
+
+      private:
+        TestTURNLoopbackClient(IMessageQueuePtr queue) :
+          zsLib::MessageQueueAssociator(queue),
+          mFailed(false),
+          mTotalSent(0),
+          mTotalReceived(0),
+          mTotalWrittenOff(0),
+          mTotalSentAtLastWriteOff(0)
+        {
+        }
+
+        void init(
+                  IDNS::SRVResultPtr udpSRV,
+                  IDNS::SRVResultPtr tcpSRV
+                  )
+        {
+          AutoRecursiveLock lock(mLock);
+
+          mSocket = Socket::createUDP();
+          mSocket->bind(IPAddress::loopbackV4());
+          mSocket->setBlocking(false);
+          mSocket->setDelegate(mThisWeak.lock());
+
+          mCreatedAt = zsLib::now();
+          mTURNSocket = ITURNSocket::create(
+                                            getAssociatedMessageQueue(),
+                                            mThisWeak.lock(),
+                                            udpSRV,
+                                            tcpSRV,
+                                            gLoopbackUsername,
+                                            gLoopbackPassword,
+                                            true
+                                            );
+        }
+
+      public:
+        static TestTURNLoopbackClientPtr create(
+                                                IMessageQueuePtr queue,
+                                                IDNS::SRVResultPtr udpSRV,
+                                                IDNS::SRVResultPtr tcpSRV
+                                                )
+        {
+          TestTURNLoopbackClientPtr pThis(new TestTURNLoopbackClient(queue));
+          pThis->mThisWeak = pThis;
+          pThis->init(udpSRV, tcpSRV);
+          return pThis;
+        }
+
+        ~TestTURNLoopbackClient()
+        {
+        }
+
+        //---------------------------------------------------------------------
+        #pragma mark
+        #pragma mark TestTURNLoopbackClient => ITURNSocketDelegate
+        #pragma mark
+
+        virtual void onTURNSocketStateChanged(
+                                              ITURNSocketPtr socket,
+                                              TURNSocketStates state
+                                              )
+        {
+          AutoRecursiveLock lock(mLock);
+          switch (state) {
+            case ITURNSocket::TURNSocketState_Ready: {
+              mReadyAt = zsLib::now();
+              break;
+            }
+            case ITURNSocket::TURNSocketState_Shutdown: {
+              if (Time() == mReadyAt) mFailed = true;
+              mTURNSocket.reset();
+              break;
+            }
+            default: break;
+          }
+        }
+
+        virtual void handleTURNSocketReceivedPacket(
+                                                    ITURNSocketPtr socket,
+                                                    IPAddress source,
+                                                    const BYTE *packet,
+                                                    size_t packetLengthInBytes
+                                                    )
+        {
+          AutoRecursiveLock lock(mLock);
+          ++mTotalReceived;
+        }
+
+        virtual bool notifyTURNSocketSendPacket(
+                                                ITURNSocketPtr socket,
+                                                IPAddress destination,
+                                                const BYTE *packet,
+                                                size_t packetLengthInBytes
+                                                )
+        {
+          AutoRecursiveLock lock(mLock);
+          if (!mSocket) return false;
+
+          bool wouldBlock = false;
+          return 0 != mSocket->sendTo(destination, packet, packetLengthInBytes, &wouldBlock);
+        }
+
+        virtual bool notifyTURNSocketSendPacketParts(
+                                                     ITURNSocketPtr socket,
+                                                     IPAddress destination,
+                                                     const PacketPart *parts,
+                                                     size_t totalParts
+                                                     )
+        {
+          // send the parts with a single gather write so the benchmark
+          // measures the path without the copy into one buffer
+          if (totalParts > OPENPEER_SERVICES_UDPBATCH_MAX_GATHERED_BUFFERS) return false;
+
+          internal::UDPBatch::SendBuffer buffers[OPENPEER_SERVICES_UDPBATCH_MAX_GATHERED_BUFFERS];
+          for (size_t index = 0; index < totalParts; ++index) {
+            buffers[index].mBuffer = parts[index].mBuffer;
+            buffers[index].mBufferLengthInBytes = parts[index].mBufferLengthInBytes;
+          }
+
+          AutoRecursiveLock lock(mLock);
+          if (!mSocket) return false;
+
+          bool wouldBlock = false;
+          return 0 != internal::UDPBatch::sendGathered(mSocket, destination, &(buffers[0]), totalParts, &wouldBlock);
+        }
+
+        virtual void onTURNSocketWriteReady(ITURNSocketPtr socket)
+        {
+        }
+
+        //---------------------------------------------------------------------
+        #pragma mark
+        #pragma mark TestTURNLoopbackClient => ISocketDelegate
+        #pragma mark
+
+        virtual void onReadReady(SocketPtr socket)
+        {
+          ITURNSocketPtr turnSocket;
+          {
+            AutoRecursiveLock lock(mLock);
+            if (socket != mSocket) return;
+            turnSocket = mTURNSocket;
+          }
+          if (!turnSocket) return;
+
+          BYTE buffer[OPENPEER_SERVICE_TEST_TURN_LOOPBACK_MAX_PACKET_IN_BYTES];
+          while (true) {
+            IPAddress ip;
+            bool wouldBlock = false;
+            size_t readBytes = 0;
+            try {
+              readBytes = socket->receiveFrom(ip, &(buffer[0]), sizeof(buffer), &wouldBlock);
+            } catch (Socket::Exceptions::Unspecified &) {
+            }
+            if (0 == readBytes) break;
+
+            if (turnSocket->handleChannelData(ip, &(buffer[0]), readBytes)) continue;
+
+            STUNPacketPtr stun = STUNPacket::parseIfSTUN(&(buffer[0]), readBytes, static_cast<STUNPacket::RFCs>(STUNPacket::RFC_5766_TURN | STUNPacket::RFC_5389_STUN), false);
+            if (!stun) continue;
+            turnSocket->handleSTUNPacket(ip, stun);
+          }
+        }
+
+        virtual void onWriteReady(SocketPtr socket)
+        {
+        }
+
+        virtual void onException(SocketPtr socket)
+        {
+        }
+
+        //---------------------------------------------------------------------
+        #pragma mark
+        #pragma mark TestTURNLoopbackClient => (benchmark)
+        #pragma mark
+
+        bool isReady() const                        {AutoRecursiveLock lock(mLock); return Time() != mReadyAt;}
+        bool isFailed() const                       {AutoRecursiveLock lock(mLock); return mFailed;}
+        Duration getAllocationLatency() const       {AutoRecursiveLock lock(mLock); return mReadyAt - mCreatedAt;}
+        ULONG getTotalReceived() const              {AutoRecursiveLock lock(mLock); return mTotalReceived;}
+
+        //---------------------------------------------------------------------
+        // PURPOSE: keep up to "window" packets in flight towards the peer
+        void send(
+                  const IPAddress &peer,
+                  const BYTE *packet,
+                  size_t packetLengthInBytes,
+                  ULONG window
+                  )
+        {
+          ITURNSocketPtr turnSocket;
+          ULONG total = 0;
+          {
+            AutoRecursiveLock lock(mLock);
+            if (Time() == mReadyAt) return;
+            turnSocket = mTURNSocket;
+
+            // a written off packet can still arrive late thus never let the
+            // accounted for packets wrap the outstanding count
+            ULONG accounted = mTotalReceived + mTotalWrittenOff;
+            ULONG outstanding = (mTotalSent > accounted ? mTotalSent - accounted : 0);
+            if (outstanding >= window) return;
+            total = window - outstanding;
+            mTotalSent += total;
+          }
+          if (!turnSocket) return;
+
+          for (ULONG loop = 0; loop < total; ++loop) {
+            turnSocket->sendPacket(peer, packet, packetLengthInBytes, true);
+          }
+        }
+
+        //---------------------------------------------------------------------
+        // PURPOSE: forget packets which are no longer expected to return so
+        //          a lost packet does not stall the window forever
+        // NOTE:    only packets sent before the previous call and still
+        //          missing are written off, packets in flight are not
+        void writeOffOutstanding()
+        {
+          AutoRecursiveLock lock(mLock);
+
+          ULONG accounted = mTotalReceived + mTotalWrittenOff;
+          if (mTotalSentAtLastWriteOff > accounted) {
+            mTotalWrittenOff += (mTotalSentAtLastWriteOff - accounted);
+          }
+          mTotalSentAtLastWriteOff = mTotalSent;
+        }
+
+        void shutdown()
+        {
+          ITURNSocketPtr turnSocket;
+          {
+            AutoRecursiveLock lock(mLock);
+            turnSocket = mTURNSocket;
+          }
+          if (turnSocket) turnSocket->shutdown();
+        }
+
+        bool isComplete() const
+        {
+          AutoRecursiveLock lock(mLock);
+          return !mTURNSocket;
+        }
+
+        void close()
+        {
+          AutoRecursiveLock lock(mLock);
+          if (mSocket) {
+            mSocket->close();
+            mSocket.reset();
+          }
+        }
+
+      private:
+        mutable RecursiveLock mLock;
+        TestTURNLoopbackClientWeakPtr mThisWeak;
+
+        SocketPtr mSocket;
+        ITURNSocketPtr mTURNSocket;
+
+        Time mCreatedAt;
+        Time mReadyAt;
+        bool mFailed;
+
+        ULONG mTotalSent;
+        ULONG mTotalReceived;
+        ULONG mTotalWrittenOff;
+        ULONG mTotalSentAtLastWriteOff;
+      };
+
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      //-----------------------------------------------------------------------
+      #pragma mark
+      #pragma mark TURNLoopbackBenchmark
+      #pragma mark
+
+      //-----------------------------------------------------------------------
+      static void runTURNLoopbackBenchmark(
+                                           LoopbackTURNServerPtr server,
+                                           bool useUDP
+                                           )
+      {
+        typedef std::list<TestTURNLoopbackClientPtr> ClientList;
+        typedef std::list<zsLib::IPAddress> IPAddressList;
+
+        const char *name = (useUDP ? "udp" : "tcp");
+
+        ISettings::setBool(OPENPEER_SERVICES_SETTING_FORCE_TURN_TO_USE_UDP, useUDP);
+        ISettings::setBool(OPENPEER_SERVICES_SETTING_FORCE_TURN_TO_USE_TCP, !useUDP);
+
+        IPAddressList udpIPs;
+        udpIPs.push_back(server->getUDPIP());
+        IPAddressList tcpIPs;
+        tcpIPs.push_back(server->getTCPIP());
+
+        IDNS::SRVResultPtr udpSRV = IDNS::convertIPAddressesToSRVResult("turn", "udp", udpIPs);
+        IDNS::SRVResultPtr tcpSRV = IDNS::convertIPAddressesToSRVResult("turn", "tcp", tcpIPs);
+
+        MessageQueueThreadPtr thread(MessageQueueThread::createBasic());
+
+        ULONG startAllocations = server->getTotalAllocations();
+
+        ClientList clients;
+        Time start = zsLib::now();
+        for (ULONG loop = 0; loop < OPENPEER_SERVICE_TEST_TURN_LOOPBACK_BENCHMARK_ALLOCATIONS; ++loop) {
+          clients.push_back(TestTURNLoopbackClient::create(thread, udpSRV, tcpSRV));
+        }
+
+        // scope: wait for every allocation to complete
+        {
+          ULONG totalWait = 0;
+          while (true) {
+            ULONG ready = 0;
+            for (ClientList::iterator iter = clients.begin(); iter != clients.end(); ++iter) {
+              if (((*iter)->isReady()) || ((*iter)->isFailed())) ++ready;
+            }
+            if (ready == clients.size()) break;
+
+            boost::this_thread::sleep(Milliseconds(10));
+            totalWait += 10;
+            if (totalWait > 60*1000) break;
+          }
+        }
+        Time allocated = zsLib::now();
+
+        ULONG totalReady = 0;
+        Duration totalLatency;
+        Duration maxLatency;
+        for (ClientList::iterator iter = clients.begin(); iter != clients.end(); ++iter) {
+          if (!(*iter)->isReady()) continue;
+          ++totalReady;
+          Duration latency = (*iter)->getAllocationLatency();
+          totalLatency += latency;
+          if (latency > maxLatency) maxLatency = latency;
+        }
+
+        BOOST_EQUAL(totalReady, static_cast<ULONG>(clients.size()))
+        BOOST_EQUAL(server->getTotalAllocations() - startAllocations, totalReady)
+
+        double allocationSeconds = static_cast<double>((allocated - start).total_microseconds()) / 1000000.0;
+        double averageLatencyMS = (0 != totalReady ? static_cast<double>(totalLatency.total_microseconds()) / 1000.0 / static_cast<double>(totalReady) : 0.0);
+
+        BOOST_STDOUT() << "BENCHMARK:    turn-loopback " << name << " allocations=" << totalReady << " allocations/s=" << (allocationSeconds > 0.0 ? static_cast<double>(totalReady) / allocationSeconds : 0.0) << " latency avg (ms)=" << averageLatencyMS << " latency max (ms)=" << maxLatency.total_milliseconds() << "\n";
+
+        // scope: relay packets through every allocation to the echo peer and back
+        {
+          IPAddress peer = server->getEchoPeerIP();
+
+          BYTE packet[OPENPEER_SERVICE_TEST_TURN_LOOPBACK_BENCHMARK_PACKET_SIZE_IN_BYTES];
+          for (size_t loop = 0; loop < sizeof(packet); ++loop) {
+            packet[loop] = static_cast<BYTE>(loop);
+          }
+
+          // prime the permissions and channel bindings before timing anything
+          for (ClientList::iterator iter = clients.begin(); iter != clients.end(); ++iter) {
+            (*iter)->send(peer, &(packet[0]), sizeof(packet), 1);
+          }
+          boost::this_thread::sleep(Seconds(2));
+
+          ULONG startReceived = 0;
+          for (ClientList::iterator iter = clients.begin(); iter != clients.end(); ++iter) {
+            (*iter)->writeOffOutstanding();
+            startReceived += (*iter)->getTotalReceived();
+          }
+          ULONG startRelayed = server->getTotalRelayed();
+          ULONG startDropped = server->getTotalDropped();
+
+          std::clock_t startCPU = std::clock();
+          Time relayStart = zsLib::now();
+          Time relayEnd = relayStart + Seconds(OPENPEER_SERVICE_TEST_TURN_LOOPBACK_BENCHMARK_SECONDS);
+          Time nextWriteOff = relayStart + Seconds(1);
+
+          while (zsLib::now() < relayEnd) {
+            for (ClientList::iterator iter = clients.begin(); iter != clients.end(); ++iter) {
+              (*iter)->send(peer, &(packet[0]), sizeof(packet), OPENPEER_SERVICE_TEST_TURN_LOOPBACK_BENCHMARK_WINDOW);
+            }
+
+            if (zsLib::now() > nextWriteOff) {
+              for (ClientList::iterator iter = clients.begin(); iter != clients.end(); ++iter) {
+                (*iter)->writeOffOutstanding();
+              }
+              nextWriteOff = zsLib::now() + Seconds(1);
+            }
+            boost::this_thread::sleep(Milliseconds(1));
+          }
+
+          std::clock_t endCPU = std::clock();
+          Time relayFinished = zsLib::now();
+
+          ULONG totalReceived = 0;
+          for (ClientList::iterator iter = clients.begin(); iter != clients.end(); ++iter) {
+            totalReceived += (*iter)->getTotalReceived();
+          }
+          totalReceived -= startReceived;
+          ULONG totalRelayed = server->getTotalRelayed() - startRelayed;
+          ULONG totalDropped = server->getTotalDropped() - startDropped;
+
+          BOOST_CHECK(0 != totalReceived)
+
+          double relaySeconds = static_cast<double>((relayFinished - relayStart).total_microseconds()) / 1000000.0;
+          double cpuMicroseconds = static_cast<double>(endCPU - startCPU) * 1000000.0 / static_cast<double>(CLOCKS_PER_SEC);
+
+          // the CPU time covers the whole process: the clients, the TURN sockets and the server
+          BOOST_STDOUT() << "BENCHMARK:    turn-loopback " << name
+                         << " packets/s=" << (relaySeconds > 0.0 ? static_cast<double>(totalReceived) / relaySeconds : 0.0)
+                         << " relayed/s=" << (relaySeconds > 0.0 ? static_cast<double>(totalRelayed) / relaySeconds : 0.0)
+                         << " cpu/relayed packet (us)=" << (0 != totalRelayed ? cpuMicroseconds / static_cast<double>(totalRelayed) : 0.0)
+                         << " dropped=" << totalDropped << "\n";
+        }
+
+        for (ClientList::iterator iter = clients.begin(); iter != clients.end(); ++iter) {
+          (*iter)->shutdown();
+        }
+
+        // scope: wait for the graceful shutdowns
+        {
+          ULONG totalWait = 0;
+          while (true) {
+            ULONG complete = 0;
+            for (ClientList::iterator iter = clients.begin(); iter != clients.end(); ++iter) {
+              if ((*iter)->isComplete()) ++complete;
+            }
+            if (complete == clients.size()) break;
+
+            boost::this_thread::sleep(Milliseconds(10));
+            totalWait += 10;
+            if (totalWait > 30*1000) break;
+          }
+        }
+
+        for (ClientList::iterator iter = clients.begin(); iter != clients.end(); ++iter) {
+          BOOST_CHECK((*iter)->isComplete())
+          (*iter)->close();
+        }
+        clients.clear();
+
+        thread->waitForShutdown();
+      }
+    }
+  }
+}
+
+using openpeer::services::test::LoopbackTURNServer;
+using openpeer::services::test::LoopbackTURNServerPtr;
+
+void doTestTURNLoopbackBenchmark()
+{
+  if (!OPENPEER_SERVICE_TEST_DO_TURN_LOOPBACK_BENCHMARK) return;
+
+  // logging is deliberately not installed as it would dominate the timings
+  {
+    MessageQueueThreadPtr serverThread(MessageQueueThread::createBasic());
+    LoopbackTURNServerPtr server = LoopbackTURNServer::create(serverThread);
+
+    openpeer::services::test::runTURNLoopbackBenchmark(server, true);
+    openpeer::services::test::runTURNLoopbackBenchmark(server, false);
+
+    ISettings::setBool(OPENPEER_SERVICES_SETTING_FORCE_TURN_TO_USE_UDP, false);
+    ISettings::setBool(OPENPEER_SERVICES_SETTING_FORCE_TURN_TO_USE_TCP, false);
+
+    server->shutdown();
+    server.reset();
+
+    serverThread->waitForShutdown();
+  }
+}
@@ -48,6 +48,7 @@
 #include "boost_replacement.h"
 
 #include <list>
+#include <vector>
 #include <iostream>
 
 namespace openpeer { namespace services { namespace test { ZS_DECLARE_SUBSYSTEM(openpeer_services_test) } } }
@@ -55,6 +55,8 @@ void doTestRUDPListener();
 void doTestRUDPICESocket();
 void doTestRUDPICESocketLoopback();
 void doTestTCPMessagingLoopback();
+void doTestCodecBenchmark();
+void doTestTURNLoopbackBenchmark();
 
 namespace BoostReplacement
 {
@@ -157,6 +159,8 @@ namespace BoostReplacement
     BOOST_RUN_TEST_FUNC(doTestRUDPListener)
     BOOST_RUN_TEST_FUNC(doTestRUDPICESocket)
     BOOST_RUN_TEST_FUNC(doTestTCPMessagingLoopback)
+    BOOST_RUN_TEST_FUNC(doTestCodecBenchmark)
+    BOOST_RUN_TEST_FUNC(doTestTURNLoopbackBenchmark)
 
     BOOST_UNINSTALL_LOGGER()
   }
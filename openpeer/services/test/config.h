@@ -53,9 +53,21 @@
 #define OPENPEER_SERVICE_TEST_DO_RUDPICESOCKET_LOOPBACK_TEST           (false)
 #define OPENPEER_SERVICE_TEST_DO_RUDPICESOCKET_CLIENT_TO_SERVER_TEST   (false)
 #define OPENPEER_SERVICE_TEST_DO_TCP_MESSAGING_TEST                    (false)
+#define OPENPEER_SERVICE_TEST_DO_CODEC_BENCHMARK                       (false)
+#define OPENPEER_SERVICE_TEST_DO_TURN_LOOPBACK_BENCHMARK               (false)
 
 #define OPENPEER_SERVICE_TEST_DNS_ZONE "dnstest.hookflash.me"
 
+#define OPENPEER_SERVICE_TEST_CODEC_BENCHMARK_ITERATIONS                (100000)
+// when non-empty, the benchmark packets are written to this directory (one file per packet) to seed fuzzers
+#define OPENPEER_SERVICE_TEST_CODEC_CORPUS_PATH                         ""
+
+#define OPENPEER_SERVICE_TEST_TURN_LOOPBACK_BENCHMARK_ALLOCATIONS       (50)
+#define OPENPEER_SERVICE_TEST_TURN_LOOPBACK_BENCHMARK_SECONDS           (10)
+#define OPENPEER_SERVICE_TEST_TURN_LOOPBACK_BENCHMARK_PACKET_SIZE_IN_BYTES (500)
+// how many packets each allocation keeps in flight towards the echo peer
+#define OPENPEER_SERVICE_TEST_TURN_LOOPBACK_BENCHMARK_WINDOW            (16)
+
 // true = running as a client, false = running as a server
 #define OPENPEER_SERVICE_TEST_RUNNING_AS_CLIENT                        (true)
 #define OPENPEER_SERVICE_TEST_RUDP_SERVER_IP                           "192.168.2.220"
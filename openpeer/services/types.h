@@ -192,6 +192,8 @@ namespace openpeer
 
     namespace internal
     {
+      ZS_DECLARE_CLASS_PTR(MessageIntegrityKey)
+
       IBackgroundingNotifierPtr getBackgroundingNotifier(IBackgroundingNotifierPtr notifier);
     }
 
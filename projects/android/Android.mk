@@ -39,22 +39,27 @@ openpeer/services/cpp/services_DHPublicKey.cpp \
 openpeer/services/cpp/services_DNS.cpp \
 openpeer/services/cpp/services_DNSMonitor.cpp \
 openpeer/services/cpp/services_Factory.cpp \
+openpeer/services/cpp/services_FastCRC32.cpp \
 openpeer/services/cpp/services_HTTP.cpp \
 openpeer/services/cpp/services_Helper.cpp \
 openpeer/services/cpp/ifaddrs-android.cc \
 openpeer/services/cpp/services_ICESocket.cpp \
 openpeer/services/cpp/services_ICESocketSession.cpp \
 openpeer/services/cpp/services_Logger.cpp \
+openpeer/services/cpp/services_MessageIntegrityKeyCache.cpp \
 openpeer/services/cpp/services_MessageLayerSecurityChannel.cpp \
 openpeer/services/cpp/services_MessageQueueManager.cpp \
+openpeer/services/cpp/services_PacketBuffer.cpp \
 openpeer/services/cpp/services_RSAPrivateKey.cpp \
 openpeer/services/cpp/services_RSAPublicKey.cpp \
 openpeer/services/cpp/services_RUDPChannel.cpp \
 openpeer/services/cpp/services_RUDPChannelStream.cpp \
+openpeer/services/cpp/services_RUDPCongestionControl.cpp \
 openpeer/services/cpp/services_RUDPListener.cpp \
 openpeer/services/cpp/services_RUDPMessaging.cpp \
 openpeer/services/cpp/services_RUDPPacket.cpp \
 openpeer/services/cpp/services_RUDPTransport.cpp \
+openpeer/services/cpp/services_SocketEventBackend.cpp \
 openpeer/services/cpp/services_STUNDiscovery.cpp \
 openpeer/services/cpp/services_STUNPacket.cpp \
 openpeer/services/cpp/services_STUNRequester.cpp \
@@ -64,6 +69,7 @@ openpeer/services/cpp/services_TCPMessaging.cpp \
 openpeer/services/cpp/services_TURNSocket.cpp \
 openpeer/services/cpp/services_TransportStream.cpp \
 openpeer/services/cpp/services_services.cpp \
+openpeer/services/cpp/services_UDPBatch.cpp \
 openpeer/services/cpp/services_wire.cpp \
 
 